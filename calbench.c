@@ -0,0 +1,1200 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calbench.c -- Benchmark harness for the iCalendar library and tools
+Last updated:  Oct 19/26
+
+Usage:
+    calbench [-n iterations] [-t threads] file.ics
+    calbench [-n iterations] -scan
+    calbench [-n iterations] -recur
+    calbench [-n iterations] -tz
+    calbench [-n iterations] [-t threads] -busy
+
+Times each library and tool function on the calendar in file.ics and
+prints the results to stdout as one JSON object. calFreeBusy and
+calConflicts are timed over the year from the first VEVENT's start,
+calMerge merges two copies of the file by DTSTART, and calDiff compares
+the calendar with a second copy of itself, the common case of a sync
+with few changes. Input is parsed from
+memory and output goes to /dev/null, so disk speed doesn't enter into it.
+For every operation the best and mean time over the iterations are
+reported, with throughput relative to the input (MB/s and components/s)
+and the process's peak RSS once the operation has run. -t sets the no. of
+threads large sorts use (see calsort.h). In a CALSTATS build
+the report also holds the instrumentation counters for the whole run.
+
+With -scan, the delimiter scanning kernels in calscan.c are timed instead,
+each kernel the CPU supports against the scalar one: calScanFind over long
+DESCRIPTION lines, readCalLine over the same lines folded (leniently and
+strictly), parseCalProp over parameter-heavy ATTENDEE lines, and the strict
+text check over the long lines next to a plain memcpy of them.
+
+With -recur, recurrence expansion (see calrecur.h) is timed instead on
+series running from 1970 to 2029: every occurrence of a daily, a weekly,
+a monthly and a yearly rule, calRecurSkip to RECUR_WINDOWS one-week
+windows of an endless daily series, and calFilter picking one week out of
+RECUR_EVENTS endless daily series.
+
+With -tz, TZID date handling (see caltz.h) is timed instead on TZ_EVENTS
+events whose DTSTARTs carry a TZID for a VTIMEZONE with the US daylight
+rules: compiling the VTIMEZONE, calTzEpoch over every DTSTART next to
+parseCalDate over the same values, and calFilter picking one month.
+
+With -busy, availability over BUSY_CALENDARS synthetic calendars (see
+calbusy.h) is timed instead, each with BUSY_EVENTS meetings in 2024 and
+two weekly series: calBusyTimes over every calendar one after another,
+calBusyMany over all of them at once (-t sets its threads), and
+calBusyFreeSlots intersecting the results for half-hour slots, all for
+March 2024.
+********/
+
+#include "caltool.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "calutil.h"
+#include "calscan.h"
+#include "calsort.h"
+#include "calstats.h"
+#include "calrecur.h"
+#include "caltz.h"
+#include "calbusy.h"
+#include "calmerge.h"
+
+#define BENCH_OPS 14        // no. of operations timed
+#define SCAN_LINES 256      // DESCRIPTION lines in the scan benchmarks
+#define SCAN_LINELEN 4096   // length of each of those lines
+#define SCAN_PROPS 20000    // ATTENDEE lines parsed per scan benchmark run
+#define RECUR_WINDOWS 10000 // one-week windows skipped to in the recurrence benchmark
+#define RECUR_EVENTS 1000   // endless daily series calFilter looks through
+#define TZ_EVENTS 10000     // events with a TZID DTSTART in the timezone benchmark
+#define BUSY_CALENDARS 1000 // calendars in the availability benchmark
+#define BUSY_EVENTS 200     // single meetings in each of those calendars
+
+static const char *const scanKernels[] = { "scalar", "sse2", "avx2", NULL };
+
+typedef enum {          // scan benchmarks, in the order they run
+    SFIND, SREAD, SSTRICT, SPARSE, SVALIDATE, SCOPY, SNONE,
+} ScanOp;
+
+static const char *const scanOpNames[] = { "calScanFind DESCRIPTION", "readCalLine DESCRIPTION folded",
+                                           "readCalLine DESCRIPTION folded strict", "parseCalProp ATTENDEE",
+                                           "calScanText DESCRIPTION", "memcpy DESCRIPTION" };
+
+static const char scanAttendee[] = "ATTENDEE;CUTYPE=INDIVIDUAL;ROLE=REQ-PARTICIPANT;PARTSTAT=NEEDS-ACTION;RSVP=TRUE;"
+    "CN=\"Smith, Jane\";DELEGATED-FROM=\"mailto:a@example.com\",\"mailto:b@example.com\";"
+    "SENT-BY=\"mailto:assistant@example.com\";LANGUAGE=en;X-NUM-GUESTS=0:mailto:jane.smith@example.com";
+
+static const char *const recurRules[] = { "FREQ=DAILY;UNTIL=20291231T235959", "FREQ=WEEKLY;BYDAY=MO,WE,FR;UNTIL=20291231T235959",
+                                          "FREQ=MONTHLY;BYDAY=-1FR;UNTIL=20291231T235959",
+                                          "FREQ=YEARLY;BYMONTH=2;BYMONTHDAY=-1;UNTIL=20291231T235959", NULL };
+
+typedef enum {          // operations timed, in the order they run
+    BREAD, BWRITE, BINFO, BEXTRACTE, BEXTRACTX, BFILTER, BFREEBUSY, BCONFLICTS, BCOMBINE, BDEDUP, BMERGE, BDIFF, BFREE, BNONE,
+} BenchOp;
+
+typedef struct {        // timing of one operation
+    const char *name;
+    double best, total;     // fastest run and sum of all runs, in seconds
+    long peakrss;           // peak RSS in KB after the operation's runs
+} BenchResult;
+
+/* Count every component below the top level
+ *
+ * Arguments: initialized CalComp structure
+ *
+ * Preconditions: *comp must be initialized
+ * Postconditions: none
+ *
+ * Return val: no. of components nested in comp
+ * */
+long benchComponents (const CalComp *comp);
+
+/* Count every property in the tree
+ *
+ * Arguments: initialized CalComp structure
+ *
+ * Preconditions: *comp must be initialized
+ * Postconditions: none
+ *
+ * Return val: no. of properties in comp and all its components
+ * */
+long benchProperties (const CalComp *comp);
+
+/* Parse the benchmark input from memory
+ *
+ * Arguments: input text, its length, and the address of the pointer that receives the calendar
+ *
+ * Preconditions: text holds len bytes
+ * Postconditions: *pcomp is set as by readCalFile
+ *
+ * Return val: status returned by readCalFile
+ * */
+CalStatus benchParse (char *text, size_t len, CalComp **const pcomp);
+
+/* Seconds on the monotonic clock
+ *
+ * Arguments: none
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: current time in seconds
+ * */
+double benchNow (void);
+
+/* Print a string as a JSON string literal
+ *
+ * Arguments: output file and string
+ *
+ * Preconditions: none
+ * Postconditions: str is written quoted and escaped
+ *
+ * Return val: none
+ * */
+void printJsonString (FILE *const out, const char *str);
+
+/* Time the delimiter scanning kernels and print the results as JSON
+ *
+ * Arguments: no. of runs per kernel and benchmark
+ *
+ * Preconditions: iterations > 0
+ * Postconditions: the kernels are back to the best one the CPU supports
+ *
+ * Return val: EXIT_SUCCESS, or EXIT_FAILURE if a benchmark line doesn't parse
+ * */
+int benchScan (int iterations);
+
+/* Time recurrence expansion and print the results as JSON
+ *
+ * Arguments: no. of runs per benchmark
+ *
+ * Preconditions: iterations > 0
+ * Postconditions: none
+ *
+ * Return val: EXIT_SUCCESS, or EXIT_FAILURE if a benchmark calendar doesn't parse
+ * */
+int benchRecur (int iterations);
+
+/* Time TZID date conversion and print the results as JSON
+ *
+ * Arguments: no. of runs per benchmark
+ *
+ * Preconditions: iterations > 0
+ * Postconditions: none
+ *
+ * Return val: EXIT_SUCCESS, or EXIT_FAILURE if the benchmark calendar doesn't parse
+ * */
+int benchTz (int iterations);
+
+/* Time free/busy computation over many calendars and print the results as JSON
+ *
+ * Arguments: no. of runs per benchmark
+ *
+ * Preconditions: iterations > 0
+ * Postconditions: none
+ *
+ * Return val: EXIT_SUCCESS, or EXIT_FAILURE if a benchmark calendar doesn't parse
+ * */
+int benchBusy (int iterations);
+
+/* Build one of the calendars used by benchBusy
+ *
+ * Arguments: the calendar's no. (which picks its meetings) and where to store the length of the text
+ *
+ * Preconditions: none
+ * Postconditions: the text is allocated; the caller frees it
+ *
+ * Return val: a VCALENDAR with BUSY_EVENTS meetings in the working hours of 2024, every tenth of them tentative, and
+ *             two weekly series
+ * */
+char *busyCalendar (int number, size_t *const len);
+
+/* Build the calendar used by benchTz
+ *
+ * Arguments: where to store the length of the text
+ *
+ * Preconditions: none
+ * Postconditions: the text is allocated; the caller frees it
+ *
+ * Return val: a VCALENDAR with a VTIMEZONE and TZ_EVENTS VEVENTs starting in it, 3 hours apart from 2000 on
+ * */
+char *tzCalendar (size_t *const len);
+
+/* Build the calendar of recurring events used by benchRecur
+ *
+ * Arguments: no. of events, the rules to give them in turn (NULL terminated), and where to store the length of the text
+ *
+ * Preconditions: rules holds at least one rule
+ * Postconditions: the text is allocated; the caller frees it
+ *
+ * Return val: a VCALENDAR whose VEVENTs start a day apart from 1970-01-01 at 9 AM
+ * */
+char *recurCalendar (int events, const char *const *rules, size_t *const len);
+
+/* Build the long DESCRIPTION lines used by benchScan
+ *
+ * Arguments: whether to fold the lines every 75 octets, and where to store the length of the text
+ *
+ * Preconditions: none
+ * Postconditions: the text is allocated; the caller frees it
+ *
+ * Return val: SCAN_LINES CRLF-terminated DESCRIPTION lines of SCAN_LINELEN characters
+ * */
+char *scanDescriptions (bool folded, size_t *const len);
+
+/* Free what parseCalProp stored in a property
+ *
+ * Arguments: property filled in by parseCalProp
+ *
+ * Preconditions: parseCalProp returned OK for prop
+ * Postconditions: the name, value and parameters of prop are free'd
+ *
+ * Return val: none
+ * */
+void benchFreeProp (CalProp *prop);
+
+int main(int argc, char *argv[]){
+
+    BenchResult results[BENCH_OPS];
+    CalStats stats;
+    struct rusage usage;
+    CalComp * pcomp, * other, * scratch;
+    const CalProp * currentProp;
+    CalStatus status;
+    FILE * ics, * sink, * merging[2];
+    char * text, * path;
+    double start, elapsed, mb;
+    time_t busyFrom;
+    size_t len, cap, got;
+    long comps, props;
+    int iterations, lines, op, i, bad;
+    bool scan, recur, tz, busy;
+
+    iterations = 5;
+    path = NULL;
+    scan = false;
+    recur = false;
+    tz = false;
+    busy = false;
+
+    for (i = 1; i < argc; ++i){
+
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            calSortSetThreads(atoi(argv[++i]));
+        else if (strcmp(argv[i], "-scan") == 0)
+            scan = true;
+        else if (strcmp(argv[i], "-recur") == 0)
+            recur = true;
+        else if (strcmp(argv[i], "-tz") == 0)
+            tz = true;
+        else if (strcmp(argv[i], "-busy") == 0)
+            busy = true;
+        else if (path == NULL)
+            path = argv[i];
+        else
+            path = NULL;
+    }
+
+    if (scan == true && recur == false && tz == false && busy == false && path == NULL && iterations > 0)
+        return benchScan(iterations);
+
+    if (recur == true && scan == false && tz == false && busy == false && path == NULL && iterations > 0)
+        return benchRecur(iterations);
+
+    if (tz == true && scan == false && recur == false && busy == false && path == NULL && iterations > 0)
+        return benchTz(iterations);
+
+    if (busy == true && scan == false && recur == false && tz == false && path == NULL && iterations > 0)
+        return benchBusy(iterations);
+
+    if (path == NULL || scan == true || recur == true || tz == true || busy == true || iterations <= 0){
+
+        fprintf(stderr, "Usage: calbench [-n iterations] [-t threads] file.ics\n       calbench [-n iterations] -scan\n"
+                        "       calbench [-n iterations] -recur\n       calbench [-n iterations] -tz\n"
+                        "       calbench [-n iterations] [-t threads] -busy\n");
+        return EXIT_FAILURE;
+    }
+
+    ics = fopen(path, "r");
+
+    if (ics == NULL){
+
+        fprintf(stderr, "Error: Unable to open file %s\n", path);
+        return EXIT_FAILURE;
+    }
+
+    /* Read the whole input up front */
+    len = 0;
+    cap = 65536;
+    text = malloc(cap);
+    assert(text);
+
+    while ((got = fread(text + len, 1, cap - len, ics)) > 0){
+
+        len += got;
+
+        if (len == cap){
+
+            cap *= 2;
+            text = realloc(text, cap);
+            assert(text);
+        }
+    }
+
+    fclose(ics);
+
+    sink = fopen("/dev/null", "w");
+    assert(sink);
+
+    status = benchParse(text, len, &pcomp);
+
+    if (status.code != OK){
+
+        fprintf(stderr, "Error: %s could not be parsed, linefrom = %d, lineto = %d\n", path, status.linefrom, status.lineto);
+        return EXIT_FAILURE;
+    }
+
+    /* calCombine relinks its inputs while it runs, so it needs two separate trees */
+    benchParse(text, len, &other);
+
+    lines = status.lineto;
+    comps = benchComponents(pcomp);
+    props = benchProperties(pcomp);
+
+    busyFrom = 0;
+
+    for (i = 0; i < pcomp->ncomps && busyFrom == 0; ++i)
+        if (strcmp(pcomp->comp[i]->name, "VEVENT") == 0)
+            for (currentProp = pcomp->comp[i]->prop; currentProp != NULL && busyFrom == 0; currentProp = currentProp->next)
+                if (strcmp(currentProp->name, "DTSTART") == 0)
+                    busyFrom = parseCalDate(currentProp->value);
+
+    results[BREAD].name = "readCalFile";
+    results[BWRITE].name = "writeCalComp";
+    results[BINFO].name = "calInfo";
+    results[BEXTRACTE].name = "calExtract e";
+    results[BEXTRACTX].name = "calExtract x";
+    results[BFILTER].name = "calFilter e";
+    results[BFREEBUSY].name = "calFreeBusy one year";
+    results[BCONFLICTS].name = "calConflicts one year";
+    results[BCOMBINE].name = "calCombine";
+    results[BDEDUP].name = "calCombineDedup";
+    results[BMERGE].name = "calMerge dtstart";
+    results[BDIFF].name = "calDiff";
+    results[BFREE].name = "freeCalComp";
+    results[BNONE].name = NULL;
+
+    calResetStats();
+
+    for (op = BREAD; op < BNONE; ++op){
+
+        results[op].best = 0;
+        results[op].total = 0;
+
+        for (i = 0; i < iterations; ++i){
+
+            /* freeCalComp needs a fresh tree every run; building it isn't timed */
+            scratch = NULL;
+            if (op == BFREE)
+                benchParse(text, len, &scratch);
+
+            start = benchNow();
+
+            switch (op){
+
+                case BREAD:
+                    benchParse(text, len, &scratch);
+                    break;
+
+                case BWRITE:
+                    writeCalComp(sink, pcomp);
+                    break;
+
+                case BINFO:
+                    calInfo(pcomp, lines, sink);
+                    break;
+
+                case BEXTRACTE:
+                    calExtract(pcomp, OEVENT, sink);
+                    break;
+
+                case BEXTRACTX:
+                    calExtract(pcomp, OPROP, sink);
+                    break;
+
+                case BFILTER:
+                    calFilter(pcomp, OEVENT, 0, 0, sink);
+                    break;
+
+                case BFREEBUSY:
+                    calFreeBusy(pcomp, busyFrom, busyFrom + 365 * 24 * 60 * 60, sink);
+                    break;
+
+                case BCONFLICTS:
+                    calConflicts(pcomp, busyFrom, busyFrom + 365 * 24 * 60 * 60, sink);
+                    break;
+
+                case BCOMBINE:
+                    calCombine(pcomp, other, sink);
+                    break;
+
+                case BDEDUP:
+                    calCombineDedup(pcomp, other, sink);
+                    break;
+
+                case BMERGE:
+                    merging[0] = fmemopen(text, len, "r");
+                    merging[1] = fmemopen(text, len, "r");
+                    assert(merging[0] && merging[1]);
+                    calMerge(merging, 2, MDTSTART, sink, &bad);
+                    fclose(merging[0]);
+                    fclose(merging[1]);
+                    break;
+
+                case BDIFF:
+                    calDiff(pcomp, other, sink);
+                    break;
+
+                case BFREE:
+                    freeCalComp(scratch);
+                    scratch = NULL;
+                    break;
+            }
+
+            fflush(sink);
+            elapsed = benchNow() - start;
+
+            if (scratch != NULL)
+                freeCalComp(scratch);
+
+            if (i == 0 || elapsed < results[op].best)
+                results[op].best = elapsed;
+
+            results[op].total += elapsed;
+        }
+
+        getrusage(RUSAGE_SELF, &usage);
+        results[op].peakrss = usage.ru_maxrss;
+    }
+
+    /* Emit the report */
+    mb = len / (1024.0 * 1024.0);
+
+    printf("{\n  \"file\": ");
+    printJsonString(stdout, path);
+    printf(",\n  \"bytes\": %zu,\n  \"lines\": %d,\n  \"components\": %ld,\n  \"properties\": %ld,\n  \"iterations\": %d,\n  \"sort_threads\": %d,\n  \"results\": [\n",
+           len, lines, comps, props, iterations, calSortGetThreads());
+
+    for (op = BREAD; op < BNONE; ++op){
+
+        printf("    {\"op\": ");
+        printJsonString(stdout, results[op].name);
+        printf(", \"best_s\": %.6f, \"mean_s\": %.6f, \"mb_per_s\": %.2f, \"comps_per_s\": %.0f, \"peak_rss_kb\": %ld}%s\n",
+               results[op].best, results[op].total / iterations,
+               results[op].best > 0 ? mb / results[op].best : 0.0,
+               results[op].best > 0 ? comps / results[op].best : 0.0,
+               results[op].peakrss, op + 1 < BNONE ? "," : "");
+    }
+
+    printf("  ]");
+
+    if (calGetStats(&stats) == true){
+
+        printf(",\n  \"stats\": {\"bytes_read\": %lld, \"lines\": %lld, \"folds\": %lld, \"properties\": %lld, \"parameters\": %lld, "
+               "\"allocations\": %lld, \"bytes_allocated\": %lld, \"line_buffers\": %lld, \"readCalLine_s\": %.6f, \"parseCalProp_s\": %.6f, "
+               "\"readCalComp_s\": %.6f, \"writeCalComp_s\": %.6f, \"calFilter_s\": %.6f}",
+               stats.bytesread, stats.lines, stats.folds, stats.props, stats.params, stats.allocs, stats.allocbytes, stats.linebufs,
+               stats.readline, stats.parseprop, stats.readcomp, stats.write, stats.filter);
+    }
+
+    printf("\n}\n");
+
+    freeCalComp(pcomp);
+    freeCalComp(other);
+    fclose(sink);
+    free(text);
+
+    return EXIT_SUCCESS;
+}
+
+long benchComponents (const CalComp *comp){
+
+    long count;
+    int i;
+
+    count = comp->ncomps;
+
+    for (i = 0; i < comp->ncomps; ++i)
+        count += benchComponents(comp->comp[i]);
+
+    return count;
+}
+
+long benchProperties (const CalComp *comp){
+
+    long count;
+    int i;
+
+    count = comp->nprops;
+
+    for (i = 0; i < comp->ncomps; ++i)
+        count += benchProperties(comp->comp[i]);
+
+    return count;
+}
+
+CalStatus benchParse (char *text, size_t len, CalComp **const pcomp){
+
+    CalStatus status;
+    FILE * ics;
+
+    ics = fmemopen(text, len, "r");
+    assert(ics);
+
+    status = readCalFile(ics, pcomp);
+    fclose(ics);
+
+    return status;
+}
+
+double benchNow (void){
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void printJsonString (FILE *const out, const char *str){
+
+    fputc('"', out);
+
+    for (; *str != '\0'; ++str){
+
+        if (*str == '"' || *str == '\\')
+            fprintf(out, "\\%c", *str);
+        else if ((unsigned char) *str < 0x20)
+            fprintf(out, "\\u%04x", (unsigned char) *str);
+        else
+            fputc(*str, out);
+    }
+
+    fputc('"', out);
+}
+
+int benchScan (int iterations){
+
+    CalProp prop;
+    CalStatus status;
+    FILE * ics;
+    char * plain, * folded, * copy, * line;
+    double start, elapsed, results[SNONE];
+    size_t plainlen, foldedlen, bytes[SNONE], pos, found;
+    long count;
+    int kernel, op, i, n;
+    bool first;
+
+    plain = scanDescriptions(false, &plainlen);
+    folded = scanDescriptions(true, &foldedlen);
+    copy = malloc(plainlen);
+    assert(copy);
+
+    bytes[SFIND] = plainlen;
+    bytes[SREAD] = foldedlen;
+    bytes[SSTRICT] = foldedlen;
+    bytes[SPARSE] = SCAN_PROPS * (sizeof(scanAttendee) - 1);
+    bytes[SVALIDATE] = plainlen;
+    bytes[SCOPY] = plainlen;
+
+    printf("{\n  \"description_bytes\": %zu,\n  \"attendee_bytes\": %zu,\n  \"iterations\": %d,\n  \"scan\": [\n",
+           plainlen, sizeof(scanAttendee) - 1, iterations);
+
+    first = true;
+
+    for (kernel = 0; scanKernels[kernel] != NULL; ++kernel){
+
+        if (calScanSelect(scanKernels[kernel]) == false)
+            continue;
+
+        for (op = SFIND; op < SNONE; ++op){
+
+            setCalStrict(op == SSTRICT);
+
+            for (i = 0; i < iterations; ++i){
+
+                count = 0;
+                start = benchNow();
+
+                switch (op){
+
+                    /* Find the end of every long line, as readCalLine does when nothing is folded */
+                    case SFIND:
+                        for (pos = 0; pos < plainlen; pos += found + 1){
+
+                            found = calScanFind(plain + pos, plainlen - pos, "\r\n", 2);
+                            ++count;
+                        }
+                        break;
+
+                    /* Read the folded lines back */
+                    case SREAD:
+                    case SSTRICT:
+                        ics = fmemopen(folded, foldedlen, "r");
+                        assert(ics);
+                        readCalLine(NULL, NULL);
+
+                        do {
+                            status = readCalLine(ics, &line);
+                            count += line != NULL;
+                            free(line);
+                        } while (status.code == OK && line != NULL);
+
+                        fclose(ics);
+                        break;
+
+                    /* Tokenize parameter-heavy lines */
+                    case SPARSE:
+                        for (n = 0; n < SCAN_PROPS; ++n){
+
+                            if (parseCalProp((char *) scanAttendee, &prop) != OK){
+
+                                fprintf(stderr, "Error: benchmark ATTENDEE line doesn't parse\n");
+                                return EXIT_FAILURE;
+                            }
+
+                            count += prop.nparams;
+                            benchFreeProp(&prop);
+                        }
+                        break;
+
+                    /* Check the long lines as strict parsing does, without their CRLFs */
+                    case SVALIDATE:
+                        for (pos = 0; pos < plainlen; pos += SCAN_LINELEN + 2)
+                            count += calScanText(plain + pos, SCAN_LINELEN) == SCAN_LINELEN;
+                        break;
+
+                    /* What the validation is measured against */
+                    case SCOPY:
+                        memcpy(copy, plain, plainlen);
+                        count = copy[plainlen - 1];
+                        break;
+                }
+
+                elapsed = benchNow() - start;
+
+                if (i == 0 || elapsed < results[op])
+                    results[op] = elapsed;
+            }
+
+            printf("%s    {\"kernel\": \"%s\", \"op\": \"%s\", \"best_s\": %.6f, \"mb_per_s\": %.2f, \"count\": %ld}",
+                   first == true ? "" : ",\n", scanKernels[kernel], scanOpNames[op], results[op],
+                   results[op] > 0 ? bytes[op] / (1024.0 * 1024.0) / results[op] : 0.0, count);
+            first = false;
+        }
+    }
+
+    printf("\n  ]\n}\n");
+
+    setCalStrict(false);
+    calScanSelect("auto");
+    free(plain);
+    free(folded);
+    free(copy);
+
+    return EXIT_SUCCESS;
+}
+
+int benchRecur (int iterations){
+
+    CalRecur recur;
+    CalComp * pcomp;
+    CalStatus status;
+    FILE * sink;
+    char * text;
+    time_t occurrence, window, from, to;
+    double start, elapsed, best;
+    size_t len;
+    long count;
+    int rule, i, w;
+
+    sink = fopen("/dev/null", "w");
+    assert(sink);
+
+    printf("{\n  \"iterations\": %d,\n  \"recur\": [\n", iterations);
+
+    /* Every occurrence of each rule, one series at a time */
+    for (rule = 0; recurRules[rule] != NULL; ++rule){
+
+        text = recurCalendar(1, recurRules + rule, &len);
+        status = benchParse(text, len, &pcomp);
+        free(text);
+
+        if (status.code != OK){
+
+            fprintf(stderr, "Error: recurrence benchmark calendar doesn't parse\n");
+            return EXIT_FAILURE;
+        }
+
+        for (i = 0; i < iterations; ++i){
+
+            count = 0;
+            start = benchNow();
+
+            calRecurInit(&recur, pcomp->comp[0], calRecurWall("19700101T090000"));
+
+            while (calRecurNext(&recur, &occurrence) == true)
+                ++count;
+
+            calRecurFree(&recur);
+            elapsed = benchNow() - start;
+
+            if (i == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        printf("    {\"op\": \"expand %s\", \"best_s\": %.6f, \"count\": %ld, \"per_s\": %.0f},\n",
+               recurRules[rule], best, count, best > 0 ? count / best : 0.0);
+        freeCalComp(pcomp);
+    }
+
+    /* A week of an endless series, at windows spread from 1970 on; each skip jumps rather than expands */
+    text = recurCalendar(1, (const char *const []) { "FREQ=DAILY", NULL }, &len);
+    status = benchParse(text, len, &pcomp);
+    free(text);
+
+    for (i = 0; i < iterations; ++i){
+
+        count = 0;
+        start = benchNow();
+
+        for (w = 0; w < RECUR_WINDOWS; ++w){
+
+            window = calRecurWall("19700101T000000") + (time_t) w * 2 * 24 * 60 * 60;
+
+            calRecurInit(&recur, pcomp->comp[0], calRecurWall("19700101T090000"));
+            calRecurSkip(&recur, window);
+
+            while (calRecurNext(&recur, &occurrence) == true && occurrence < window + 7 * 24 * 60 * 60)
+                ++count;
+
+            calRecurFree(&recur);
+        }
+
+        elapsed = benchNow() - start;
+
+        if (i == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    printf("    {\"op\": \"calRecurSkip one-week windows FREQ=DAILY\", \"best_s\": %.6f, \"count\": %ld, \"per_s\": %.0f},\n",
+           best, count, best > 0 ? RECUR_WINDOWS / best : 0.0);
+    freeCalComp(pcomp);
+
+    /* One week out of many endless series */
+    text = recurCalendar(RECUR_EVENTS, (const char *const []) { "FREQ=DAILY", NULL }, &len);
+    status = benchParse(text, len, &pcomp);
+    free(text);
+
+    if (status.code != OK){
+
+        fprintf(stderr, "Error: recurrence benchmark calendar doesn't parse\n");
+        return EXIT_FAILURE;
+    }
+
+    from = parseCalDate("20250602T000000");
+    to = parseCalDate("20250608T235959");
+
+    for (i = 0; i < iterations; ++i){
+
+        start = benchNow();
+        calFilter(pcomp, OEVENT, from, to, sink);
+        fflush(sink);
+        elapsed = benchNow() - start;
+
+        if (i == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    printf("    {\"op\": \"calFilter e one week\", \"best_s\": %.6f, \"count\": %d, \"per_s\": %.0f}\n  ]\n}\n",
+           best, RECUR_EVENTS, best > 0 ? RECUR_EVENTS / best : 0.0);
+
+    freeCalComp(pcomp);
+    fclose(sink);
+
+    return EXIT_SUCCESS;
+}
+
+int benchTz (int iterations){
+
+    static const char *const names[] = { "calTzEpoch TZID", "parseCalDate" };
+    CalTzSet * zones;
+    CalComp * pcomp;
+    CalStatus status;
+    FILE * sink;
+    char * text;
+    time_t from, to;
+    double start, elapsed, best;
+    size_t len;
+    long count;
+    int i, j, op;
+
+    sink = fopen("/dev/null", "w");
+    assert(sink);
+
+    text = tzCalendar(&len);
+    status = benchParse(text, len, &pcomp);
+    free(text);
+
+    if (status.code != OK){
+
+        fprintf(stderr, "Error: timezone benchmark calendar doesn't parse\n");
+        fclose(sink);
+        return EXIT_FAILURE;
+    }
+
+    printf("{\n  \"iterations\": %d,\n  \"tz\": [\n", iterations);
+
+    best = 0;
+
+    for (i = 0; i < iterations; ++i){
+
+        start = benchNow();
+        zones = calTzBuild(pcomp);
+        elapsed = benchNow() - start;
+        count = (long) zones->zones[0].ntrans;
+        calTzFree(zones);
+
+        if (i == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    printf("    {\"op\": \"calTzBuild\", \"best_s\": %.6f, \"count\": %ld},\n", best, count);
+
+    /* The same DTSTART values through the table and through libc; the sums keep the calls from being dropped */
+    zones = calTzBuild(pcomp);
+
+    for (op = 0; op < 2; ++op){
+
+        for (i = 0; i < iterations; ++i){
+
+            count = 0;
+            start = benchNow();
+
+            for (j = 1; j < pcomp->ncomps; ++j)
+                count += (long) (op == 0 ? calTzEpoch(zones, pcomp->comp[j]->prop->next) : parseCalDate(pcomp->comp[j]->prop->next->value)) & 1;
+
+            elapsed = benchNow() - start;
+
+            if (i == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        printf("    {\"op\": \"%s\", \"best_s\": %.6f, \"count\": %d, \"per_s\": %.0f},\n",
+               names[op], best, TZ_EVENTS, best > 0 ? TZ_EVENTS / best : 0.0);
+    }
+
+    calTzFree(zones);
+
+    /* One month out of the events, the VTIMEZONE compiled once per call */
+    from = calTzToUTC(NULL, calRecurWall("20100601T000000"));
+    to = calTzToUTC(NULL, calRecurWall("20100630T235959"));
+
+    for (i = 0; i < iterations; ++i){
+
+        start = benchNow();
+        calFilter(pcomp, OEVENT, from, to, sink);
+        fflush(sink);
+        elapsed = benchNow() - start;
+
+        if (i == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    printf("    {\"op\": \"calFilter e one month\", \"best_s\": %.6f, \"count\": %d, \"per_s\": %.0f}\n  ]\n}\n",
+           best, TZ_EVENTS, best > 0 ? TZ_EVENTS / best : 0.0);
+
+    freeCalComp(pcomp);
+    fclose(sink);
+
+    return EXIT_SUCCESS;
+}
+
+int benchBusy (int iterations){
+
+    static const char *const names[] = { "calBusyTimes each", "calBusyMany" };
+    CalComp * comps[BUSY_CALENDARS];
+    CalBusy busy[BUSY_CALENDARS];
+    CalSpan * slots;
+    CalStatus status;
+    char * text;
+    time_t from, to;
+    double start, elapsed, best;
+    size_t len, nslots;
+    long count;
+    int i, j, op;
+
+    /* Parsing is timed once, as one would load the calendars */
+    start = benchNow();
+
+    for (j = 0; j < BUSY_CALENDARS; ++j){
+
+        text = busyCalendar(j, &len);
+        status = benchParse(text, len, &comps[j]);
+        free(text);
+
+        if (status.code != OK){
+
+            fprintf(stderr, "Error: availability benchmark calendar doesn't parse\n");
+
+            while (j-- > 0)
+                freeCalComp(comps[j]);
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    elapsed = benchNow() - start;
+
+    printf("{\n  \"iterations\": %d,\n  \"threads\": %d,\n  \"busy\": [\n", iterations, calSortGetThreads());
+    printf("    {\"op\": \"readCalFile\", \"best_s\": %.6f, \"count\": %d, \"per_s\": %.0f},\n",
+           elapsed, BUSY_CALENDARS, elapsed > 0 ? BUSY_CALENDARS / elapsed : 0.0);
+
+    from = calTzToUTC(NULL, calRecurWall("20240301T000000"));
+    to = calTzToUTC(NULL, calRecurWall("20240401T000000"));
+    best = 0;
+
+    for (op = 0; op < 2; ++op){
+
+        for (i = 0; i < iterations; ++i){
+
+            start = benchNow();
+
+            if (op == 0){
+
+                for (j = 0; j < BUSY_CALENDARS; ++j)
+                    calBusyTimes(comps[j], from, to, &busy[j]);
+            }
+
+            else
+                calBusyMany((const CalComp *const *) comps, BUSY_CALENDARS, from, to, busy);
+
+            elapsed = benchNow() - start;
+
+            for (j = 0, count = 0; j < BUSY_CALENDARS; ++j){
+
+                count += (long) busy[j].nbusy;
+                calBusyFree(&busy[j]);
+            }
+
+            if (i == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        printf("    {\"op\": \"%s\", \"best_s\": %.6f, \"count\": %d, \"per_s\": %.0f, \"spans\": %ld},\n",
+               names[op], best, BUSY_CALENDARS, best > 0 ? BUSY_CALENDARS / best : 0.0, count);
+    }
+
+    /* The intersection on its own, over results kept from one more run */
+    calBusyMany((const CalComp *const *) comps, BUSY_CALENDARS, from, to, busy);
+
+    for (i = 0; i < iterations; ++i){
+
+        start = benchNow();
+        nslots = calBusyFreeSlots(busy, BUSY_CALENDARS, from, to, 30 * 60, &slots);
+        elapsed = benchNow() - start;
+        free(slots);
+
+        if (i == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    printf("    {\"op\": \"calBusyFreeSlots 30 min\", \"best_s\": %.6f, \"count\": %d, \"per_s\": %.0f, \"slots\": %zu}\n  ]\n}\n",
+           best, BUSY_CALENDARS, best > 0 ? BUSY_CALENDARS / best : 0.0, nslots);
+
+    for (j = 0; j < BUSY_CALENDARS; ++j){
+
+        calBusyFree(&busy[j]);
+        freeCalComp(comps[j]);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+char *busyCalendar (int number, size_t *const len){
+
+    char * text;
+    time_t wall;
+    unsigned long seed;
+    size_t cap;
+    int i;
+
+    cap = 256 + (size_t) (BUSY_EVENTS + 2) * 192;
+    text = malloc(cap);
+    assert(text);
+
+    *len = sprintf(text, "BEGIN:VCALENDAR\r\nVERSION:2.0\r\nPRODID:-//calbench//EN\r\n");
+
+    /* A small linear congruential generator keeps every run's calendars the same */
+    seed = 2654435761UL * (unsigned long) (number + 1);
+
+    for (i = 0; i < BUSY_EVENTS + 2; ++i){
+
+        seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+        wall = calRecurWall("20240101T080000") + (time_t) ((seed >> 33) % 366) * 24 * 60 * 60 + (time_t) ((seed >> 20) % 18) * 30 * 60;
+
+        *len += sprintf(text + *len, "BEGIN:VEVENT\r\nUID:%d-%d@calbench\r\n", number, i);
+        *len += strftime(text + *len, cap - *len, "DTSTART:%Y%m%dT%H%M%S\r\n", gmtime(&wall));
+        *len += sprintf(text + *len, "DURATION:PT%dM\r\n", 30 + (int) ((seed >> 40) % 4) * 30);
+
+        if (i >= BUSY_EVENTS)
+            *len += sprintf(text + *len, "RRULE:FREQ=WEEKLY\r\n");
+        else if (i % 10 == 0)
+            *len += sprintf(text + *len, "STATUS:TENTATIVE\r\n");
+
+        *len += sprintf(text + *len, "SUMMARY:meeting %d\r\nEND:VEVENT\r\n", i);
+    }
+
+    *len += sprintf(text + *len, "END:VCALENDAR\r\n");
+
+    return text;
+}
+
+char *tzCalendar (size_t *const len){
+
+    char * text;
+    time_t wall;
+    size_t cap;
+    int i;
+
+    cap = 1024 + (size_t) TZ_EVENTS * 160;
+    text = malloc(cap);
+    assert(text);
+
+    *len = sprintf(text, "BEGIN:VCALENDAR\r\nVERSION:2.0\r\nPRODID:-//calbench//EN\r\n"
+                         "BEGIN:VTIMEZONE\r\nTZID:America/New_York\r\n"
+                         "BEGIN:DAYLIGHT\r\nDTSTART:19670430T020000\r\nRRULE:FREQ=YEARLY;BYMONTH=4;BYDAY=-1SU;UNTIL=19730429T070000Z\r\n"
+                         "TZOFFSETFROM:-0500\r\nTZOFFSETTO:-0400\r\nTZNAME:EDT\r\nEND:DAYLIGHT\r\n"
+                         "BEGIN:DAYLIGHT\r\nDTSTART:20070311T020000\r\nRRULE:FREQ=YEARLY;BYMONTH=3;BYDAY=2SU\r\n"
+                         "TZOFFSETFROM:-0500\r\nTZOFFSETTO:-0400\r\nTZNAME:EDT\r\nEND:DAYLIGHT\r\n"
+                         "BEGIN:STANDARD\r\nDTSTART:19671029T020000\r\nRRULE:FREQ=YEARLY;BYMONTH=10;BYDAY=-1SU;UNTIL=20061029T060000Z\r\n"
+                         "TZOFFSETFROM:-0400\r\nTZOFFSETTO:-0500\r\nTZNAME:EST\r\nEND:STANDARD\r\n"
+                         "BEGIN:STANDARD\r\nDTSTART:20071104T020000\r\nRRULE:FREQ=YEARLY;BYMONTH=11;BYDAY=1SU\r\n"
+                         "TZOFFSETFROM:-0400\r\nTZOFFSETTO:-0500\r\nTZNAME:EST\r\nEND:STANDARD\r\n"
+                         "END:VTIMEZONE\r\n");
+
+    /* UID comes first so each event's DTSTART is its second property */
+    for (i = 0; i < TZ_EVENTS; ++i){
+
+        wall = calRecurWall("20000101T000000") + (time_t) i * 3 * 60 * 60;
+
+        *len += sprintf(text + *len, "BEGIN:VEVENT\r\nUID:%d@calbench\r\nDTSTART;TZID=America/New_York:", i);
+        *len += strftime(text + *len, cap - *len, "%Y%m%dT%H%M%S", gmtime(&wall));
+        *len += sprintf(text + *len, "\r\nSUMMARY:event %d\r\nEND:VEVENT\r\n", i);
+    }
+
+    *len += sprintf(text + *len, "END:VCALENDAR\r\n");
+
+    return text;
+}
+
+char *recurCalendar (int events, const char *const *rules, size_t *const len){
+
+    struct tm date;
+    char * text;
+    size_t cap;
+    int i, rule;
+
+    cap = 128 + (size_t) events * 256;
+    text = malloc(cap);
+    assert(text);
+
+    *len = sprintf(text, "BEGIN:VCALENDAR\r\nVERSION:2.0\r\nPRODID:-//calbench//EN\r\n");
+
+    for (i = 0, rule = 0; i < events; ++i, rule = rules[rule + 1] != NULL ? rule + 1 : 0){
+
+        /* mktime folds the day count into a proper date */
+        memset(&date, 0, sizeof(struct tm));
+        date.tm_year = 70;
+        date.tm_mday = 1 + i;
+        date.tm_hour = 9;
+        date.tm_isdst = -1;
+        mktime(&date);
+
+        *len += sprintf(text + *len, "BEGIN:VEVENT\r\nUID:%d@calbench\r\nRRULE:%s\r\n", i, rules[rule]);
+        *len += strftime(text + *len, cap - *len, "DTSTART:%Y%m%dT%H%M%S\r\n", &date);
+        *len += sprintf(text + *len, "SUMMARY:series %d\r\nEND:VEVENT\r\n", i);
+    }
+
+    *len += sprintf(text + *len, "END:VCALENDAR\r\n");
+
+    return text;
+}
+
+char *scanDescriptions (bool folded, size_t *const len){
+
+    char * text;
+    size_t cap;
+    int i, j, col;
+
+    /* Every character may be followed by a fold */
+    cap = (size_t) SCAN_LINES * (SCAN_LINELEN + 16) * 2;
+    text = malloc(cap);
+    assert(text);
+
+    *len = 0;
+
+    for (i = 0; i < SCAN_LINES; ++i){
+
+        memcpy(text + *len, "DESCRIPTION:", 12);
+        *len += 12;
+        col = 12;
+
+        for (j = 12; j < SCAN_LINELEN; ++j){
+
+            if (folded == true && col == 75){
+
+                memcpy(text + *len, "\r\n ", 3);
+                *len += 3;
+                col = 1;
+            }
+
+            text[(*len)++] = "lorem ipsum dolor sit amet, consectetur adipiscing elit. "[j % 57];
+            ++col;
+        }
+
+        memcpy(text + *len, "\r\n", 2);
+        *len += 2;
+    }
+
+    return text;
+}
+
+void benchFreeProp (CalProp *prop){
+
+    CalParam * param, * next;
+    int i;
+
+    free(prop->name);
+    free(prop->value);
+    free(prop->rawparam);
+
+    for (param = prop->param; param != NULL; param = next){
+
+        next = param->next;
+
+        for (i = 0; i < param->nvalues; ++i)
+            free(param->value[i]);
+
+        free(param->name);
+        free(param);
+    }
+}
@@ -0,0 +1,784 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calbusy.c -- Source code for free/busy computation
+Last updated:  Oct 19/26
+********/
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "calbusy.h"
+#include "calrecur.h"
+#include "calsnap.h"
+#include "calsort.h"
+#include "caltz.h"
+
+typedef struct {        // spans while they are collected
+    CalSpan *spans;
+    size_t n, cap;
+} BusyList;
+
+typedef struct {        // where calBusyTimes collects occurrences
+    BusyList busy, tentative;
+    time_t from, to;        // window the spans are clipped to
+} BusyLists;
+
+typedef struct {        // an occurrence calBusyConflicts sweeps over
+    CalBusyEvent occ;
+    size_t order;           // no. of occurrences collected before it, so ties keep file order
+} ConflictRec;
+
+typedef struct {        // what calBusyConflicts collects, grown by doubling
+    ConflictRec *recs;
+    size_t n, cap;
+} ConflictList;
+
+/* Take one occurrence of an event that overlaps the window
+ *
+ * Arguments: where occurrences go, the VEVENT, the occurrence's start and end, and whether the event is tentative
+ *
+ * Preconditions: end > start
+ * Postconditions: the occurrence is stored
+ *
+ * Return val: none
+ * */
+typedef void (*BusyAdd)( void *list, const CalComp *event, time_t start, time_t end, bool tentative );
+
+typedef struct {        // calendars shared out among calBusyMany's threads
+    const CalComp *const *comps;
+    CalBusy *busy;
+    size_t n, next;         // no. of calendars and the first one no thread has taken yet
+    time_t from, to;
+    pthread_mutex_t lock;   // guards next
+} BusyBatch;
+
+typedef struct {        // one run of spans in calBusyFreeSlots' heap
+    const CalSpan *span;    // next span of the run
+    const CalSpan *end;     // one past its last span
+} BusyCursor;
+
+/* Find the occurrences of one VEVENT
+ *
+ * Arguments: top level CalComp structure, its VTIMEZONEs, the VEVENT, the window, and where and how to store
+ *            occurrences
+ *
+ * Preconditions: comp belongs to top's tree, zones was built from top by calTzBuild
+ * Postconditions: add is called for each occurrence of the event that overlaps the window, in order of start,
+ *                 unless the event takes no time or blocks none
+ *
+ * Return val: none
+ * */
+void collectBusy (const CalComp *top, const CalTzSet *zones, const CalComp *comp, time_t from, time_t to, BusyAdd add, void *list);
+
+/* Store an occurrence for calBusyTimes, see BusyAdd
+ *
+ * Arguments: the BusyLists, then as for BusyAdd
+ *
+ * Preconditions: as for BusyAdd
+ * Postconditions: the occurrence, clipped to the window, is at the end of the busy or the tentative list; only its
+ *                 times are kept, so event isn't used
+ *
+ * Return val: none
+ * */
+void addBusyTimes (void *list, const CalComp *event, time_t start, time_t end, bool tentative);
+
+/* Store an occurrence for calBusyConflicts, see BusyAdd
+ *
+ * Arguments: the ConflictList, then as for BusyAdd
+ *
+ * Preconditions: as for BusyAdd
+ * Postconditions: the occurrence is at the end of the list, which grows if it must; a tentative occurrence
+ *                 conflicts like any other, so tentative isn't used
+ *
+ * Return val: none
+ * */
+void addConflictRec (void *list, const CalComp *event, time_t start, time_t end, bool tentative);
+
+/* Get the calendar time of a date property, from the snapshot's epochs when there are some
+ *
+ * Arguments: top level CalComp structure, its VTIMEZONEs and one of its date properties
+ *
+ * Preconditions: prop belongs to top's tree
+ * Postconditions: none
+ *
+ * Return val: the calendar time, local times converted by calTzLocal's table
+ * */
+time_t busyEpoch (const CalComp *top, const CalTzSet *zones, const CalProp *prop);
+
+/* Add a span clipped to a window
+ *
+ * Arguments: the list, the span's start and end, and the window
+ *
+ * Preconditions: none
+ * Postconditions: the part of the span in the window (if any) is at the end of list, which grows if it must
+ *
+ * Return val: none
+ * */
+void addBusySpan (BusyList *list, time_t start, time_t end, time_t from, time_t to);
+
+/* Compare two occurrences by start, then by the order they were found in, for calSort
+ *
+ * Arguments: both a and b are ConflictRec * variables
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: negative, zero or positive as a comes before, with or after b
+ * */
+int compareConflictRecs (const void *a, const void *b);
+
+/* Restore the heap order below one entry of calBusyConflicts' heap of overlapping occurrences
+ *
+ * Arguments: the heap (indexes of occurrences), how many entries it holds, the occurrences and the entry that may be
+ *            out of place
+ *
+ * Preconditions: below i the heap is in order
+ * Postconditions: the entry is moved down until no entry below it ends earlier
+ *
+ * Return val: none
+ * */
+void siftConflictHeap (size_t *heap, size_t n, const ConflictRec *recs, size_t i);
+
+/* Sort spans and merge the ones that overlap or touch
+ *
+ * Arguments: the spans and how many there are
+ *
+ * Preconditions: none
+ * Postconditions: the first spans of the array (as many as returned) are ascending and apart
+ *
+ * Return val: no. of merged spans
+ * */
+size_t mergeBusySpans (CalSpan *spans, size_t n);
+
+/* Take one set of merged spans away from another
+ *
+ * Arguments: the spans to cut, how many there are, the spans to cut out and how many there are, and where to put
+ *            the result
+ *
+ * Preconditions: both sets are as mergeBusySpans leaves them; out has room for n + nbusy spans
+ * Postconditions: out holds what is in spans but in none of busy, ascending
+ *
+ * Return val: no. of spans in out
+ * */
+size_t subtractBusySpans (const CalSpan *spans, size_t n, const CalSpan *busy, size_t nbusy, CalSpan *out);
+
+/* Compare two spans by start for calSort
+ *
+ * Arguments: both a and b are CalSpan * variables
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: negative, zero or positive as a starts before, with or after b
+ * */
+int compareBusySpans (const void *a, const void *b);
+
+/* Work out the busy time of calendars from a batch until none are left
+ *
+ * Arguments: the BusyBatch
+ *
+ * Preconditions: the batch's lock is initialized
+ * Postconditions: every calendar this thread took has its result filled in
+ *
+ * Return val: NULL
+ * */
+void *runBusyBatch (void *arg);
+
+/* Restore the heap order below one cursor of calBusyFreeSlots' heap
+ *
+ * Arguments: the heap, how many cursors it holds and the cursor that may be out of place
+ *
+ * Preconditions: every cursor has a span left; below i the heap is in order
+ * Postconditions: the cursor is moved down until no cursor below it starts earlier
+ *
+ * Return val: none
+ * */
+void siftBusyHeap (BusyCursor *heap, size_t n, size_t i);
+
+void calBusyTimes( const CalComp *comp, time_t from, time_t to, CalBusy *const busy ){
+
+    BusyLists lists;
+    CalTzSet * zones;
+    size_t n;
+    int i;
+
+    memset(&lists, 0, sizeof(BusyLists));
+    lists.from = from;
+    lists.to = to;
+
+    zones = calTzBuild(comp);
+
+    for (i = 0; i < comp->ncomps; ++i)
+        if (strcmp(comp->comp[i]->name, "VEVENT") == 0)
+            collectBusy(comp, zones, comp->comp[i], from, to, addBusyTimes, &lists);
+
+    calTzFree(zones);
+
+    busy->busy = lists.busy.spans;
+    busy->nbusy = mergeBusySpans(lists.busy.spans, lists.busy.n);
+
+    /* Time that is busy for certain isn't tentative as well */
+    n = mergeBusySpans(lists.tentative.spans, lists.tentative.n);
+    busy->tentative = malloc(sizeof(CalSpan) * (n + busy->nbusy + 1));
+    assert(busy->tentative);
+
+    busy->ntentative = subtractBusySpans(lists.tentative.spans, n, busy->busy, busy->nbusy, busy->tentative);
+    free(lists.tentative.spans);
+}
+
+size_t calBusyConflicts( const CalComp *comp, time_t from, time_t to, CalConflictFn report, void *arg ){
+
+    ConflictList list;
+    CalTzSet * zones;
+    size_t * heap;
+    size_t i, j, nheap, found;
+    int k;
+
+    memset(&list, 0, sizeof(ConflictList));
+
+    zones = calTzBuild(comp);
+
+    for (k = 0; k < comp->ncomps; ++k)
+        if (strcmp(comp->comp[k]->name, "VEVENT") == 0)
+            collectBusy(comp, zones, comp->comp[k], from, to, addConflictRec, &list);
+
+    calTzFree(zones);
+
+    calSort(list.recs, list.n, sizeof(ConflictRec), compareConflictRecs);
+
+    heap = malloc(sizeof(size_t) * (list.n + 1));
+    assert(heap);
+
+    /* Sweep in order of start, keeping the occurrences still going in a heap by end: an occurrence overlaps exactly
+       the ones left once those that ended by its start are dropped, so the work beyond the sort is one push and at
+       most one pop per occurrence and one report per pair */
+    nheap = 0;
+    found = 0;
+
+    for (i = 0; i < list.n; ++i){
+
+        while (nheap > 0 && list.recs[heap[0]].occ.span.end <= list.recs[i].occ.span.start){
+
+            heap[0] = heap[--nheap];
+            siftConflictHeap(heap, nheap, list.recs, 0);
+        }
+
+        for (j = 0; j < nheap; ++j){
+
+            ++found;
+
+            if (report(&list.recs[heap[j]].occ, &list.recs[i].occ, arg) == false){
+
+                free(heap);
+                free(list.recs);
+                return found;
+            }
+        }
+
+        /* Push, moving the new entry up past the ones that end later */
+        for (j = nheap++; j > 0 && list.recs[heap[(j - 1) / 2]].occ.span.end > list.recs[i].occ.span.end; j = (j - 1) / 2)
+            heap[j] = heap[(j - 1) / 2];
+
+        heap[j] = i;
+    }
+
+    free(heap);
+    free(list.recs);
+
+    return found;
+}
+
+void calBusyMany( const CalComp *const *comps, size_t n, time_t from, time_t to, CalBusy *const busy ){
+
+    pthread_t threads[CALSORT_MAXTHREADS];
+    bool started[CALSORT_MAXTHREADS];
+    BusyBatch batch;
+    int nthreads, i;
+
+    batch.comps = comps;
+    batch.busy = busy;
+    batch.n = n;
+    batch.next = 0;
+    batch.from = from;
+    batch.to = to;
+    pthread_mutex_init(&batch.lock, NULL);
+
+    nthreads = calSortGetThreads();
+
+    if ((size_t) nthreads > n)
+        nthreads = n > 0 ? (int) n : 1;
+
+    /* Calendars are handed out one at a time, so a large one holds up only its own thread; the caller works through
+       the batch too, and finishes it alone if no thread starts */
+    for (i = 1; i < nthreads; ++i)
+        started[i] = pthread_create(&threads[i], NULL, runBusyBatch, &batch) == 0;
+
+    runBusyBatch(&batch);
+
+    for (i = 1; i < nthreads; ++i)
+        if (started[i] == true)
+            pthread_join(threads[i], NULL);
+
+    pthread_mutex_destroy(&batch.lock);
+}
+
+size_t calBusyFreeSlots( const CalBusy *busy, size_t n, time_t from, time_t to, time_t length, CalSpan **const slots ){
+
+    BusyCursor * heap;
+    const CalSpan * span;
+    size_t i, nheap, total, nslots;
+    time_t clear;
+
+    heap = malloc(sizeof(BusyCursor) * (2 * n + 1));
+    assert(heap);
+
+    /* Every calendar gives two runs, each already ascending: its busy and its tentative spans */
+    nheap = 0;
+    total = 0;
+
+    for (i = 0; i < n; ++i){
+
+        if (busy[i].nbusy > 0){
+
+            heap[nheap].span = busy[i].busy;
+            heap[nheap].end = busy[i].busy + busy[i].nbusy;
+            ++nheap;
+        }
+
+        if (busy[i].ntentative > 0){
+
+            heap[nheap].span = busy[i].tentative;
+            heap[nheap].end = busy[i].tentative + busy[i].ntentative;
+            ++nheap;
+        }
+
+        total += busy[i].nbusy + busy[i].ntentative;
+    }
+
+    *slots = malloc(sizeof(CalSpan) * (total + 1));
+    assert(*slots);
+
+    for (i = nheap / 2; i-- > 0; )
+        siftBusyHeap(heap, nheap, i);
+
+    /* Spans come off the heap in order of start, so clear is where the time nobody is busy in begins */
+    clear = from;
+    nslots = 0;
+
+    while (nheap > 0 && heap[0].span->start < to){
+
+        span = heap[0].span;
+
+        if (span->start > clear && span->start - clear >= length){
+
+            (*slots)[nslots].start = clear;
+            (*slots)[nslots].end = span->start;
+            ++nslots;
+        }
+
+        if (span->end > clear)
+            clear = span->end;
+
+        if (++heap[0].span == heap[0].end)
+            heap[0] = heap[--nheap];
+
+        siftBusyHeap(heap, nheap, 0);
+    }
+
+    if (to > clear && to - clear >= length){
+
+        (*slots)[nslots].start = clear;
+        (*slots)[nslots].end = to;
+        ++nslots;
+    }
+
+    free(heap);
+
+    return nslots;
+}
+
+void calBusyFree( CalBusy *busy ){
+
+    free(busy->busy);
+    free(busy->tentative);
+    busy->busy = NULL;
+    busy->tentative = NULL;
+    busy->nbusy = 0;
+    busy->ntentative = 0;
+}
+
+bool calBusyDuration( const char *value, time_t *const length ){
+
+    static const char units[] = "WDHMS";
+    static const long seconds[] = { 7 * 24 * 60 * 60, 24 * 60 * 60, 60 * 60, 60, 1 };
+    const char * unit;
+    char * stop;
+    long number;
+    bool negative, time, any;
+
+    negative = *value == '-';
+
+    if (*value == '+' || *value == '-')
+        ++value;
+
+    if (*value != 'P')
+        return false;
+
+    ++value;
+    *length = 0;
+    time = false;
+    any = false;
+
+    /* Each part is a number and its unit; H, M and S only after the T */
+    while (*value != '\0'){
+
+        if (*value == 'T' && time == false){
+
+            time = true;
+            ++value;
+            continue;
+        }
+
+        if (*value < '0' || *value > '9')
+            return false;
+
+        number = strtol(value, &stop, 10);
+        unit = *stop != '\0' ? strchr(units, *stop) : NULL;
+
+        if (unit == NULL || (unit - units >= 2) != time)
+            return false;
+
+        *length += number * seconds[unit - units];
+        value = stop + 1;
+        any = true;
+    }
+
+    if (negative == true)
+        *length = -*length;
+
+    return any;
+}
+
+void collectBusy (const CalComp *top, const CalTzSet *zones, const CalComp *comp, time_t from, time_t to, BusyAdd add, void *list){
+
+    const CalProp * currentProp, * dtstart, * dtend, * duration;
+    const CalTzZone * zone;
+    CalRecur recur;
+    time_t start, end, length, occurrence;
+    bool recurs, tentative, nominal;
+
+    dtstart = NULL;
+    dtend = NULL;
+    duration = NULL;
+    recurs = false;
+    tentative = false;
+
+    for (currentProp = comp->prop; currentProp != NULL; currentProp = currentProp->next){
+
+        if (dtstart == NULL && strcmp(currentProp->name, "DTSTART") == 0)
+            dtstart = currentProp;
+        else if (dtend == NULL && strcmp(currentProp->name, "DTEND") == 0)
+            dtend = currentProp;
+        else if (duration == NULL && strcmp(currentProp->name, "DURATION") == 0)
+            duration = currentProp;
+        else if (strcmp(currentProp->name, "RRULE") == 0 || strcmp(currentProp->name, "RDATE") == 0)
+            recurs = true;
+
+        /* Transparent and cancelled events don't block time */
+        else if (strcmp(currentProp->name, "TRANSP") == 0 && strcmp(currentProp->value, "TRANSPARENT") == 0)
+            return;
+        else if (strcmp(currentProp->name, "STATUS") == 0 && strcmp(currentProp->value, "CANCELLED") == 0)
+            return;
+        else if (strcmp(currentProp->name, "STATUS") == 0 && strcmp(currentProp->value, "TENTATIVE") == 0)
+            tentative = true;
+    }
+
+    if (dtstart == NULL)
+        return;
+
+    start = busyEpoch(top, zones, dtstart);
+
+    /* Without an end or a duration, a DATE event takes its day and a DATE-TIME one no time at all (RFC 5545 3.6.1) */
+    if (dtend != NULL)
+        length = busyEpoch(top, zones, dtend) - start;
+    else if (duration == NULL || calBusyDuration(duration->value, &length) == false)
+        length = strchr(dtstart->value, 'T') == NULL ? 24 * 60 * 60 : 0;
+
+    if (length <= 0)
+        return;
+
+    /* Occurrences run on DTSTART's clock, and so do the days of a DATE event, which last from midnight to midnight
+       even across a daylight saving change */
+    zone = calTzZone(zones, dtstart);
+
+    if (zone == NULL)
+        zone = calTzLocal();
+
+    nominal = dtend == NULL && strchr(dtstart->value, 'T') == NULL;
+
+    if (recurs == false){
+
+        end = nominal == true ? calTzToUTC(zone, calRecurWall(dtstart->value) + length) : start + length;
+
+        if (start < to && end > from)
+            add(list, comp, start, end, tentative);
+
+        return;
+    }
+
+    /* The first occurrence that can reach the window is skipped to, less some slack */
+    calRecurInit(&recur, comp, calRecurWall(dtstart->value));
+
+    if (recur.untilUTC == true)
+        recur.until = calTzFromUTC(zone, recur.until);
+
+    calRecurSkip(&recur, calTzFromUTC(zone, from - length) - CALTZ_SLACK);
+
+    while (calRecurNext(&recur, &occurrence) == true){
+
+        end = nominal == true ? calTzToUTC(zone, occurrence + length) : 0;
+        occurrence = calTzToUTC(zone, occurrence);
+
+        if (occurrence >= to)
+            break;
+
+        if (nominal == false)
+            end = occurrence + length;
+
+        if (end > from)
+            add(list, comp, occurrence, end, tentative);
+    }
+
+    calRecurFree(&recur);
+}
+
+time_t busyEpoch (const CalComp *top, const CalTzSet *zones, const CalProp *prop){
+
+    const CalTzZone * zone;
+    time_t date;
+
+    if (calSnapEpoch(top, prop, &date) == true)
+        return date;
+
+    zone = calTzZone(zones, prop);
+
+    return calTzToUTC(zone != NULL ? zone : calTzLocal(), calRecurWall(prop->value));
+}
+
+void addBusyTimes (void *list, const CalComp *event, time_t start, time_t end, bool tentative){
+
+    BusyLists * lists = (BusyLists *) list;
+
+    (void) event;
+
+    addBusySpan(tentative == true ? &lists->tentative : &lists->busy, start, end, lists->from, lists->to);
+}
+
+void addConflictRec (void *list, const CalComp *event, time_t start, time_t end, bool tentative){
+
+    ConflictList * recs = (ConflictList *) list;
+
+    (void) tentative;
+
+    if (recs->n == recs->cap){
+
+        recs->cap = recs->cap == 0 ? 256 : recs->cap * 2;
+        recs->recs = realloc(recs->recs, sizeof(ConflictRec) * recs->cap);
+        assert(recs->recs);
+    }
+
+    recs->recs[recs->n].occ.event = event;
+    recs->recs[recs->n].occ.span.start = start;
+    recs->recs[recs->n].occ.span.end = end;
+    recs->recs[recs->n].order = recs->n;
+    ++recs->n;
+}
+
+void addBusySpan (BusyList *list, time_t start, time_t end, time_t from, time_t to){
+
+    if (start < from)
+        start = from;
+
+    if (end > to)
+        end = to;
+
+    if (start >= end)
+        return;
+
+    if (list->n == list->cap){
+
+        list->cap = list->cap == 0 ? 256 : list->cap * 2;
+        list->spans = realloc(list->spans, sizeof(CalSpan) * list->cap);
+        assert(list->spans);
+    }
+
+    list->spans[list->n].start = start;
+    list->spans[list->n].end = end;
+    ++list->n;
+}
+
+size_t mergeBusySpans (CalSpan *spans, size_t n){
+
+    size_t i, merged;
+
+    if (n == 0)
+        return 0;
+
+    calSort(spans, n, sizeof(CalSpan), compareBusySpans);
+
+    /* One sweep: each span either stretches the last merged one or starts the next */
+    merged = 0;
+
+    for (i = 1; i < n; ++i){
+
+        if (spans[i].start <= spans[merged].end){
+
+            if (spans[i].end > spans[merged].end)
+                spans[merged].end = spans[i].end;
+        }
+
+        else
+            spans[++merged] = spans[i];
+    }
+
+    return merged + 1;
+}
+
+size_t subtractBusySpans (const CalSpan *spans, size_t n, const CalSpan *busy, size_t nbusy, CalSpan *out){
+
+    size_t i, j, nout;
+    time_t start;
+
+    nout = 0;
+    j = 0;
+
+    for (i = 0; i < n; ++i){
+
+        start = spans[i].start;
+
+        /* Busy spans that end before this one starts can't cut any later one either */
+        while (j < nbusy && busy[j].end <= start)
+            ++j;
+
+        while (j < nbusy && busy[j].start < spans[i].end){
+
+            if (busy[j].start > start){
+
+                out[nout].start = start;
+                out[nout].end = busy[j].start;
+                ++nout;
+            }
+
+            start = busy[j].end;
+
+            if (busy[j].end > spans[i].end)
+                break;
+
+            ++j;
+        }
+
+        if (start < spans[i].end){
+
+            out[nout].start = start;
+            out[nout].end = spans[i].end;
+            ++nout;
+        }
+    }
+
+    return nout;
+}
+
+void *runBusyBatch (void *arg){
+
+    BusyBatch * batch = (BusyBatch *) arg;
+    size_t i;
+
+    while (true){
+
+        pthread_mutex_lock(&batch->lock);
+        i = batch->next;
+
+        if (batch->next < batch->n)
+            ++batch->next;
+
+        pthread_mutex_unlock(&batch->lock);
+
+        if (i == batch->n)
+            return NULL;
+
+        calBusyTimes(batch->comps[i], batch->from, batch->to, &batch->busy[i]);
+    }
+}
+
+void siftBusyHeap (BusyCursor *heap, size_t n, size_t i){
+
+    BusyCursor moving;
+    size_t child;
+
+    if (n == 0)
+        return;
+
+    moving = heap[i];
+
+    while ((child = 2 * i + 1) < n){
+
+        if (child + 1 < n && heap[child + 1].span->start < heap[child].span->start)
+            ++child;
+
+        if (heap[child].span->start >= moving.span->start)
+            break;
+
+        heap[i] = heap[child];
+        i = child;
+    }
+
+    heap[i] = moving;
+}
+
+int compareConflictRecs (const void *a, const void *b){
+
+    const ConflictRec * castA = (const ConflictRec *) a;
+    const ConflictRec * castB = (const ConflictRec *) b;
+
+    if (castA->occ.span.start != castB->occ.span.start)
+        return castA->occ.span.start < castB->occ.span.start ? -1 : 1;
+
+    return castA->order < castB->order ? -1 : castA->order > castB->order;
+}
+
+void siftConflictHeap (size_t *heap, size_t n, const ConflictRec *recs, size_t i){
+
+    size_t moving, child;
+
+    if (n == 0)
+        return;
+
+    moving = heap[i];
+
+    while ((child = 2 * i + 1) < n){
+
+        if (child + 1 < n && recs[heap[child + 1]].occ.span.end < recs[heap[child]].occ.span.end)
+            ++child;
+
+        if (recs[heap[child]].occ.span.end >= recs[moving].occ.span.end)
+            break;
+
+        heap[i] = heap[child];
+        i = child;
+    }
+
+    heap[i] = moving;
+}
+
+int compareBusySpans (const void *a, const void *b){
+
+    time_t castA = ((const CalSpan *) a)->start;
+    time_t castB = ((const CalSpan *) b)->start;
+
+    return castA < castB ? -1 : castA > castB;
+}
@@ -0,0 +1,138 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calbusy.h -- Public interface for free/busy computation in calbusy.c
+Last updated:  Oct 19/26
+
+The busy time of a calendar over a window is found in one pass over its
+VEVENTs and one sweep. Each event (and each occurrence of a recurring
+one) that overlaps the window becomes a span from its DTSTART to its
+DTEND, or DTSTART plus DURATION, or the whole day of a DATE DTSTART.
+Events with TRANSP:TRANSPARENT or STATUS:CANCELLED take no time, and
+STATUS:TENTATIVE ones are kept apart as tentatively busy. The spans are
+sorted by start and swept once, merging every run that overlaps or
+touches. Local times are converted through calTzLocal's table rather than
+mktime, so the cost is the sort.
+
+calBusyMany does the same for a batch of calendars, spreading them over
+as many threads as calsort.h's large sorts use. calBusyFreeSlots then
+finds the time none of them is busy in (tentatively or not) with one
+k-way sweep: the calendars' merged span lists are drawn from a heap in
+order of start, so only the earliest pending span of each list is ever
+compared, and every gap at least the requested length is a common free
+slot.
+
+calBusyConflicts reports every pair of overlapping VEVENT occurrences
+with a sort and one sweep rather than by comparing every pair: the
+occurrences are sorted by start, and those still going are kept in a
+heap by end, so each new one overlaps exactly what is left in the heap
+once the ones that ended by its start are dropped. That is O(n log n)
+for n occurrences plus the k pairs, and pairs are handed to a callback
+as they are found rather than stored.
+********/
+
+#ifndef CALBUSY_H
+#define CALBUSY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include "calutil.h"
+
+typedef struct {        // a span of calendar time, start included and end not
+    time_t start, end;
+} CalSpan;
+
+typedef struct {        // one occurrence of a VEVENT, see calBusyConflicts
+    const CalComp *event;   // the VEVENT
+    CalSpan span;           // when the occurrence starts and ends, not clipped to any window
+} CalBusyEvent;
+
+/* Take one pair of overlapping occurrences from calBusyConflicts
+ *
+ * Arguments: the occurrence that started first (or was found first if they start together), the other, and the
+ *            caller's argument
+ *
+ * Return val: false to stop the search, true to go on
+ * */
+typedef bool (*CalConflictFn)( const CalBusyEvent *first, const CalBusyEvent *second, void *arg );
+
+typedef struct {        // busy time of a calendar over a window, see calBusyTimes
+    CalSpan *busy;          // merged, ascending, none touching
+    size_t nbusy;
+    CalSpan *tentative;     // tentatively busy time not already in busy, kept the same way
+    size_t ntentative;
+} CalBusy;
+
+/*	Find the busy time of a calendar over a window
+ *
+ * Arguments: the calendar, the window (from included, to not) and where to put the result
+ *
+ * Preconditions: *comp must be initialized
+ * Postconditions: *busy holds malloc'd spans clipped to the window, to be released with calBusyFree
+ *
+ * Return val: none
+ * */
+void calBusyTimes( const CalComp *comp, time_t from, time_t to, CalBusy *const busy );
+
+/*	Find the busy time of many calendars over one window, in parallel
+ *
+ * Arguments: the calendars, how many there are, the window (from included, to not) and an array of n results
+ *
+ * Preconditions: the calendars must be initialized and distinct, since decoding parameters changes them
+ * Postconditions: busy[i] holds calendar i's result as calBusyTimes gives it, each to be released with calBusyFree
+ *
+ * Return val: none
+ * */
+void calBusyMany( const CalComp *const *comps, size_t n, time_t from, time_t to, CalBusy *const busy );
+
+/*	Find the time free in every one of a set of calendars
+ *
+ * Arguments: the calendars' results from calBusyTimes or calBusyMany, how many there are, the window (from included,
+ *            to not), the shortest slot wanted and where to put the slots
+ *
+ * Preconditions: length > 0
+ * Postconditions: *slots is malloc'd (even when no slot is found); the caller frees it
+ *
+ * Return val: no. of slots, ascending, each a whole gap of at least length in which no calendar is busy or
+ *             tentatively busy
+ * */
+size_t calBusyFreeSlots( const CalBusy *busy, size_t n, time_t from, time_t to, time_t length, CalSpan **const slots );
+
+/*	Find every pair of VEVENT occurrences that overlap
+ *
+ * Arguments: the calendar, the window (from included, to not), the callback and its argument
+ *
+ * Preconditions: *comp must be initialized
+ * Postconditions: report is called once for each pair of occurrences that overlap the window and each other (an
+ *                 end touching a start doesn't count), in order of the second's start; occurrences are found as
+ *                 calBusyTimes finds busy ones, so TRANSPARENT and CANCELLED events never conflict
+ *
+ * Return val: no. of pairs reported
+ * */
+size_t calBusyConflicts( const CalComp *comp, time_t from, time_t to, CalConflictFn report, void *arg );
+
+/*	Release what calBusyTimes stored
+ *
+ * Arguments: the result
+ *
+ * Preconditions: busy was filled in by calBusyTimes
+ * Postconditions: its spans are free'd and it is left empty
+ *
+ * Return val: none
+ * */
+void calBusyFree( CalBusy *busy );
+
+/*	Read a DURATION value
+ *
+ * Arguments: the value ([+-]P followed by weeks, or days and a time) and where to put its length
+ *
+ * Preconditions: none
+ * Postconditions: *length is set in seconds if the value can be read
+ *
+ * Return val: false if the value can't be read, true otherwise
+ * */
+bool calBusyDuration( const char *value, time_t *const length );
+
+#endif
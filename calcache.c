@@ -0,0 +1,489 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calcache.c -- Source code for the content-hash parse cache
+Last updated:  Oct 19/26
+********/
+
+#define _GNU_SOURCE   // for fmemopen and utimensat
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "calcache.h"
+#include "calsnap.h"
+
+#define CACHE_SUFFIX ".snap"    // extension of cache entries
+
+typedef struct {        // cache entry found while trimming
+    char *name;
+    long long size;
+    struct timespec used;   // mtime, bumped on every hit
+} CacheEntry;
+
+/* Parse a size limit such as 512K, 64M or 1G
+ *
+ * Arguments: limit string
+ *
+ * Preconditions: *str must be initialized
+ * Postconditions: none
+ *
+ * Return val: the limit in bytes, or -1 if str isn't a valid limit
+ * */
+long long parseCacheSize (const char *str);
+
+/* Compares two cache entries and checks which was used less recently
+ *
+ * Arguments: both a and b are initialized CacheEntry variables
+ *
+ * Preconditions: both a and b are initialized CacheEntry variables
+ * Postconditions: none
+ *
+ * Return val: negative int if a was used first, positive int if b was used first, 0 if at the same time
+ * */
+int compareCacheEntries (const void *a, const void *b);
+
+/* Create a cache directory along with any of its parents that are missing, as mkdir -p does
+ *
+ * Arguments: path of the directory
+ *
+ * Preconditions: *dir must be initialized
+ * Postconditions: each missing directory on the path is created with mode 0700
+ *
+ * Return val: true if the directory exists afterwards, false otherwise
+ * */
+bool makeCacheDir (const char *dir);
+
+/* Run one 64-byte block through the SHA-256 compression function
+ *
+ * Arguments: the running hash state and the block
+ *
+ * Preconditions: block holds at least 64 bytes
+ * Postconditions: state is updated with the block
+ *
+ * Return val: none
+ * */
+void digestCacheBlock (uint32_t state[8], const unsigned char *block);
+
+CalStatus readCalInput( FILE *const ics, CalComp **const pcomp ){
+
+    return readCalSource(ics, NULL, pcomp);
+}
+
+CalStatus readCalSource( FILE *const ics, const char *srcpath, CalComp **const pcomp ){
+
+    CalCache cache;
+
+    /* Snapshots are recognized by their first byte, so either kind can be piped in */
+    if (isCalSnap(ics) == true)
+        return readCalSnap(ics, srcpath, pcomp);
+
+    if (getCalCacheEnv(&cache) == true)
+        return readCalCached(ics, &cache, pcomp);
+
+    return readCalFile(ics, pcomp);
+}
+
+bool getCalCacheEnv( CalCache *const cache ){
+
+    const char * value;
+    long long limit;
+
+    cache->dir = getenv(CALCACHE_DIR_ENV);
+    cache->maxbytes = CALCACHE_BYTES;
+    cache->maxentries = CALCACHE_ENTRIES;
+
+    if (cache->dir == NULL || cache->dir[0] == '\0')
+        return false;
+
+    /* Override the default limits with any that are set */
+    value = getenv(CALCACHE_BYTES_ENV);
+    if (value != NULL && (limit = parseCacheSize(value)) >= 0)
+        cache->maxbytes = limit;
+
+    value = getenv(CALCACHE_ENTRIES_ENV);
+    if (value != NULL && (limit = parseCacheSize(value)) >= 0)
+        cache->maxentries = limit;
+
+    return true;
+}
+
+CalStatus readCalCached( FILE *const ics, const CalCache *cache, CalComp **const pcomp ){
+
+    CalStatus status;
+    FILE * entry, * text;
+    char * buffer, * path, * tmppath;
+    unsigned char digest[CALSNAP_DIGEST], stored[CALSNAP_DIGEST];
+    size_t len, cap, got, i;
+    int fd;
+
+    /* Read all of the input so it can be hashed */
+    len = 0;
+    cap = 65536;
+    buffer = malloc(cap);
+    assert(buffer);
+
+    while ((got = fread(buffer + len, 1, cap - len, ics)) > 0){
+
+        len += got;
+
+        if (len == cap){
+
+            cap *= 2;
+            buffer = realloc(buffer, cap);
+            assert(buffer);
+        }
+    }
+
+    /* Nothing to hash, let readCalFile report the empty input */
+    if (len == 0){
+
+        free(buffer);
+        return readCalFile(ics, pcomp);
+    }
+
+    digestCalText(buffer, len, digest);
+
+    path = malloc(strlen(cache->dir) + 128);
+    assert(path);
+    sprintf(path, "%s/", cache->dir);
+
+    for (i = 0; i < CALSNAP_DIGEST; ++i)
+        sprintf(path + strlen(path), "%02x", digest[i]);
+
+    /* A tree parsed leniently may not pass strict parsing, so the two are cached apart */
+    sprintf(path + strlen(path), "-%llx%s%s", (unsigned long long)len, getCalStrict() == true ? "-strict" : "", CACHE_SUFFIX);
+
+    /* Check for a hit; an unusable entry (e.g. from another build) is treated as a miss */
+    entry = fopen(path, "r");
+
+    if (entry != NULL){
+
+        status = readCalSnap(entry, NULL, pcomp);
+        fclose(entry);
+
+        /* The name alone isn't trusted: the entry must record the digest of this very text */
+        if (status.code == OK && (calSnapDigest(*pcomp, stored) == false || memcmp(stored, digest, CALSNAP_DIGEST) != 0)){
+
+            freeCalComp(*pcomp);
+            *pcomp = NULL;
+            status.code = IOERR;
+        }
+
+        if (status.code == OK){
+
+            utimensat(AT_FDCWD, path, NULL, 0); // Mark as most recently used
+
+            free(path);
+            free(buffer);
+            return status;
+        }
+    }
+
+    /* Parse the text we already read */
+    text = fmemopen(buffer, len, "r");
+    assert(text);
+
+    status = readCalFile(text, pcomp);
+    fclose(text);
+    free(buffer);
+
+    /* Only successful parses are cached; errors are cheap to reproduce */
+    if (status.code == OK){
+
+        makeCacheDir(cache->dir);
+
+        /* Write under a temporary name and rename so concurrent readers never see a partial entry */
+        tmppath = malloc(strlen(path) + 32);
+        assert(tmppath);
+        sprintf(tmppath, "%s.%ld.tmp", path, (long)getpid());
+
+        fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        entry = fd >= 0 ? fdopen(fd, "w") : NULL;
+
+        if (entry != NULL){
+
+            if (writeCalSnap(entry, *pcomp, status.lineto, NULL, digest).code == OK && fclose(entry) == 0)
+                rename(tmppath, path);
+            else
+                unlink(tmppath);
+
+            trimCalCache(cache);
+        }
+
+        free(tmppath);
+    }
+
+    free(path);
+
+    return status;
+}
+
+int trimCalCache( const CalCache *cache ){
+
+    DIR * dir;
+    struct dirent * ent;
+    struct stat st;
+    CacheEntry * entries;
+    char * path;
+    long long total;
+    size_t len, count, cap, i;
+    int removed;
+
+    dir = opendir(cache->dir);
+
+    if (dir == NULL)
+        return 0;
+
+    count = 0;
+    cap = 64;
+    total = 0;
+    entries = malloc(sizeof(CacheEntry) * cap);
+    assert(entries);
+
+    path = malloc(strlen(cache->dir) + 258);
+    assert(path);
+
+    /* Collect every entry with its size and last use */
+    while ((ent = readdir(dir)) != NULL){
+
+        len = strlen(ent->d_name);
+
+        if (len <= strlen(CACHE_SUFFIX) || strcmp(ent->d_name + len - strlen(CACHE_SUFFIX), CACHE_SUFFIX) != 0)
+            continue;
+
+        sprintf(path, "%s/%s", cache->dir, ent->d_name);
+
+        if (stat(path, &st) != 0)
+            continue;
+
+        if (count == cap){
+
+            cap *= 2;
+            entries = realloc(entries, sizeof(CacheEntry) * cap);
+            assert(entries);
+        }
+
+        entries[count].name = strdup(ent->d_name);
+        assert(entries[count].name);
+        entries[count].size = st.st_size;
+        entries[count].used = st.st_mtim;
+        total += st.st_size;
+        ++count;
+    }
+
+    closedir(dir);
+
+    qsort(entries, count, sizeof(CacheEntry), compareCacheEntries); // Oldest first
+
+    /* Remove the least recently used entries until both limits hold */
+    removed = 0;
+    for (i = 0; i < count; ++i){
+
+        if ((cache->maxbytes == 0 || total <= cache->maxbytes) && (cache->maxentries == 0 || (long)(count - removed) <= cache->maxentries))
+            break;
+
+        sprintf(path, "%s/%s", cache->dir, entries[i].name);
+
+        if (unlink(path) == 0){
+
+            total -= entries[i].size;
+            ++removed;
+        }
+    }
+
+    for (i = 0; i < count; ++i)
+        free(entries[i].name);
+
+    free(entries);
+    free(path);
+
+    return removed;
+}
+
+uint64_t hashCalText (const char *text, size_t len){
+
+    uint64_t hash, word;
+    size_t i;
+
+    hash = 14695981039346656037ULL ^ len;
+
+    /* Mix eight bytes at a time, then the remaining tail */
+    for (i = 0; i + 8 <= len; i += 8){
+
+        memcpy(&word, text + i, sizeof(word));
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 32;
+    }
+
+    for (; i < len; ++i)
+        hash = (hash ^ (unsigned char)text[i]) * 1099511628211ULL;
+
+    hash ^= hash >> 29;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+void digestCalText( const char *text, size_t len, unsigned char digest[CALSNAP_DIGEST] ){
+
+    uint32_t state[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    unsigned char tail[128];
+    uint64_t bits;
+    size_t done, rest, i;
+
+    for (done = 0; done + 64 <= len; done += 64)
+        digestCacheBlock(state, (const unsigned char *)text + done);
+
+    /* Pad the last bytes with a 1 bit, zeros and the length in bits, spilling into a second block if need be */
+    rest = len - done;
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, text + done, rest);
+    tail[rest] = 0x80;
+    rest = rest < 56 ? 64 : 128;
+
+    bits = (uint64_t)len * 8;
+    for (i = 0; i < 8; ++i)
+        tail[rest - 1 - i] = (unsigned char)(bits >> (i * 8));
+
+    for (i = 0; i < rest; i += 64)
+        digestCacheBlock(state, tail + i);
+
+    for (i = 0; i < 8; ++i){
+
+        digest[i * 4] = (unsigned char)(state[i] >> 24);
+        digest[i * 4 + 1] = (unsigned char)(state[i] >> 16);
+        digest[i * 4 + 2] = (unsigned char)(state[i] >> 8);
+        digest[i * 4 + 3] = (unsigned char)state[i];
+    }
+}
+
+void digestCacheBlock (uint32_t state[8], const unsigned char *block){
+
+    static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+    uint32_t w[64], v[8], s0, s1, t1, t2;
+    int i;
+
+    #define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+    for (i = 0; i < 16; ++i)
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 | (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+
+    for (i = 16; i < 64; ++i){
+
+        s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    memcpy(v, state, sizeof(v));
+
+    for (i = 0; i < 64; ++i){
+
+        s1 = ROTR(v[4], 6) ^ ROTR(v[4], 11) ^ ROTR(v[4], 25);
+        t1 = v[7] + s1 + ((v[4] & v[5]) ^ (~v[4] & v[6])) + k[i] + w[i];
+        s0 = ROTR(v[0], 2) ^ ROTR(v[0], 13) ^ ROTR(v[0], 22);
+        t2 = s0 + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+
+        memmove(v + 1, v, sizeof(uint32_t) * 7);
+        v[4] += t1;
+        v[0] = t1 + t2;
+    }
+
+    #undef ROTR
+
+    for (i = 0; i < 8; ++i)
+        state[i] += v[i];
+}
+
+long long parseCacheSize (const char *str){
+
+    char * end;
+    long long value;
+
+    value = strtoll(str, &end, 10);
+
+    if (end == str || value < 0)
+        return -1;
+
+    /* Apply the optional unit suffix */
+    if (*end == 'K' || *end == 'k')
+        value *= 1024;
+    else if (*end == 'M' || *end == 'm')
+        value *= 1024 * 1024;
+    else if (*end == 'G' || *end == 'g')
+        value *= 1024LL * 1024 * 1024;
+    else if (*end != '\0')
+        return -1;
+
+    if (*end != '\0' && end[1] != '\0')
+        return -1;
+
+    return value;
+}
+
+int compareCacheEntries (const void *a, const void *b){
+
+    /* Cast parameters */
+    const CacheEntry * castA = (const CacheEntry *) a;
+    const CacheEntry * castB = (const CacheEntry *) b;
+
+    if (castA->used.tv_sec != castB->used.tv_sec)
+        return castA->used.tv_sec < castB->used.tv_sec ? -1 : 1;
+
+    if (castA->used.tv_nsec != castB->used.tv_nsec)
+        return castA->used.tv_nsec < castB->used.tv_nsec ? -1 : 1;
+
+    return strcmp(castA->name, castB->name);
+}
+
+bool makeCacheDir (const char *dir){
+
+    struct stat info;
+    char * path, * slash;
+    bool made;
+
+    if (mkdir(dir, 0700) == 0 || (errno == EEXIST && stat(dir, &info) == 0 && S_ISDIR(info.st_mode)))
+        return true;
+
+    if (errno != ENOENT)
+        return false;
+
+    path = strdup(dir);
+    assert(path);
+
+    /* Create each parent in turn, skipping the root and any that already exist */
+    made = true;
+
+    for (slash = strchr(path + 1, '/'); slash != NULL && made == true; slash = strchr(slash + 1, '/')){
+
+        *slash = '\0';
+
+        if (slash[-1] != '/' && mkdir(path, 0700) != 0 && errno != EEXIST)
+            made = false;
+
+        *slash = '/';
+    }
+
+    free(path);
+
+    return made == true && (mkdir(dir, 0700) == 0 || errno == EEXIST);
+}
@@ -0,0 +1,118 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calcache.h -- Public interface for the content-hash parse cache in calcache.c
+Last updated:  Oct 19/26
+
+The cache is a directory of snapshots (see calsnap.h) named after the
+SHA-256 digest and the length of the iCalendar text they were parsed
+from, so reading the same bytes again loads the snapshot instead of
+calling readCalFile. Each snapshot also records the digest, and an entry
+whose digest doesn't match the text is treated as a miss. The directory
+and its entries are created readable by their owner only. Least
+recently used entries are evicted once the directory grows past its
+size or entry limits.
+********/
+
+#ifndef CALCACHE_H
+#define CALCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "calutil.h"
+
+#define CALCACHE_DIR_ENV "CALTOOL_CACHE"            // cache directory; caching is off when unset
+#define CALCACHE_BYTES_ENV "CALTOOL_CACHE_MAX"      // size limit in bytes (K, M or G suffix allowed)
+#define CALCACHE_ENTRIES_ENV "CALTOOL_CACHE_ENTRIES" // entry limit
+#define CALCACHE_BYTES 268435456LL                   // default size limit (256M)
+#define CALCACHE_ENTRIES 1000                        // default entry limit
+
+typedef struct {
+    const char *dir;        // directory holding the cached snapshots
+    long long maxbytes;     // total size allowed before eviction (0 = no limit)
+    long maxentries;        // no. of entries allowed before eviction (0 = no limit)
+} CalCache;
+
+/*	Read a calendar from iCalendar text or a snapshot, going through the parse cache if one is configured
+ *
+ * Arguments: an open input file and the address of the pointer that receives the calendar
+ *
+ * Preconditions: nothing has been read from ics yet
+ * Postconditions: *pcomp is set as by readCalFile; the tree is released with freeCalComp
+ *
+ * Return val: status returned by readCalFile, readCalSnap or readCalCached
+ * */
+CalStatus readCalInput( FILE *const ics, CalComp **const pcomp );
+
+/*	Read a calendar as readCalInput does, naming the file a snapshot was made from
+ *
+ * Arguments: an open input file, the path of the .ics file a snapshot on ics was made from (or NULL) and the
+ *            address of the pointer that receives the calendar
+ *
+ * Preconditions: nothing has been read from ics yet
+ * Postconditions: as for readCalInput; a snapshot is parsed from srcpath instead if that file has changed since
+ *                 the snapshot was written (see readCalSnap)
+ *
+ * Return val: as for readCalInput, or STALE if srcpath has changed but can't be read
+ * */
+CalStatus readCalSource( FILE *const ics, const char *srcpath, CalComp **const pcomp );
+
+/*	Fill in cache settings from the CALTOOL_CACHE* environment variables
+ *
+ * Arguments: settings to fill in
+ *
+ * Preconditions: none
+ * Postconditions: *cache holds the configured directory and limits (defaults for limits that aren't set)
+ *
+ * Return val: true if a cache directory is configured, false otherwise
+ * */
+bool getCalCacheEnv( CalCache *const cache );
+
+/*	Read a calendar, loading it from the cache when the same text was parsed before
+ *
+ * Arguments: an open iCalendar file, cache settings and the address of the pointer that receives the calendar
+ *
+ * Preconditions: cache->dir exists or can be created
+ * Postconditions: *pcomp is set as by readCalFile; on a miss that parses successfully a snapshot is added to
+ *                 the cache and least recently used entries are evicted, on a hit the entry becomes most recent
+ *
+ * Return val: status returned by readCalFile (or readCalSnap on a hit)
+ * */
+CalStatus readCalCached( FILE *const ics, const CalCache *cache, CalComp **const pcomp );
+
+/*	Evict least recently used entries until the cache is within its limits
+ *
+ * Arguments: cache settings
+ *
+ * Preconditions: none
+ * Postconditions: the oldest entries are removed from cache->dir until both limits hold
+ *
+ * Return val: no. of entries removed
+ * */
+int trimCalCache( const CalCache *cache );
+
+/*	Hash a block of text quickly, for hash tables and change detection (not collision resistant)
+ *
+ * Arguments: text and its length
+ *
+ * Preconditions: text holds at least len bytes
+ * Postconditions: none
+ *
+ * Return val: 64-bit hash of the bytes
+ * */
+uint64_t hashCalText( const char *text, size_t len );
+
+/*	Compute the SHA-256 digest of a block of text, as cache entries are named and checked
+ *
+ * Arguments: text, its length and the buffer to store the digest in
+ *
+ * Preconditions: text holds at least len bytes
+ * Postconditions: digest holds the 32 byte digest
+ *
+ * Return val: none
+ * */
+void digestCalText( const char *text, size_t len, unsigned char digest[32] );
+
+#endif
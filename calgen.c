@@ -0,0 +1,333 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calgen.c -- Synthetic iCalendar generator for benchmarking
+Last updated:  Oct 19/26
+
+Usage:
+    calgen [-e events] [-t todos] [-a alarms] [-p params] [-x xprops] [-d desclen] [-s seed] > file.ics
+
+    -e  no. of VEVENT components (default 500)
+    -t  no. of VTODO components (default 100)
+    -a  VALARM components in each event (default 1)
+    -p  extra parameters on each ORGANIZER and ATTENDEE line (default 3)
+    -x  X-properties in each component (default 2)
+    -d  characters in each DESCRIPTION (default 200)
+    -s  random seed, the same seed always gives the same file (default 1)
+
+Lines longer than 75 octets are folded. DESCRIPTION may be any length
+(-d 1048576 gives megabyte values to read and write back); -p is clamped
+so that person lines fit the generator's own line buffer.
+********/
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "calutil.h"
+
+#define FOLD_OCTETS 75                      // longest physical line written
+#define LINE_ROOM (MAXSTRINGLENGTH - 64)    // longest person line built
+
+typedef struct {        // shape of the generated calendar
+    long events, todos;
+    int alarms, params, xprops, desclen;
+    uint64_t seed;
+} GenOpts;
+
+/* Words used for summaries, descriptions and names */
+static const char *const genWords[] = { "project", "review", "meeting", "budget", "planning", "lunch", "design",
+                                        "release", "team", "call", "notes", "quarterly", "sync", "travel",
+                                        "workshop", "demo", "report", "customer", "launch", "retro" };
+
+/* Parameters added to ORGANIZER and ATTENDEE lines, in turn */
+static const char *const genParams[] = { "ROLE=REQ-PARTICIPANT", "PARTSTAT=NEEDS-ACTION", "RSVP=TRUE",
+                                         "CUTYPE=INDIVIDUAL", "LANGUAGE=en-CA", "X-NUM-GUESTS=0" };
+
+/* Next value of the generator's random sequence
+ *
+ * Arguments: generator state
+ *
+ * Preconditions: *state is non-zero
+ * Postconditions: *state is advanced
+ *
+ * Return val: a pseudo-random 64-bit value
+ * */
+uint64_t nextRandom (uint64_t *state);
+
+/* Write one content line, folding it at FOLD_OCTETS
+ *
+ * Arguments: output file and the unfolded line
+ *
+ * Preconditions: none
+ * Postconditions: the line and its CRLF are written
+ *
+ * Return val: none
+ * */
+void emitLine (FILE *const ics, const char *line);
+
+/* Append a random date-time to a line
+ *
+ * Arguments: line being built, random state, no. of seconds to add, and a value returned by an earlier
+ *            call to build a related date from (0 for a new date)
+ *
+ * Preconditions: line has room for 16 more characters
+ * Postconditions: a date in 2010-2019 in the form YYYYMMDDTHHMMSS is appended
+ *
+ * Return val: the random value used, so a related date can be generated from it
+ * */
+uint64_t appendDate (char *line, uint64_t *state, long offset, uint64_t from);
+
+/* Build a property line for a person with the configured parameters
+ *
+ * Arguments: line buffer, property name, person number, no. of parameters
+ *
+ * Preconditions: line holds MAXSTRINGLENGTH characters
+ * Postconditions: line holds the full property
+ *
+ * Return val: none
+ * */
+void buildPerson (char *line, const char *name, long who, int params);
+
+/* Write one VEVENT or VTODO with its subcomponents
+ *
+ * Arguments: output file, options, random state, component number, and whether it's a todo
+ *
+ * Preconditions: none
+ * Postconditions: the component is written
+ *
+ * Return val: none
+ * */
+void emitComponent (FILE *const ics, const GenOpts *opts, uint64_t *state, long index, bool todo);
+
+int main(int argc, char *argv[]){
+
+    GenOpts opts;
+    uint64_t state;
+    long value, i;
+    char * end;
+
+    opts.events = 500;
+    opts.todos = 100;
+    opts.alarms = 1;
+    opts.params = 3;
+    opts.xprops = 2;
+    opts.desclen = 200;
+    opts.seed = 1;
+
+    /* Read option pairs */
+    for (i = 1; i < argc; i += 2){
+
+        value = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : -1;
+
+        if (i + 1 == argc || *end != '\0' || value < 0 || strlen(argv[i]) != 2 || argv[i][0] != '-'){
+
+            fprintf(stderr, "Usage: calgen [-e events] [-t todos] [-a alarms] [-p params] [-x xprops] [-d desclen] [-s seed]\n");
+            return EXIT_FAILURE;
+        }
+
+        switch (argv[i][1]){
+
+            case 'e': opts.events = value; break;
+            case 't': opts.todos = value; break;
+            case 'a': opts.alarms = value; break;
+            case 'p': opts.params = value; break;
+            case 'x': opts.xprops = value; break;
+            case 'd': opts.desclen = value; break;
+            case 's': opts.seed = value; break;
+
+            default:
+                fprintf(stderr, "Error: unknown option %s\n", argv[i]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    /* Keep person lines within the buffer buildPerson fills */
+    if (opts.params > LINE_ROOM / 32){
+
+        opts.params = LINE_ROOM / 32;
+        fprintf(stderr, "calgen: -p clamped to %d\n", opts.params);
+    }
+
+    state = opts.seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    emitLine(stdout, "BEGIN:VCALENDAR");
+    emitLine(stdout, "VERSION:2.0");
+    emitLine(stdout, "PRODID:-//VCalendar//calgen//EN");
+    emitLine(stdout, "CALSCALE:GREGORIAN");
+    emitLine(stdout, "X-WR-CALNAME:Generated calendar");
+
+    /* Interleave todos among the events so both kinds are spread through the file */
+    for (i = 0; i < opts.events + opts.todos; ++i){
+
+        if (opts.todos > 0 && (opts.events == 0 || (i * opts.todos) / (opts.events + opts.todos) != ((i + 1) * opts.todos) / (opts.events + opts.todos)))
+            emitComponent(stdout, &opts, &state, i, true);
+        else
+            emitComponent(stdout, &opts, &state, i, false);
+    }
+
+    emitLine(stdout, "END:VCALENDAR");
+
+    return EXIT_SUCCESS;
+}
+
+uint64_t nextRandom (uint64_t *state){
+
+    /* xorshift64*, so a seed gives the same file on every platform */
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+void emitLine (FILE *const ics, const char *line){
+
+    size_t len, pos, chunk;
+
+    len = strlen(line);
+    chunk = len < FOLD_OCTETS ? len : FOLD_OCTETS;
+
+    fwrite(line, 1, chunk, ics);
+    fputs("\r\n", ics);
+
+    /* Continuation lines start with a space, which counts towards their octets */
+    for (pos = chunk; pos < len; pos += chunk){
+
+        chunk = len - pos < FOLD_OCTETS - 1 ? len - pos : FOLD_OCTETS - 1;
+
+        fputc(' ', ics);
+        fwrite(line + pos, 1, chunk, ics);
+        fputs("\r\n", ics);
+    }
+}
+
+uint64_t appendDate (char *line, uint64_t *state, long offset, uint64_t from){
+
+    uint64_t r;
+    int year, month, day, hour, minute;
+
+    r = from != 0 ? from : nextRandom(state);
+
+    year = 2010 + r % 10;
+    month = 1 + (r >> 8) % 12;
+    day = 1 + (r >> 16) % 28;
+    hour = 8 + (r >> 24) % 10 + offset / 3600;
+    minute = ((r >> 32) % 4) * 15;
+
+    sprintf(line + strlen(line), "%04d%02d%02dT%02d%02d00", year, month, day, hour, minute);
+
+    return r;
+}
+
+void buildPerson (char *line, const char *name, long who, int params){
+
+    int i;
+
+    sprintf(line, "%s;CN=\"%s %ld\"", name, genWords[who % 20], who);
+
+    for (i = 0; i < params; ++i)
+        sprintf(line + strlen(line), ";%s", genParams[i % 6]);
+
+    sprintf(line + strlen(line), ":mailto:%s%ld@example.com", genWords[who % 20], who);
+}
+
+void emitComponent (FILE *const ics, const GenOpts *opts, uint64_t *state, long index, bool todo){
+
+    char line[MAXSTRINGLENGTH], * desc;
+    const char * kind;
+    uint64_t r;
+    size_t len;
+    int i;
+
+    kind = todo == true ? "VTODO" : "VEVENT";
+
+    sprintf(line, "BEGIN:%s", kind);
+    emitLine(ics, line);
+
+    sprintf(line, "UID:%s-%ld@calgen.example.com", todo == true ? "todo" : "event", index);
+    emitLine(ics, line);
+
+    strcpy(line, "DTSTAMP:");
+    appendDate(line, state, 0, 0);
+    emitLine(ics, line);
+
+    /* Events get a start and end, todos a due date */
+    if (todo == false){
+
+        strcpy(line, "DTSTART:");
+        r = appendDate(line, state, 0, 0);
+        emitLine(ics, line);
+
+        strcpy(line, "DTEND:");
+        appendDate(line, state, 3600, r);
+        emitLine(ics, line);
+    }
+
+    else{
+
+        strcpy(line, "DUE:");
+        appendDate(line, state, 0, 0);
+        emitLine(ics, line);
+
+        sprintf(line, "PRIORITY:%d", (int)(nextRandom(state) % 10));
+        emitLine(ics, line);
+
+        emitLine(ics, "STATUS:NEEDS-ACTION");
+    }
+
+    sprintf(line, "SUMMARY:%s %s %ld", genWords[nextRandom(state) % 20], genWords[nextRandom(state) % 20], index);
+    emitLine(ics, line);
+
+    buildPerson(line, "ORGANIZER", nextRandom(state) % 50, opts->params);
+    emitLine(ics, line);
+
+    if (todo == false){
+
+        buildPerson(line, "ATTENDEE", nextRandom(state) % 500, opts->params);
+        emitLine(ics, line);
+    }
+
+    /* Description of random words cut to the requested length */
+    if (opts->desclen > 0){
+
+        desc = malloc(12 + (size_t) opts->desclen + 16);
+        assert(desc);
+
+        strcpy(desc, "DESCRIPTION:");
+        len = strlen(desc);
+
+        while (len < 12 + (size_t) opts->desclen){
+
+            strcpy(desc + len, genWords[nextRandom(state) % 20]);
+            strcat(desc + len, " ");
+            len += strlen(desc + len);
+        }
+
+        desc[12 + opts->desclen] = '\0';
+        emitLine(ics, desc);
+        free(desc);
+    }
+
+    for (i = 0; i < opts->xprops; ++i){
+
+        sprintf(line, "X-CALGEN-FIELD%d:%s", i, genWords[nextRandom(state) % 20]);
+        emitLine(ics, line);
+    }
+
+    for (i = 0; todo == false && i < opts->alarms; ++i){
+
+        emitLine(ics, "BEGIN:VALARM");
+        emitLine(ics, "ACTION:DISPLAY");
+        sprintf(line, "TRIGGER:-PT%dM", 5 * (1 + i));
+        emitLine(ics, line);
+        emitLine(ics, "DESCRIPTION:Reminder");
+        emitLine(ics, "END:VALARM");
+    }
+
+    sprintf(line, "END:%s", kind);
+    emitLine(ics, line);
+}
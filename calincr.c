@@ -0,0 +1,521 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calincr.c -- Source code for incremental reparsing
+Last updated:  Oct 19/26
+********/
+
+#define _GNU_SOURCE   // for fmemopen, fileno and strncasecmp
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include "calcache.h"
+#include "calincr.h"
+
+/* Read a whole file into memory
+ *
+ * Arguments: path, where to store the text and its length, and where to store the file's status
+ *
+ * Preconditions: none
+ * Postconditions: on success *text is malloc'd and holds the st_size bytes the file had when it was opened; the
+ *                 caller frees it
+ *
+ * Return val: false if the file can't be opened or read, true otherwise
+ * */
+bool readIncrFile (const char *path, char **text, size_t *len, struct stat *st);
+
+/* Split calendar text into its top-level components by their BEGIN and END lines
+ *
+ * Arguments: the text, its length, and where to store the spans, their number, the checksum of the text outside
+ *            them and the no. of lines
+ *
+ * Preconditions: none
+ * Postconditions: on success *spans is malloc'd for the caller to free; on failure it is NULL
+ *
+ * Return val: false unless the text is one calendar with at least one component and its BEGIN and END lines pair
+ *             up, true otherwise
+ * */
+bool scanIncrSpans (const char *text, size_t len, CalIncrSpan **spans, int *nspans, uint64_t *frame, int *lines);
+
+/* Check if a line starts with a delimiter, as readCalFile compares names
+ *
+ * Arguments: the line, its length and "BEGIN:" or "END:"
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: true if the line starts with the delimiter in any case, false otherwise
+ * */
+bool isIncrLine (const char *line, size_t len, const char *delim);
+
+/* Parse calendar text held in memory
+ *
+ * Arguments: the text, its length and the address of the pointer that receives the calendar
+ *
+ * Preconditions: none
+ * Postconditions: *pcomp is set as by readCalFile
+ *
+ * Return val: the status readCalFile returns
+ * */
+CalStatus parseIncrText (const char *text, size_t len, CalComp **pcomp);
+
+/* Make a CalIncr hold a new version of its file, parsed whole
+ *
+ * Arguments: the CalIncr, the file's text, its length and its status
+ *
+ * Preconditions: none
+ * Postconditions: on success the old tree is free'd and the new one kept with its spans (none if the scan can't
+ *                 split the text, so the next change is parsed whole too); on error incr is left as it was
+ *
+ * Return val: the status readCalFile returns
+ * */
+CalStatus loadIncrText (CalIncr *incr, const char *text, size_t len, const struct stat *st);
+
+/* Reparse only the components of a new version that differ from the old, and splice them into the tree
+ *
+ * Arguments: the CalIncr, the file's text, its length and its status, the new spans (which incr takes over), their
+ *            number, the no. of lines and where to store the no. of components parsed
+ *
+ * Preconditions: the text outside the new spans is the same as it was outside the old ones
+ * Postconditions: incr holds the new version; if the changed components can't be parsed on their own, the whole
+ *                 text is parsed instead so that an error is reported just as readCalFile reports it
+ *
+ * Return val: OK, or the status readCalFile returns for the whole text
+ * */
+CalStatus patchIncrText (CalIncr *incr, const char *text, size_t len, const struct stat *st, CalIncrSpan *spans,
+                         int nspans, int lines, int *reparsed);
+
+/* Give up a tree (or the replaced part of one) that a CalIncr no longer holds
+ *
+ * Arguments: the CalIncr and the components to give up
+ *
+ * Preconditions: none
+ * Postconditions: comp is free'd, or with incr->defer set, kept in incr->retired for the caller
+ *
+ * Return val: none
+ * */
+void retireIncrComp (CalIncr *incr, CalComp *comp);
+
+/* Record the status of the file a CalIncr's tree was read from
+ *
+ * Arguments: the CalIncr and the file's status
+ *
+ * Preconditions: none
+ * Postconditions: calIncrRefresh will take the file as unchanged while its status matches
+ *
+ * Return val: none
+ * */
+void noteIncrFile (CalIncr *incr, const struct stat *st);
+
+CalStatus calIncrOpen( const char *path, CalIncr *const incr ){
+
+    CalStatus status;
+    struct stat st;
+    char * text;
+    size_t len;
+
+    memset(incr, 0, sizeof(CalIncr));
+
+    if (readIncrFile(path, &text, &len, &st) == false){
+
+        status.code = IOERR;
+        status.linefrom = 0;
+        status.lineto = 0;
+
+        return status;
+    }
+
+    status = loadIncrText(incr, text, len, &st);
+    free(text);
+
+    if (status.code == OK){
+
+        incr->path = strdup(path);
+        assert(incr->path);
+    }
+
+    return status;
+}
+
+CalStatus calIncrRefresh( CalIncr *const incr, int *const reparsed ){
+
+    CalIncrSpan * spans;
+    CalStatus status;
+    struct stat st;
+    uint64_t frame;
+    char * text;
+    size_t len;
+    int nspans, lines;
+
+    *reparsed = 0;
+    status.code = OK;
+    status.linefrom = incr->lines;
+    status.lineto = incr->lines;
+
+    /* A file with the same size, modification time and inode is taken as unchanged without reading it */
+    if (stat(incr->path, &st) == 0 && st.st_dev == incr->dev && st.st_ino == incr->ino && st.st_size == incr->size &&
+        st.st_mtim.tv_sec == incr->mtime.tv_sec && st.st_mtim.tv_nsec == incr->mtime.tv_nsec)
+        return status;
+
+    if (readIncrFile(incr->path, &text, &len, &st) == false){
+
+        status.code = IOERR;
+        status.linefrom = 0;
+        status.lineto = 0;
+
+        return status;
+    }
+
+    /* Only components can be reparsed on their own; any other change means parsing the whole file */
+    if (incr->spans == NULL || scanIncrSpans(text, len, &spans, &nspans, &frame, &lines) == false || frame != incr->frame){
+
+        if (incr->spans != NULL)
+            free(spans);
+
+        status = loadIncrText(incr, text, len, &st);
+
+        if (status.code == OK)
+            *reparsed = incr->comp->ncomps;
+    }
+
+    else{
+
+        status = patchIncrText(incr, text, len, &st, spans, nspans, lines, reparsed);
+    }
+
+    free(text);
+
+    return status;
+}
+
+void calIncrClose( CalIncr *const incr ){
+
+    if (incr->comp != NULL)
+        freeCalComp(incr->comp);
+    if (incr->retired != NULL)
+        freeCalComp(incr->retired);
+    free(incr->retiredTop);
+
+    free(incr->spans);
+    free(incr->path);
+    memset(incr, 0, sizeof(CalIncr));
+}
+
+bool readIncrFile (const char *path, char **text, size_t *len, struct stat *st){
+
+    FILE * ics;
+    bool ok;
+
+    ics = fopen(path, "r");
+
+    if (ics == NULL)
+        return false;
+
+    /* The status is taken from the open file, so it describes the bytes read even if the file is replaced */
+    if (fstat(fileno(ics), st) != 0){
+
+        fclose(ics);
+        return false;
+    }
+
+    *text = malloc((size_t) st->st_size + 1);
+    assert(*text);
+
+    *len = fread(*text, 1, (size_t) st->st_size, ics);
+    ok = *len == (size_t) st->st_size && ferror(ics) == 0;
+
+    fclose(ics);
+
+    if (ok == false)
+        free(*text);
+
+    return ok;
+}
+
+bool scanIncrSpans (const char *text, size_t len, CalIncrSpan **spans, int *nspans, uint64_t *frame, int *lines){
+
+    const char * eol;
+    size_t pos, next, start, outside;
+    int depth, cap, line, startline, calendars;
+
+    *spans = NULL;
+    *nspans = 0;
+    *frame = 0;
+    cap = 0;
+    depth = 0;
+    line = 0;
+    calendars = 0;
+    start = 0;
+    startline = 0;
+    outside = 0;
+
+    /* Folded lines begin with white space, so a BEGIN or END is always the first line of its content line */
+    for (pos = 0; pos < len; pos = next){
+
+        eol = memchr(text + pos, '\n', len - pos);
+        next = eol == NULL ? len : (size_t) (eol - text) + 1;
+        ++line;
+
+        if (isIncrLine(text + pos, next - pos, "BEGIN:") == true){
+
+            if (depth == 0 && ++calendars > 1)
+                break;
+
+            /* A component starts; the text since the last one ended (if any) is part of the calendar's frame, which
+               mustn't depend on how many components there are */
+            if (depth == 1){
+
+                if (pos > outside)
+                    *frame = (*frame ^ hashCalText(text + outside, pos - outside)) * 1099511628211ULL;
+
+                start = pos;
+                startline = line;
+            }
+
+            ++depth;
+        }
+
+        else if (isIncrLine(text + pos, next - pos, "END:") == true){
+
+            if (depth == 0)
+                break;
+
+            if (--depth == 1){
+
+                if (*nspans == cap){
+
+                    cap = cap == 0 ? 256 : cap * 2;
+                    *spans = realloc(*spans, sizeof(CalIncrSpan) * cap);
+                    assert(*spans);
+                }
+
+                (*spans)[*nspans].offset = start;
+                (*spans)[*nspans].length = next - start;
+                (*spans)[*nspans].hash = hashCalText(text + start, next - start);
+                (*spans)[*nspans].line = startline;
+                ++*nspans;
+                outside = next;
+            }
+        }
+    }
+
+    *frame = (*frame ^ hashCalText(text + outside, len - outside)) * 1099511628211ULL;
+    *lines = line;
+
+    if (pos < len || depth != 0 || *nspans == 0){
+
+        free(*spans);
+        *spans = NULL;
+        *nspans = 0;
+
+        return false;
+    }
+
+    return true;
+}
+
+bool isIncrLine (const char *line, size_t len, const char *delim){
+
+    size_t dlen;
+
+    dlen = strlen(delim);
+
+    return len >= dlen && strncasecmp(line, delim, dlen) == 0;
+}
+
+CalStatus parseIncrText (const char *text, size_t len, CalComp **pcomp){
+
+    CalStatus status;
+    FILE * ics;
+
+    ics = fmemopen((void *) text, len, "r");
+    assert(ics);
+
+    *pcomp = NULL;
+    status = readCalFile(ics, pcomp);
+    fclose(ics);
+
+    return status;
+}
+
+CalStatus loadIncrText (CalIncr *incr, const char *text, size_t len, const struct stat *st){
+
+    CalComp * pcomp;
+    CalStatus status;
+    int lines;
+
+    status = parseIncrText(text, len, &pcomp);
+
+    if (status.code != OK)
+        return status;
+
+    if (incr->comp != NULL)
+        retireIncrComp(incr, incr->comp);
+    free(incr->spans);
+
+    incr->comp = pcomp;
+    incr->lines = status.lineto;
+    noteIncrFile(incr, st);
+
+    /* The scan must agree with the parser on where every component is, or it can't be trusted with the next change */
+    if (scanIncrSpans(text, len, &incr->spans, &incr->nspans, &incr->frame, &lines) == true &&
+        (incr->nspans != pcomp->ncomps || lines != incr->lines)){
+
+        free(incr->spans);
+        incr->spans = NULL;
+        incr->nspans = 0;
+    }
+
+    return status;
+}
+
+CalStatus patchIncrText (CalIncr *incr, const char *text, size_t len, const struct stat *st, CalIncrSpan *spans,
+                         int nspans, int lines, int *reparsed){
+
+    static const char wrapStart[] = "BEGIN:VCALENDAR\r\nVERSION:2.0\r\nPRODID:-//caltool//incr//EN\r\n";
+    static const char wrapEnd[] = "END:VCALENDAR\r\n";
+    const CalIncrSpan * old;
+    CalComp * comp, * region, * shell;
+    CalStatus status;
+    char * wrapped;
+    size_t from, to, wraplen;
+    int nold, head, tail, nregion, i;
+
+    old = incr->spans;
+    nold = incr->nspans;
+
+    /* Keep the longest run of unchanged components from the front, then the longest from the back of the rest */
+    for (head = 0; head < nold && head < nspans; ++head)
+        if (old[head].length != spans[head].length || old[head].hash != spans[head].hash)
+            break;
+
+    for (tail = 0; tail < nold - head && tail < nspans - head; ++tail)
+        if (old[nold - 1 - tail].length != spans[nspans - 1 - tail].length ||
+            old[nold - 1 - tail].hash != spans[nspans - 1 - tail].hash)
+            break;
+
+    nregion = nspans - head - tail;
+    region = NULL;
+
+    /* The components in between are parsed in a calendar of their own, since readCalFile only reads whole ones */
+    if (nregion > 0){
+
+        from = spans[head].offset;
+        to = spans[head + nregion - 1].offset + spans[head + nregion - 1].length;
+        wraplen = strlen(wrapStart) + (to - from) + strlen(wrapEnd);
+
+        wrapped = malloc(wraplen);
+        assert(wrapped);
+
+        memcpy(wrapped, wrapStart, strlen(wrapStart));
+        memcpy(wrapped + strlen(wrapStart), text + from, to - from);
+        memcpy(wrapped + strlen(wrapStart) + (to - from), wrapEnd, strlen(wrapEnd));
+
+        status = parseIncrText(wrapped, wraplen, &region);
+        free(wrapped);
+
+        /* Let the whole file be parsed to report the error with the right lines (or to get past a quirk of the scan) */
+        if (status.code != OK || region->ncomps != nregion){
+
+            if (status.code == OK)
+                freeCalComp(region);
+
+            free(spans);
+
+            status = loadIncrText(incr, text, len, st);
+
+            if (status.code == OK)
+                *reparsed = incr->comp->ncomps;
+
+            return status;
+        }
+    }
+
+    comp = malloc(sizeof(CalComp) + sizeof(CalComp *) * nspans);
+    assert(comp);
+
+    memcpy(comp, incr->comp, sizeof(CalComp));
+    comp->ncomps = nspans;
+
+    memcpy(comp->comp, incr->comp->comp, sizeof(CalComp *) * head);
+    memcpy(comp->comp + nspans - tail, incr->comp->comp + nold - tail, sizeof(CalComp *) * tail);
+
+    if (region != NULL){
+
+        memcpy(comp->comp + head, region->comp, sizeof(CalComp *) * nregion);
+        region->ncomps = 0;
+        freeCalComp(region);
+    }
+
+    /* The calendar's properties move to the new top component; only the replaced components and the old top go
+       (readCalFile trees have no store, so each component is freed on its own) */
+    if (incr->defer == true){
+
+        /* The old tree may still be read, so the replaced components are gathered in a calendar of their own */
+        shell = malloc(sizeof(CalComp) + sizeof(CalComp *) * (nold - tail - head));
+        assert(shell);
+
+        shell->name = NULL;
+        shell->nprops = 0;
+        shell->prop = NULL;
+        shell->store = NULL;
+        shell->ncomps = nold - tail - head;
+        memcpy(shell->comp, incr->comp->comp + head, sizeof(CalComp *) * shell->ncomps);
+
+        retireIncrComp(incr, shell);
+        incr->retiredTop = incr->comp;
+    }
+
+    else{
+
+        for (i = head; i < nold - tail; ++i)
+            freeCalComp(incr->comp->comp[i]);
+
+        free(incr->comp);
+    }
+
+    free(incr->spans);
+
+    incr->comp = comp;
+    incr->spans = spans;
+    incr->nspans = nspans;
+    incr->lines = lines;
+    noteIncrFile(incr, st);
+
+    *reparsed = nregion;
+
+    status.code = OK;
+    status.linefrom = lines;
+    status.lineto = lines;
+
+    return status;
+}
+
+void retireIncrComp (CalIncr *incr, CalComp *comp){
+
+    if (incr->defer == true){
+
+        assert(incr->retired == NULL);
+        incr->retired = comp;
+    }
+
+    else{
+
+        freeCalComp(comp);
+    }
+}
+
+void noteIncrFile (CalIncr *incr, const struct stat *st){
+
+    incr->dev = st->st_dev;
+    incr->ino = st->st_ino;
+    incr->size = st->st_size;
+    incr->mtime = st->st_mtim;
+}
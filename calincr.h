@@ -0,0 +1,103 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calincr.h -- Public interface for incremental reparsing in calincr.c
+Last updated:  Oct 19/26
+
+A CalIncr keeps a calendar's tree in step with its file without parsing
+the whole file each time it changes. Alongside the tree it remembers
+where each top-level component's text lay in the file and a checksum of
+that text, and a checksum of everything between them (the calendar's own
+properties and END:VCALENDAR). calIncrRefresh first compares the file's
+size, modification time and inode with what was read last, and does
+nothing if they match. Otherwise the file is read again and split into
+component spans with a line scan, which is much cheaper than parsing.
+The longest run of spans matching the old ones from the front and the
+longest from the back are kept; only the components between them, the
+region that changed, are parsed (wrapped in a calendar of their own, as
+readCalFile needs), and they are spliced into the existing tree in place
+of the old ones. Appending to a file reparses only what was appended,
+and editing one event reparses only that event. When the text outside
+the components changed, or the scan can't make sense of the file, the
+whole file is parsed as readCalFile would. With defer set, the old tree
+is left untouched and what a refresh replaces is handed back rather than
+freed, for a caller whose readers may still be using it.
+********/
+
+#ifndef CALINCR_H
+#define CALINCR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include "calutil.h"
+
+typedef struct {        // where a top-level component's text lay in the file when last read
+    size_t offset;          // byte its BEGIN line starts at
+    size_t length;          // no. of bytes up to the end of its END line
+    uint64_t hash;          // checksum of those bytes
+    int line;               // line its BEGIN is on
+} CalIncrSpan;
+
+typedef struct {        // a calendar kept in step with its file, see calIncrOpen
+    char *path;
+    CalComp *comp;          // the tree, patched in place by calIncrRefresh
+    int lines;              // no. of lines in the file when last read, as readCalFile counts them
+    dev_t dev;              // the file as last read, to tell when it has changed
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    CalIncrSpan *spans;     // one for each of comp's components, in order (NULL if the scan couldn't split the file)
+    int nspans;
+    uint64_t frame;         // checksum of the text outside the spans
+    bool defer;             // set to keep what calIncrRefresh replaces in retired instead of freeing it
+    CalComp *retired;       // with defer, what the last refresh replaced (or NULL), for the caller to take and free
+    CalComp *retiredTop;    // with defer, the old top component after a patch (or NULL): its name and properties
+                            // went to the new one, so it is freed with free() alone
+} CalIncr;
+
+/*	Parse a calendar file and remember where its components lie
+ *
+ * Arguments: path of the iCalendar file and the CalIncr to fill in
+ *
+ * Preconditions: none
+ * Postconditions: on success *incr holds the tree and the file's spans, to be released with calIncrClose; on error
+ *                 nothing is kept
+ *
+ * Return val: IOERR if the file can't be read, otherwise the status readCalFile returns for it
+ * */
+CalStatus calIncrOpen( const char *path, CalIncr *const incr );
+
+/*	Bring a calendar up to date with its file, parsing only the components that changed
+ *
+ * Arguments: the CalIncr and where to store the no. of components parsed again
+ *
+ * Preconditions: incr was filled in by calIncrOpen; with defer set, incr->retired and incr->retiredTop are NULL
+ * Postconditions: if the file changed, incr->comp is the tree readCalFile would give for it now and the spans are
+ *                 those of the new text; *reparsed is the no. of components parsed (0 if the file is unchanged, all
+ *                 of them if the whole file had to be parsed); on error incr is left as it was. The old tree's top
+ *                 component and the components replaced are freed; with defer set, the old tree is left as it was
+ *                 and they are handed over instead, the replaced components in incr->retired (a calendar with no
+ *                 name or properties holding them, or the whole old tree when the file was parsed whole) and the
+ *                 top in incr->retiredTop, to be freed once the old tree is out of use
+ *
+ * Return val: IOERR if the file can't be read, otherwise the status readCalFile returns for the text parsed, with
+ *             lines counted from the start of the file
+ * */
+CalStatus calIncrRefresh( CalIncr *const incr, int *const reparsed );
+
+/*	Release a CalIncr
+ *
+ * Arguments: the CalIncr
+ *
+ * Preconditions: incr was filled in by calIncrOpen
+ * Postconditions: the tree, the spans, the path and anything left in retired are free'd
+ *
+ * Return val: none
+ * */
+void calIncrClose( CalIncr *const incr );
+
+#endif
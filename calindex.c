@@ -0,0 +1,1009 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calindex.c -- Source code for the full-text search index
+Last updated:  Oct 19/26
+********/
+
+#define _GNU_SOURCE   // for fileno and st_mtim
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "calindex.h"
+#include "calcache.h"
+#include "calincr.h"
+
+#define INDEX_ORDER 0x01020304u     // written in the writer's byte order, so a reader can tell if it matches
+
+typedef struct {        // the start of an index file
+    char magic[8];          // CALINDEX_MAGIC
+    uint32_t version;       // CALINDEX_VER
+    uint32_t order;         // INDEX_ORDER
+    uint32_t ncomps;
+    uint32_t nterms;
+    uint64_t textlen;
+    uint64_t listlen;
+    int64_t srcmtime;
+    int64_t srcnsec;
+    int64_t srcsize;
+    uint64_t srcdev;
+    uint64_t srcino;
+    uint64_t checksum;      // hash of everything after the header, see hashIndexBody
+    uint32_t spans;         // 1 if the spans follow the posting lists, 0 if the index has none
+    uint32_t unused;
+} IndexHeader;
+
+typedef struct {        // a term while an index is being built
+    uint32_t text;          // offset of the term in the builder's text
+    uint32_t count;         // no. of components in its list
+    uint32_t last;          // the last component added to the list, plus one (0 if none)
+    uint32_t used;          // bytes of list in use
+    uint32_t cap;
+    unsigned char *list;
+} IndexTerm;
+
+typedef struct {        // an index being built, see calIndexBuild
+    IndexTerm *terms;
+    uint32_t nterms;
+    uint32_t termcap;
+    char *text;             // the terms in the order they were met, each ending in '\0'
+    uint64_t textlen;
+    uint64_t textcap;
+    uint32_t *slots;        // hash table of terms: a term's no. plus one, or 0 for an empty slot
+    uint32_t nslots;
+} IndexBuilder;
+
+typedef struct {        // a term and its no. in the builder, to sort by
+    const char *text;
+    uint32_t term;
+} IndexOrder;
+
+typedef struct {        // one word of a search
+    char term[CALINDEX_MAXTERM + 1];
+    bool prefix;            // the word ended in *, so it matches every term it begins
+    uint32_t first;         // the terms it matches, first to one past the last
+    uint32_t last;
+    uint64_t size;          // no. of components in their lists, counting a component once per term
+} IndexWord;
+
+/* Find the next term in some text
+ *
+ * Arguments: the text, a buffer of CALINDEX_MAXTERM + 1 bytes and where to store the term's length
+ *
+ * Preconditions: text ends in '\0'
+ * Postconditions: term holds the term folded to lowercase (cut to CALINDEX_MAXTERM bytes) and ending in '\0'
+ *
+ * Return val: the text just after the term, or NULL if there are no more terms
+ * */
+const char *nextIndexTerm (const char *text, char *term, int *len);
+
+/* Add the terms of a property value to a component's posting lists
+ *
+ * Arguments: the builder, the value as read (escapes and all) and the component's no.
+ *
+ * Preconditions: components are added in order
+ * Postconditions: each term of value has comp at the end of its list, once
+ *
+ * Return val: none
+ * */
+void addIndexText (IndexBuilder *build, const char *value, uint32_t comp);
+
+/* Look up a term being built, adding it if it is new
+ *
+ * Arguments: the builder, the term and its length
+ *
+ * Preconditions: none
+ * Postconditions: the term is in the builder's table
+ *
+ * Return val: the term
+ * */
+IndexTerm *findIndexTerm (IndexBuilder *build, const char *term, int len);
+
+/* Append a component to a term's posting list
+ *
+ * Arguments: the term and the gap from the component before (the component's no. plus one for the first)
+ *
+ * Preconditions: none
+ * Postconditions: the gap is at the end of term->list as a varint
+ *
+ * Return val: none
+ * */
+void putIndexGap (IndexTerm *term, uint32_t gap);
+
+/* Read one gap of a posting list
+ *
+ * Arguments: where the gap starts and where to store it
+ *
+ * Preconditions: the varint ends within its list (calIndexRead checks that the last byte of a list ends one)
+ * Postconditions: none
+ *
+ * Return val: where the next gap starts
+ * */
+const unsigned char *getIndexGap (const unsigned char *pos, uint32_t *gap);
+
+/* Sort the terms built and pack them and their lists into an index
+ *
+ * Arguments: the builder and the index
+ *
+ * Preconditions: every component has been added
+ * Postconditions: index holds the terms and lists; the builder's arrays are free'd
+ *
+ * Return val: none
+ * */
+void packIndex (IndexBuilder *build, CalIndex *index);
+
+/* Compare two IndexOrder by their text, for qsort
+ *
+ * Arguments: the two IndexOrder
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: < 0, 0 or > 0 as strcmp
+ * */
+int compareIndexOrder (const void *a, const void *b);
+
+/* Compare two IndexWord by the no. of components in their lists, for qsort
+ *
+ * Arguments: the two IndexWord
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: < 0 if a has fewer, 0 if the same, > 0 if more
+ * */
+int compareIndexWord (const void *a, const void *b);
+
+/* Find the first term not before some text, comparing only its first len bytes
+ *
+ * Arguments: the index, the text, the no. of bytes to compare and whether to find the first term after instead
+ *
+ * Preconditions: the index's terms are sorted
+ * Postconditions: none
+ *
+ * Return val: the no. of the term, or index->nterms if there is none
+ * */
+uint32_t seekIndexTerm (const CalIndex *index, const char *text, size_t len, bool after);
+
+/* List the components any of a word's terms appear in
+ *
+ * Arguments: the index, the word, where to store the components and how many there is room for
+ *
+ * Preconditions: word->first < word->last
+ * Postconditions: ids holds the components in order, no more than cap of them
+ *
+ * Return val: the no. of components stored
+ * */
+int expandIndexWord (const CalIndex *index, const IndexWord *word, int *ids, int cap);
+
+/* Keep only the components a word's terms appear in
+ *
+ * Arguments: the index, the word, the components in order and how many there are
+ *
+ * Preconditions: word->first < word->last
+ * Postconditions: the first components of ids are the ones kept, in order
+ *
+ * Return val: the no. of components kept
+ * */
+int narrowIndexWord (const CalIndex *index, const IndexWord *word, int *ids, int n);
+
+/* Set the bit of each component a range of terms appears in
+ *
+ * Arguments: the index, the first term, one past the last and the bits (one for each component)
+ *
+ * Preconditions: none
+ * Postconditions: bits are set for the components in the terms' lists
+ *
+ * Return val: none
+ * */
+void markIndexTerms (const CalIndex *index, uint32_t first, uint32_t last, uint64_t *bits);
+
+/* Write an index to a file beside the one it was made from, replacing it in one step
+ *
+ * Arguments: the index and the path to write
+ *
+ * Preconditions: none
+ * Postconditions: path holds the index, or is left as it was if it couldn't be written
+ *
+ * Return val: none
+ * */
+void saveIndexSidecar (const CalIndex *index, const char *path);
+
+/* Hash the arrays of an index, in the order they are written after the header
+ *
+ * Arguments: the index
+ *
+ * Preconditions: index is filled in
+ * Postconditions: none
+ *
+ * Return val: a hash that changes with any byte of the terms, counts, postings, text, lists or spans
+ * */
+uint64_t hashIndexBody (const CalIndex *index);
+
+void calIndexBuild( const CalComp *comp, CalIndex *const index ){
+
+    IndexBuilder build;
+    const CalProp * prop;
+    int i;
+
+    build.nterms = 0;
+    build.termcap = 1024;
+    build.terms = malloc(build.termcap * sizeof(IndexTerm));
+    assert(build.terms);
+
+    build.textlen = 0;
+    build.textcap = 8192;
+    build.text = malloc(build.textcap);
+    assert(build.text);
+
+    build.nslots = 2048;
+    build.slots = calloc(build.nslots, sizeof(uint32_t));
+    assert(build.slots);
+
+    for (i = 0; i < comp->ncomps; ++i){
+
+        for (prop = comp->comp[i]->prop; prop != NULL; prop = prop->next){
+
+            if (strcmp(prop->name, "SUMMARY") == 0 || strcmp(prop->name, "DESCRIPTION") == 0 ||
+            strcmp(prop->name, "LOCATION") == 0)
+                addIndexText(&build, prop->value, i);
+        }
+    }
+
+    index->ncomps = comp->ncomps;
+    index->spans = NULL;
+    index->srcmtime = 0;
+    index->srcnsec = 0;
+    index->srcsize = 0;
+    index->srcdev = 0;
+    index->srcino = 0;
+
+    packIndex(&build, index);
+}
+
+CalStatus calIndexOpen( const char *path, CalIndex *const index ){
+
+    CalStatus status;
+    CalIncr incr;
+    struct stat st;
+    char * sidecar;
+    FILE * idx;
+    uint32_t i;
+
+    status.code = IOERR;
+    status.linefrom = 0;
+    status.lineto = 0;
+
+    if (stat(path, &st) != 0)
+        return status;
+
+    sidecar = malloc(strlen(path) + strlen(CALINDEX_SUFFIX) + 1);
+    assert(sidecar);
+    sprintf(sidecar, "%s%s", path, CALINDEX_SUFFIX);
+
+    /* A sidecar is used as is if it was made from the file as it is now: the same inode, size and modification
+       time to the nanosecond, as calIncrRefresh decides a file is unchanged */
+    idx = fopen(sidecar, "rb");
+
+    if (idx != NULL){
+
+        status = calIndexRead(idx, index);
+        fclose(idx);
+
+        if (status.code == OK && index->srcdev == (uint64_t) st.st_dev && index->srcino == (uint64_t) st.st_ino &&
+        index->srcsize == st.st_size && index->srcmtime == st.st_mtim.tv_sec && index->srcnsec == st.st_mtim.tv_nsec){
+
+            free(sidecar);
+            return status;
+        }
+
+        if (status.code == OK)
+            calIndexFree(index);
+    }
+
+    /* calIncrOpen parses the file and splits it into component spans in the same read */
+    status = calIncrOpen(path, &incr);
+
+    if (status.code != OK){
+
+        free(sidecar);
+        return status;
+    }
+
+    calIndexBuild(incr.comp, index);
+
+    if (incr.spans != NULL && incr.nspans == (int)index->ncomps){
+
+        index->spans = malloc(2 * sizeof(uint64_t) * (index->ncomps + 1));
+        assert(index->spans);
+
+        for (i = 0; i < index->ncomps; ++i){
+
+            index->spans[2 * i] = incr.spans[i].offset;
+            index->spans[2 * i + 1] = incr.spans[i].length;
+        }
+    }
+
+    /* The file as calIncrOpen read it, so a change made since then makes the sidecar stale */
+    index->srcmtime = incr.mtime.tv_sec;
+    index->srcnsec = incr.mtime.tv_nsec;
+    index->srcsize = incr.size;
+    index->srcdev = incr.dev;
+    index->srcino = incr.ino;
+
+    calIncrClose(&incr);
+
+    saveIndexSidecar(index, sidecar);
+    free(sidecar);
+
+    return status;
+}
+
+CalStatus calIndexWrite( FILE *const idx, const CalIndex *index ){
+
+    CalStatus status;
+    IndexHeader hdr;
+    bool ok;
+
+    status.code = OK;
+    status.linefrom = 0;
+    status.lineto = 0;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CALINDEX_MAGIC, sizeof(hdr.magic));
+    hdr.version = CALINDEX_VER;
+    hdr.order = INDEX_ORDER;
+    hdr.ncomps = index->ncomps;
+    hdr.nterms = index->nterms;
+    hdr.textlen = index->textlen;
+    hdr.listlen = index->listlen;
+    hdr.srcmtime = index->srcmtime;
+    hdr.srcnsec = index->srcnsec;
+    hdr.srcsize = index->srcsize;
+    hdr.srcdev = index->srcdev;
+    hdr.srcino = index->srcino;
+    hdr.checksum = hashIndexBody(index);
+    hdr.spans = index->spans != NULL ? 1 : 0;
+
+    ok = fwrite(&hdr, sizeof(hdr), 1, idx) == 1;
+    ok = ok && fwrite(index->terms, sizeof(uint32_t), index->nterms, idx) == index->nterms;
+    ok = ok && fwrite(index->counts, sizeof(uint32_t), index->nterms, idx) == index->nterms;
+    ok = ok && fwrite(index->postings, sizeof(uint64_t), index->nterms + 1, idx) == index->nterms + 1;
+    ok = ok && fwrite(index->text, 1, index->textlen, idx) == index->textlen;
+    ok = ok && fwrite(index->lists, 1, index->listlen, idx) == index->listlen;
+
+    if (index->spans != NULL)
+        ok = ok && fwrite(index->spans, 2 * sizeof(uint64_t), index->ncomps, idx) == index->ncomps;
+
+    /* Check if we wrote to idx succesfully */
+    if (ok == false)
+        status.code = IOERR;
+
+    return status;
+}
+
+CalStatus calIndexRead( FILE *const idx, CalIndex *const index ){
+
+    CalStatus status;
+    IndexHeader hdr;
+    struct stat st;
+    uint64_t size;
+    uint32_t i;
+    bool ok;
+
+    status.code = IOERR;
+    status.linefrom = 0;
+    status.lineto = 0;
+
+    /* Check that the index was written by a compatible build, and that its sizes can be right before allocating */
+    if (fread(&hdr, sizeof(hdr), 1, idx) != 1 || memcmp(hdr.magic, CALINDEX_MAGIC, sizeof(hdr.magic)) != 0 ||
+    hdr.version != CALINDEX_VER || hdr.order != INDEX_ORDER || hdr.textlen > UINT32_MAX ||
+    hdr.textlen < 2 * (uint64_t) hdr.nterms || hdr.listlen < hdr.nterms)
+        return status;
+
+    size = sizeof(hdr) + (2 * sizeof(uint32_t) + sizeof(uint64_t)) * (uint64_t) hdr.nterms + sizeof(uint64_t) +
+    hdr.textlen + hdr.listlen + (hdr.spans != 0 ? 2 * sizeof(uint64_t) * (uint64_t) hdr.ncomps : 0);
+
+    if (fstat(fileno(idx), &st) != 0 || hdr.listlen > UINT64_MAX / 2 || size != (uint64_t) st.st_size)
+        return status;
+
+    index->ncomps = hdr.ncomps;
+    index->nterms = hdr.nterms;
+    index->textlen = hdr.textlen;
+    index->listlen = hdr.listlen;
+    index->srcmtime = hdr.srcmtime;
+    index->srcnsec = hdr.srcnsec;
+    index->srcsize = hdr.srcsize;
+    index->srcdev = hdr.srcdev;
+    index->srcino = hdr.srcino;
+
+    index->terms = malloc(sizeof(uint32_t) * (index->nterms + 1));
+    index->counts = malloc(sizeof(uint32_t) * (index->nterms + 1));
+    index->postings = malloc(sizeof(uint64_t) * (index->nterms + 1));
+    index->text = malloc(index->textlen + 1);
+    index->lists = malloc(index->listlen + 1);
+    assert(index->terms && index->counts && index->postings && index->text && index->lists);
+
+    index->spans = NULL;
+
+    if (hdr.spans != 0){
+
+        index->spans = malloc(2 * sizeof(uint64_t) * (index->ncomps + 1));
+        assert(index->spans);
+    }
+
+    ok = fread(index->terms, sizeof(uint32_t), index->nterms, idx) == index->nterms;
+    ok = ok && fread(index->counts, sizeof(uint32_t), index->nterms, idx) == index->nterms;
+    ok = ok && fread(index->postings, sizeof(uint64_t), index->nterms + 1, idx) == index->nterms + 1;
+    ok = ok && fread(index->text, 1, index->textlen, idx) == index->textlen;
+    ok = ok && fread(index->lists, 1, index->listlen, idx) == index->listlen;
+
+    if (index->spans != NULL)
+        ok = ok && fread(index->spans, 2 * sizeof(uint64_t), index->ncomps, idx) == index->ncomps;
+
+    /* A damaged file may still be well formed, so the arrays must also hash to what was written */
+    ok = ok && hashIndexBody(index) == hdr.checksum;
+
+    /* Every term must end within the text and every list within the lists, ending in the last byte of a varint,
+       so a search never reads outside them */
+    ok = ok && index->postings[0] == 0 && index->postings[index->nterms] == index->listlen &&
+    (index->textlen == 0 || index->text[index->textlen - 1] == '\0');
+
+    for (i = 0; ok == true && i < index->nterms; ++i){
+
+        ok = index->terms[i] < index->textlen && index->postings[i] < index->postings[i + 1] &&
+        index->postings[i + 1] <= index->listlen && index->lists[index->postings[i + 1] - 1] < 0x80;
+    }
+
+    if (ok == false){
+
+        calIndexFree(index);
+        return status;
+    }
+
+    status.code = OK;
+
+    return status;
+}
+
+int calIndexSearch( const CalIndex *index, const char *query, int **hits ){
+
+    IndexWord * words, * word;
+    char term[CALINDEX_MAXTERM + 1];
+    const char * pos;
+    int nwords, wordcap, len, n, i;
+    uint32_t t;
+
+    *hits = NULL;
+
+    nwords = 0;
+    wordcap = 8;
+    words = malloc(wordcap * sizeof(IndexWord));
+    assert(words);
+
+    for (pos = nextIndexTerm(query, term, &len); pos != NULL; pos = nextIndexTerm(pos, term, &len)){
+
+        if (nwords == wordcap){
+
+            wordcap *= 2;
+            words = realloc(words, wordcap * sizeof(IndexWord));
+            assert(words);
+        }
+
+        word = &words[nwords++];
+        memcpy(word->term, term, len + 1);
+        word->prefix = *pos == '*';
+
+        /* The terms a prefix begins are a run in sorted order; a whole term compares its '\0' too */
+        if (word->prefix == true){
+
+            word->first = seekIndexTerm(index, term, len, false);
+            word->last = seekIndexTerm(index, term, len, true);
+        }
+
+        else{
+
+            word->first = seekIndexTerm(index, term, len + 1, false);
+            word->last = word->first;
+
+            if (word->first < index->nterms && strcmp(index->text + index->terms[word->first], term) == 0)
+                word->last = word->first + 1;
+        }
+
+        word->size = 0;
+
+        for (t = word->first; t < word->last; ++t)
+            word->size += index->counts[t];
+
+        /* A word in no component settles the search */
+        if (word->size == 0){
+
+            free(words);
+            return 0;
+        }
+    }
+
+    if (nwords == 0){
+
+        free(words);
+        return 0;
+    }
+
+    /* Start from the rarest word, so the components carried along are never more than its list */
+    qsort(words, nwords, sizeof(IndexWord), compareIndexWord);
+
+    n = words[0].size < index->ncomps ? (int)words[0].size : (int)index->ncomps;
+    *hits = malloc(sizeof(int) * (n + 1));
+    assert(*hits);
+
+    n = expandIndexWord(index, &words[0], *hits, n);
+
+    for (i = 1; i < nwords && n > 0; ++i)
+        n = narrowIndexWord(index, &words[i], *hits, n);
+
+    free(words);
+
+    if (n == 0){
+
+        free(*hits);
+        *hits = NULL;
+    }
+
+    return n;
+}
+
+void calIndexFree( CalIndex *const index ){
+
+    free(index->text);
+    free(index->terms);
+    free(index->counts);
+    free(index->postings);
+    free(index->lists);
+    free(index->spans);
+
+    index->text = NULL;
+    index->terms = NULL;
+    index->counts = NULL;
+    index->postings = NULL;
+    index->lists = NULL;
+    index->spans = NULL;
+    index->nterms = 0;
+}
+
+const char *nextIndexTerm (const char *text, char *term, int *len){
+
+    unsigned char c;
+
+    *len = 0;
+
+    /* Skip to the start of a term; an escape stands for punctuation or a line break, so it is skipped whole */
+    while (*text != '\0'){
+
+        c = *text;
+
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80)
+            break;
+
+        if (c == '\\' && text[1] != '\0')
+            ++text;
+
+        ++text;
+    }
+
+    if (*text == '\0')
+        return NULL;
+
+    for (; *text != '\0'; ++text){
+
+        c = *text;
+
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+
+        else if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80))
+            break;
+
+        if (*len < CALINDEX_MAXTERM)
+            term[(*len)++] = c;
+    }
+
+    term[*len] = '\0';
+
+    return text;
+}
+
+void addIndexText (IndexBuilder *build, const char *value, uint32_t comp){
+
+    char term[CALINDEX_MAXTERM + 1];
+    IndexTerm * entry;
+    int len;
+
+    for (value = nextIndexTerm(value, term, &len); value != NULL; value = nextIndexTerm(value, term, &len)){
+
+        entry = findIndexTerm(build, term, len);
+
+        /* A term said twice in a component is listed once */
+        if (entry->last == comp + 1)
+            continue;
+
+        putIndexGap(entry, comp + 1 - entry->last);
+        entry->last = comp + 1;
+        ++entry->count;
+    }
+}
+
+IndexTerm *findIndexTerm (IndexBuilder *build, const char *term, int len){
+
+    uint32_t * slots;
+    uint32_t slot, nslots, i;
+    IndexTerm * entry;
+
+    slot = hashCalText(term, len) & (build->nslots - 1);
+
+    while (build->slots[slot] != 0){
+
+        entry = &build->terms[build->slots[slot] - 1];
+
+        if (memcmp(build->text + entry->text, term, len + 1) == 0)
+            return entry;
+
+        slot = (slot + 1) & (build->nslots - 1);
+    }
+
+    /* Keep the table at most half full, rehashing into one twice the size */
+    if (2 * (build->nterms + 1) > build->nslots){
+
+        nslots = 2 * build->nslots;
+        slots = calloc(nslots, sizeof(uint32_t));
+        assert(slots);
+
+        for (i = 0; i < build->nterms; ++i){
+
+            entry = &build->terms[i];
+            slot = hashCalText(build->text + entry->text, strlen(build->text + entry->text)) & (nslots - 1);
+
+            while (slots[slot] != 0)
+                slot = (slot + 1) & (nslots - 1);
+
+            slots[slot] = i + 1;
+        }
+
+        free(build->slots);
+        build->slots = slots;
+        build->nslots = nslots;
+
+        slot = hashCalText(term, len) & (nslots - 1);
+
+        while (slots[slot] != 0)
+            slot = (slot + 1) & (nslots - 1);
+    }
+
+    if (build->nterms == build->termcap){
+
+        build->termcap *= 2;
+        build->terms = realloc(build->terms, build->termcap * sizeof(IndexTerm));
+        assert(build->terms);
+    }
+
+    while (build->textlen + len + 1 > build->textcap){
+
+        build->textcap *= 2;
+        build->text = realloc(build->text, build->textcap);
+        assert(build->text);
+    }
+
+    entry = &build->terms[build->nterms];
+    entry->text = build->textlen;
+    entry->count = 0;
+    entry->last = 0;
+    entry->used = 0;
+    entry->cap = 0;
+    entry->list = NULL;
+
+    memcpy(build->text + build->textlen, term, len + 1);
+    build->textlen += len + 1;
+
+    build->slots[slot] = ++build->nterms;
+
+    return entry;
+}
+
+void putIndexGap (IndexTerm *term, uint32_t gap){
+
+    /* A varint is at most 5 bytes for 32 bits */
+    if (term->used + 5 > term->cap){
+
+        term->cap = term->cap == 0 ? 8 : 2 * term->cap;
+        term->list = realloc(term->list, term->cap);
+        assert(term->list);
+    }
+
+    while (gap >= 0x80){
+
+        term->list[term->used++] = (gap & 0x7f) | 0x80;
+        gap >>= 7;
+    }
+
+    term->list[term->used++] = gap;
+}
+
+const unsigned char *getIndexGap (const unsigned char *pos, uint32_t *gap){
+
+    int shift;
+
+    *gap = 0;
+
+    for (shift = 0; *pos >= 0x80; shift += 7)
+        *gap |= (uint32_t)(*pos++ & 0x7f) << (shift & 31);
+
+    *gap |= (uint32_t)*pos++ << (shift & 31);
+
+    return pos;
+}
+
+void packIndex (IndexBuilder *build, CalIndex *index){
+
+    IndexOrder * order;
+    IndexTerm * entry;
+    uint64_t textlen, listlen;
+    uint32_t i;
+
+    order = malloc(sizeof(IndexOrder) * (build->nterms + 1));
+    assert(order);
+
+    listlen = 0;
+
+    for (i = 0; i < build->nterms; ++i){
+
+        order[i].text = build->text + build->terms[i].text;
+        order[i].term = i;
+        listlen += build->terms[i].used;
+    }
+
+    qsort(order, build->nterms, sizeof(IndexOrder), compareIndexOrder);
+
+    index->nterms = build->nterms;
+    index->textlen = build->textlen;
+    index->listlen = listlen;
+    index->text = malloc(build->textlen + 1);
+    index->terms = malloc(sizeof(uint32_t) * (build->nterms + 1));
+    index->counts = malloc(sizeof(uint32_t) * (build->nterms + 1));
+    index->postings = malloc(sizeof(uint64_t) * (build->nterms + 1));
+    index->lists = malloc(listlen + 1);
+    assert(index->text && index->terms && index->counts && index->postings && index->lists);
+
+    textlen = 0;
+    listlen = 0;
+
+    for (i = 0; i < build->nterms; ++i){
+
+        entry = &build->terms[order[i].term];
+
+        index->terms[i] = textlen;
+        strcpy(index->text + textlen, order[i].text);
+        textlen += strlen(order[i].text) + 1;
+
+        index->counts[i] = entry->count;
+        index->postings[i] = listlen;
+        memcpy(index->lists + listlen, entry->list, entry->used);
+        listlen += entry->used;
+
+        free(entry->list);
+    }
+
+    index->postings[build->nterms] = listlen;
+
+    free(order);
+    free(build->terms);
+    free(build->text);
+    free(build->slots);
+}
+
+int compareIndexOrder (const void *a, const void *b){
+
+    return strcmp(((const IndexOrder *) a)->text, ((const IndexOrder *) b)->text);
+}
+
+int compareIndexWord (const void *a, const void *b){
+
+    uint64_t sizeA, sizeB;
+
+    sizeA = ((const IndexWord *) a)->size;
+    sizeB = ((const IndexWord *) b)->size;
+
+    return sizeA < sizeB ? -1 : sizeA > sizeB ? 1 : 0;
+}
+
+uint32_t seekIndexTerm (const CalIndex *index, const char *text, size_t len, bool after){
+
+    uint32_t low, high, mid;
+    int cmp;
+
+    low = 0;
+    high = index->nterms;
+
+    while (low < high){
+
+        mid = low + (high - low) / 2;
+        cmp = strncmp(index->text + index->terms[mid], text, len);
+
+        if (cmp < 0 || (after == true && cmp == 0))
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+int expandIndexWord (const CalIndex *index, const IndexWord *word, int *ids, int cap){
+
+    const unsigned char * pos, * end;
+    uint64_t * bits;
+    uint32_t gap, prev, id, i;
+    int n;
+
+    n = 0;
+
+    /* One term's list is already in order */
+    if (word->last - word->first == 1){
+
+        pos = index->lists + index->postings[word->first];
+        end = index->lists + index->postings[word->last];
+        prev = 0;
+
+        while (pos < end && n < cap){
+
+            pos = getIndexGap(pos, &gap);
+            prev += gap;
+
+            if (prev - 1 < index->ncomps)
+                ids[n++] = prev - 1;
+        }
+
+        return n;
+    }
+
+    /* Several terms' lists overlap, so they are merged through a bit for each component */
+    bits = calloc(index->ncomps / 64 + 1, sizeof(uint64_t));
+    assert(bits);
+
+    markIndexTerms(index, word->first, word->last, bits);
+
+    for (i = 0; i < index->ncomps / 64 + 1 && n < cap; ++i){
+
+        while (bits[i] != 0 && n < cap){
+
+            id = 64 * i + __builtin_ctzll(bits[i]);
+            bits[i] &= bits[i] - 1;
+            ids[n++] = id;
+        }
+    }
+
+    free(bits);
+
+    return n;
+}
+
+int narrowIndexWord (const CalIndex *index, const IndexWord *word, int *ids, int n){
+
+    const unsigned char * pos, * end;
+    uint64_t * bits;
+    uint32_t gap, prev, id;
+    int kept, i;
+
+    kept = 0;
+
+    /* Walk the list alongside the components, stopping once they run out */
+    if (word->last - word->first == 1){
+
+        pos = index->lists + index->postings[word->first];
+        end = index->lists + index->postings[word->last];
+        prev = 0;
+        i = 0;
+
+        while (pos < end && i < n){
+
+            pos = getIndexGap(pos, &gap);
+            prev += gap;
+            id = prev - 1;
+
+            while (i < n && (uint32_t) ids[i] < id)
+                ++i;
+
+            if (i < n && (uint32_t) ids[i] == id)
+                ids[kept++] = ids[i++];
+        }
+
+        return kept;
+    }
+
+    bits = calloc(index->ncomps / 64 + 1, sizeof(uint64_t));
+    assert(bits);
+
+    markIndexTerms(index, word->first, word->last, bits);
+
+    for (i = 0; i < n; ++i){
+
+        if ((bits[ids[i] / 64] >> (ids[i] % 64) & 1) != 0)
+            ids[kept++] = ids[i];
+    }
+
+    free(bits);
+
+    return kept;
+}
+
+void markIndexTerms (const CalIndex *index, uint32_t first, uint32_t last, uint64_t *bits){
+
+    const unsigned char * pos, * end;
+    uint32_t gap, prev, id, t;
+
+    for (t = first; t < last; ++t){
+
+        pos = index->lists + index->postings[t];
+        end = index->lists + index->postings[t + 1];
+        prev = 0;
+
+        while (pos < end){
+
+            pos = getIndexGap(pos, &gap);
+            prev += gap;
+            id = prev - 1;
+
+            if (id < index->ncomps)
+                bits[id / 64] |= (uint64_t)1 << (id % 64);
+        }
+    }
+}
+
+uint64_t hashIndexBody (const CalIndex *index){
+
+    uint64_t hash;
+
+    /* Each array is hashed on its own and folded in, as calincr.c folds the text between spans */
+    hash = 14695981039346656037ULL;
+    hash = (hash ^ hashCalText((const char *)index->terms, sizeof(uint32_t) * index->nterms)) * 1099511628211ULL;
+    hash = (hash ^ hashCalText((const char *)index->counts, sizeof(uint32_t) * index->nterms)) * 1099511628211ULL;
+    hash = (hash ^ hashCalText((const char *)index->postings, sizeof(uint64_t) * (index->nterms + 1))) * 1099511628211ULL;
+    hash = (hash ^ hashCalText(index->text, index->textlen)) * 1099511628211ULL;
+    hash = (hash ^ hashCalText((const char *)index->lists, index->listlen)) * 1099511628211ULL;
+
+    if (index->spans != NULL)
+        hash = (hash ^ hashCalText((const char *)index->spans, 2 * sizeof(uint64_t) * index->ncomps)) * 1099511628211ULL;
+
+    return hash;
+}
+
+void saveIndexSidecar (const CalIndex *index, const char *path){
+
+    char * temp;
+    FILE * idx;
+    bool ok;
+
+    /* Written under another name and renamed over the sidecar, so a reader never sees half of one */
+    temp = malloc(strlen(path) + 32);
+    assert(temp);
+    sprintf(temp, "%s.%ld", path, (long) getpid());
+
+    idx = fopen(temp, "wb");
+
+    if (idx == NULL){
+
+        free(temp);
+        return;
+    }
+
+    ok = calIndexWrite(idx, index).code == OK;
+    ok = fclose(idx) == 0 && ok;
+
+    if (ok == false || rename(temp, path) != 0)
+        unlink(temp);
+
+    free(temp);
+}
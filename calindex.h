@@ -0,0 +1,133 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calindex.h -- Public interface for the full-text search index in calindex.c
+Last updated:  Oct 19/26
+
+A CalIndex finds the top-level components of a calendar whose SUMMARY,
+DESCRIPTION or LOCATION holds some words. The text is split into terms:
+runs of letters and digits, ASCII folded to lowercase, with any byte
+outside ASCII kept as part of a term so UTF-8 words stay whole, and
+escapes (\n, \,) splitting terms as the text they stand for would. Each
+term keeps a posting list, the components it appears in, stored as the
+gap from the one before in a varint, so common words cost about a byte
+a component. Terms are kept sorted, so a term is found by binary search
+and a prefix by the run of terms that start with it.
+
+A search is a list of words, all of which must appear; a word ending in
+* matches any term it begins. The rarest word is expanded first and the
+others only narrow it down, so the work is bounded by the lists read,
+not by the size of the calendar.
+
+calIndexOpen keeps an index in a sidecar file next to the calendar
+(file.ics.idx), written when it is missing or the calendar's inode, size
+or modification time (to the nanosecond) no longer match, and loaded as
+is otherwise. An index
+built from a file also records where each component's text lies in it,
+so matches can be printed straight from the file without parsing it.
+********/
+
+#ifndef CALINDEX_H
+#define CALINDEX_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "calutil.h"
+
+#define CALINDEX_MAGIC "\211VCINDX\n"  // first 8 bytes of every index file
+#define CALINDEX_VER 3                  // bumped whenever the file layout (or how text is split into terms) changes
+#define CALINDEX_SUFFIX ".idx"          // added to a calendar's path to name its sidecar index
+#define CALINDEX_MAXTERM 64             // bytes of a term kept; longer terms are cut (in the index and searches alike)
+
+typedef struct {        // a full-text index of a calendar's top-level components, see calIndexBuild
+    uint32_t ncomps;        // no. of components indexed; searches give their indexes in the calendar, from 0
+    uint32_t nterms;
+    char *text;             // the terms, each ending in '\0', in strcmp order
+    uint64_t textlen;
+    uint32_t *terms;        // offset in text of each term
+    uint32_t *counts;       // no. of components each term appears in
+    uint64_t *postings;     // offset in lists of each term's posting list, and of the end of the last one
+    unsigned char *lists;   // the posting lists, one after another
+    uint64_t listlen;
+    uint64_t *spans;        // offset and length of each component's text in the source file (NULL if not known)
+    int64_t srcmtime;       // modification time of the source file when it was indexed (0 if none)
+    int64_t srcnsec;        // nanoseconds of the modification time
+    int64_t srcsize;        // size of the source file when it was indexed
+    uint64_t srcdev;        // device and inode of the source file, so a file replaced by another is noticed
+    uint64_t srcino;
+} CalIndex;
+
+/*	Build a full-text index of a calendar
+ *
+ * Arguments: the calendar and the CalIndex to fill in
+ *
+ * Preconditions: comp was produced by readCalFile or readCalSnap
+ * Postconditions: *index holds the terms of each top-level component's SUMMARY, DESCRIPTION and LOCATION, to be
+ *                 released with calIndexFree; it has no spans or source file
+ *
+ * Return val: none
+ * */
+void calIndexBuild( const CalComp *comp, CalIndex *const index );
+
+/*	Open the sidecar index of a calendar file, writing it first if it is missing or stale
+ *
+ * Arguments: path of the iCalendar file and the CalIndex to fill in
+ *
+ * Preconditions: none
+ * Postconditions: on success *index is up to date with the file, with its spans if the file could be split into
+ *                 them, to be released with calIndexFree; a fresh sidecar is written if it can be (failing to write
+ *                 it is not an error)
+ *
+ * Return val: OK, IOERR if the file can't be read, or the status readCalFile returns for it
+ * */
+CalStatus calIndexOpen( const char *path, CalIndex *const index );
+
+/*	Write an index out
+ *
+ * Arguments: output file and the index
+ *
+ * Preconditions: idx is open for writing
+ * Postconditions: the index, with its spans and source file details, is written to idx
+ *
+ * Return val: IOERR if writing fails, OK otherwise
+ * */
+CalStatus calIndexWrite( FILE *const idx, const CalIndex *index );
+
+/*	Read an index written by calIndexWrite
+ *
+ * Arguments: an open index file and the CalIndex to fill in
+ *
+ * Preconditions: idx is a file holding the index alone, positioned at its start
+ * Postconditions: on success *index is the index as written, to be released with calIndexFree; on error nothing
+ *                 is kept. Whether the source file has changed since is left to the caller (see srcmtime)
+ *
+ * Return val: OK, or IOERR if the file is unreadable, damaged (its arrays are checked against a hash of them
+ *             stored in the header) or was written by an incompatible build
+ * */
+CalStatus calIndexRead( FILE *const idx, CalIndex *const index );
+
+/*	Find the components that hold every word of a search
+ *
+ * Arguments: the index, the search text and where to store the matches
+ *
+ * Preconditions: index was filled in by calIndexBuild, calIndexOpen or calIndexRead
+ * Postconditions: *hits is a malloc'd array of the indexes of the matching components in order, for the caller
+ *                 to free (NULL if none match)
+ *
+ * Return val: the no. of matching components; 0 if the search has no words
+ * */
+int calIndexSearch( const CalIndex *index, const char *query, int **hits );
+
+/*	Release an index
+ *
+ * Arguments: the CalIndex
+ *
+ * Preconditions: index was filled in by calIndexBuild, calIndexOpen or calIndexRead
+ * Postconditions: its arrays are free'd
+ *
+ * Return val: none
+ * */
+void calIndexFree( CalIndex *const index );
+
+#endif
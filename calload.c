@@ -0,0 +1,469 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calload.c -- Load-test and command line client for the caltool daemon
+Last updated:  Oct 19/26
+
+Usage:
+    calload socket file.ics [clients] [requests]
+        loads file.ics into the daemon, then runs clients connections in
+        parallel, each sending requests requests (info, extract and filter
+        in turn), and prints throughput and latency percentiles
+
+    calload socket -send command...
+        sends one request and prints the response; for "load NAME" the
+        calendar text is read from stdin
+********/
+
+#define _GNU_SOURCE   // for clock_gettime
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "calserve.h"
+
+#define LOAD_NAME "calload"     // name the test calendar is loaded under
+
+typedef struct {        // one load-test connection
+    const char *sockpath;
+    int requests;
+    double *latency;        // seconds taken by each request
+    int errors;
+} LoadClient;
+
+/* Requests cycled through by every load-test connection */
+static const char *const loadRequests[] = { "info " LOAD_NAME "\n", "extract " LOAD_NAME " e\n",
+                                            "extract " LOAD_NAME " x\n", "filter " LOAD_NAME " e\n",
+                                            "filter " LOAD_NAME " t\n" };
+
+/* Connect to the daemon
+ *
+ * Arguments: socket path
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: connected socket, or -1 on failure
+ * */
+int connectDaemon (const char *sockpath);
+
+/* Send one request frame and wait for its response
+ *
+ * Arguments: connected socket, command line (ending in '\n'), data sent after it and its length,
+ *            and the address of the pointer that receives the response payload
+ *
+ * Preconditions: fd is connected to the daemon
+ * Postconditions: *presp is malloc'd and '\0' terminated; caller frees it
+ *
+ * Return val: response length, or -1 if the connection failed
+ * */
+long sendRequest (int fd, const char *command, const char *data, size_t datalen, char **presp);
+
+/* Read or write exactly count bytes
+ *
+ * Arguments: socket, buffer, no. of bytes, and whether to write
+ *
+ * Preconditions: buf holds count bytes
+ * Postconditions: none
+ *
+ * Return val: true if all bytes were transferred, false otherwise
+ * */
+bool transferAll (int fd, void *buf, size_t count, bool out);
+
+/* Thread body of a load-test connection
+ *
+ * Arguments: LoadClient to run
+ *
+ * Preconditions: latency holds requests slots
+ * Postconditions: latency and errors are filled in
+ *
+ * Return val: NULL
+ * */
+void *runLoadClient (void *arg);
+
+/* Read a whole file into memory
+ *
+ * Arguments: open file and where to store the length
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: malloc'd contents
+ * */
+char *readAll (FILE *file, size_t *plen);
+
+/* Compares two latencies
+ *
+ * Arguments: both a and b point to doubles
+ *
+ * Preconditions: both a and b point to doubles
+ * Postconditions: none
+ *
+ * Return val: negative int if a is smaller, positive int if b is smaller, 0 if equal
+ * */
+int compareLatency (const void *a, const void *b);
+
+/* Seconds on the monotonic clock
+ *
+ * Arguments: none
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: current time in seconds
+ * */
+double nowSeconds (void);
+
+int main(int argc, char *argv[]){
+
+    LoadClient * clients;
+    pthread_t * threads;
+    FILE * ics;
+    char * text, * resp, * command;
+    double * all;
+    double start, elapsed;
+    size_t len, cmdlen;
+    long total, errors;
+    long resplen;
+    int nclients, requests, fd, i, j;
+
+    if (argc >= 4 && strcmp(argv[2], "-send") == 0){
+
+        /* Join the words back into one command line */
+        cmdlen = 2;
+        for (i = 3; i < argc; ++i)
+            cmdlen += strlen(argv[i]) + 1;
+
+        command = malloc(cmdlen);
+        assert(command);
+        command[0] = '\0';
+
+        for (i = 3; i < argc; ++i){
+
+            strcat(command, argv[i]);
+            strcat(command, i + 1 < argc ? " " : "\n");
+        }
+
+        text = NULL;
+        len = 0;
+        if (argc == 5 && strcmp(argv[3], "load") == 0)
+            text = readAll(stdin, &len);
+
+        fd = connectDaemon(argv[1]);
+
+        if (fd < 0){
+
+            fprintf(stderr, "Error: unable to connect to %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+
+        resplen = sendRequest(fd, command, text, len, &resp);
+        close(fd);
+        free(command);
+        free(text);
+
+        if (resplen < 0){
+
+            fprintf(stderr, "Error: connection to %s failed\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+
+        /* Print the output on success, or the reason on stderr */
+        if (resplen >= 3 && strncmp(resp, "OK\n", 3) == 0){
+
+            fwrite(resp + 3, 1, resplen - 3, stdout);
+            free(resp);
+            return EXIT_SUCCESS;
+        }
+
+        fprintf(stderr, "Error: %s", resplen >= 4 ? resp + 4 : resp);
+        free(resp);
+        return EXIT_FAILURE;
+    }
+
+    if (argc < 3 || argc > 5){
+
+        fprintf(stderr, "Usage: calload socket file.ics [clients] [requests]\n");
+        fprintf(stderr, "       calload socket -send command...\n");
+        return EXIT_FAILURE;
+    }
+
+    nclients = argc >= 4 ? atoi(argv[3]) : 16;
+    requests = argc >= 5 ? atoi(argv[4]) : 1000;
+
+    if (nclients <= 0 || requests <= 0){
+
+        fprintf(stderr, "Error: clients and requests must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    ics = fopen(argv[2], "r");
+
+    if (ics == NULL){
+
+        fprintf(stderr, "Error: Unable to open file %s\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    text = readAll(ics, &len);
+    fclose(ics);
+
+    /* Load the calendar once; every connection then reads it from the daemon's memory */
+    fd = connectDaemon(argv[1]);
+
+    if (fd < 0){
+
+        fprintf(stderr, "Error: unable to connect to %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    resplen = sendRequest(fd, "load " LOAD_NAME "\n", text, len, &resp);
+    free(text);
+
+    if (resplen < 3 || strncmp(resp, "OK\n", 3) != 0){
+
+        fprintf(stderr, "Error: load failed: %s", resplen >= 4 ? resp + 4 : "connection failed\n");
+        free(resp);
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    free(resp);
+
+    clients = malloc(sizeof(LoadClient) * nclients);
+    assert(clients);
+    threads = malloc(sizeof(pthread_t) * nclients);
+    assert(threads);
+
+    start = nowSeconds();
+
+    for (i = 0; i < nclients; ++i){
+
+        clients[i].sockpath = argv[1];
+        clients[i].requests = requests;
+        clients[i].latency = malloc(sizeof(double) * requests);
+        assert(clients[i].latency);
+        clients[i].errors = 0;
+
+        if (pthread_create(&threads[i], NULL, runLoadClient, &clients[i]) != 0){
+
+            fprintf(stderr, "Error: unable to start client %d\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (i = 0; i < nclients; ++i)
+        pthread_join(threads[i], NULL);
+
+    elapsed = nowSeconds() - start;
+
+    /* Merge every connection's latencies to get percentiles */
+    total = (long) nclients * requests;
+    all = malloc(sizeof(double) * total);
+    assert(all);
+
+    errors = 0;
+    for (i = 0; i < nclients; ++i){
+
+        for (j = 0; j < requests; ++j)
+            all[(long) i * requests + j] = clients[i].latency[j];
+
+        errors += clients[i].errors;
+        free(clients[i].latency);
+    }
+
+    qsort(all, total, sizeof(double), compareLatency);
+
+    printf("clients: %d\n", nclients);
+    printf("requests: %ld\n", total);
+    printf("errors: %ld\n", errors);
+    printf("elapsed: %.3f s\n", elapsed);
+    printf("throughput: %.0f req/s\n", total / elapsed);
+    printf("latency p50: %.3f ms\n", all[total / 2] * 1000);
+    printf("latency p99: %.3f ms\n", all[total * 99 / 100] * 1000);
+    printf("latency max: %.3f ms\n", all[total - 1] * 1000);
+
+    resplen = sendRequest(fd, "unload " LOAD_NAME "\n", NULL, 0, &resp);
+    if (resplen >= 0)
+        free(resp);
+
+    close(fd);
+    free(all);
+    free(clients);
+    free(threads);
+
+    return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int connectDaemon (const char *sockpath){
+
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(sockpath) >= sizeof(addr.sun_path))
+        return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sockpath);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd >= 0 && connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0){
+
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+long sendRequest (int fd, const char *command, const char *data, size_t datalen, char **presp){
+
+    uint32_t netlen;
+    size_t len;
+
+    *presp = NULL;
+
+    len = strlen(command) + datalen;
+    netlen = htonl(len);
+
+    if (transferAll(fd, &netlen, CALSERVE_HDR, true) == false || transferAll(fd, (void *) command, strlen(command), true) == false)
+        return -1;
+
+    if (datalen > 0 && transferAll(fd, (void *) data, datalen, true) == false)
+        return -1;
+
+    if (transferAll(fd, &netlen, CALSERVE_HDR, false) == false)
+        return -1;
+
+    len = ntohl(netlen);
+
+    *presp = malloc(len + 1);
+    assert(*presp);
+
+    if (transferAll(fd, *presp, len, false) == false){
+
+        free(*presp);
+        *presp = NULL;
+        return -1;
+    }
+
+    (*presp)[len] = '\0';
+
+    return len;
+}
+
+bool transferAll (int fd, void *buf, size_t count, bool out){
+
+    ssize_t done;
+    char * pos;
+
+    pos = buf;
+
+    while (count > 0){
+
+        done = out == true ? send(fd, pos, count, MSG_NOSIGNAL) : recv(fd, pos, count, 0);
+
+        if (done < 0 && errno == EINTR)
+            continue;
+
+        if (done <= 0)
+            return false;
+
+        pos += done;
+        count -= done;
+    }
+
+    return true;
+}
+
+void *runLoadClient (void *arg){
+
+    LoadClient * client;
+    char * resp;
+    double start;
+    long resplen;
+    int fd, i;
+
+    client = arg;
+
+    fd = connectDaemon(client->sockpath);
+
+    for (i = 0; i < client->requests; ++i){
+
+        start = nowSeconds();
+
+        resp = NULL;
+        resplen = fd >= 0 ? sendRequest(fd, loadRequests[i % (sizeof(loadRequests) / sizeof(loadRequests[0]))], NULL, 0, &resp) : -1;
+
+        client->latency[i] = nowSeconds() - start;
+
+        if (resplen < 3 || strncmp(resp, "OK\n", 3) != 0)
+            ++client->errors;
+
+        free(resp);
+    }
+
+    if (fd >= 0)
+        close(fd);
+
+    return NULL;
+}
+
+char *readAll (FILE *file, size_t *plen){
+
+    char * buffer;
+    size_t cap, got;
+
+    *plen = 0;
+    cap = 65536;
+    buffer = malloc(cap);
+    assert(buffer);
+
+    while ((got = fread(buffer + *plen, 1, cap - *plen, file)) > 0){
+
+        *plen += got;
+
+        if (*plen == cap){
+
+            cap *= 2;
+            buffer = realloc(buffer, cap);
+            assert(buffer);
+        }
+    }
+
+    return buffer;
+}
+
+int compareLatency (const void *a, const void *b){
+
+    /* Cast parameters */
+    const double * castA = (const double *) a;
+    const double * castB = (const double *) b;
+
+    if (*castA != *castB)
+        return *castA < *castB ? -1 : 1;
+
+    return 0;
+}
+
+double nowSeconds (void){
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
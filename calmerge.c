@@ -0,0 +1,573 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calmerge.c -- Source code for the streaming merge
+Last updated:  Oct 19/26
+********/
+
+#define _GNU_SOURCE   // for getline, fmemopen and strncasecmp
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+#include <time.h>
+#include "calmerge.h"
+#include "calrecur.h"
+#include "caltz.h"
+
+typedef struct {        // text grown by doubling
+    char *text;
+    size_t len, cap;
+} MergeText;
+
+typedef struct {        // one input of calMerge
+    FILE *ics;
+    char *line;             // line last read, CRLF included
+    size_t linecap;
+    ssize_t linelen;        // its length, -1 at end of file
+    int lineno;             // no. of lines read
+    MergeText comp;         // the waiting component, lines as read
+    int compfrom;           // line it begins on
+    bool waiting;           // false once the input has no components left
+    bool timed;             // the waiting component has a DTSTART
+    time_t start;           // its calendar time
+    const char *tzid;       // its TZID if it is a VTIMEZONE, else NULL
+    CalComp **tzcomps;      // the VTIMEZONEs read so far, each in a calendar of its own
+    CalTzSet **zones;       // the sets compiled from them
+    size_t nzones;
+} MergeInput;
+
+/* Read the next line of an input
+ *
+ * Arguments: the input
+ *
+ * Preconditions: none
+ * Postconditions: in->line holds the line and in->linelen its length, or -1 at end of file
+ *
+ * Return val: IOERR if reading fails, NOCRNL if the line doesn't end in CRLF, OK otherwise
+ * */
+CalError readMergeLine (MergeInput *in);
+
+/* Read the next component of an input
+ *
+ * Arguments: the input, what to order by, and where to keep calendar properties (or NULL to skip them)
+ *
+ * Preconditions: the input's BEGIN:VCALENDAR has been read
+ * Postconditions: in->comp holds the component with its key worked out, or in->waiting is false if the calendar
+ *                 ended; calendar properties read on the way are added to header
+ *
+ * Return val: as for calMerge
+ * */
+CalStatus readMergeComp (MergeInput *in, CalMergeKey key, MergeText *header);
+
+/* Work out the key of an input's waiting component
+ *
+ * Arguments: the input and what to order by
+ *
+ * Preconditions: in->comp holds a whole component
+ * Postconditions: a VTIMEZONE is compiled and kept for the components after it; in->timed, in->start and in->tzid
+ *                 are set
+ *
+ * Return val: none
+ * */
+void keyMergeComp (MergeInput *in, CalMergeKey key);
+
+/* Find and parse a property of a component's own (not its subcomponents')
+ *
+ * Arguments: the component's text, the property name and where to store it
+ *
+ * Preconditions: text begins with the component's BEGIN line
+ * Postconditions: *prop holds the first such property, unfolded and parsed by parseCalProp, to be released with
+ *                 freeMergeProp
+ *
+ * Return val: false if there is no such property or it can't be parsed, true otherwise
+ * */
+bool findMergeProp (const char *text, const char *name, CalProp *prop);
+
+/* Release what parseCalProp stored in a property
+ *
+ * Arguments: property filled in by parseCalProp
+ *
+ * Preconditions: parseCalProp returned OK for prop
+ * Postconditions: its name, value and parameters are free'd
+ *
+ * Return val: none
+ * */
+void freeMergeProp (CalProp *prop);
+
+/* Check if a line is a given one, ignoring case
+ *
+ * Arguments: the line (CRLF included, and what follows it is ignored) and what it should be (without CRLF)
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: true if the line is expected followed by CRLF, false otherwise
+ * */
+bool isMergeLine (const char *line, const char *expected);
+
+/* Add text to the end of a MergeText
+ *
+ * Arguments: the MergeText, the text and its length
+ *
+ * Preconditions: none
+ * Postconditions: the text is appended, growing the buffer if it must
+ *
+ * Return val: none
+ * */
+void appendMergeText (MergeText *buff, const char *text, size_t len);
+
+/* Restore the heap order below one entry of calMerge's heap of inputs
+ *
+ * Arguments: the heap (input nos.), how many entries it holds, the inputs and the entry that may be out of place
+ *
+ * Preconditions: every input in the heap has a component waiting; below i the heap is in order
+ * Postconditions: the entry is moved down until no entry below it comes first
+ *
+ * Return val: none
+ * */
+void siftMergeHeap (int *heap, int n, const MergeInput *ins, int i);
+
+/* Check if one input's waiting component goes out before another's
+ *
+ * Arguments: the inputs and the two input nos.
+ *
+ * Preconditions: both inputs have a component waiting
+ * Postconditions: none
+ *
+ * Return val: true if a's goes first: it has no DTSTART and b's has, or it starts earlier, or they tie and a is the
+ *             earlier input
+ * */
+bool mergeBefore (const MergeInput *ins, int a, int b);
+
+CalStatus calMerge( FILE *const *inputs, int ninputs, CalMergeKey key, FILE *const icsfile, int *const bad ){
+
+    MergeInput * ins, * in;
+    MergeText header;
+    CalStatus status;
+    const char ** tzids;
+    size_t ntzids, t, z;
+    int * heap;
+    int nheap, i;
+    bool write;
+
+    ins = calloc(ninputs, sizeof(MergeInput));
+    heap = malloc(sizeof(int) * ninputs);
+    tzids = NULL;
+    ntzids = 0;
+    assert(ins && heap);
+
+    memset(&header, 0, sizeof(MergeText));
+    appendMergeText(&header, "BEGIN:VCALENDAR\r\n", strlen("BEGIN:VCALENDAR\r\n"));
+
+    status.code = OK;
+    status.linefrom = 0;
+    status.lineto = 0;
+    *bad = -1;
+    nheap = 0;
+
+    /* Every input's first component is read before anything is written, so the first input's properties are known */
+    for (i = 0; i < ninputs && status.code == OK; ++i){
+
+        in = &ins[i];
+        in->ics = inputs[i];
+        status.code = readMergeLine(in);
+
+        if (status.code == OK && (in->linelen < 0 || isMergeLine(in->line, "BEGIN:VCALENDAR") == false))
+            status.code = NOCAL;
+
+        status.linefrom = in->lineno;
+        status.lineto = in->lineno;
+
+        if (status.code == OK)
+            status = readMergeComp(in, key, i == 0 ? &header : NULL);
+
+        if (status.code != OK)
+            *bad = i;
+        else if (in->waiting == true)
+            heap[nheap++] = i;
+    }
+
+    if (status.code == OK && fwrite(header.text, 1, header.len, icsfile) < header.len)
+        status.code = IOERR;
+
+    for (i = nheap / 2; i-- > 0; )
+        siftMergeHeap(heap, nheap, ins, i);
+
+    /* The input at the top of the heap gives up its component and reads the next */
+    while (status.code == OK && nheap > 0){
+
+        in = &ins[heap[0]];
+        write = true;
+
+        if (in->tzid != NULL){
+
+            for (t = 0; t < ntzids && write == true; ++t)
+                write = strcmp(tzids[t], in->tzid) != 0;
+
+            if (write == true){
+
+                tzids = realloc(tzids, sizeof(char *) * (ntzids + 1));
+                assert(tzids);
+                tzids[ntzids++] = in->tzid;
+            }
+        }
+
+        if (write == true && fwrite(in->comp.text, 1, in->comp.len, icsfile) < in->comp.len){
+
+            status.code = IOERR;
+            break;
+        }
+
+        status = readMergeComp(in, key, NULL);
+
+        if (status.code != OK){
+
+            *bad = heap[0];
+            break;
+        }
+
+        if (in->waiting == false)
+            heap[0] = heap[--nheap];
+
+        siftMergeHeap(heap, nheap, ins, 0);
+    }
+
+    if (status.code == OK && fputs("END:VCALENDAR\r\n", icsfile) == EOF)
+        status.code = IOERR;
+
+    /* The TZIDs written point into the inputs' VTIMEZONE trees, so those go last */
+    free(tzids);
+
+    for (i = 0; i < ninputs; ++i){
+
+        for (z = 0; z < ins[i].nzones; ++z){
+
+            calTzFree(ins[i].zones[z]);
+            freeCalComp(ins[i].tzcomps[z]);
+        }
+
+        free(ins[i].zones);
+        free(ins[i].tzcomps);
+        free(ins[i].line);
+        free(ins[i].comp.text);
+    }
+
+    free(ins);
+    free(heap);
+    free(header.text);
+
+    return status;
+}
+
+CalError readMergeLine (MergeInput *in){
+
+    in->linelen = getline(&in->line, &in->linecap, in->ics);
+
+    if (in->linelen < 0)
+        return ferror(in->ics) ? IOERR : OK;
+
+    ++in->lineno;
+
+    if (in->linelen < 2 || in->line[in->linelen - 2] != '\r' || in->line[in->linelen - 1] != '\n')
+        return NOCRNL;
+
+    return OK;
+}
+
+CalStatus readMergeComp (MergeInput *in, CalMergeKey key, MergeText *header){
+
+    CalStatus status;
+    const char * name;
+    size_t namelen;
+    int depth;
+
+    in->comp.len = 0;
+    in->waiting = true;
+    depth = 0;
+
+    while (true){
+
+        status.code = readMergeLine(in);
+        status.linefrom = depth > 0 ? in->compfrom : in->lineno;
+        status.lineto = in->lineno;
+
+        if (status.code != OK)
+            return status;
+
+        if (in->linelen < 0){
+
+            status.code = BEGEND;
+            return status;
+        }
+
+        /* Between components: calendar properties, the next component or the end of the calendar */
+        if (depth == 0){
+
+            if (isMergeLine(in->line, "END:VCALENDAR") == true)
+                break;
+
+            if (strncasecmp(in->line, "BEGIN:", 6) == 0){
+
+                depth = 1;
+                in->compfrom = in->lineno;
+            }
+
+            else{
+
+                if (header != NULL)
+                    appendMergeText(header, in->line, in->linelen);
+
+                continue;
+            }
+        }
+
+        else if (strncasecmp(in->line, "BEGIN:", 6) == 0)
+            ++depth;
+
+        else if (strncasecmp(in->line, "END:", 4) == 0 && --depth == 0){
+
+            /* The component must end with its own name */
+            name = in->comp.text + 6;
+            namelen = strcspn(name, "\r");
+
+            if ((size_t) in->linelen != namelen + 6 || strncasecmp(in->line + 4, name, namelen) != 0){
+
+                status.code = BEGEND;
+                return status;
+            }
+
+            appendMergeText(&in->comp, in->line, in->linelen);
+            keyMergeComp(in, key);
+
+            return status;
+        }
+
+        appendMergeText(&in->comp, in->line, in->linelen);
+    }
+
+    in->waiting = false;
+
+    /* Only blank lines may follow the calendar */
+    while ((status.code = readMergeLine(in)) == OK && in->linelen >= 0){
+
+        if (in->linelen != 2){
+
+            status.code = AFTEND;
+            status.linefrom = in->lineno;
+            status.lineto = in->lineno;
+            break;
+        }
+    }
+
+    return status;
+}
+
+void keyMergeComp (MergeInput *in, CalMergeKey key){
+
+    static const char wrapStart[] = "BEGIN:VCALENDAR\r\nVERSION:2.0\r\nPRODID:-//caltool//merge//EN\r\n";
+    const CalTzZone * zone;
+    CalComp * pcomp;
+    CalTzSet * set;
+    CalProp prop;
+    MergeText wrapped;
+    FILE * ics;
+    size_t z;
+
+    in->timed = false;
+    in->tzid = NULL;
+
+    /* A VTIMEZONE is parsed in a calendar of its own and compiled, for this input's later TZIDs */
+    if (isMergeLine(in->comp.text, "BEGIN:VTIMEZONE") == true){
+
+        memset(&wrapped, 0, sizeof(MergeText));
+        appendMergeText(&wrapped, wrapStart, strlen(wrapStart));
+        appendMergeText(&wrapped, in->comp.text, in->comp.len);
+        appendMergeText(&wrapped, "END:VCALENDAR\r\n", strlen("END:VCALENDAR\r\n"));
+
+        ics = fmemopen(wrapped.text, wrapped.len, "r");
+        assert(ics);
+
+        pcomp = NULL;
+
+        if (readCalFile(ics, &pcomp).code == OK){
+
+            set = calTzBuild(pcomp);
+
+            if (set->nzones == 1){
+
+                in->tzcomps = realloc(in->tzcomps, sizeof(CalComp *) * (in->nzones + 1));
+                in->zones = realloc(in->zones, sizeof(CalTzSet *) * (in->nzones + 1));
+                assert(in->tzcomps && in->zones);
+
+                in->tzcomps[in->nzones] = pcomp;
+                in->zones[in->nzones] = set;
+                in->tzid = set->zones[0].tzid;
+                ++in->nzones;
+            }
+
+            else{
+
+                calTzFree(set);
+                freeCalComp(pcomp);
+            }
+        }
+
+        fclose(ics);
+        free(wrapped.text);
+
+        return;
+    }
+
+    if (key == MCONCAT || findMergeProp(in->comp.text, "DTSTART", &prop) == false)
+        return;
+
+    /* A value ending in Z needs no VTIMEZONE; a TZID is looked for in each one the input has shown */
+    zone = calTzZone(NULL, &prop);
+
+    for (z = 0; z < in->nzones && zone == NULL; ++z)
+        zone = calTzZone(in->zones[z], &prop);
+
+    in->start = zone != NULL ? calTzToUTC(zone, calRecurWall(prop.value)) : parseCalDate(prop.value);
+    in->timed = true;
+
+    freeMergeProp(&prop);
+}
+
+bool findMergeProp (const char *text, const char *name, CalProp *prop){
+
+    const char * line, * next;
+    char * unfolded;
+    size_t namelen, len;
+    int depth;
+    bool found;
+
+    namelen = strlen(name);
+    depth = 0;
+
+    /* Line by line after the component's BEGIN, not counting what is inside its subcomponents */
+    for (line = strstr(text, "\r\n") + 2; *line != '\0'; line = next){
+
+        next = strstr(line, "\r\n") + 2;
+
+        if (strncasecmp(line, "BEGIN:", 6) == 0)
+            ++depth;
+        else if (strncasecmp(line, "END:", 4) == 0)
+            --depth;
+        else if (depth == 0 && strncasecmp(line, name, namelen) == 0 && (line[namelen] == ';' || line[namelen] == ':'))
+            break;
+    }
+
+    if (*line == '\0')
+        return false;
+
+    unfolded = malloc(strlen(line) + 1);
+    assert(unfolded);
+
+    /* Join the folded lines that follow, dropping each CRLF and the space or tab after it */
+    len = 0;
+
+    while (true){
+
+        next = strstr(line, "\r\n");
+        memcpy(unfolded + len, line, next - line);
+        len += next - line;
+        line = next + 2;
+
+        if (*line != ' ' && *line != '\t')
+            break;
+
+        ++line;
+    }
+
+    /* parseCalProp frees what it stored itself when the line doesn't parse */
+    unfolded[len] = '\0';
+    found = parseCalProp(unfolded, prop) == OK;
+    free(unfolded);
+
+    return found;
+}
+
+void freeMergeProp (CalProp *prop){
+
+    CalParam * param, * next;
+    int i;
+
+    free(prop->name);
+    free(prop->value);
+    free(prop->rawparam);
+
+    for (param = prop->param; param != NULL; param = next){
+
+        next = param->next;
+
+        for (i = 0; i < param->nvalues; ++i)
+            free(param->value[i]);
+
+        free(param->name);
+        free(param);
+    }
+}
+
+bool isMergeLine (const char *line, const char *expected){
+
+    size_t len = strlen(expected);
+
+    return strncasecmp(line, expected, len) == 0 && line[len] == '\r' && line[len + 1] == '\n';
+}
+
+void appendMergeText (MergeText *buff, const char *text, size_t len){
+
+    if (buff->len + len + 1 > buff->cap){
+
+        while (buff->len + len + 1 > buff->cap)
+            buff->cap = buff->cap == 0 ? 4096 : buff->cap * 2;
+
+        buff->text = realloc(buff->text, buff->cap);
+        assert(buff->text);
+    }
+
+    memcpy(buff->text + buff->len, text, len);
+    buff->len += len;
+    buff->text[buff->len] = '\0';
+}
+
+void siftMergeHeap (int *heap, int n, const MergeInput *ins, int i){
+
+    int moving, child;
+
+    if (n == 0)
+        return;
+
+    moving = heap[i];
+
+    while ((child = 2 * i + 1) < n){
+
+        if (child + 1 < n && mergeBefore(ins, heap[child + 1], heap[child]) == true)
+            ++child;
+
+        if (mergeBefore(ins, heap[child], moving) == false)
+            break;
+
+        heap[i] = heap[child];
+        i = child;
+    }
+
+    heap[i] = moving;
+}
+
+bool mergeBefore (const MergeInput *ins, int a, int b){
+
+    if (ins[a].timed != ins[b].timed)
+        return ins[b].timed;
+
+    if (ins[a].timed == true && ins[a].start != ins[b].start)
+        return ins[a].start < ins[b].start;
+
+    return a < b;
+}
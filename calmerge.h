@@ -0,0 +1,48 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calmerge.h -- Public interface for the streaming merge in calmerge.c
+Last updated:  Oct 19/26
+
+calMerge writes one calendar holding the components of many without
+loading any of them whole. Each input is read a component at a time with
+only that component's text in memory, and the components waiting (one
+per input) sit in a heap keyed by DTSTART, so merging inputs that are
+each in DTSTART order gives output in DTSTART order, with memory bounded
+by the number of inputs and the largest component whatever the total
+size. Components are copied through as they were read. Only the DTSTART
+line is parsed, and a TZID is resolved through the VTIMEZONEs the input
+has shown so far. Components without a DTSTART (VTIMEZONEs among them)
+go out as soon as they come to the front of their input, and a VTIMEZONE
+whose TZID has already been written is left out. The output keeps the
+first input's calendar properties.
+********/
+
+#ifndef CALMERGE_H
+#define CALMERGE_H
+
+#include <stdio.h>
+#include "calutil.h"
+
+typedef enum {          // order calMerge writes components in
+    MCONCAT,    // each input in turn
+    MDTSTART,   // by DTSTART, ties going to the earlier input
+} CalMergeKey;
+
+/*	Merge calendars into one, streaming
+ *
+ * Arguments: the inputs, how many there are, the order to merge by, the output file and where to store the input at
+ *            fault if there is an error
+ *
+ * Preconditions: the inputs are open for reading and ninputs > 0
+ * Postconditions: the merged calendar is written to icsfile; on error, output stops where the error was found and
+ *                 *bad is the input at fault (-1 if writing failed)
+ *
+ * Return val: OK, IOERR if reading or writing fails, NOCAL if an input doesn't begin a VCALENDAR, NOCRNL if a line
+ *             doesn't end in CRLF, BEGEND if components aren't closed in order, AFTEND if text follows the
+ *             calendar; the lines are those of the input at fault
+ * */
+CalStatus calMerge( FILE *const *inputs, int ninputs, CalMergeKey key, FILE *const icsfile, int *const bad );
+
+#endif
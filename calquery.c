@@ -0,0 +1,814 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calquery.c -- Source code for compiled component queries
+Last updated:  Oct 19/26
+********/
+
+#define _GNU_SOURCE   // for strptime, timegm and strcasestr
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "calquery.h"
+#include "calsnap.h"
+
+/* Properties whose values compare as dates, and as numbers */
+static const char *const dateProps[] = { "DTSTART", "DTEND", "DUE", "COMPLETED", "DTSTAMP", "CREATED",
+                                         "LAST-MODIFIED", "RECURRENCE-ID", NULL };
+static const char *const numberProps[] = { "PRIORITY", "SEQUENCE", "PERCENT-COMPLETE", "REPEAT", NULL };
+
+typedef struct {        // where calQueryCompile has got to
+    const char *expr;       // the whole query, to count columns from
+    const char *pos;        // next character not yet read
+    CalQuery *query;
+    int stepcap, testcap;   // no. of steps and tests allocated
+    int errcol;             // column the first error was found at (0 while there is none)
+} QueryParser;
+
+/* Compile an or-chain, the whole query or what is in parentheses
+ *
+ * Arguments: the parser
+ *
+ * Preconditions: none
+ * Postconditions: the chain's steps are added; its jumps go to the step after it
+ *
+ * Return val: false with errcol set if the text doesn't make sense, true otherwise
+ * */
+bool parseQueryOr (QueryParser *parser);
+
+/* Compile an and-chain
+ *
+ * Arguments: the parser
+ *
+ * Preconditions: none
+ * Postconditions: as for parseQueryOr
+ *
+ * Return val: as for parseQueryOr
+ * */
+bool parseQueryAnd (QueryParser *parser);
+
+/* Compile a test, a negation or something in parentheses
+ *
+ * Arguments: the parser
+ *
+ * Preconditions: none
+ * Postconditions: as for parseQueryOr
+ *
+ * Return val: as for parseQueryOr
+ * */
+bool parseQueryUnary (QueryParser *parser);
+
+/* Compile one test
+ *
+ * Arguments: the parser
+ *
+ * Preconditions: none
+ * Postconditions: the test is added with its QTEST step, followed by QNOT for !=
+ *
+ * Return val: as for parseQueryOr
+ * */
+bool parseQueryTest (QueryParser *parser);
+
+/* Read a component, property or parameter name
+ *
+ * Arguments: the parser
+ *
+ * Preconditions: none
+ * Postconditions: the name is read past
+ *
+ * Return val: the name uppercased and malloc'd, or NULL if there is none here
+ * */
+char *readQueryName (QueryParser *parser);
+
+/* Read a value, bare or in double quotes
+ *
+ * Arguments: the parser
+ *
+ * Preconditions: none
+ * Postconditions: the value is read past
+ *
+ * Return val: the value malloc'd, with quotes and backslash escapes taken out, or NULL if there is none here
+ * */
+char *readQueryValue (QueryParser *parser);
+
+/* Read past a keyword if it comes next
+ *
+ * Arguments: the parser and the keyword in lowercase
+ *
+ * Preconditions: none
+ * Postconditions: the keyword and the spaces before it are read past if it is there
+ *
+ * Return val: true if the keyword came next, in any case and not as the start of a longer name, false otherwise
+ * */
+bool readQueryWord (QueryParser *parser, const char *word);
+
+/* Add a step to the program
+ *
+ * Arguments: the parser, the step's code and its argument
+ *
+ * Preconditions: none
+ * Postconditions: the step is added at the end
+ *
+ * Return val: the step's index, for a jump to be pointed later
+ * */
+int addQueryStep (QueryParser *parser, CalQueryCode code, int arg);
+
+/* Point a chain of jumps at the step after the last one added
+ *
+ * Arguments: the parser and the last jump of the chain (-1 for none)
+ *
+ * Preconditions: each jump's argument is the jump before it in the chain, the first's -1
+ * Postconditions: every jump in the chain goes to the next step to be added
+ *
+ * Return val: none
+ * */
+void pointQueryJumps (QueryParser *parser, int pending);
+
+/* Convert a date given in a query
+ *
+ * Arguments: the text and where to store the first and last second it stands for
+ *
+ * Preconditions: none
+ * Postconditions: a date stands for the whole day, a date and time for that second
+ *
+ * Return val: false if the text is no date, true otherwise
+ * */
+bool parseQueryDate (const char *text, time_t *from, time_t *to);
+
+/* Check if a component passes one test
+ *
+ * Arguments: the test, the calendar, its timezones and the component
+ *
+ * Preconditions: as for calQueryMatch
+ * Postconditions: none
+ *
+ * Return val: true if some property or parameter value passes the test, false otherwise
+ * */
+bool runQueryTest (const CalQueryTest *test, const CalComp *cal, const CalTzSet *zones, const CalComp *comp);
+
+/* Check if one value passes a test
+ *
+ * Arguments: the test, the calendar, its timezones, the property and the value (the property's or a parameter's)
+ *
+ * Preconditions: test->op isn't QPRESENT
+ * Postconditions: none
+ *
+ * Return val: true if the value passes, false otherwise
+ * */
+bool matchQueryValue (const CalQueryTest *test, const CalComp *cal, const CalTzSet *zones, const CalProp *prop,
+                      const char *value);
+
+/* Compare a value with a test's text, ignoring case and the quotes round a parameter value
+ *
+ * Arguments: the value and the text
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: less than, equal to or greater than 0 as the value sorts before, with or after the text
+ * */
+int compareQueryText (const char *value, const char *text);
+
+/* Check if a name is in a NULL-terminated list
+ *
+ * Arguments: the list and the name
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: true if it is, false otherwise
+ * */
+bool inQueryList (const char *const *list, const char *name);
+
+CalStatus calQueryCompile( const char *expr, CalQuery *const query ){
+
+    QueryParser parser;
+    CalStatus status;
+    bool ok;
+
+    memset(query, 0, sizeof(CalQuery));
+
+    parser.expr = expr;
+    parser.pos = expr;
+    parser.query = query;
+    parser.stepcap = 0;
+    parser.testcap = 0;
+    parser.errcol = 0;
+
+    ok = parseQueryOr(&parser);
+
+    /* Everything must have been read */
+    while (ok == true && isspace((unsigned char) *parser.pos))
+        ++parser.pos;
+
+    if (ok == true && *parser.pos != '\0'){
+
+        parser.errcol = parser.pos - expr + 1;
+        ok = false;
+    }
+
+    status.code = ok == true ? OK : SYNTAX;
+    status.linefrom = ok == true ? 0 : parser.errcol;
+    status.lineto = status.linefrom;
+
+    if (ok == false)
+        calQueryFree(query);
+
+    return status;
+}
+
+bool calQueryMatch( const CalQuery *query, const CalComp *cal, const CalTzSet *zones, const CalComp *comp ){
+
+    const CalQueryStep * step;
+    bool result;
+    int pc;
+
+    result = true;
+    pc = 0;
+
+    while (pc < query->nsteps){
+
+        step = &query->steps[pc];
+
+        switch (step->code){
+
+            case QTEST:
+                result = runQueryTest(&query->tests[step->arg], cal, zones, comp);
+                ++pc;
+                break;
+
+            case QJUMPFALSE:
+                pc = result == false ? step->arg : pc + 1;
+                break;
+
+            case QJUMPTRUE:
+                pc = result == true ? step->arg : pc + 1;
+                break;
+
+            case QNOT:
+                result = !result;
+                ++pc;
+                break;
+        }
+    }
+
+    return result;
+}
+
+void calQueryFree( CalQuery *const query ){
+
+    int i;
+
+    for (i = 0; i < query->ntests; ++i){
+
+        free(query->tests[i].name);
+        free(query->tests[i].param);
+        free(query->tests[i].text);
+    }
+
+    free(query->tests);
+    free(query->steps);
+    memset(query, 0, sizeof(CalQuery));
+}
+
+bool parseQueryOr (QueryParser *parser){
+
+    int pending;
+
+    /* Each or jumps to the end of the chain as soon as the result is true; until the end is known, the jumps
+       are chained through their arguments */
+    pending = -1;
+
+    if (parseQueryAnd(parser) == false)
+        return false;
+
+    while (readQueryWord(parser, "or") == true){
+
+        pending = addQueryStep(parser, QJUMPTRUE, pending);
+
+        if (parseQueryAnd(parser) == false)
+            return false;
+    }
+
+    pointQueryJumps(parser, pending);
+
+    return true;
+}
+
+bool parseQueryAnd (QueryParser *parser){
+
+    int pending;
+
+    /* As for or, jumping as soon as the result is false */
+    pending = -1;
+
+    if (parseQueryUnary(parser) == false)
+        return false;
+
+    while (readQueryWord(parser, "and") == true){
+
+        pending = addQueryStep(parser, QJUMPFALSE, pending);
+
+        if (parseQueryUnary(parser) == false)
+            return false;
+    }
+
+    pointQueryJumps(parser, pending);
+
+    return true;
+}
+
+bool parseQueryUnary (QueryParser *parser){
+
+    if (readQueryWord(parser, "not") == true){
+
+        if (parseQueryUnary(parser) == false)
+            return false;
+
+        addQueryStep(parser, QNOT, 0);
+        return true;
+    }
+
+    while (isspace((unsigned char) *parser->pos))
+        ++parser->pos;
+
+    if (*parser->pos == '('){
+
+        ++parser->pos;
+
+        if (parseQueryOr(parser) == false)
+            return false;
+
+        while (isspace((unsigned char) *parser->pos))
+            ++parser->pos;
+
+        if (*parser->pos != ')'){
+
+            parser->errcol = parser->pos - parser->expr + 1;
+            return false;
+        }
+
+        ++parser->pos;
+        return true;
+    }
+
+    return parseQueryTest(parser);
+}
+
+bool parseQueryTest (QueryParser *parser){
+
+    static const char *const opText[] = { "!=", "<=", ">=", "=", "~", "<", ">" };
+    static const CalQueryOp opCode[] = { QEQUAL, QATMOST, QATLEAST, QEQUAL, QCONTAINS, QLESS, QMORE };
+    CalQueryTest test;
+    const char * start;
+    bool negate, valid;
+    char * end;
+    int i;
+
+    memset(&test, 0, sizeof(CalQueryTest));
+    test.op = QPRESENT;
+    test.kind = QTEXT;
+    negate = false;
+
+    while (isspace((unsigned char) *parser->pos))
+        ++parser->pos;
+
+    start = parser->pos;
+    test.name = readQueryName(parser);
+
+    if (test.name == NULL){
+
+        parser->errcol = start - parser->expr + 1;
+        return false;
+    }
+
+    if (*parser->pos == '.'){
+
+        ++parser->pos;
+        start = parser->pos;
+        test.param = readQueryName(parser);
+
+        if (test.param == NULL){
+
+            free(test.name);
+            parser->errcol = start - parser->expr + 1;
+            return false;
+        }
+    }
+
+    while (isspace((unsigned char) *parser->pos))
+        ++parser->pos;
+
+    for (i = 0; i < 7; ++i){
+
+        if (strncmp(parser->pos, opText[i], strlen(opText[i])) == 0){
+
+            parser->pos += strlen(opText[i]);
+            test.op = opCode[i];
+            negate = i == 0;
+            break;
+        }
+    }
+
+    /* comp names the component itself, and only = and != make sense of it */
+    test.comp = test.param == NULL && strcmp(test.name, "COMP") == 0 && test.op != QPRESENT;
+
+    if (test.op != QPRESENT){
+
+        while (isspace((unsigned char) *parser->pos))
+            ++parser->pos;
+
+        start = parser->pos;
+        test.text = readQueryValue(parser);
+        valid = test.text != NULL;
+
+        /* Names, dates and numbers are settled here so that matching needn't look at them again */
+        if (valid == true && test.comp == true){
+
+            /* comp only takes = and != */
+            valid = test.op == QEQUAL;
+
+            free(test.name);
+            test.name = test.text;
+            test.text = NULL;
+
+            for (i = 0; test.name[i] != '\0'; ++i)
+                test.name[i] = toupper((unsigned char) test.name[i]);
+        }
+
+        else if (valid == true && test.param == NULL && test.op != QCONTAINS &&
+                 inQueryList(dateProps, test.name) == true){
+
+            test.kind = QDATE;
+            parser->query->dates = true;
+            valid = parseQueryDate(test.text, &test.from, &test.to);
+        }
+
+        else if (valid == true && test.param == NULL && test.op != QCONTAINS &&
+                 inQueryList(numberProps, test.name) == true){
+
+            test.kind = QNUMBER;
+            test.number = strtol(test.text, &end, 10);
+            valid = *end == '\0' && end != test.text;
+        }
+
+        /* The text isn't needed once converted */
+        if (test.kind != QTEXT){
+
+            free(test.text);
+            test.text = NULL;
+        }
+
+        if (valid == false){
+
+            free(test.name);
+            free(test.param);
+            free(test.text);
+            parser->errcol = start - parser->expr + 1;
+            return false;
+        }
+    }
+
+    if (parser->query->ntests == parser->testcap){
+
+        parser->testcap = parser->testcap == 0 ? 8 : parser->testcap * 2;
+        parser->query->tests = realloc(parser->query->tests, sizeof(CalQueryTest) * parser->testcap);
+        assert(parser->query->tests);
+    }
+
+    parser->query->tests[parser->query->ntests] = test;
+    addQueryStep(parser, QTEST, parser->query->ntests++);
+
+    /* != holds where = doesn't, including where there is nothing to compare */
+    if (negate == true)
+        addQueryStep(parser, QNOT, 0);
+
+    return true;
+}
+
+char *readQueryName (QueryParser *parser){
+
+    const char * start;
+    char * name;
+    size_t i;
+
+    start = parser->pos;
+
+    while (isalnum((unsigned char) *parser->pos) || *parser->pos == '-' || *parser->pos == '_')
+        ++parser->pos;
+
+    if (parser->pos == start)
+        return NULL;
+
+    name = malloc(parser->pos - start + 1);
+    assert(name);
+
+    for (i = 0; i < (size_t)(parser->pos - start); ++i)
+        name[i] = toupper((unsigned char) start[i]);
+
+    name[i] = '\0';
+
+    return name;
+}
+
+char *readQueryValue (QueryParser *parser){
+
+    const char * start;
+    char * value;
+    size_t length;
+
+    /* A quoted value runs to the closing quote, with \" and \\ standing for the characters themselves */
+    if (*parser->pos == '"'){
+
+        start = ++parser->pos;
+
+        value = malloc(strlen(start) + 1);
+        assert(value);
+
+        length = 0;
+
+        while (*parser->pos != '"'){
+
+            if (*parser->pos == '\0'){
+
+                free(value);
+                parser->pos = start - 1;
+                return NULL;
+            }
+
+            if (*parser->pos == '\\' && (parser->pos[1] == '"' || parser->pos[1] == '\\'))
+                ++parser->pos;
+
+            value[length++] = *parser->pos++;
+        }
+
+        ++parser->pos;
+        value[length] = '\0';
+
+        return value;
+    }
+
+    /* A bare value runs to a space or a parenthesis */
+    start = parser->pos;
+
+    while (*parser->pos != '\0' && isspace((unsigned char) *parser->pos) == 0 && *parser->pos != '(' &&
+           *parser->pos != ')')
+        ++parser->pos;
+
+    if (parser->pos == start)
+        return NULL;
+
+    value = strndup(start, parser->pos - start);
+    assert(value);
+
+    return value;
+}
+
+bool readQueryWord (QueryParser *parser, const char *word){
+
+    const char * pos;
+    size_t length;
+
+    pos = parser->pos;
+
+    while (isspace((unsigned char) *pos))
+        ++pos;
+
+    length = strlen(word);
+
+    if (strncasecmp(pos, word, length) != 0 || isalnum((unsigned char) pos[length]) || pos[length] == '-' ||
+        pos[length] == '_' || pos[length] == '.')
+        return false;
+
+    parser->pos = pos + length;
+
+    return true;
+}
+
+int addQueryStep (QueryParser *parser, CalQueryCode code, int arg){
+
+    CalQuery * query;
+
+    query = parser->query;
+
+    if (query->nsteps == parser->stepcap){
+
+        parser->stepcap = parser->stepcap == 0 ? 16 : parser->stepcap * 2;
+        query->steps = realloc(query->steps, sizeof(CalQueryStep) * parser->stepcap);
+        assert(query->steps);
+    }
+
+    query->steps[query->nsteps].code = code;
+    query->steps[query->nsteps].arg = arg;
+
+    return query->nsteps++;
+}
+
+void pointQueryJumps (QueryParser *parser, int pending){
+
+    int next;
+
+    while (pending >= 0){
+
+        next = parser->query->steps[pending].arg;
+        parser->query->steps[pending].arg = parser->query->nsteps;
+        pending = next;
+    }
+}
+
+bool parseQueryDate (const char *text, time_t *from, time_t *to){
+
+    static const char *const formats[] = { "%Y-%m-%dT%H:%M:%S", "%Y-%m-%dT%H:%M", "%Y-%m-%d", "%Y%m%dT%H%M%S",
+                                           "%Y%m%d" };
+    const char * end;
+    struct tm tm;
+    bool utc;
+    int i;
+
+    for (i = 0; i < 5; ++i){
+
+        memset(&tm, 0, sizeof(struct tm));
+        tm.tm_isdst = -1;
+
+        end = strptime(text, formats[i], &tm);
+
+        if (end == NULL)
+            continue;
+
+        utc = *end == 'Z';
+
+        if (utc == true)
+            ++end;
+
+        if (*end != '\0')
+            continue;
+
+        *from = utc == true ? timegm(&tm) : mktime(&tm);
+
+        /* A date alone runs to the last second of the day, as -filter takes its end date */
+        if (strchr(formats[i], 'H') == NULL){
+
+            tm.tm_mday += 1;
+            tm.tm_isdst = -1;
+            *to = (utc == true ? timegm(&tm) : mktime(&tm)) - 1;
+        }
+
+        else{
+
+            *to = *from;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+bool runQueryTest (const CalQueryTest *test, const CalComp *cal, const CalTzSet *zones, const CalComp *comp){
+
+    const CalProp * prop;
+    const CalParam * param;
+    int i;
+
+    if (test->comp == true)
+        return strcmp(comp->name, test->name) == 0;
+
+    for (prop = comp->prop; prop != NULL; prop = prop->next){
+
+        if (prop->name[0] != test->name[0] || strcmp(prop->name, test->name) != 0)
+            continue;
+
+        if (test->param == NULL){
+
+            if (test->op == QPRESENT || matchQueryValue(test, cal, zones, prop, prop->value) == true)
+                return true;
+
+            continue;
+        }
+
+        for (param = getCalParams(prop); param != NULL; param = param->next){
+
+            if (strcmp(param->name, test->param) != 0)
+                continue;
+
+            if (test->op == QPRESENT)
+                return true;
+
+            for (i = 0; i < param->nvalues; ++i)
+                if (matchQueryValue(test, cal, zones, prop, param->value[i]) == true)
+                    return true;
+        }
+    }
+
+    return false;
+}
+
+bool matchQueryValue (const CalQueryTest *test, const CalComp *cal, const CalTzSet *zones, const CalProp *prop,
+                      const char *value){
+
+    time_t date;
+    long number;
+    char * end;
+    int order;
+
+    if (test->kind == QDATE){
+
+        if (calSnapEpoch(cal, prop, &date) == false)
+            date = calTzEpoch(zones, prop);
+
+        switch (test->op){
+
+            case QEQUAL:
+                return test->from <= date && date <= test->to;
+            case QLESS:
+                return date < test->from;
+            case QATMOST:
+                return date <= test->to;
+            case QMORE:
+                return date > test->to;
+            case QATLEAST:
+                return date >= test->from;
+            default:
+                return false;
+        }
+    }
+
+    if (test->kind == QNUMBER){
+
+        number = strtol(value, &end, 10);
+
+        if (end == value)
+            return false;
+
+        order = number < test->number ? -1 : number > test->number;
+    }
+
+    else if (test->op == QCONTAINS){
+
+        return strcasestr(value, test->text) != NULL;
+    }
+
+    else{
+
+        order = compareQueryText(value, test->text);
+    }
+
+    switch (test->op){
+
+        case QEQUAL:
+            return order == 0;
+        case QLESS:
+            return order < 0;
+        case QATMOST:
+            return order <= 0;
+        case QMORE:
+            return order > 0;
+        case QATLEAST:
+            return order >= 0;
+        default:
+            return false;
+    }
+}
+
+int compareQueryText (const char *value, const char *text){
+
+    size_t length, i;
+    int diff;
+
+    length = strlen(value);
+
+    if (length >= 2 && value[0] == '"' && value[length - 1] == '"'){
+
+        ++value;
+        length -= 2;
+    }
+
+    for (i = 0; i < length && text[i] != '\0'; ++i){
+
+        diff = tolower((unsigned char) value[i]) - tolower((unsigned char) text[i]);
+
+        if (diff != 0)
+            return diff;
+    }
+
+    if (i < length)
+        return 1;
+
+    return text[i] == '\0' ? 0 : -1;
+}
+
+bool inQueryList (const char *const *list, const char *name){
+
+    int i;
+
+    for (i = 0; list[i] != NULL; ++i)
+        if (strcmp(list[i], name) == 0)
+            return true;
+
+    return false;
+}
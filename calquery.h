@@ -0,0 +1,123 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calquery.h -- Public interface for compiled component queries in calquery.c
+Last updated:  Oct 19/26
+
+A query picks components by their name, properties and parameters:
+
+    comp=VEVENT and ORGANIZER.CN~"jen" and DTSTART>=2010-01-01
+
+A test is comp=NAME or comp!=NAME, or a property name, optionally with
+.PARAM after it, followed by one of = != ~ < <= > >= and a value (bare
+or in double quotes). A test with no operator asks if the property (or
+parameter) is there at all. Tests combine with and, or, not and
+parentheses; and binds tighter than or. A property test holds if any of
+the component's properties of that name (or any value of the parameter)
+satisfies it, except that != holds when none equals the value.
+
+Text compares ignoring case, and ~ asks if the value contains the text.
+Date properties (DTSTART, DTEND, DUE, ...) compare as times: the value
+is a date (2010-01-01, or 20100101) standing for the whole day, or a
+date and time (2010-01-01T09:30, 20100101T093000, with Z for UTC), in
+the local timezone unless given in UTC. Numeric properties (PRIORITY,
+SEQUENCE, ...) compare as numbers.
+
+calQueryCompile parses a query once into a list of tests and a short
+program of jumps over them, so and and or stop at the first test that
+settles them. Names are uppercased and dates and numbers converted
+then, and each property test knows how its values compare, so
+calQueryMatch only walks a component's properties and compares.
+********/
+
+#ifndef CALQUERY_H
+#define CALQUERY_H
+
+#include <stdbool.h>
+#include <time.h>
+#include "calutil.h"
+#include "caltz.h"
+
+typedef enum {          // what a test asks of the values it looks at
+    QPRESENT,   // there is one
+    QEQUAL,     // one equals the value (for a date, falls within it)
+    QCONTAINS,  // one contains the text
+    QLESS,      // one is before the value
+    QATMOST,    // one is not after it
+    QMORE,      // one is after it
+    QATLEAST,   // one is not before it
+} CalQueryOp;
+
+typedef enum {          // how a test compares
+    QTEXT,      // as text, ignoring case
+    QNUMBER,    // as whole numbers
+    QDATE,      // as calendar times
+} CalQueryKind;
+
+typedef struct {        // one test of a compiled query
+    bool comp;              // a comp= test, rather than one of the properties
+    char *name;             // the component or property name, uppercase
+    char *param;            // the parameter name, uppercase (NULL to test the property's value)
+    CalQueryOp op;
+    CalQueryKind kind;
+    char *text;             // QTEXT: the value (NULL for QPRESENT)
+    long number;            // QNUMBER: the value
+    time_t from, to;        // QDATE: the first and last second the value stands for
+} CalQueryTest;
+
+typedef enum {          // one step of a compiled query's program
+    QTEST,      // set the result to whether the component passes a test
+    QJUMPFALSE, // if the result is false, go to a later step
+    QJUMPTRUE,  // if the result is true, go to a later step
+    QNOT,       // negate the result
+} CalQueryCode;
+
+typedef struct {
+    CalQueryCode code;
+    int arg;                // QTEST: the test; QJUMPFALSE, QJUMPTRUE: the step to go to (nsteps to finish)
+} CalQueryStep;
+
+typedef struct {        // a query compiled by calQueryCompile
+    CalQueryTest *tests;
+    int ntests;
+    CalQueryStep *steps;
+    int nsteps;
+    bool dates;             // a test compares dates, so calQueryMatch needs the calendar's timezones
+} CalQuery;
+
+/*	Compile a query
+ *
+ * Arguments: the query text and the CalQuery to fill in
+ *
+ * Preconditions: none
+ * Postconditions: on success *query holds the compiled query, to be released with calQueryFree; on error nothing
+ *                 is kept
+ *
+ * Return val: OK, or SYNTAX with linefrom and lineto the column (from 1) where the query stopped making sense
+ * */
+CalStatus calQueryCompile( const char *expr, CalQuery *const query );
+
+/*	Check if a component satisfies a compiled query
+ *
+ * Arguments: the query, the calendar the component is in, the calendar's timezones and the component
+ *
+ * Preconditions: zones was built from cal by calTzBuild (it may be NULL unless query->dates is set)
+ * Postconditions: the parameters of properties tested are decoded, as getCalParams decodes them
+ *
+ * Return val: true if comp satisfies the query, false otherwise
+ * */
+bool calQueryMatch( const CalQuery *query, const CalComp *cal, const CalTzSet *zones, const CalComp *comp );
+
+/*	Release a compiled query
+ *
+ * Arguments: the CalQuery
+ *
+ * Preconditions: query was filled in by calQueryCompile
+ * Postconditions: its tests and program are free'd
+ *
+ * Return val: none
+ * */
+void calQueryFree( CalQuery *const query );
+
+#endif
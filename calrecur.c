@@ -0,0 +1,998 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calrecur.c -- Source code for recurrence expansion
+Last updated:  Oct 19/26
+********/
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "calrecur.h"
+
+static const char *const freqNames[] = { "", "SECONDLY", "MINUTELY", "HOURLY", "DAILY", "WEEKLY", "MONTHLY", "YEARLY" };
+static const char *const dayNames[] = { "SU", "MO", "TU", "WE", "TH", "FR", "SA" };
+
+/* Count the days from 1970-01-01 to a date of the Gregorian calendar
+ *
+ * Arguments: year, month (1-12) and day of the month (1-31)
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: no. of days, negative for dates before 1970
+ * */
+long recurDays (long year, int month, int mday);
+
+/* Get the date a wall-clock time falls on
+ *
+ * Arguments: the time as calRecurWall gives it
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: the date as days since 1970-01-01
+ * */
+long recurDay (time_t wall);
+
+/* Turn a day count from recurDays back into a date
+ *
+ * Arguments: no. of days since 1970-01-01 and where to put the year, month (1-12) and day of the month
+ *
+ * Preconditions: none
+ * Postconditions: *year, *month and *mday are set
+ *
+ * Return val: none
+ * */
+void recurDate (long days, long *year, int *month, int *mday);
+
+/* Get the day of the week of a day count from recurDays
+ *
+ * Arguments: no. of days since 1970-01-01
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: 0 for Sunday through 6 for Saturday
+ * */
+int recurWeekday (long days);
+
+/* Get the no. of days in a month
+ *
+ * Arguments: year and month (1-12)
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: 28 to 31
+ * */
+int recurMonthLength (long year, int month);
+
+/* Read an RRULE value into an iterator
+ *
+ * Arguments: iterator and the RRULE value
+ *
+ * Preconditions: recur's fields for the rule are at their defaults
+ * Postconditions: the rule's parts are stored in recur
+ *
+ * Return val: false if the rule can't be read or has a part that isn't understood, true otherwise
+ * */
+bool readRecurRule (CalRecur *recur, const char *rule);
+
+/* Read a comma separated list of numbers from a rule part
+ *
+ * Arguments: start and end of the part's value, the smallest and largest value allowed, whether 0 is allowed,
+ *            where to put the numbers and how many fit
+ *
+ * Preconditions: none
+ * Postconditions: the numbers are stored in values
+ *
+ * Return val: no. of numbers read, or -1 if the list can't be read
+ * */
+int readRecurList (const char *value, const char *end, int lowest, int highest, bool zero, int *values, int max);
+
+/* Read every date of the RDATE or EXDATE properties of a component
+ *
+ * Arguments: the component, the property name and where to put the dates
+ *
+ * Preconditions: *comp must be initialized
+ * Postconditions: *pdates is a malloc'd array of the dates in ascending order (or NULL if there are none)
+ *
+ * Return val: no. of dates
+ * */
+size_t readRecurDates (const CalComp *comp, const char *name, time_t **pdates);
+
+/* Move on to the rule's next period and mark its candidate dates
+ *
+ * Arguments: iterator
+ *
+ * Preconditions: recur->freq is RDAILY or longer
+ * Postconditions: recur->period is one more, recur->days holds its candidates; recur->ruleDone is set past CALRECUR_MAXYEAR
+ *
+ * Return val: none
+ * */
+void fillRecurPeriod (CalRecur *recur);
+
+/* Mark the candidate dates of one month for a MONTHLY or YEARLY rule
+ *
+ * Arguments: iterator, year and month (1-12)
+ *
+ * Preconditions: the month lies within the period starting at recur->periodday
+ * Postconditions: the month's dates picked by BYMONTHDAY and BYDAY (or DTSTART's day of the month) are marked
+ *
+ * Return val: none
+ * */
+void markRecurMonth (CalRecur *recur, long year, int month);
+
+/* Check a date against the rule parts that limit rather than expand
+ *
+ * Arguments: iterator, the date as days since 1970-01-01, and whether BYDAY limits too
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: true if the date passes BYMONTH, BYMONTHDAY and (if checkDay) BYDAY
+ * */
+bool recurLimits (const CalRecur *recur, long day, bool checkDay);
+
+/* Check whether BYDAY lists a weekday
+ *
+ * Arguments: iterator and weekday (0 for Sunday)
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: true if any BYDAY entry is on that weekday, whatever its ordinal
+ * */
+bool recurWeekdayListed (const CalRecur *recur, int wday);
+
+/* Get the next occurrence of the rule after DTSTART
+ *
+ * Arguments: iterator and where to put the occurrence
+ *
+ * Preconditions: none
+ * Postconditions: recur->emitted counts the occurrence; recur->ruleDone is set once COUNT, UNTIL or
+ *                 CALRECUR_MAXEMPTY ends the rule
+ *
+ * Return val: false if the rule has no more occurrences, true otherwise
+ * */
+bool nextRecurRule (CalRecur *recur, time_t *const occurrence);
+
+/* Get the wall-clock time of a time of day on a date
+ *
+ * Arguments: the date as days since 1970-01-01, and the hour, minute and second
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: the time as calRecurWall gives it
+ * */
+time_t recurTime (long day, int hour, int min, int sec);
+
+/* Find the first of a sorted array of times that isn't before a time
+ *
+ * Arguments: the array, its length and the time
+ *
+ * Preconditions: dates is in ascending order
+ * Postconditions: none
+ *
+ * Return val: index of the first time >= from, or n if there is none
+ * */
+size_t findRecurTime (const time_t *dates, size_t n, time_t from);
+
+/* Compare two times for qsort
+ *
+ * Arguments: both a and b are time_t * variables
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: negative, zero or positive as a is before, equal to or after b
+ * */
+int compareRecurTimes (const void *a, const void *b);
+
+bool calRecurInit( CalRecur *recur, const CalComp *comp, time_t dtstart ){
+
+    const CalProp * currentProp;
+    long year, seconds;
+    bool recurs;
+
+    memset(recur, 0, sizeof(CalRecur));
+
+    recur->dtstart = dtstart;
+    recur->startday = recurDay(dtstart);
+    recurDate(recur->startday, &year, &recur->startmonth, &recur->startmday);
+    recur->startyear = (int) year;
+    recur->startwday = recurWeekday(recur->startday);
+
+    seconds = (long) (dtstart - (time_t) recur->startday * 24 * 60 * 60);
+    recur->hour = (int) (seconds / 3600);
+    recur->min = (int) (seconds / 60 % 60);
+    recur->sec = (int) (seconds % 60);
+
+    recur->freq = RNONE;
+    recur->interval = 1;
+    recur->wkst = 1;
+    recur->period = -1;
+    recur->emitted = 1;
+    recurs = false;
+
+    /* Only the first rule counts; more than one is deprecated (RFC 5545 3.8.5.3) */
+    for (currentProp = comp->prop; currentProp != NULL; currentProp = currentProp->next){
+
+        if (strcmp(currentProp->name, "RRULE") == 0){
+
+            recurs = true;
+
+            if (readRecurRule(recur, currentProp->value) == false)
+                recur->freq = RNONE;
+
+            break;
+        }
+    }
+
+    recur->nrdates = readRecurDates(comp, "RDATE", &recur->rdates);
+    recur->nexdates = readRecurDates(comp, "EXDATE", &recur->exdates);
+
+    if (recur->nrdates > 0)
+        recurs = true;
+
+    recur->ruleDone = recur->freq == RNONE;
+
+    /* Nothing is skipped until calRecurSkip is called */
+    recur->from = dtstart;
+
+    if (recur->nrdates > 0 && recur->rdates[0] < recur->from)
+        recur->from = recur->rdates[0];
+
+    return recurs;
+}
+
+bool calRecurNext( CalRecur *recur, time_t *const occurrence ){
+
+    time_t next;
+    int source;
+
+    for (;;){
+
+        if (recur->hasPending == false && recur->ruleDone == false)
+            recur->hasPending = nextRecurRule(recur, &recur->pending);
+
+        /* Take the earliest of DTSTART, the rule's next occurrence and the next RDATE */
+        source = 0;
+        next = 0;
+
+        if (recur->started == false){
+
+            next = recur->dtstart;
+            source = 1;
+        }
+
+        if (recur->hasPending == true && (source == 0 || recur->pending < next)){
+
+            next = recur->pending;
+            source = 2;
+        }
+
+        if (recur->nextrdate < recur->nrdates && (source == 0 || recur->rdates[recur->nextrdate] < next)){
+
+            next = recur->rdates[recur->nextrdate];
+            source = 3;
+        }
+
+        if (source == 0)
+            return false;
+        else if (source == 1)
+            recur->started = true;
+        else if (source == 2)
+            recur->hasPending = false;
+        else
+            ++recur->nextrdate;
+
+        /* An RDATE may repeat an occurrence of the rule */
+        if (next < recur->from || (recur->hasLast == true && next == recur->last))
+            continue;
+
+        /* EXDATEs come in order too, so the ones passed are dropped as we go */
+        while (recur->nextexdate < recur->nexdates && recur->exdates[recur->nextexdate] < next)
+            ++recur->nextexdate;
+
+        if (recur->nextexdate < recur->nexdates && recur->exdates[recur->nextexdate] == next)
+            continue;
+
+        recur->last = next;
+        recur->hasLast = true;
+        *occurrence = next;
+
+        return true;
+    }
+}
+
+void calRecurSkip( CalRecur *recur, time_t from ){
+
+    long fromday, target, step, year;
+    int month, mday;
+
+    if (from <= recur->from)
+        return;
+
+    recur->from = from;
+
+    if (recur->nextrdate < recur->nrdates)
+        recur->nextrdate += findRecurTime(recur->rdates + recur->nextrdate, recur->nrdates - recur->nextrdate, from);
+
+    if (recur->nextexdate < recur->nexdates)
+        recur->nextexdate += findRecurTime(recur->exdates + recur->nextexdate, recur->nexdates - recur->nextexdate, from);
+
+    /* COUNT needs every occurrence before from counted, so those are still expanded (and dropped) one by one */
+    if (recur->ruleDone == true || recur->count != 0)
+        return;
+
+    fromday = recurDay(from);
+    recurDate(fromday, &year, &month, &mday);
+
+    switch (recur->freq){
+
+        case RSECONDLY:
+        case RMINUTELY:
+        case RHOURLY:
+            step = recur->interval * (recur->freq == RHOURLY ? 3600 : recur->freq == RMINUTELY ? 60 : 1);
+            target = (long) ((from - recur->dtstart) / step);
+            break;
+
+        case RDAILY:
+            target = (fromday - recur->startday) / recur->interval;
+            break;
+
+        case RWEEKLY:
+            target = (fromday - (recur->startday - (recur->startwday - recur->wkst + 7) % 7)) / 7 / recur->interval;
+            break;
+
+        case RMONTHLY:
+            target = (year * 12 + month - 1 - (recur->startyear * 12L + recur->startmonth - 1)) / recur->interval;
+            break;
+
+        default:
+            target = (year - recur->startyear) / recur->interval;
+            break;
+    }
+
+    /* Start again just before the period holding from; everything in the periods jumped over comes before it */
+    if (target - 1 > recur->period){
+
+        recur->period = target - 1;
+        memset(recur->days, 0, sizeof(recur->days));
+        recur->nextday = 0;
+        recur->empty = 0;
+        recur->hasPending = false;
+    }
+}
+
+bool calRecurBounded( const CalRecur *recur ){
+
+    return recur->freq == RNONE || recur->count != 0 || recur->hasUntil == true;
+}
+
+void calRecurFree( CalRecur *recur ){
+
+    free(recur->rdates);
+    free(recur->exdates);
+    recur->rdates = NULL;
+    recur->exdates = NULL;
+}
+
+time_t calRecurWall( const char *value ){
+
+    static const int widths[] = { 4, 2, 2, 2, 2, 2 };
+    long fields[] = { 1970, 1, 1, 0, 0, 0 };
+    int i, j;
+
+    /* YYYYMMDD, then THHMMSS for a DATE-TIME; whatever follows (Z, a comma, a PERIOD's slash) is left to the caller */
+    for (i = 0; i < 6; ++i){
+
+        if (i == 3){
+
+            if (*value != 'T')
+                break;
+
+            ++value;
+        }
+
+        for (j = 0; j < widths[i] && value[j] >= '0' && value[j] <= '9'; ++j)
+            ;
+
+        if (j < widths[i])
+            break;
+
+        for (fields[i] = 0, j = 0; j < widths[i]; ++j)
+            fields[i] = fields[i] * 10 + (value[j] - '0');
+
+        value += widths[i];
+    }
+
+    if (fields[1] < 1 || fields[1] > 12)
+        fields[1] = 1;
+
+    return (time_t) recurDays(fields[0], (int) fields[1], (int) fields[2]) * 24 * 60 * 60 + fields[3] * 3600 + fields[4] * 60 + fields[5];
+}
+
+long recurDay (time_t wall){
+
+    time_t day = 24 * 60 * 60;
+
+    return (long) (wall / day - (wall % day < 0));
+}
+
+long recurDays (long year, int month, int mday){
+
+    long era, yoe, doy;
+
+    /* Count from March so the leap day comes last (H. Hinnant's days_from_civil) */
+    year -= month <= 2;
+    era = (year >= 0 ? year : year - 399) / 400;
+    yoe = year - era * 400;
+    doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + mday - 1;
+
+    return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+void recurDate (long days, long *year, int *month, int *mday){
+
+    long era, doe, yoe, doy, mp;
+
+    days += 719468;
+    era = (days >= 0 ? days : days - 146096) / 146097;
+    doe = days - era * 146097;
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp = (5 * doy + 2) / 153;
+
+    *mday = (int) (doy - (153 * mp + 2) / 5 + 1);
+    *month = (int) (mp < 10 ? mp + 3 : mp - 9);
+    *year = yoe + era * 400 + (*month <= 2);
+}
+
+int recurWeekday (long days){
+
+    /* 1970-01-01 was a Thursday */
+    return (int) (((days + 4) % 7 + 7) % 7);
+}
+
+int recurMonthLength (long year, int month){
+
+    static const int lengths[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+    if (month == 2 && year % 4 == 0 && (year % 100 != 0 || year % 400 == 0))
+        return 29;
+
+    return lengths[month - 1];
+}
+
+bool readRecurRule (CalRecur *recur, const char *rule){
+
+    const char * part, * value, * end;
+    char * stop;
+    int months[12];
+    long number;
+    int i, n;
+
+    for (part = rule; *part != '\0'; part = *end == ';' ? end + 1 : end){
+
+        end = part + strcspn(part, ";");
+        value = memchr(part, '=', end - part);
+
+        if (value == NULL)
+            return false;
+
+        ++value;
+
+        if (strncmp(part, "FREQ=", 5) == 0){
+
+            for (i = RSECONDLY; i <= RYEARLY; ++i)
+                if (strlen(freqNames[i]) == (size_t) (end - value) && strncmp(value, freqNames[i], end - value) == 0)
+                    break;
+
+            if (i > RYEARLY)
+                return false;
+
+            recur->freq = i;
+        }
+
+        else if (strncmp(part, "INTERVAL=", 9) == 0 || strncmp(part, "COUNT=", 6) == 0){
+
+            number = strtol(value, &stop, 10);
+
+            if (stop != end || number < 1)
+                return false;
+
+            if (part[0] == 'I')
+                recur->interval = number;
+            else
+                recur->count = number;
+        }
+
+        /* A DATE value ends with its day */
+        else if (strncmp(part, "UNTIL=", 6) == 0){
+
+            recur->until = calRecurWall(value);
+            recur->hasUntil = true;
+            recur->untilUTC = end[-1] == 'Z';
+
+            if (memchr(value, 'T', end - value) == NULL)
+                recur->until += 24 * 60 * 60 - 1;
+        }
+
+        else if (strncmp(part, "BYMONTH=", 8) == 0){
+
+            n = readRecurList(value, end, 1, 12, false, months, 12);
+
+            if (n < 0)
+                return false;
+
+            for (i = 0; i < n; ++i)
+                recur->bymonth |= 1u << months[i];
+        }
+
+        else if (strncmp(part, "BYMONTHDAY=", 11) == 0){
+
+            recur->nbymonthday = readRecurList(value, end, -31, 31, false, recur->bymonthday, CALRECUR_MAXBY);
+
+            if (recur->nbymonthday < 0)
+                return false;
+        }
+
+        /* Each entry is a weekday with an optional ordinal in front, as in 2MO or -1FR */
+        else if (strncmp(part, "BYDAY=", 6) == 0){
+
+            for (n = 0; value < end; value = stop + (stop < end)){
+
+                if (n == CALRECUR_MAXBY)
+                    return false;
+
+                number = 0;
+                stop = (char *) value;
+
+                if (*value == '+' || *value == '-' || (*value >= '0' && *value <= '9')){
+
+                    number = strtol(value, &stop, 10);
+
+                    if (number == 0 || number < -53 || number > 53)
+                        return false;
+                }
+
+                for (i = 0; i < 7; ++i)
+                    if (end - stop >= 2 && strncmp(stop, dayNames[i], 2) == 0)
+                        break;
+
+                if (i == 7 || (stop + 2 != end && stop[2] != ','))
+                    return false;
+
+                recur->bydaywday[n] = i;
+                recur->bydayord[n] = (int) number;
+                ++n;
+                stop += 2;
+            }
+
+            recur->nbyday = n;
+        }
+
+        else if (strncmp(part, "WKST=", 5) == 0){
+
+            for (i = 0; i < 7; ++i)
+                if (end - value == 2 && strncmp(value, dayNames[i], 2) == 0)
+                    break;
+
+            if (i == 7)
+                return false;
+
+            recur->wkst = i;
+        }
+
+        /* Extensions can be ignored; BYSETPOS, BYHOUR and the like can't */
+        else if (strncmp(part, "X-", 2) != 0){
+
+            return false;
+        }
+    }
+
+    return recur->freq != RNONE;
+}
+
+int readRecurList (const char *value, const char *end, int lowest, int highest, bool zero, int *values, int max){
+
+    char * stop;
+    long number;
+    int n;
+
+    for (n = 0; value < end; value = stop + 1){
+
+        number = strtol(value, &stop, 10);
+
+        if (stop == value || stop > end || (stop != end && *stop != ',') || number < lowest || number > highest || (number == 0 && zero == false) || n == max)
+            return -1;
+
+        values[n] = (int) number;
+        ++n;
+
+        if (stop == end)
+            break;
+    }
+
+    return n;
+}
+
+size_t readRecurDates (const CalComp *comp, const char *name, time_t **pdates){
+
+    const CalProp * currentProp;
+    const char * value, * comma;
+    time_t * dates;
+    size_t n, cap;
+
+    dates = NULL;
+    n = 0;
+    cap = 0;
+
+    /* calRecurWall stops at the comma after each date, or at the slash of a PERIOD */
+    for (currentProp = comp->prop; currentProp != NULL; currentProp = currentProp->next){
+
+        if (strcmp(currentProp->name, name) != 0)
+            continue;
+
+        for (value = currentProp->value; value != NULL; value = comma != NULL ? comma + 1 : NULL){
+
+            comma = strchr(value, ',');
+
+            if (n == cap){
+
+                cap = cap == 0 ? 8 : cap * 2;
+                dates = realloc(dates, sizeof(time_t) * cap);
+                assert(dates);
+            }
+
+            dates[n] = calRecurWall(value);
+            ++n;
+        }
+    }
+
+    if (n > 1)
+        qsort(dates, n, sizeof(time_t), compareRecurTimes);
+
+    *pdates = dates;
+
+    return n;
+}
+
+void fillRecurPeriod (CalRecur *recur){
+
+    long year, index, length, last;
+    int month, first, i, n, d;
+
+    ++recur->period;
+    memset(recur->days, 0, sizeof(recur->days));
+    recur->nextday = 0;
+
+    switch (recur->freq){
+
+        case RDAILY:
+            recur->periodday = recur->startday + recur->period * recur->interval;
+
+            if (recurLimits(recur, recur->periodday, true) == true)
+                recur->days[0] = 1;
+            break;
+
+        /* BYDAY picks the days of the week, or the week repeats DTSTART's */
+        case RWEEKLY:
+            recur->periodday = recur->startday - (recur->startwday - recur->wkst + 7) % 7 + 7 * recur->period * recur->interval;
+
+            for (i = 0; i < 7; ++i){
+
+                d = recurWeekday(recur->periodday + i);
+
+                if ((recur->nbyday == 0 ? d == recur->startwday : recurWeekdayListed(recur, d)) && recurLimits(recur, recur->periodday + i, false) == true)
+                    recur->days[0] |= 1ull << i;
+            }
+            break;
+
+        case RMONTHLY:
+            index = recur->startyear * 12L + recur->startmonth - 1 + recur->period * recur->interval;
+            year = index / 12;
+            month = (int) (index % 12) + 1;
+            recur->periodday = recurDays(year, month, 1);
+
+            if (recur->bymonth == 0 || (recur->bymonth & (1u << month)) != 0)
+                markRecurMonth(recur, year, month);
+            break;
+
+        default:
+            year = recur->startyear + recur->period * recur->interval;
+            recur->periodday = recurDays(year, 1, 1);
+
+            /* BYDAY alone counts its ordinals through the whole year */
+            if (recur->nbyday > 0 && recur->nbymonthday == 0 && recur->bymonth == 0){
+
+                length = recurDays(year + 1, 1, 1) - recur->periodday;
+
+                for (n = 0; n < recur->nbyday; ++n){
+
+                    first = (recur->bydaywday[n] - recurWeekday(recur->periodday) + 7) % 7;
+                    last = length - 1 - (recurWeekday(recur->periodday + length - 1) - recur->bydaywday[n] + 7) % 7;
+
+                    if (recur->bydayord[n] == 0)
+                        for (i = first; i < length; i += 7)
+                            recur->days[i / 64] |= 1ull << (i % 64);
+
+                    else if (recur->bydayord[n] > 0 && first + 7 * (recur->bydayord[n] - 1) < length){
+
+                        i = first + 7 * (recur->bydayord[n] - 1);
+                        recur->days[i / 64] |= 1ull << (i % 64);
+                    }
+
+                    else if (recur->bydayord[n] < 0 && last + 7 * (recur->bydayord[n] + 1) >= 0){
+
+                        i = (int) (last + 7 * (recur->bydayord[n] + 1));
+                        recur->days[i / 64] |= 1ull << (i % 64);
+                    }
+                }
+            }
+
+            /* Otherwise month by month: BYMONTH's, every month for BYMONTHDAY, or DTSTART's */
+            else{
+
+                for (month = 1; month <= 12; ++month)
+                    if (recur->bymonth != 0 ? (recur->bymonth & (1u << month)) != 0 : recur->nbymonthday > 0 || month == recur->startmonth)
+                        markRecurMonth(recur, year, month);
+            }
+            break;
+    }
+
+    if (recur->periodday > recurDays(CALRECUR_MAXYEAR, 12, 31))
+        recur->ruleDone = true;
+}
+
+void markRecurMonth (CalRecur *recur, long year, int month){
+
+    long first;
+    int offset, length, i, n, d, last;
+
+    first = recurDays(year, month, 1);
+    offset = (int) (first - recur->periodday);
+    length = recurMonthLength(year, month);
+
+    /* Days of the month, negative ones counting back from its end; BYDAY then only limits */
+    if (recur->nbymonthday > 0){
+
+        for (n = 0; n < recur->nbymonthday; ++n){
+
+            d = recur->bymonthday[n] > 0 ? recur->bymonthday[n] : length + recur->bymonthday[n] + 1;
+
+            if (d >= 1 && d <= length && (recur->nbyday == 0 || recurWeekdayListed(recur, recurWeekday(first + d - 1)))){
+
+                i = offset + d - 1;
+                recur->days[i / 64] |= 1ull << (i % 64);
+            }
+        }
+    }
+
+    /* Weekdays of the month: every one, the nth, or the nth from the end */
+    else if (recur->nbyday > 0){
+
+        for (n = 0; n < recur->nbyday; ++n){
+
+            d = (recur->bydaywday[n] - recurWeekday(first) + 7) % 7;
+            last = length - 1 - (recurWeekday(first + length - 1) - recur->bydaywday[n] + 7) % 7;
+
+            if (recur->bydayord[n] == 0){
+
+                for (; d < length; d += 7){
+
+                    i = offset + d;
+                    recur->days[i / 64] |= 1ull << (i % 64);
+                }
+            }
+
+            else if (recur->bydayord[n] > 0 && d + 7 * (recur->bydayord[n] - 1) < length){
+
+                i = offset + d + 7 * (recur->bydayord[n] - 1);
+                recur->days[i / 64] |= 1ull << (i % 64);
+            }
+
+            else if (recur->bydayord[n] < 0 && last + 7 * (recur->bydayord[n] + 1) >= 0){
+
+                i = offset + last + 7 * (recur->bydayord[n] + 1);
+                recur->days[i / 64] |= 1ull << (i % 64);
+            }
+        }
+    }
+
+    /* DTSTART's day, skipped in months too short to have it */
+    else if (recur->startmday <= length){
+
+        i = offset + recur->startmday - 1;
+        recur->days[i / 64] |= 1ull << (i % 64);
+    }
+}
+
+bool recurLimits (const CalRecur *recur, long day, bool checkDay){
+
+    long year;
+    int month, mday, length, n;
+
+    recurDate(day, &year, &month, &mday);
+
+    if (recur->bymonth != 0 && (recur->bymonth & (1u << month)) == 0)
+        return false;
+
+    if (recur->nbymonthday > 0){
+
+        length = recurMonthLength(year, month);
+
+        for (n = 0; n < recur->nbymonthday; ++n)
+            if (recur->bymonthday[n] == mday || recur->bymonthday[n] == mday - length - 1)
+                break;
+
+        if (n == recur->nbymonthday)
+            return false;
+    }
+
+    return checkDay == false || recur->nbyday == 0 || recurWeekdayListed(recur, recurWeekday(day));
+}
+
+bool recurWeekdayListed (const CalRecur *recur, int wday){
+
+    int n;
+
+    for (n = 0; n < recur->nbyday; ++n)
+        if (recur->bydaywday[n] == wday)
+            return true;
+
+    return false;
+}
+
+bool nextRecurRule (CalRecur *recur, time_t *const occurrence){
+
+    time_t next;
+    uint64_t word;
+    long day, step;
+    int i;
+
+    while (recur->ruleDone == false){
+
+        /* DTSTART is the first of COUNT */
+        if (recur->count != 0 && recur->emitted >= recur->count){
+
+            recur->ruleDone = true;
+            break;
+        }
+
+        /* Rules shorter than a day step through time itself, BY parts only limiting */
+        if (recur->freq <= RHOURLY){
+
+            step = recur->interval * (recur->freq == RHOURLY ? 3600 : recur->freq == RMINUTELY ? 60 : 1);
+            ++recur->period;
+            next = recur->dtstart + (time_t) recur->period * step;
+
+            if (recur->hasUntil == true && next > recur->until){
+
+                recur->ruleDone = true;
+                break;
+            }
+
+            day = recurDay(next);
+
+            if (day > recurDays(CALRECUR_MAXYEAR, 12, 31)){
+
+                recur->ruleDone = true;
+                break;
+            }
+
+            if (next <= recur->dtstart)
+                continue;
+
+            /* A date the BY parts rule out is passed over whole, so it counts once towards CALRECUR_MAXEMPTY */
+            if (recurLimits(recur, day, true) == false){
+
+                recur->period = (long) ((recurTime(day + 1, 0, 0, 0) - recur->dtstart + step - 1) / step) - 1;
+
+                if (++recur->empty > CALRECUR_MAXEMPTY)
+                    recur->ruleDone = true;
+
+                continue;
+            }
+
+            recur->empty = 0;
+            ++recur->emitted;
+            *occurrence = next;
+
+            return true;
+        }
+
+        /* Find the next marked date of the period, a word of the mask at a time */
+        for (i = recur->nextday; i < CALRECUR_MAXDAYS; i = (i / 64 + 1) * 64){
+
+            word = recur->days[i / 64] >> (i % 64);
+
+            if (word != 0){
+
+                i += __builtin_ctzll(word);
+                break;
+            }
+        }
+
+        if (i >= CALRECUR_MAXDAYS){
+
+            fillRecurPeriod(recur);
+
+            for (i = 0; i < (CALRECUR_MAXDAYS + 63) / 64 && recur->days[i] == 0; ++i)
+                ;
+
+            if (i < (CALRECUR_MAXDAYS + 63) / 64)
+                recur->empty = 0;
+            else if (++recur->empty > CALRECUR_MAXEMPTY)
+                recur->ruleDone = true;
+
+            continue;
+        }
+
+        recur->nextday = i + 1;
+        day = recur->periodday + i;
+
+        /* The first period may start before DTSTART */
+        if (day < recur->startday)
+            continue;
+
+        next = recurTime(day, recur->hour, recur->min, recur->sec);
+
+        if (next <= recur->dtstart)
+            continue;
+
+        if (recur->hasUntil == true && next > recur->until){
+
+            recur->ruleDone = true;
+            break;
+        }
+
+        ++recur->emitted;
+        *occurrence = next;
+
+        return true;
+    }
+
+    return false;
+}
+
+time_t recurTime (long day, int hour, int min, int sec){
+
+    return (time_t) day * 24 * 60 * 60 + hour * 3600 + min * 60 + sec;
+}
+
+size_t findRecurTime (const time_t *dates, size_t n, time_t from){
+
+    size_t low, high, mid;
+
+    low = 0;
+    high = n;
+
+    while (low < high){
+
+        mid = low + (high - low) / 2;
+
+        if (dates[mid] < from)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+int compareRecurTimes (const void *a, const void *b){
+
+    time_t castA = *(const time_t *) a;
+    time_t castB = *(const time_t *) b;
+
+    return castA < castB ? -1 : castA > castB;
+}
@@ -0,0 +1,154 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calrecur.h -- Public interface for recurrence expansion in calrecur.c
+Last updated:  Oct 19/26
+
+A component's DTSTART, RRULE, RDATE and EXDATE properties are expanded
+into its occurrences one at a time, in order, so a series with no end
+is never held in memory. Only one period of the rule (a day, week,
+month or year, as a bitmask of its dates) is kept at once, and calRecurSkip
+jumps straight to the period holding a given time unless COUNT makes
+every earlier occurrence matter.
+
+The rule parts understood are FREQ, INTERVAL, COUNT, UNTIL, BYDAY,
+BYMONTHDAY, BYMONTH and WKST. A rule with any other BY part (BYSETPOS,
+BYHOUR, BYYEARDAY...) or one that can't be read isn't expanded: the
+component then occurs at DTSTART and its RDATEs only. Times are
+wall-clock times, counted in seconds from 1970-01-01 as if the
+component's zone were UTC (see calRecurWall), so the rule's dates never
+need a libc timezone call; caltz turns them into calendar times.
+********/
+
+#ifndef CALRECUR_H
+#define CALRECUR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "calutil.h"
+
+#define CALRECUR_MAXDAYS 366    // most days one period covers (a year)
+#define CALRECUR_MAXBY 64       // most values in a BYDAY or BYMONTHDAY list
+#define CALRECUR_MAXEMPTY 10000 // periods in a row without an occurrence before a rule is taken to have no more
+#define CALRECUR_MAXYEAR 9999   // last year a rule is expanded into
+
+typedef enum {
+    RNONE,      // no rule, or one that isn't expanded
+    RSECONDLY,
+    RMINUTELY,
+    RHOURLY,
+    RDAILY,
+    RWEEKLY,
+    RMONTHLY,
+    RYEARLY,
+} CalFreq;
+
+typedef struct {        // occurrences of one component, see calRecurInit
+    time_t dtstart;         // first occurrence
+    long startday;          // DTSTART's date as days since 1970-01-01
+    int startyear, startmonth, startmday, startwday;
+    int hour, min, sec;     // DTSTART's time of day
+
+    CalFreq freq;           // the rule (RNONE if there is none)
+    long interval;
+    long count;             // COUNT, 0 for none
+    time_t until;           // UNTIL, if hasUntil
+    bool hasUntil;
+    bool untilUTC;          // UNTIL was given in UTC: until is a calendar time the caller must make wall-clock
+    unsigned bymonth;       // bit m set for each month m in BYMONTH, 0 for none
+    int nbyday, nbymonthday;
+    int bydaywday[CALRECUR_MAXBY];  // BYDAY weekdays, 0 for SU
+    int bydayord[CALRECUR_MAXBY];   // and their ordinals (-1 for the last...), 0 for every one
+    int bymonthday[CALRECUR_MAXBY];
+    int wkst;               // first day of the week, 0 for SU
+
+    time_t *rdates, *exdates;       // sorted
+    size_t nrdates, nexdates, nextrdate, nextexdate;
+
+    long period;            // the rule's period the candidates are from, -1 before the first
+    long periodday;         // first date of that period as days since 1970-01-01
+    uint64_t days[(CALRECUR_MAXDAYS + 63) / 64];    // bit i set if the period's date i is a candidate
+    int nextday;            // first of the period's dates not yet looked at
+    long empty;             // periods in a row that held no candidates
+    long emitted;           // rule occurrences so far, DTSTART included
+    bool ruleDone;          // no more rule occurrences
+    time_t pending;         // next rule occurrence, if hasPending
+    bool hasPending;
+    bool started;           // DTSTART has been returned or skipped
+    time_t from;            // occurrences before this are skipped
+    time_t last;            // last occurrence returned, if hasLast
+    bool hasLast;
+} CalRecur;
+
+/*	Read a DATE or DATE-TIME value as a wall-clock time
+ *
+ * Arguments: the value
+ *
+ * Preconditions: value is not NULL
+ * Postconditions: none
+ *
+ * Return val: seconds from 1970-01-01T000000 to the date and time written, as if both were UTC; a trailing
+ *             Z or anything after the value is ignored, and a part that can't be read counts from 1970-01-01
+ * */
+time_t calRecurWall( const char *value );
+
+/*	Start iterating over the occurrences of a component
+ *
+ * Arguments: iterator to set up, the component, and the wall-clock time of its DTSTART
+ *
+ * Preconditions: *comp must be initialized
+ * Postconditions: recur is ready for calRecurNext and must be released with calRecurFree
+ *
+ * Return val: true if the component recurs (it has an RRULE or RDATE), false if it only occurs at DTSTART
+ * */
+bool calRecurInit( CalRecur *recur, const CalComp *comp, time_t dtstart );
+
+/*	Get the next occurrence
+ *
+ * Arguments: iterator and where to put the occurrence
+ *
+ * Preconditions: recur was set up by calRecurInit
+ * Postconditions: *occurrence is the wall-clock time of the next occurrence not removed by an EXDATE
+ *
+ * Return val: false once there are no more occurrences, true otherwise
+ * */
+bool calRecurNext( CalRecur *recur, time_t *const occurrence );
+
+/*	Skip the occurrences before a time
+ *
+ * Arguments: iterator and the time to skip to
+ *
+ * Preconditions: recur was set up by calRecurInit
+ * Postconditions: calRecurNext returns no occurrence before from; without COUNT the rule's earlier periods
+ *                 aren't expanded at all
+ *
+ * Return val: none
+ * */
+void calRecurSkip( CalRecur *recur, time_t from );
+
+/*	Check whether a component's occurrences end
+ *
+ * Arguments: iterator
+ *
+ * Preconditions: recur was set up by calRecurInit
+ * Postconditions: none
+ *
+ * Return val: false if the component has a rule with neither COUNT nor UNTIL, true otherwise
+ * */
+bool calRecurBounded( const CalRecur *recur );
+
+/*	Release an iterator
+ *
+ * Arguments: iterator
+ *
+ * Preconditions: recur was set up by calRecurInit
+ * Postconditions: what calRecurInit allocated is free'd
+ *
+ * Return val: none
+ * */
+void calRecurFree( CalRecur *recur );
+
+#endif
@@ -0,0 +1,635 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calscan.c -- Source code for the delimiter scanning kernels
+Last updated:  Oct 19/26
+********/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "calscan.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+typedef struct {        // one implementation of the kernels
+    const char *name;
+    uint64_t (*mask)( const char *block, const char *set, int nset );
+    size_t (*find)( const char *text, size_t len, const char *set, int nset );
+    size_t (*space)( const char *text, size_t len );
+    void (*upper)( char *text, size_t len );
+    size_t (*plain)( const char *text, size_t len );
+} ScanKernels;
+
+/* Scalar kernels, used on any CPU
+ *
+ * Arguments, preconditions and return val: as for calScanMask, calScanFind, calScanSpace and calScanUpper;
+ * the plain kernels return the index of the first byte that isn't printable ASCII or a tab, or len
+ * */
+uint64_t scanMaskScalar (const char *block, const char *set, int nset);
+size_t scanFindScalar (const char *text, size_t len, const char *set, int nset);
+size_t scanSpaceScalar (const char *text, size_t len);
+void scanUpperScalar (char *text, size_t len);
+size_t scanPlainScalar (const char *text, size_t len);
+
+static const ScanKernels scalarKernels = { "scalar", scanMaskScalar, scanFindScalar, scanSpaceScalar, scanUpperScalar, scanPlainScalar };
+
+#ifdef SCAN_X86
+
+/* SSE2 and AVX2 kernels; the AVX2 ones are compiled for AVX2 on their own so the rest of the
+ * program still runs on CPUs without it
+ *
+ * Arguments, preconditions and return val: as for the scalar kernels
+ * */
+uint64_t scanMaskSse2 (const char *block, const char *set, int nset);
+size_t scanFindSse2 (const char *text, size_t len, const char *set, int nset);
+size_t scanSpaceSse2 (const char *text, size_t len);
+void scanUpperSse2 (char *text, size_t len);
+size_t scanPlainSse2 (const char *text, size_t len);
+uint64_t scanMaskAvx2 (const char *block, const char *set, int nset) __attribute__((target("avx2")));
+size_t scanFindAvx2 (const char *text, size_t len, const char *set, int nset) __attribute__((target("avx2")));
+size_t scanSpaceAvx2 (const char *text, size_t len) __attribute__((target("avx2")));
+void scanUpperAvx2 (char *text, size_t len) __attribute__((target("avx2")));
+size_t scanPlainAvx2 (const char *text, size_t len) __attribute__((target("avx2")));
+
+static const ScanKernels sse2Kernels = { "sse2", scanMaskSse2, scanFindSse2, scanSpaceSse2, scanUpperSse2, scanPlainSse2 };
+static const ScanKernels avx2Kernels = { "avx2", scanMaskAvx2, scanFindAvx2, scanSpaceAvx2, scanUpperAvx2, scanPlainAvx2 };
+
+#endif
+
+static const ScanKernels *kernels = &scalarKernels;   // replaced by the best the CPU supports at startup
+
+/* Choose the kernels for this CPU before main (or when the library is loaded), so threads never race to choose them
+ *
+ * Arguments: none
+ *
+ * Preconditions: none
+ * Postconditions: kernels points at the best kernels the CPU supports
+ *
+ * Return val: none
+ * */
+void chooseScanKernels (void) __attribute__((constructor));
+
+/* Mask the block an iterator is on, padding a short last block
+ *
+ * Arguments: iterator
+ *
+ * Preconditions: iter->block < iter->len
+ * Postconditions: none
+ *
+ * Return val: delimiter mask of the block
+ * */
+uint64_t scanBlock (const CalScanIter *iter);
+
+/* Measure the UTF-8 sequence that starts with a non-ASCII byte
+ *
+ * Arguments: start of the sequence and the no. of bytes left in the text
+ *
+ * Preconditions: len >= 1 and text[0] >= 0x80
+ * Postconditions: none
+ *
+ * Return val: length of the sequence (2 to 4), or 0 if it isn't valid UTF-8
+ * */
+int scanUtf8 (const unsigned char *text, size_t len);
+
+uint64_t calScanMask( const char *block, const char *set, int nset ){
+
+    return kernels->mask(block, set, nset);
+}
+
+size_t calScanFind( const char *text, size_t len, const char *set, int nset ){
+
+    return kernels->find(text, len, set, nset);
+}
+
+void calScanStart( CalScanIter *const iter, const char *text, size_t len, const char *set, int nset ){
+
+    iter->text = text;
+    iter->len = len;
+    iter->set = set;
+    iter->nset = nset;
+    iter->block = 0;
+    iter->mask = 0;
+
+    if (len > 0)
+        iter->mask = scanBlock(iter);
+}
+
+size_t calScanNext( CalScanIter *const iter ){
+
+    size_t pos;
+
+    /* Move on to the next block that has a delimiter in it */
+    while (iter->mask == 0){
+
+        iter->block += CALSCAN_BLOCK;
+
+        if (iter->block >= iter->len)
+            return iter->len;
+
+        iter->mask = scanBlock(iter);
+    }
+
+    pos = iter->block + __builtin_ctzll(iter->mask);
+    iter->mask &= iter->mask - 1;   // Clear the lowest bit
+
+    return pos;
+}
+
+size_t calScanSpace( const char *text, size_t len ){
+
+    return kernels->space(text, len);
+}
+
+void calScanUpper( char *text, size_t len ){
+
+    kernels->upper(text, len);
+}
+
+size_t calScanText( const char *text, size_t len ){
+
+    size_t pos;
+    int seq;
+
+    pos = 0;
+
+    /* Skip printable ASCII a vector at a time and decode whatever stops the kernel */
+    while ((pos += kernels->plain(text + pos, len - pos)) < len){
+
+        if ((unsigned char) text[pos] < 0x80)
+            return pos;     // control character
+
+        seq = scanUtf8((const unsigned char *) text + pos, len - pos);
+
+        if (seq == 0)
+            return pos;
+
+        pos += seq;
+    }
+
+    return len;
+}
+
+bool calScanSelect( const char *name ){
+
+    bool automatic;
+
+    automatic = strcmp(name, "auto") == 0;
+
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+
+    if ((automatic == true || strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2")){
+
+        kernels = &avx2Kernels;
+        return true;
+    }
+
+    if ((automatic == true || strcmp(name, "sse2") == 0) && __builtin_cpu_supports("sse2")){
+
+        kernels = &sse2Kernels;
+        return true;
+    }
+#endif
+
+    if (automatic == true || strcmp(name, "scalar") == 0){
+
+        kernels = &scalarKernels;
+        return true;
+    }
+
+    return false;
+}
+
+const char *calScanName( void ){
+
+    return kernels->name;
+}
+
+void chooseScanKernels (void){
+
+    calScanSelect("auto");
+}
+
+uint64_t scanBlock (const CalScanIter *iter){
+
+    char padded[CALSCAN_BLOCK];
+    size_t left;
+
+    left = iter->len - iter->block;
+
+    if (left >= CALSCAN_BLOCK)
+        return calScanMask(iter->text + iter->block, iter->set, iter->nset);
+
+    /* Delimiters are never '\0', so the zero padding can't match */
+    memset(padded, 0, CALSCAN_BLOCK);
+    memcpy(padded, iter->text + iter->block, left);
+
+    return calScanMask(padded, iter->set, iter->nset);
+}
+
+int scanUtf8 (const unsigned char *text, size_t len){
+
+    int need, i;
+    unsigned char low, high;
+
+    /* Lead byte gives the length; the second byte's range rules out overlongs, surrogates and > U+10FFFF */
+    low = 0x80;
+    high = 0xBF;
+
+    if (text[0] >= 0xC2 && text[0] <= 0xDF)
+        need = 2;
+    else if (text[0] >= 0xE0 && text[0] <= 0xEF){
+        need = 3;
+        if (text[0] == 0xE0)
+            low = 0xA0;
+        else if (text[0] == 0xED)
+            high = 0x9F;
+    }
+    else if (text[0] >= 0xF0 && text[0] <= 0xF4){
+        need = 4;
+        if (text[0] == 0xF0)
+            low = 0x90;
+        else if (text[0] == 0xF4)
+            high = 0x8F;
+    }
+    else
+        return 0;
+
+    if (len < need || text[1] < low || text[1] > high)
+        return 0;
+
+    for (i = 2; i < need; ++i){
+
+        if (text[i] < 0x80 || text[i] > 0xBF)
+            return 0;
+    }
+
+    return need;
+}
+
+uint64_t scanMaskScalar (const char *block, const char *set, int nset){
+
+    uint64_t mask;
+    int i, k;
+
+    mask = 0;
+
+    for (i = 0; i < CALSCAN_BLOCK; ++i){
+
+        for (k = 0; k < nset; ++k){
+
+            if (block[i] == set[k])
+                mask |= (uint64_t) 1 << i;
+        }
+    }
+
+    return mask;
+}
+
+size_t scanFindScalar (const char *text, size_t len, const char *set, int nset){
+
+    size_t i;
+    int k;
+
+    for (i = 0; i < len; ++i){
+
+        for (k = 0; k < nset; ++k){
+
+            if (text[i] == set[k])
+                return i;
+        }
+    }
+
+    return len;
+}
+
+size_t scanSpaceScalar (const char *text, size_t len){
+
+    size_t i;
+
+    for (i = 0; i < len; ++i){
+
+        if (text[i] != ' ' && (text[i] < '\t' || text[i] > '\r'))
+            return i;
+    }
+
+    return len;
+}
+
+void scanUpperScalar (char *text, size_t len){
+
+    size_t i;
+
+    for (i = 0; i < len; ++i){
+
+        if (text[i] >= 'a' && text[i] <= 'z')
+            text[i] -= 'a' - 'A';
+    }
+}
+
+size_t scanPlainScalar (const char *text, size_t len){
+
+    size_t i;
+
+    for (i = 0; i < len; ++i){
+
+        if ((text[i] < ' ' || text[i] > '~') && text[i] != '\t')
+            return i;
+    }
+
+    return len;
+}
+
+#ifdef SCAN_X86
+
+/* Compare 16 bytes against four delimiters (short sets repeat their first byte)
+ *
+ * Arguments: the bytes and the broadcast delimiters
+ *
+ * Preconditions: 16 bytes are readable at p
+ * Postconditions: none
+ *
+ * Return val: 16-bit mask of matching bytes
+ * */
+static inline unsigned scanSse2Step (const char *p, const __m128i *delims){
+
+    __m128i bytes, hits;
+
+    bytes = _mm_loadu_si128((const __m128i *) p);
+
+    hits = _mm_or_si128(_mm_cmpeq_epi8(bytes, delims[0]), _mm_cmpeq_epi8(bytes, delims[1]));
+    hits = _mm_or_si128(hits, _mm_or_si128(_mm_cmpeq_epi8(bytes, delims[2]), _mm_cmpeq_epi8(bytes, delims[3])));
+
+    return (unsigned) _mm_movemask_epi8(hits);
+}
+
+uint64_t scanMaskSse2 (const char *block, const char *set, int nset){
+
+    __m128i delims[CALSCAN_MAXSET];
+    int k;
+
+    for (k = 0; k < CALSCAN_MAXSET; ++k)
+        delims[k] = _mm_set1_epi8(set[k < nset ? k : 0]);
+
+    return (uint64_t) scanSse2Step(block, delims) | (uint64_t) scanSse2Step(block + 16, delims) << 16 |
+           (uint64_t) scanSse2Step(block + 32, delims) << 32 | (uint64_t) scanSse2Step(block + 48, delims) << 48;
+}
+
+size_t scanFindSse2 (const char *text, size_t len, const char *set, int nset){
+
+    __m128i delims[CALSCAN_MAXSET];
+    unsigned mask;
+    size_t pos;
+    int k;
+
+    for (k = 0; k < CALSCAN_MAXSET; ++k)
+        delims[k] = _mm_set1_epi8(set[k < nset ? k : 0]);
+
+    for (pos = 0; pos + 16 <= len; pos += 16){
+
+        mask = scanSse2Step(text + pos, delims);
+
+        if (mask != 0)
+            return pos + __builtin_ctz(mask);
+    }
+
+    /* Fewer than 16 bytes left */
+    return pos + scanFindScalar(text + pos, len - pos, set, nset);
+}
+
+/* Mark the bytes that are either one given byte or inside a range, 16 at a time; the space and plain
+ * kernels are both a byte plus a range (' ' plus \t-\r, and \t plus ' '-'~')
+ *
+ * Arguments: the bytes and the broadcast constants: the single byte, the start of the range and its span
+ *
+ * Preconditions: 16 bytes are readable at p
+ * Postconditions: none
+ *
+ * Return val: 16-bit mask of matching bytes
+ * */
+static inline unsigned scanSse2Class (const char *p, const __m128i *consts){
+
+    __m128i bytes, off;
+
+    bytes = _mm_loadu_si128((const __m128i *) p);
+
+    /* bytes - start <= span as unsigned bytes */
+    off = _mm_sub_epi8(bytes, consts[1]);
+
+    return (unsigned) _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(bytes, consts[0]), _mm_cmpeq_epi8(_mm_min_epu8(off, consts[2]), off)));
+}
+
+size_t scanSpaceSse2 (const char *text, size_t len){
+
+    __m128i consts[3];
+    unsigned mask;
+    size_t pos;
+
+    consts[0] = _mm_set1_epi8(' ');
+    consts[1] = _mm_set1_epi8('\t');
+    consts[2] = _mm_set1_epi8('\r' - '\t');
+
+    for (pos = 0; pos + 16 <= len; pos += 16){
+
+        mask = scanSse2Class(text + pos, consts) ^ 0xFFFF;
+
+        if (mask != 0)
+            return pos + __builtin_ctz(mask);
+    }
+
+    return pos + scanSpaceScalar(text + pos, len - pos);
+}
+
+void scanUpperSse2 (char *text, size_t len){
+
+    __m128i bytes, off, start, span, diff;
+    size_t pos;
+
+    start = _mm_set1_epi8('a');
+    span = _mm_set1_epi8('z' - 'a');
+    diff = _mm_set1_epi8('a' - 'A');
+
+    for (pos = 0; pos + 16 <= len; pos += 16){
+
+        bytes = _mm_loadu_si128((const __m128i *) (text + pos));
+        off = _mm_sub_epi8(bytes, start);
+        off = _mm_cmpeq_epi8(_mm_min_epu8(off, span), off);
+        _mm_storeu_si128((__m128i *) (text + pos), _mm_sub_epi8(bytes, _mm_and_si128(off, diff)));
+    }
+
+    scanUpperScalar(text + pos, len - pos);
+}
+
+size_t scanPlainSse2 (const char *text, size_t len){
+
+    __m128i consts[3];
+    unsigned mask;
+    size_t pos;
+
+    consts[0] = _mm_set1_epi8('\t');
+    consts[1] = _mm_set1_epi8(' ');
+    consts[2] = _mm_set1_epi8('~' - ' ');
+
+    for (pos = 0; pos + 16 <= len; pos += 16){
+
+        mask = scanSse2Class(text + pos, consts) ^ 0xFFFF;
+
+        if (mask != 0)
+            return pos + __builtin_ctz(mask);
+    }
+
+    return pos + scanPlainScalar(text + pos, len - pos);
+}
+
+/* Compare 32 bytes against four delimiters (short sets repeat their first byte)
+ *
+ * Arguments: the bytes and the broadcast delimiters
+ *
+ * Preconditions: 32 bytes are readable at p
+ * Postconditions: none
+ *
+ * Return val: 32-bit mask of matching bytes
+ * */
+__attribute__((target("avx2"))) static inline uint32_t scanAvx2Step (const char *p, const __m256i *delims){
+
+    __m256i bytes, hits;
+
+    bytes = _mm256_loadu_si256((const __m256i *) p);
+
+    hits = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, delims[0]), _mm256_cmpeq_epi8(bytes, delims[1]));
+    hits = _mm256_or_si256(hits, _mm256_or_si256(_mm256_cmpeq_epi8(bytes, delims[2]), _mm256_cmpeq_epi8(bytes, delims[3])));
+
+    return (uint32_t) _mm256_movemask_epi8(hits);
+}
+
+uint64_t scanMaskAvx2 (const char *block, const char *set, int nset){
+
+    __m256i delims[CALSCAN_MAXSET];
+    int k;
+
+    for (k = 0; k < CALSCAN_MAXSET; ++k)
+        delims[k] = _mm256_set1_epi8(set[k < nset ? k : 0]);
+
+    return (uint64_t) scanAvx2Step(block, delims) | (uint64_t) scanAvx2Step(block + 32, delims) << 32;
+}
+
+size_t scanFindAvx2 (const char *text, size_t len, const char *set, int nset){
+
+    __m256i delims[CALSCAN_MAXSET];
+    uint64_t mask;
+    size_t pos;
+    int k;
+
+    for (k = 0; k < CALSCAN_MAXSET; ++k)
+        delims[k] = _mm256_set1_epi8(set[k < nset ? k : 0]);
+
+    /* Whole 64-byte blocks first, then one 32-byte step */
+    for (pos = 0; pos + CALSCAN_BLOCK <= len; pos += CALSCAN_BLOCK){
+
+        mask = (uint64_t) scanAvx2Step(text + pos, delims) | (uint64_t) scanAvx2Step(text + pos + 32, delims) << 32;
+
+        if (mask != 0)
+            return pos + __builtin_ctzll(mask);
+    }
+
+    if (pos + 32 <= len){
+
+        mask = scanAvx2Step(text + pos, delims);
+
+        if (mask != 0)
+            return pos + __builtin_ctzll(mask);
+
+        pos += 32;
+    }
+
+    return pos + scanFindScalar(text + pos, len - pos, set, nset);
+}
+
+/* AVX2 version of scanSse2Class, 32 bytes at a time
+ *
+ * Arguments: the bytes and the broadcast constants: the single byte, the start of the range and its span
+ *
+ * Preconditions: 32 bytes are readable at p
+ * Postconditions: none
+ *
+ * Return val: 32-bit mask of matching bytes
+ * */
+__attribute__((target("avx2"))) static inline uint32_t scanAvx2Class (const char *p, const __m256i *consts){
+
+    __m256i bytes, off;
+
+    bytes = _mm256_loadu_si256((const __m256i *) p);
+    off = _mm256_sub_epi8(bytes, consts[1]);
+
+    return (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, consts[0]), _mm256_cmpeq_epi8(_mm256_min_epu8(off, consts[2]), off)));
+}
+
+size_t scanSpaceAvx2 (const char *text, size_t len){
+
+    __m256i consts[3];
+    uint32_t mask;
+    size_t pos;
+
+    consts[0] = _mm256_set1_epi8(' ');
+    consts[1] = _mm256_set1_epi8('\t');
+    consts[2] = _mm256_set1_epi8('\r' - '\t');
+
+    for (pos = 0; pos + 32 <= len; pos += 32){
+
+        mask = ~scanAvx2Class(text + pos, consts);
+
+        if (mask != 0)
+            return pos + __builtin_ctz(mask);
+    }
+
+    return pos + scanSpaceSse2(text + pos, len - pos);
+}
+
+void scanUpperAvx2 (char *text, size_t len){
+
+    __m256i bytes, off, start, span, diff;
+    size_t pos;
+
+    start = _mm256_set1_epi8('a');
+    span = _mm256_set1_epi8('z' - 'a');
+    diff = _mm256_set1_epi8('a' - 'A');
+
+    for (pos = 0; pos + 32 <= len; pos += 32){
+
+        bytes = _mm256_loadu_si256((const __m256i *) (text + pos));
+        off = _mm256_sub_epi8(bytes, start);
+        off = _mm256_cmpeq_epi8(_mm256_min_epu8(off, span), off);
+        _mm256_storeu_si256((__m256i *) (text + pos), _mm256_sub_epi8(bytes, _mm256_and_si256(off, diff)));
+    }
+
+    scanUpperSse2(text + pos, len - pos);
+}
+
+size_t scanPlainAvx2 (const char *text, size_t len){
+
+    __m256i consts[3];
+    uint32_t mask;
+    size_t pos;
+
+    consts[0] = _mm256_set1_epi8('\t');
+    consts[1] = _mm256_set1_epi8(' ');
+    consts[2] = _mm256_set1_epi8('~' - ' ');
+
+    for (pos = 0; pos + 32 <= len; pos += 32){
+
+        mask = ~scanAvx2Class(text + pos, consts);
+
+        if (mask != 0)
+            return pos + __builtin_ctz(mask);
+    }
+
+    return pos + scanPlainSse2(text + pos, len - pos);
+}
+
+#endif
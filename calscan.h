@@ -0,0 +1,139 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calscan.h -- Public interface for the delimiter scanning kernels in calscan.c
+Last updated:  Oct 19/26
+
+The line reader and tokenizer look for a handful of delimiter bytes
+(CR and LF, or ; : " = ,) and copy everything in between. The kernels
+here compare a 64-byte block against up to CALSCAN_MAXSET delimiters at
+once and return a bitmask with bit i set when byte i is one of them.
+The same kernel sets also find the first non-whitespace byte of a line,
+uppercase ASCII names in place, and check lines for control characters
+and invalid UTF-8 for strict parsing.
+AVX2, SSE2 and scalar versions exist; the best one the CPU supports is
+picked by a constructor when the program or library is loaded, before
+main runs, so no kernel call has to check for it.
+********/
+
+#ifndef CALSCAN_H
+#define CALSCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CALSCAN_BLOCK 64    // bytes covered by one mask
+#define CALSCAN_MAXSET 4    // most delimiters searched for at once
+
+typedef struct {        // walks the delimiters of a string one mask at a time
+    const char *text;
+    size_t len;
+    const char *set;        // delimiter bytes
+    int nset;               // no. of delimiter bytes
+    size_t block;           // offset of the block mask covers
+    uint64_t mask;          // delimiters in that block not yet returned
+} CalScanIter;
+
+/*	Find the delimiters in a 64-byte block
+ *
+ * Arguments: start of the block, the delimiter bytes and how many there are
+ *
+ * Preconditions: CALSCAN_BLOCK bytes are readable at block, 1 <= nset <= CALSCAN_MAXSET
+ * Postconditions: none
+ *
+ * Return val: bitmask with bit i set if block[i] is one of the delimiters
+ * */
+uint64_t calScanMask( const char *block, const char *set, int nset );
+
+/*	Find the first delimiter in a run of bytes
+ *
+ * Arguments: start of the bytes, how many there are, the delimiter bytes and how many there are
+ *
+ * Preconditions: len bytes are readable at text, 1 <= nset <= CALSCAN_MAXSET
+ * Postconditions: none
+ *
+ * Return val: index of the first delimiter, or len if there is none
+ * */
+size_t calScanFind( const char *text, size_t len, const char *set, int nset );
+
+/*	Start walking the delimiters of a string
+ *
+ * Arguments: iterator to set up, the string, its length, the delimiter bytes and how many there are
+ *
+ * Preconditions: len bytes are readable at text, 1 <= nset <= CALSCAN_MAXSET, no delimiter is '\0'
+ * Postconditions: the first block has been scanned
+ *
+ * Return val: none
+ * */
+void calScanStart( CalScanIter *const iter, const char *text, size_t len, const char *set, int nset );
+
+/*	Get the position of the next delimiter
+ *
+ * Arguments: iterator set up by calScanStart
+ *
+ * Preconditions: none
+ * Postconditions: the iterator moves past the delimiter returned
+ *
+ * Return val: index of the next delimiter in the string, or its length once there are no more
+ * */
+size_t calScanNext( CalScanIter *const iter );
+
+/*	Find the first byte that isn't whitespace, as isspace defines it in the C locale
+ *
+ * Arguments: start of the bytes and how many there are
+ *
+ * Preconditions: len bytes are readable at text
+ * Postconditions: none
+ *
+ * Return val: index of the first byte other than space, \t, \n, \v, \f or \r, or len if there is none
+ * */
+size_t calScanSpace( const char *text, size_t len );
+
+/*	Uppercase ASCII letters in place, as toupper does in the C locale
+ *
+ * Arguments: start of the bytes and how many there are
+ *
+ * Preconditions: len bytes are writable at text
+ * Postconditions: every a-z in text is replaced with A-Z; other bytes are unchanged
+ *
+ * Return val: none
+ * */
+void calScanUpper( char *text, size_t len );
+
+/*	Check that text is valid UTF-8 without control characters (other than horizontal tab)
+ *
+ * Arguments: start of the bytes and how many there are
+ *
+ * Preconditions: len bytes are readable at text
+ * Postconditions: none
+ *
+ * Return val: index of the first control character or of the first byte of an invalid UTF-8 sequence
+ *             (overlong, surrogate, above U+10FFFF or cut short), or len if the text is valid
+ * */
+size_t calScanText( const char *text, size_t len );
+
+/*	Choose the kernels used from now on
+ *
+ * Arguments: "avx2", "sse2", "scalar", or "auto" for the best one the CPU supports
+ *
+ * Preconditions: no other thread is scanning; "auto" is chosen at startup, so this is only needed to switch
+ * Postconditions: the kernels are switched if name is supported, unchanged otherwise
+ *
+ * Return val: true if name is supported on this CPU, false otherwise
+ * */
+bool calScanSelect( const char *name );
+
+/*	Name the kernels in use
+ *
+ * Arguments: none
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: "avx2", "sse2" or "scalar"
+ * */
+const char *calScanName( void );
+
+#endif
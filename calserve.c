@@ -0,0 +1,925 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calserve.c -- Source code for the caltool daemon
+Last updated:  Oct 19/26
+********/
+
+#include "caltool.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "calutil.h"
+#include "calcache.h"
+#include "calincr.h"
+#include "calserve.h"
+#include "calwatch.h"
+
+#define SERVE_MAXARGS 8     // most words accepted on a command line
+
+typedef struct {        // calendar kept in memory
+    char *name;
+    CalComp *comp;
+    int lines;              // line count returned when it was read
+    char *path;             // file it was loaded from, NULL if it came with the request
+    CalIncr *incr;          // what reload keeps of the file (NULL before the first reload); comp is incr->comp
+    CalWatch *watch;        // the watcher keeping it up to date once watched (or NULL), see calwatch.h
+    const CalWatchVersion *version;     // version of watch the request being run reads (or NULL); comp is its tree
+} ServeCal;
+
+typedef struct {        // connected client
+    int fd;
+    char *in;               // bytes received but not yet handled
+    size_t inlen, incap;
+    char *out;              // responses not yet sent
+    size_t outlen, outpos, outcap;
+    bool closing;           // client finished sending, close once out is flushed
+} ServeClient;
+
+typedef struct {        // everything the event loop owns
+    ServeCal *cals;
+    int ncals, calcap;
+    ServeClient *clients;
+    int nclients;
+} ServeState;
+
+/* Names of the CalError codes, in enum order */
+static const char *const errorNames[] = { "OK", "AFTEND", "BADVER", "BEGEND", "IOERR", "NOCAL",
+                                          "NOCRNL", "NODATA", "NOPROD", "SUBCOM", "SYNTAX", "STALE", "BADTEXT" };
+
+static volatile sig_atomic_t stopServe = 0;
+
+/* Signal handler for SIGINT and SIGTERM
+ *
+ * Arguments: signal number
+ *
+ * Preconditions: none
+ * Postconditions: the event loop stops after its current pass
+ *
+ * Return val: none
+ * */
+void stopServeHandler (int sig);
+
+/* Find a loaded calendar by name
+ *
+ * Arguments: daemon state and calendar name
+ *
+ * Preconditions: *state must be initialized
+ * Postconditions: a watched calendar's current version is acquired for the rest of the request, and comp and
+ *                 lines are set from it
+ *
+ * Return val: the calendar, or NULL if nothing is loaded under name
+ * */
+ServeCal *findServeCal (ServeState *state, const char *name);
+
+/* Read from a client until its next request frame is whole, and handle every complete frame read
+ *
+ * Arguments: daemon state and the client to read from
+ *
+ * Preconditions: client->fd is non-blocking
+ * Postconditions: responses are queued on client->out; closing is set at end of input. No more is read once a
+ *                 frame is whole, so the buffer never grows past CALSERVE_HDR + CALSERVE_MAXFRAME and poll gets
+ *                 back to the other clients
+ *
+ * Return val: false if the client must be dropped (read error or oversized frame), true otherwise
+ * */
+bool readServeClient (ServeState *state, ServeClient *client);
+
+/* Send as much of a client's queued output as the socket accepts
+ *
+ * Arguments: the client to write to
+ *
+ * Preconditions: client->fd is non-blocking
+ * Postconditions: sent bytes are removed from client->out
+ *
+ * Return val: false if the client must be dropped (write error), true otherwise
+ * */
+bool writeServeClient (ServeClient *client);
+
+/* Run one request and queue its response frame
+ *
+ * Arguments: daemon state, the requesting client, and the request payload
+ *
+ * Preconditions: payload holds len bytes
+ * Postconditions: one response frame is appended to client->out
+ *
+ * Return val: none
+ * */
+void handleServeRequest (ServeState *state, ServeClient *client, const char *payload, size_t len);
+
+/* Run one command, writing its output
+ *
+ * Arguments: daemon state, command words, no. of words, data after the command line and its length,
+ *            stream for the output and buffer for a one line error reason
+ *
+ * Preconditions: argc >= 1, reason holds at least 256 bytes
+ * Postconditions: on success the command's output is written to txtfile
+ *
+ * Return val: true on success, false with reason set otherwise
+ * */
+bool runServeCommand (ServeState *state, char **argv, int argc, const char *data, size_t datalen, FILE *const txtfile, char *reason);
+
+/* Convert a filter date argument to calendar time
+ *
+ * Arguments: date string (anything getdate_r accepts, or today), whether it ends the range, and where to store the result
+ *
+ * Preconditions: none
+ * Postconditions: *date is set to the start (00:00) or end (23:59) of the given day
+ *
+ * Return val: 0 on success, otherwise the getdate_r error code
+ * */
+int parseServeDate (const char *str, bool end, time_t *const date);
+
+/* Append bytes to a growable buffer
+ *
+ * Arguments: buffer, its length and capacity, and the bytes to append
+ *
+ * Preconditions: *buf was allocated with malloc (or is NULL with *cap 0)
+ * Postconditions: the bytes are appended, growing the buffer as needed
+ *
+ * Return val: none
+ * */
+void appendServeBytes (char **buf, size_t *len, size_t *cap, const void *bytes, size_t count);
+
+/* Close a client connection and free its buffers
+ *
+ * Arguments: daemon state and index of the client
+ *
+ * Preconditions: index < state->nclients
+ * Postconditions: the last client is moved into the freed slot
+ *
+ * Return val: none
+ * */
+void dropServeClient (ServeState *state, int index);
+
+/* Free what a loaded calendar holds, except its name
+ *
+ * Arguments: the calendar
+ *
+ * Preconditions: none
+ * Postconditions: its tree (and what reload or the watcher kept) and its path are free'd
+ *
+ * Return val: none
+ * */
+void releaseServeCal (ServeCal *cal);
+
+/* Hand back the versions of watched calendars acquired by findServeCal for a request
+ *
+ * Arguments: daemon state
+ *
+ * Preconditions: *state must be initialized
+ * Postconditions: no calendar holds a version
+ *
+ * Return val: none
+ * */
+void unpinServeCals (ServeState *state);
+
+CalStatus serveCal( const char *sockpath ){
+
+    CalStatus status;
+    ServeState state;
+    struct sockaddr_un addr;
+    struct sigaction action;
+    struct pollfd * fds;
+    struct stat st;
+    int listenfd, fd, ready, i;
+
+    status.code = OK;
+    status.linefrom = 0;
+    status.lineto = 0;
+
+    if (strlen(sockpath) >= sizeof(addr.sun_path)){
+
+        fprintf(stderr, "Error: socket path %s is too long\n", sockpath);
+        status.code = IOERR;
+        return status;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sockpath);
+
+    /* Replace a socket left behind by a daemon that didn't shut down cleanly */
+    if (stat(sockpath, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(sockpath);
+
+    listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (listenfd < 0 || bind(listenfd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(listenfd, SOMAXCONN) != 0){
+
+        perror("Error: unable to listen on socket");
+
+        if (listenfd >= 0)
+            close(listenfd);
+
+        status.code = IOERR;
+        return status;
+    }
+
+    fcntl(listenfd, F_SETFL, O_NONBLOCK);
+
+    /* No SA_RESTART, so a signal interrupts poll and the loop sees stopServe */
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopServeHandler;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    state.cals = NULL;
+    state.ncals = 0;
+    state.calcap = 0;
+    state.nclients = 0;
+    state.clients = malloc(sizeof(ServeClient) * CALSERVE_MAXCLIENTS);
+    assert(state.clients);
+
+    fds = malloc(sizeof(struct pollfd) * (CALSERVE_MAXCLIENTS + 1));
+    assert(fds);
+
+    /* Single threaded event loop; the parser keeps static state so requests are never run concurrently */
+    while (stopServe == 0){
+
+        fds[0].fd = listenfd;
+        fds[0].events = state.nclients < CALSERVE_MAXCLIENTS ? POLLIN : 0;
+
+        for (i = 0; i < state.nclients; ++i){
+
+            fds[i + 1].fd = state.clients[i].fd;
+            fds[i + 1].events = state.clients[i].closing == true ? 0 : POLLIN;
+
+            if (state.clients[i].outlen > state.clients[i].outpos)
+                fds[i + 1].events |= POLLOUT;
+        }
+
+        ready = poll(fds, state.nclients + 1, -1);
+
+        if (ready < 0){
+
+            if (errno == EINTR)
+                continue;
+
+            perror("Error: poll failed");
+            status.code = IOERR;
+            break;
+        }
+
+        /* Walk clients from the end so dropping one (which moves the last into its slot) doesn't skip any */
+        for (i = state.nclients - 1; i >= 0; --i){
+
+            if (fds[i + 1].revents == 0)
+                continue;
+
+            if ((fds[i + 1].revents & POLLIN) != 0 || (fds[i + 1].revents & (POLLHUP | POLLERR)) != 0){
+
+                if (readServeClient(&state, &state.clients[i]) == false){
+
+                    dropServeClient(&state, i);
+                    continue;
+                }
+            }
+
+            if (writeServeClient(&state.clients[i]) == false ||
+                (state.clients[i].closing == true && state.clients[i].outpos == state.clients[i].outlen))
+                dropServeClient(&state, i);
+        }
+
+        /* Accept new connections after the clients are handled so their pollfd slots stay in step */
+        if ((fds[0].revents & POLLIN) != 0){
+
+            while (state.nclients < CALSERVE_MAXCLIENTS && (fd = accept4(listenfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0){
+
+                state.clients[state.nclients].fd = fd;
+                state.clients[state.nclients].in = NULL;
+                state.clients[state.nclients].inlen = 0;
+                state.clients[state.nclients].incap = 0;
+                state.clients[state.nclients].out = NULL;
+                state.clients[state.nclients].outlen = 0;
+                state.clients[state.nclients].outpos = 0;
+                state.clients[state.nclients].outcap = 0;
+                state.clients[state.nclients].closing = false;
+                ++state.nclients;
+            }
+        }
+    }
+
+    /* Shut down: drop every client, free every calendar and remove the socket */
+    while (state.nclients > 0)
+        dropServeClient(&state, state.nclients - 1);
+
+    for (i = 0; i < state.ncals; ++i){
+
+        free(state.cals[i].name);
+        releaseServeCal(&state.cals[i]);
+    }
+
+    free(state.cals);
+    free(state.clients);
+    free(fds);
+
+    close(listenfd);
+    unlink(sockpath);
+
+    return status;
+}
+
+void stopServeHandler (int sig){
+
+    stopServe = 1;
+}
+
+ServeCal *findServeCal (ServeState *state, const char *name){
+
+    int i;
+
+    for (i = 0; i < state->ncals; ++i){
+
+        if (strcmp(state->cals[i].name, name) == 0){
+
+            /* The version read stays the same for the whole request, whatever the watcher does meanwhile */
+            if (state->cals[i].watch != NULL && state->cals[i].version == NULL){
+
+                state->cals[i].version = calWatchAcquire(state->cals[i].watch);
+                state->cals[i].comp = (CalComp *) state->cals[i].version->comp;
+                state->cals[i].lines = state->cals[i].version->lines;
+            }
+
+            return &state->cals[i];
+        }
+    }
+
+    return NULL;
+}
+
+bool readServeClient (ServeState *state, ServeClient *client){
+
+    ssize_t got;
+    uint32_t netlen;
+    size_t framelen, used, want;
+
+    /* Read until the first frame in the buffer is whole; an oversized frame is refused as soon as its length is in */
+    while (true){
+
+        want = CALSERVE_HDR;
+
+        if (client->inlen >= CALSERVE_HDR){
+
+            memcpy(&netlen, client->in, CALSERVE_HDR);
+            framelen = ntohl(netlen);
+
+            if (framelen > CALSERVE_MAXFRAME)
+                return false;
+
+            want = CALSERVE_HDR + framelen;
+        }
+
+        if (client->inlen >= want)
+            break;
+
+        /* Grow by doubling while the frame doesn't fit, never past the largest frame */
+        if (client->incap == client->inlen){
+
+            client->incap = client->incap == 0 ? 65536 : client->incap * 2;
+
+            if (client->incap > CALSERVE_HDR + CALSERVE_MAXFRAME)
+                client->incap = CALSERVE_HDR + CALSERVE_MAXFRAME;
+
+            client->in = realloc(client->in, client->incap);
+            assert(client->in);
+        }
+
+        got = read(client->fd, client->in + client->inlen, client->incap - client->inlen);
+
+        if (got > 0){
+
+            client->inlen += got;
+            continue;
+        }
+
+        if (got == 0){
+
+            client->closing = true;
+            break;
+        }
+
+        if (errno == EINTR)
+            continue;
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+
+        return false;
+    }
+
+    /* Handle every complete frame, in order */
+    used = 0;
+    while (client->inlen - used >= CALSERVE_HDR){
+
+        memcpy(&netlen, client->in + used, CALSERVE_HDR);
+        framelen = ntohl(netlen);
+
+        if (framelen > CALSERVE_MAXFRAME)
+            return false;
+
+        if (client->inlen - used - CALSERVE_HDR < framelen)
+            break;
+
+        handleServeRequest(state, client, client->in + used + CALSERVE_HDR, framelen);
+        used += CALSERVE_HDR + framelen;
+    }
+
+    /* Keep any partial frame at the start of the buffer */
+    memmove(client->in, client->in + used, client->inlen - used);
+    client->inlen -= used;
+
+    return true;
+}
+
+bool writeServeClient (ServeClient *client){
+
+    ssize_t sent;
+
+    while (client->outpos < client->outlen){
+
+        sent = send(client->fd, client->out + client->outpos, client->outlen - client->outpos, MSG_NOSIGNAL);
+
+        if (sent > 0){
+
+            client->outpos += sent;
+            continue;
+        }
+
+        if (sent < 0 && errno == EINTR)
+            continue;
+
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+
+        return false;
+    }
+
+    /* Everything went out, reuse the buffer from the start */
+    client->outpos = 0;
+    client->outlen = 0;
+
+    return true;
+}
+
+void handleServeRequest (ServeState *state, ServeClient *client, const char *payload, size_t len){
+
+    FILE * txtfile;
+    char * line, * output, * word, * save;
+    char * argv[SERVE_MAXARGS];
+    char reason[256];
+    const char * newline, * data;
+    size_t linelen, datalen, outlen;
+    uint32_t netlen;
+    int argc;
+    bool ok;
+
+    /* Split off the command line; anything after it is data */
+    newline = memchr(payload, '\n', len);
+    linelen = newline != NULL ? (size_t)(newline - payload) : len;
+    data = newline != NULL ? newline + 1 : payload + len;
+    datalen = len - (data - payload);
+
+    line = malloc(linelen + 1);
+    assert(line);
+    memcpy(line, payload, linelen);
+    line[linelen] = '\0';
+
+    argc = 0;
+    for (word = strtok_r(line, " \t\r", &save); word != NULL && argc < SERVE_MAXARGS; word = strtok_r(NULL, " \t\r", &save))
+        argv[argc++] = word;
+
+    output = NULL;
+    outlen = 0;
+    txtfile = open_memstream(&output, &outlen);
+    assert(txtfile);
+
+    if (argc == 0){
+
+        strcpy(reason, "empty request");
+        ok = false;
+    }
+
+    else if (word != NULL){
+
+        strcpy(reason, "too many arguments");
+        ok = false;
+    }
+
+    else
+        ok = runServeCommand(state, argv, argc, data, datalen, txtfile, reason);
+
+    unpinServeCals(state);
+    fclose(txtfile);
+
+    /* Queue the frame: length, status line, then the output on success */
+    if (ok == true){
+
+        netlen = htonl(3 + outlen);
+        appendServeBytes(&client->out, &client->outlen, &client->outcap, &netlen, CALSERVE_HDR);
+        appendServeBytes(&client->out, &client->outlen, &client->outcap, "OK\n", 3);
+        appendServeBytes(&client->out, &client->outlen, &client->outcap, output, outlen);
+    }
+
+    else{
+
+        netlen = htonl(4 + strlen(reason) + 1);
+        appendServeBytes(&client->out, &client->outlen, &client->outcap, &netlen, CALSERVE_HDR);
+        appendServeBytes(&client->out, &client->outlen, &client->outcap, "ERR ", 4);
+        appendServeBytes(&client->out, &client->outlen, &client->outcap, reason, strlen(reason));
+        appendServeBytes(&client->out, &client->outlen, &client->outcap, "\n", 1);
+    }
+
+    free(output);
+    free(line);
+}
+
+bool runServeCommand (ServeState *state, char **argv, int argc, const char *data, size_t datalen, FILE *const txtfile, char *reason){
+
+    ServeCal * cal, * cal2;
+    CalComp * pcomp;
+    CalIncr * incr;
+    CalWatch * watch;
+    CalStatus status;
+    CalOpt content;
+    FILE * ics;
+    time_t datefrom, dateto;
+    char * path;
+    int i, reparsed;
+
+    /* All commands but load work on a calendar that is already loaded */
+    cal = NULL;
+    if (strcmp(argv[0], "load") != 0 && argc >= 2){
+
+        cal = findServeCal(state, argv[1]);
+
+        if (cal == NULL){
+
+            snprintf(reason, 256, "%.200s is not loaded", argv[1]);
+            return false;
+        }
+    }
+
+    if (strcmp(argv[0], "load") == 0 && (argc == 2 || argc == 3)){
+
+        /* Parse from the named file, or from the text sent with the request */
+        if (argc == 3)
+            ics = fopen(argv[2], "r");
+        else
+            ics = datalen > 0 ? fmemopen((void *) data, datalen, "r") : NULL;
+
+        if (ics == NULL){
+
+            snprintf(reason, 256, "unable to open %.200s", argc == 3 ? argv[2] : "calendar data");
+            return false;
+        }
+
+        pcomp = NULL;
+        status = readCalInput(ics, &pcomp);
+        fclose(ics);
+
+        if (status.code != OK){
+
+            snprintf(reason, 256, "%s reported by readCalFile, linefrom = %d, lineto = %d", errorNames[status.code], status.linefrom, status.lineto);
+            return false;
+        }
+
+        /* Replace a calendar of the same name, otherwise add one */
+        cal = findServeCal(state, argv[1]);
+
+        if (cal != NULL)
+            releaseServeCal(cal);
+
+        else{
+
+            if (state->ncals == state->calcap){
+
+                state->calcap = state->calcap == 0 ? 16 : state->calcap * 2;
+                state->cals = realloc(state->cals, sizeof(ServeCal) * state->calcap);
+                assert(state->cals);
+            }
+
+            cal = &state->cals[state->ncals++];
+            cal->name = strdup(argv[1]);
+            assert(cal->name);
+        }
+
+        cal->comp = pcomp;
+        cal->lines = status.lineto;
+        cal->path = argc == 3 ? strdup(argv[2]) : NULL;
+        cal->incr = NULL;
+        cal->watch = NULL;
+        cal->version = NULL;
+        assert(argc == 2 || cal->path);
+
+        fprintf(txtfile, "%d lines\n", cal->lines);
+        return true;
+    }
+
+    else if (strcmp(argv[0], "unload") == 0 && argc == 2){
+
+        free(cal->name);
+        releaseServeCal(cal);
+        *cal = state->cals[--state->ncals];
+        return true;
+    }
+
+    else if (strcmp(argv[0], "reload") == 0 && argc == 2){
+
+        if (cal->path == NULL){
+
+            snprintf(reason, 256, "%.200s was not loaded from a file", argv[1]);
+            return false;
+        }
+
+        /* A watched calendar is reloaded as its file changes, so just tell how the latest reload went */
+        if (cal->watch != NULL){
+
+            status = calWatchStatus(cal->watch);
+
+            if (status.code == IOERR){
+
+                snprintf(reason, 256, "unable to read %.200s", cal->path);
+                return false;
+            }
+
+            if (status.code != OK){
+
+                snprintf(reason, 256, "%s reported by readCalFile, linefrom = %d, lineto = %d", errorNames[status.code], status.linefrom, status.lineto);
+                return false;
+            }
+
+            fprintf(txtfile, "%d lines, version %ld\n", cal->lines, cal->version->serial);
+            return true;
+        }
+
+        /* The first reload parses the whole file and notes where its components lie; later ones parse what changed */
+        if (cal->incr == NULL){
+
+            incr = malloc(sizeof(CalIncr));
+            assert(incr);
+
+            status = calIncrOpen(cal->path, incr);
+
+            if (status.code == OK){
+
+                freeCalComp(cal->comp);
+                cal->incr = incr;
+                reparsed = incr->comp->ncomps;
+            }
+
+            else{
+
+                free(incr);
+            }
+        }
+
+        else{
+
+            status = calIncrRefresh(cal->incr, &reparsed);
+        }
+
+        /* On error the calendar is left as it was */
+        if (status.code == IOERR){
+
+            snprintf(reason, 256, "unable to read %.200s", cal->path);
+            return false;
+        }
+
+        if (status.code != OK){
+
+            snprintf(reason, 256, "%s reported by readCalFile, linefrom = %d, lineto = %d", errorNames[status.code], status.linefrom, status.lineto);
+            return false;
+        }
+
+        cal->comp = cal->incr->comp;
+        cal->lines = cal->incr->lines;
+
+        fprintf(txtfile, "%d lines, %d components reparsed\n", cal->lines, reparsed);
+        return true;
+    }
+
+    else if (strcmp(argv[0], "watch") == 0 && argc == 2){
+
+        if (cal->path == NULL){
+
+            snprintf(reason, 256, "%.200s was not loaded from a file", argv[1]);
+            return false;
+        }
+
+        if (cal->watch != NULL){
+
+            snprintf(reason, 256, "%.200s is already watched", argv[1]);
+            return false;
+        }
+
+        watch = malloc(sizeof(CalWatch));
+        assert(watch);
+
+        status = calWatchOpen(cal->path, watch);
+
+        if (status.code != OK){
+
+            free(watch);
+
+            if (status.code == IOERR)
+                snprintf(reason, 256, "unable to watch %.200s", cal->path);
+            else
+                snprintf(reason, 256, "%s reported by readCalFile, linefrom = %d, lineto = %d", errorNames[status.code], status.linefrom, status.lineto);
+
+            return false;
+        }
+
+        /* The watcher's tree replaces the one loaded; the path is kept for reload's messages */
+        path = cal->path;
+        cal->path = NULL;
+        releaseServeCal(cal);
+
+        cal->path = path;
+        cal->watch = watch;
+        cal->version = calWatchAcquire(watch);
+        cal->comp = (CalComp *) cal->version->comp;
+        cal->lines = cal->version->lines;
+
+        fprintf(txtfile, "%d lines, watching %s\n", cal->lines, cal->path);
+        return true;
+    }
+
+    else if (strcmp(argv[0], "info") == 0 && argc == 2)
+        status = calInfo(cal->comp, cal->lines, txtfile);
+
+    else if (strcmp(argv[0], "extract") == 0 && argc == 3 && strcmp(argv[2], "e") == 0)
+        status = calExtract(cal->comp, OEVENT, txtfile);
+
+    else if (strcmp(argv[0], "extract") == 0 && argc == 3 && strcmp(argv[2], "x") == 0)
+        status = calExtract(cal->comp, OPROP, txtfile);
+
+    else if (strcmp(argv[0], "filter") == 0 && argc >= 3 && (strcmp(argv[2], "t") == 0 || strcmp(argv[2], "e") == 0)){
+
+        content = strcmp(argv[2], "t") == 0 ? OTODO : OEVENT;
+        datefrom = 0;
+        dateto = 0;
+
+        /* Remaining words come in pairs: from DATE and/or to DATE */
+        for (i = 3; i < argc; i += 2){
+
+            if (i + 1 == argc || (strcmp(argv[i], "from") != 0 && strcmp(argv[i], "to") != 0)){
+
+                strcpy(reason, "usage: filter NAME t|e [from DATE] [to DATE]");
+                return false;
+            }
+
+            if (parseServeDate(argv[i + 1], strcmp(argv[i], "to") == 0, strcmp(argv[i], "to") == 0 ? &dateto : &datefrom) != 0){
+
+                snprintf(reason, 256, "Date \"%.200s\" could not be interpreted", argv[i + 1]);
+                return false;
+            }
+        }
+
+        if (datefrom != 0 && dateto != 0 && datefrom > dateto){
+
+            strcpy(reason, "filter start date is not before end date");
+            return false;
+        }
+
+        status = calFilter(cal->comp, content, datefrom, dateto, txtfile);
+    }
+
+    else if (strcmp(argv[0], "combine") == 0 && argc == 3){
+
+        cal2 = findServeCal(state, argv[2]);
+
+        if (cal2 == NULL){
+
+            snprintf(reason, 256, "%.200s is not loaded", argv[2]);
+            return false;
+        }
+
+        status = calCombine(cal->comp, cal2->comp, txtfile);
+    }
+
+    else if (strcmp(argv[0], "write") == 0 && argc == 2)
+        status = writeCalComp(txtfile, cal->comp);
+
+    else{
+
+        snprintf(reason, 256, "invalid request: %.200s", argv[0]);
+        return false;
+    }
+
+    if (status.code != OK){
+
+        snprintf(reason, 256, "%s received from %s", errorNames[status.code], argv[0]);
+        return false;
+    }
+
+    return true;
+}
+
+int parseServeDate (const char *str, bool end, time_t *const date){
+
+    struct tm tm;
+    time_t today;
+    int error;
+
+    if (strcmp(str, "today") == 0){
+
+        today = time(NULL);
+        localtime_r(&today, &tm);
+    }
+
+    else if ((error = getdate_r(str, &tm)) != 0)
+        return error;
+
+    /* Ranges cover whole days, as with caltool -filter */
+    tm.tm_sec = 0;
+    tm.tm_min = end == true ? 59 : 0;
+    tm.tm_hour = end == true ? 23 : 0;
+    tm.tm_isdst = -1;
+
+    *date = mktime(&tm);
+
+    return 0;
+}
+
+void appendServeBytes (char **buf, size_t *len, size_t *cap, const void *bytes, size_t count){
+
+    if (*len + count > *cap){
+
+        while (*len + count > *cap)
+            *cap = *cap == 0 ? 65536 : *cap * 2;
+
+        *buf = realloc(*buf, *cap);
+        assert(*buf);
+    }
+
+    memcpy(*buf + *len, bytes, count);
+    *len += count;
+}
+
+void dropServeClient (ServeState *state, int index){
+
+    close(state->clients[index].fd);
+    free(state->clients[index].in);
+    free(state->clients[index].out);
+
+    state->clients[index] = state->clients[--state->nclients];
+}
+
+void unpinServeCals (ServeState *state){
+
+    int i;
+
+    for (i = 0; i < state->ncals; ++i){
+
+        if (state->cals[i].version != NULL){
+
+            calWatchRelease(state->cals[i].watch, state->cals[i].version);
+            state->cals[i].version = NULL;
+        }
+    }
+}
+
+void releaseServeCal (ServeCal *cal){
+
+    if (cal->watch != NULL){
+
+        if (cal->version != NULL)
+            calWatchRelease(cal->watch, cal->version);
+
+        calWatchClose(cal->watch);
+        free(cal->watch);
+    }
+
+    else if (cal->incr != NULL){
+
+        calIncrClose(cal->incr);
+        free(cal->incr);
+    }
+
+    else{
+
+        freeCalComp(cal->comp);
+    }
+
+    free(cal->path);
+    cal->comp = NULL;
+    cal->incr = NULL;
+    cal->watch = NULL;
+    cal->version = NULL;
+    cal->path = NULL;
+}
@@ -0,0 +1,56 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calserve.h -- Public interface for the caltool daemon in calserve.c
+Last updated:  Oct 19/26
+
+The daemon keeps parsed calendars in memory under names chosen by its
+clients and answers requests over a Unix domain socket.
+
+Every message in either direction is a frame: a 4-byte length in network
+byte order followed by that many bytes of payload. A request payload is a
+command line ending in '\n', optionally followed by data:
+
+    load NAME [PATH]        parse PATH, or the iCalendar text after the command line, and keep it as NAME
+    unload NAME             free NAME
+    info NAME               output of caltool -info
+    extract NAME e|x        output of caltool -extract
+    filter NAME t|e [from DATE] [to DATE]
+                            output of caltool -filter (dates as for DATEMSK, or today)
+    combine NAME NAME2      output of caltool -combine
+    write NAME              NAME written back out as iCalendar text
+    reload NAME             parse the file NAME was loaded from again; after the
+                            first reload only the components that changed are
+                            parsed (see calincr.h); for a watched calendar, tells
+                            how the latest reload went
+    watch NAME              reload the file NAME was loaded from whenever it changes
+                            (see calwatch.h); each request reads the version current
+                            when it started
+
+The response payload is "OK\n" followed by the command's output, or
+"ERR " followed by a one line reason.
+********/
+
+#ifndef CALSERVE_H
+#define CALSERVE_H
+
+#include "calutil.h"
+
+#define CALSERVE_HDR 4                  // bytes in a frame's length prefix
+#define CALSERVE_MAXFRAME (64 << 20)    // largest payload accepted (64M)
+#define CALSERVE_MAXCLIENTS 1024        // connections served at once
+
+/*	Serve requests on a Unix domain socket until SIGINT or SIGTERM
+ *
+ * Arguments: path of the socket to create
+ *
+ * Preconditions: nothing else is listening on sockpath
+ * Postconditions: a stale socket file at sockpath is replaced; on return the socket file is removed and
+ *                 every loaded calendar is freed
+ *
+ * Return val: IOERR if the socket can't be set up, OK once the daemon is stopped
+ * */
+CalStatus serveCal( const char *sockpath );
+
+#endif
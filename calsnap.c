@@ -0,0 +1,763 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calsnap.c -- Source code for binary calendar snapshots
+Last updated:  Oct 19/26
+********/
+
+#define _GNU_SOURCE   // for realpath
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "calsnap.h"
+#include "caltz.h"
+
+#define SNAP_ALIGN(n) (((n) + 7) & ~(size_t)7)    // keep every structure 8-byte aligned
+#define SNAP_MAXDEPTH 64                          // deepest component nesting accepted when loading
+
+typedef struct {        // store of a loaded snapshot
+    CalStore store;
+    bool epochsValid;   // false if the writer's timezone differs from ours
+} SnapStore;
+
+typedef struct {        // state used while building a snapshot image
+    char *image;        // header and structure sections
+    size_t compCur;     // next free offset in the component section
+    size_t propCur;     // index of the next free CalProp slot
+    size_t paramCur;    // next free offset in the parameter section
+    const CalSnapHeader *hdr;
+    char *strings;      // string table
+    size_t strLen, strCap;
+    uint64_t *slots;    // open addressing table of string offsets (0 = empty)
+    size_t nslots, nused;
+    const CalTzSet *zones;  // the calendar's VTIMEZONEs, for the epochs of TZID dates
+} SnapWriter;
+
+/* Compute the layout fingerprint of this build
+ *
+ * Arguments: none
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: a value that differs between builds whose structures can't share snapshots
+ * */
+uint32_t snapLayout (void);
+
+/* Compute the timezone check values stored in a snapshot header
+ *
+ * Arguments: array of two values to fill in
+ *
+ * Preconditions: none
+ * Postconditions: check[0] and check[1] hold mktime() of a winter and a summer date
+ *
+ * Return val: none
+ * */
+void snapTzCheck (int64_t check[2]);
+
+/* Add up the space the structures of a tree need in a snapshot
+ *
+ * Arguments: initialized CalComp structure and the totals to add to
+ *
+ * Preconditions: *comp must be initialized
+ * Postconditions: *compBytes, *nprops and *paramBytes are increased by the amounts needed for comp and its subcomponents
+ *
+ * Return val: none
+ * */
+void sizeSnapTree (const CalComp *comp, size_t *compBytes, size_t *nprops, size_t *paramBytes);
+
+/* Copy a tree into a snapshot image
+ *
+ * Arguments: writer state and initialized CalComp structure
+ *
+ * Preconditions: w->image is large enough for the tree (see sizeSnapTree)
+ * Postconditions: comp, its properties, parameters and subcomponents are laid out in the image with pointers stored as offsets
+ *
+ * Return val: offset of comp in the image
+ * */
+uint64_t emitSnapComp (SnapWriter *w, const CalComp *comp);
+
+/* Add a string to the snapshot's string table, reusing an identical string if one is already there
+ *
+ * Arguments: writer state and string to add
+ *
+ * Preconditions: *str must be initialized
+ * Postconditions: str is in the string table
+ *
+ * Return val: file offset of the string
+ * */
+uint64_t internSnapString (SnapWriter *w, const char *str);
+
+/* Turn a stored offset back into a pointer into one section of the mapped snapshot
+ *
+ * Arguments: snapshot base, the section's first offset and the offset just past it, the stride of the structures in
+ *            it (1 for strings), the no. of bytes the target needs, whether 0 (NULL) is allowed and the address of the
+ *            pointer field to fix
+ *
+ * Preconditions: *field holds an offset written by emitSnapComp
+ * Postconditions: *field points into the section (or is NULL for offset 0)
+ *
+ * Return val: false if the offset is 0 where a pointer is needed, lies outside the section, isn't a multiple of
+ *             the stride from its start or leaves too little room for the target, true otherwise
+ * */
+bool fixSnapPointer (char *base, uint64_t from, uint64_t to, size_t stride, size_t need, bool null, void *field);
+
+/* Fix the pointers of a property's parameters
+ *
+ * Arguments: snapshot base, snapshot header and the property
+ *
+ * Preconditions: prop->param holds a stored offset
+ * Postconditions: the parameter list and each parameter's name and values point into the snapshot
+ *
+ * Return val: false if the snapshot is corrupt, true otherwise
+ * */
+bool fixSnapParams (char *base, const CalSnapHeader *hdr, CalProp *prop);
+
+/* Fix the pointers of a component and its subcomponents
+ *
+ * Arguments: snapshot base, snapshot header, the component to fix and its nesting depth
+ *
+ * Preconditions: comp points into the snapshot's component section, with room for a CalComp
+ * Postconditions: all pointers in comp and below are fixed
+ *
+ * Return val: false if the snapshot is corrupt, true otherwise
+ * */
+bool fixSnapComp (char *base, const CalSnapHeader *hdr, CalComp *comp, int depth);
+
+/* Free a store whose block was mapped with mmap
+ *
+ * Arguments: store to free
+ *
+ * Preconditions: store was created by readCalSnap
+ * Postconditions: the block is unmapped and the store is free'd
+ *
+ * Return val: none
+ * */
+void releaseSnapMap (CalStore *store);
+
+/* Free a store whose block was read into memory with malloc
+ *
+ * Arguments: store to free
+ *
+ * Preconditions: store was created by readCalSnap
+ * Postconditions: the block and the store are free'd
+ *
+ * Return val: none
+ * */
+void releaseSnapBuffer (CalStore *store);
+
+/* Check if a property holds one of the dates calTool works with
+ *
+ * Arguments: property name
+ *
+ * Preconditions: *name must be initialized
+ * Postconditions: none
+ *
+ * Return val: true if name is a recognized date property, false otherwise
+ * */
+bool isSnapDate (const char *name);
+
+CalStatus writeCalSnap( FILE *const snap, const CalComp *comp, int lines, const char *srcpath, const unsigned char *srcdigest ){
+
+    CalStatus status;
+    CalSnapHeader * hdr;
+    SnapWriter w;
+    CalTzSet * zones;
+    struct stat srcstat;
+    char fullpath[PATH_MAX];
+    size_t compBytes, nprops, paramBytes, imageSize;
+
+    status.code = OK;
+    status.linefrom = lines;
+    status.lineto = lines;
+
+    compBytes = 0;
+    nprops = 0;
+    paramBytes = 0;
+    sizeSnapTree(comp, &compBytes, &nprops, &paramBytes);
+
+    /* Allocate the image with every section at its final offset */
+    imageSize = SNAP_ALIGN(sizeof(CalSnapHeader)) + compBytes + nprops * sizeof(CalProp) + paramBytes + nprops * sizeof(int64_t);
+
+    w.image = calloc(imageSize, 1);
+    assert(w.image);
+
+    hdr = (CalSnapHeader *)w.image;
+    memcpy(hdr->magic, CALSNAP_MAGIC, sizeof(hdr->magic));
+    hdr->version = CALSNAP_VER;
+    hdr->layout = snapLayout();
+    snapTzCheck(hdr->tzcheck);
+    hdr->lines = lines;
+    hdr->nprops = nprops;
+    hdr->root = SNAP_ALIGN(sizeof(CalSnapHeader));
+    hdr->propoff = hdr->root + compBytes;
+    hdr->paramoff = hdr->propoff + nprops * sizeof(CalProp);
+    hdr->epochoff = hdr->paramoff + paramBytes;
+    hdr->stroff = hdr->epochoff + nprops * sizeof(int64_t);
+
+    w.hdr = hdr;
+    w.compCur = hdr->root;
+    w.propCur = 0;
+    w.paramCur = hdr->paramoff;
+    w.strLen = 0;
+    w.strCap = 4096;
+    w.strings = malloc(w.strCap);
+    assert(w.strings);
+    w.nslots = 1024;
+    w.nused = 0;
+    w.slots = calloc(w.nslots, sizeof(uint64_t));
+    assert(w.slots);
+    zones = calTzBuild(comp);
+    w.zones = zones;
+
+    emitSnapComp(&w, comp);
+
+    /* Record where the snapshot came from so readers can tell when it goes stale */
+    if (srcpath != NULL && stat(srcpath, &srcstat) == 0){
+
+        hdr->srcmtime = srcstat.st_mtime;
+        hdr->srcsize = srcstat.st_size;
+
+        if (realpath(srcpath, fullpath) != NULL)
+            hdr->srcpath = internSnapString(&w, fullpath);
+        else
+            hdr->srcpath = internSnapString(&w, srcpath);
+    }
+
+    if (srcdigest != NULL)
+        memcpy(hdr->srcdigest, srcdigest, CALSNAP_DIGEST);
+
+    hdr->size = hdr->stroff + w.strLen;
+
+    /* Check if we wrote to snap succesfully */
+    if (fwrite(w.image, 1, imageSize, snap) != imageSize || fwrite(w.strings, 1, w.strLen, snap) != w.strLen){
+
+        status.code = IOERR;
+    }
+
+    free(w.image);
+    free(w.strings);
+    free(w.slots);
+    calTzFree(zones);
+
+    return status;
+}
+
+CalStatus readCalSnap( FILE *const snap, const char *srcpath, CalComp **const pcomp ){
+
+    CalStatus status;
+    CalSnapHeader * hdr;
+    SnapStore * store;
+    CalProp * props;
+    FILE * src;
+    struct stat st;
+    char * base;
+    size_t size, cap, got, i;
+    int64_t tzcheck[2];
+    bool ok;
+
+    status.code = IOERR;
+    status.linefrom = 0;
+    status.lineto = 0;
+
+    *pcomp = NULL;
+
+    store = malloc(sizeof(SnapStore));
+    assert(store);
+
+    /* Map regular files directly; anything else (pipes) is read into memory */
+    if (fstat(fileno(snap), &st) == 0 && S_ISREG(st.st_mode) && ftell(snap) == 0){
+
+        size = st.st_size;
+        base = size >= sizeof(CalSnapHeader) ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(snap), 0) : MAP_FAILED;
+
+        if (base == MAP_FAILED){
+
+            free(store);
+            return status;
+        }
+
+        store->store.release = releaseSnapMap;
+    }
+
+    else{
+
+        size = 0;
+        cap = 65536;
+        base = malloc(cap);
+        assert(base);
+
+        while ((got = fread(base + size, 1, cap - size, snap)) > 0){
+
+            size += got;
+
+            if (size == cap){
+
+                cap *= 2;
+                base = realloc(base, cap);
+                assert(base);
+            }
+        }
+
+        store->store.release = releaseSnapBuffer;
+    }
+
+    store->store.base = base;
+    store->store.size = size;
+
+    hdr = (CalSnapHeader *)base;
+
+    /* Check that the snapshot was written by a compatible build and is complete, and that its sections follow one
+       another as writeCalSnap lays them out: aligned, each property with its epoch, and strings last */
+    if (size < sizeof(CalSnapHeader) || memcmp(hdr->magic, CALSNAP_MAGIC, sizeof(hdr->magic)) != 0 ||
+    hdr->version != CALSNAP_VER || hdr->layout != snapLayout() || hdr->size != size ||
+    hdr->root != SNAP_ALIGN(sizeof(CalSnapHeader)) || hdr->root + sizeof(CalComp) > hdr->propoff ||
+    hdr->propoff % 8 != 0 || hdr->paramoff % 8 != 0 || hdr->epochoff % 8 != 0 ||
+    hdr->propoff > hdr->paramoff || hdr->paramoff > hdr->epochoff || hdr->epochoff > hdr->stroff || hdr->stroff >= size ||
+    hdr->paramoff - hdr->propoff != (uint64_t) hdr->nprops * sizeof(CalProp) ||
+    hdr->stroff - hdr->epochoff != (uint64_t) hdr->nprops * sizeof(int64_t) || base[size - 1] != '\0'){
+
+        store->store.release(&store->store);
+        return status;
+    }
+
+    /* If the caller's source .ics changed since the snapshot was written, parse the source instead; the path the
+       snapshot itself records is never opened, as the snapshot may have come from anywhere */
+    if (srcpath != NULL && stat(srcpath, &st) == 0 && (st.st_mtime != hdr->srcmtime || st.st_size != hdr->srcsize)){
+
+        store->store.release(&store->store);
+        src = fopen(srcpath, "r");
+
+        if (src == NULL){
+
+            status.code = STALE;
+            return status;
+        }
+
+        status = readCalFile(src, pcomp);
+        fclose(src);
+
+        if (status.code != OK)
+            *pcomp = NULL;
+
+        return status;
+    }
+
+    /* Fix the pointers of every property and its parameters. The string table ends in '\0' (checked above), so every
+       string in it ends within it; a property's next lies after it, so no list can loop */
+    props = (CalProp *)(base + hdr->propoff);
+    ok = true;
+
+    for (i = 0; i < hdr->nprops && ok == true; ++i){
+
+        ok = fixSnapPointer(base, hdr->stroff, size, 1, 1, false, &props[i].name) &&
+             fixSnapPointer(base, hdr->stroff, size, 1, 1, false, &props[i].value) &&
+             fixSnapPointer(base, hdr->propoff + (i + 1) * sizeof(CalProp), hdr->paramoff, sizeof(CalProp), sizeof(CalProp), true, &props[i].next) &&
+             fixSnapParams(base, hdr, &props[i]);
+
+        /* Images always hold decoded parameters */
+        props[i].rawparam = NULL;
+        props[i].line = NULL;
+    }
+
+    /* Fix the component tree starting at the top level */
+    if (ok == false || fixSnapComp(base, hdr, (CalComp *)(base + hdr->root), 0) == false){
+
+        store->store.release(&store->store);
+        return status;
+    }
+
+    /* Epochs are only usable if they were computed in the same timezone */
+    snapTzCheck(tzcheck);
+    store->epochsValid = tzcheck[0] == hdr->tzcheck[0] && tzcheck[1] == hdr->tzcheck[1];
+
+    *pcomp = (CalComp *)(base + hdr->root);
+    (*pcomp)->store = &store->store;
+
+    status.code = OK;
+    status.linefrom = hdr->lines;
+    status.lineto = hdr->lines;
+
+    return status;
+}
+
+bool isCalSnap( FILE *const ics ){
+
+    int c;
+
+    /* The first magic byte can never start iCalendar text, so peeking one character is enough */
+    c = getc(ics);
+
+    if (c == EOF)
+        return false;
+
+    ungetc(c, ics);
+
+    return (char)c == CALSNAP_MAGIC[0];
+}
+
+bool calSnapEpoch( const CalComp *comp, const CalProp *prop, time_t *const epoch ){
+
+    const CalSnapHeader * hdr;
+    const SnapStore * store;
+    const char * props;
+    int64_t stored;
+    size_t index;
+
+    /* Check if comp was loaded from a snapshot at all */
+    if (comp->store == NULL || (comp->store->release != releaseSnapMap && comp->store->release != releaseSnapBuffer))
+        return false;
+
+    store = (const SnapStore *)comp->store;
+    hdr = (const CalSnapHeader *)store->store.base;
+    props = store->store.base + hdr->propoff;
+
+    /* Check if the property lies in the snapshot's property array */
+    if (store->epochsValid == false || (const char *)prop < props || (const char *)prop >= props + hdr->nprops * sizeof(CalProp))
+        return false;
+
+    index = ((const char *)prop - props) / sizeof(CalProp);
+    memcpy(&stored, store->store.base + hdr->epochoff + index * sizeof(int64_t), sizeof(int64_t));
+
+    if (stored == CALSNAP_NODATE)
+        return false;
+
+    *epoch = (time_t)stored;
+
+    return true;
+}
+
+bool calSnapDigest( const CalComp *comp, unsigned char digest[CALSNAP_DIGEST] ){
+
+    static const unsigned char none[CALSNAP_DIGEST];
+    const CalSnapHeader * hdr;
+
+    /* Check if comp was loaded from a snapshot at all */
+    if (comp->store == NULL || (comp->store->release != releaseSnapMap && comp->store->release != releaseSnapBuffer))
+        return false;
+
+    hdr = (const CalSnapHeader *)comp->store->base;
+
+    if (memcmp(hdr->srcdigest, none, CALSNAP_DIGEST) == 0)
+        return false;
+
+    memcpy(digest, hdr->srcdigest, CALSNAP_DIGEST);
+
+    return true;
+}
+
+uint32_t snapLayout (void){
+
+    return ((uint32_t)sizeof(void *) << 24) ^ ((uint32_t)sizeof(CalComp) << 16) ^ ((uint32_t)sizeof(CalProp) << 8) ^ (uint32_t)sizeof(CalParam);
+}
+
+void snapTzCheck (int64_t check[2]){
+
+    struct tm date;
+    int i;
+
+    /* Convert noon on Jan 1 and Jul 1 2000 so both standard and daylight offsets are covered */
+    for (i = 0; i < 2; ++i){
+
+        memset(&date, 0, sizeof(date));
+        date.tm_year = 100;
+        date.tm_mon = i * 6;
+        date.tm_mday = 1;
+        date.tm_hour = 12;
+        date.tm_isdst = -1;
+
+        check[i] = mktime(&date);
+    }
+}
+
+void sizeSnapTree (const CalComp *comp, size_t *compBytes, size_t *nprops, size_t *paramBytes){
+
+    CalProp * currentProp;
+    CalParam * currentParam;
+    int i;
+
+    *compBytes += SNAP_ALIGN(sizeof(CalComp) + sizeof(CalComp *) * comp->ncomps);
+
+    /* Iterate through all properties and their parameters */
+    for (currentProp = comp->prop; currentProp != NULL; currentProp = currentProp->next){
+
+        ++*nprops;
+
+        for (currentParam = getCalParams(currentProp); currentParam != NULL; currentParam = currentParam->next)
+            *paramBytes += SNAP_ALIGN(sizeof(CalParam) + sizeof(char *) * currentParam->nvalues);
+    }
+
+    /* Recursively size all subcomponents */
+    for (i = 0; i < comp->ncomps; ++i){
+
+        if (comp->comp[i] != NULL)
+            sizeSnapTree(comp->comp[i], compBytes, nprops, paramBytes);
+    }
+}
+
+uint64_t emitSnapComp (SnapWriter *w, const CalComp *comp){
+
+    CalComp * img;
+    CalProp * propImg;
+    CalParam * paramImg, * prevParam;
+    const CalProp * currentProp;
+    const CalParam * currentParam;
+    uint64_t off, propOff, paramOff, child;
+    int64_t epoch;
+    int i, y, ncomps;
+
+    off = w->compCur;
+
+    /* Skip components that were removed from the tree (set to NULL) */
+    ncomps = 0;
+    for (i = 0; i < comp->ncomps; ++i){
+
+        if (comp->comp[i] != NULL)
+            ++ncomps;
+    }
+
+    w->compCur += SNAP_ALIGN(sizeof(CalComp) + sizeof(CalComp *) * comp->ncomps);
+
+    img = (CalComp *)(w->image + off);
+    img->name = (char *)(uintptr_t)internSnapString(w, comp->name);
+    img->nprops = comp->nprops;
+    img->prop = NULL;
+    img->store = NULL;
+    img->ncomps = ncomps;
+
+    /* Lay out properties contiguously so each one's index finds its epoch (the image never moves) */
+    propImg = NULL;
+    for (currentProp = comp->prop; currentProp != NULL; currentProp = currentProp->next){
+
+        propOff = w->hdr->propoff + w->propCur * sizeof(CalProp);
+
+        if (propImg == NULL)
+            img->prop = (CalProp *)(uintptr_t)propOff;
+        else
+            propImg->next = (CalProp *)(uintptr_t)propOff;
+
+        propImg = (CalProp *)(w->image + propOff);
+        propImg->name = (char *)(uintptr_t)internSnapString(w, currentProp->name);
+        propImg->value = (char *)(uintptr_t)internSnapString(w, currentProp->value);
+        propImg->nparams = currentProp->nparams;
+        propImg->param = NULL;
+        propImg->rawparam = NULL;
+        propImg->line = NULL;
+        propImg->next = NULL;
+
+        /* Precompute the epoch of recognized date properties */
+        epoch = isSnapDate(currentProp->name) ? (int64_t)calTzEpoch(w->zones, currentProp) : CALSNAP_NODATE;
+        memcpy(w->image + w->hdr->epochoff + w->propCur * sizeof(int64_t), &epoch, sizeof(int64_t));
+
+        ++w->propCur;
+
+        /* Copy the parameter list */
+        prevParam = NULL;
+        for (currentParam = getCalParams(currentProp); currentParam != NULL; currentParam = currentParam->next){
+
+            paramOff = w->paramCur;
+            w->paramCur += SNAP_ALIGN(sizeof(CalParam) + sizeof(char *) * currentParam->nvalues);
+
+            if (prevParam == NULL)
+                propImg->param = (CalParam *)(uintptr_t)paramOff;
+            else
+                prevParam->next = (CalParam *)(uintptr_t)paramOff;
+
+            paramImg = (CalParam *)(w->image + paramOff);
+            paramImg->name = (char *)(uintptr_t)internSnapString(w, currentParam->name);
+            paramImg->next = NULL;
+            paramImg->nvalues = currentParam->nvalues;
+
+            for (y = 0; y < currentParam->nvalues; ++y)
+                paramImg->value[y] = (char *)(uintptr_t)internSnapString(w, currentParam->value[y]);
+
+            prevParam = paramImg;
+        }
+    }
+
+    /* Recursively emit all subcomponents, filling in their offsets afterwards */
+    y = 0;
+    for (i = 0; i < comp->ncomps; ++i){
+
+        if (comp->comp[i] == NULL)
+            continue;
+
+        child = emitSnapComp(w, comp->comp[i]);
+        img->comp[y] = (CalComp *)(uintptr_t)child;
+        ++y;
+    }
+
+    return off;
+}
+
+uint64_t internSnapString (SnapWriter *w, const char *str){
+
+    uint64_t hash, * oldSlots;
+    size_t len, i, oldCount;
+    const unsigned char * c;
+
+    /* Grow the table once it is half full */
+    if (w->nused * 2 >= w->nslots){
+
+        oldSlots = w->slots;
+        oldCount = w->nslots;
+
+        w->nslots *= 2;
+        w->slots = calloc(w->nslots, sizeof(uint64_t));
+        assert(w->slots);
+
+        /* Reinsert every string at its new position */
+        for (i = 0; i < oldCount; ++i){
+
+            if (oldSlots[i] == 0)
+                continue;
+
+            hash = 14695981039346656037ULL;
+            for (c = (const unsigned char *)w->strings + (oldSlots[i] - w->hdr->stroff); *c != '\0'; ++c)
+                hash = (hash ^ *c) * 1099511628211ULL;
+
+            hash &= w->nslots - 1;
+            while (w->slots[hash] != 0)
+                hash = (hash + 1) & (w->nslots - 1);
+
+            w->slots[hash] = oldSlots[i];
+        }
+
+        free(oldSlots);
+    }
+
+    /* FNV-1a hash of the string */
+    hash = 14695981039346656037ULL;
+    for (c = (const unsigned char *)str; *c != '\0'; ++c)
+        hash = (hash ^ *c) * 1099511628211ULL;
+
+    len = (const char *)c - str;
+
+    /* Probe for an identical string */
+    hash &= w->nslots - 1;
+    while (w->slots[hash] != 0){
+
+        if (strcmp(w->strings + (w->slots[hash] - w->hdr->stroff), str) == 0)
+            return w->slots[hash];
+
+        hash = (hash + 1) & (w->nslots - 1);
+    }
+
+    /* Append the new string to the table */
+    while (w->strLen + len + 1 > w->strCap){
+
+        w->strCap *= 2;
+        w->strings = realloc(w->strings, w->strCap);
+        assert(w->strings);
+    }
+
+    memcpy(w->strings + w->strLen, str, len + 1);
+    w->slots[hash] = w->hdr->stroff + w->strLen;
+    w->strLen += len + 1;
+    ++w->nused;
+
+    return w->slots[hash];
+}
+
+bool fixSnapPointer (char *base, uint64_t from, uint64_t to, size_t stride, size_t need, bool null, void *field){
+
+    uintptr_t off;
+
+    memcpy(&off, field, sizeof(off));
+
+    if (off == 0)
+        return null;
+
+    if (off < from || off >= to || to - off < need || (off - from) % stride != 0)
+        return false;
+
+    off = (uintptr_t)(base + off);
+    memcpy(field, &off, sizeof(off));
+
+    return true;
+}
+
+bool fixSnapParams (char *base, const CalSnapHeader *hdr, CalProp *prop){
+
+    CalParam * param;
+    uint64_t from;
+    int y;
+
+    from = hdr->paramoff;
+
+    /* Each parameter lies after the one before it, with room for its values, so the list can't loop or overlap */
+    if (fixSnapPointer(base, from, hdr->epochoff, 8, sizeof(CalParam), true, &prop->param) == false)
+        return false;
+
+    for (param = prop->param; param != NULL; param = param->next){
+
+        if (param->nvalues < 0 || (uint64_t) param->nvalues > (hdr->epochoff - ((char *)param - base) - sizeof(CalParam)) / sizeof(char *))
+            return false;
+
+        from = ((char *)param - base) + SNAP_ALIGN(sizeof(CalParam) + sizeof(char *) * param->nvalues);
+
+        if (fixSnapPointer(base, hdr->stroff, hdr->size, 1, 1, false, &param->name) == false ||
+        fixSnapPointer(base, from, hdr->epochoff, 8, sizeof(CalParam), true, &param->next) == false)
+            return false;
+
+        for (y = 0; y < param->nvalues; ++y){
+
+            if (fixSnapPointer(base, hdr->stroff, hdr->size, 1, 1, false, &param->value[y]) == false)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool fixSnapComp (char *base, const CalSnapHeader *hdr, CalComp *comp, int depth){
+
+    uint64_t off;
+    int i;
+
+    off = (char *)comp - base;
+
+    /* The subcomponent pointers must fit in the component section too */
+    if (depth > SNAP_MAXDEPTH || comp->ncomps < 0 || (uint64_t) comp->ncomps > (hdr->propoff - off - sizeof(CalComp)) / sizeof(CalComp *) ||
+    fixSnapPointer(base, hdr->stroff, hdr->size, 1, 1, false, &comp->name) == false ||
+    fixSnapPointer(base, hdr->propoff, hdr->paramoff, sizeof(CalProp), sizeof(CalProp), true, &comp->prop) == false)
+        return false;
+
+    comp->store = NULL;
+
+    /* Recursively fix all subcomponents, which lie in the component section after their parent */
+    for (i = 0; i < comp->ncomps; ++i){
+
+        if (fixSnapPointer(base, off + SNAP_ALIGN(sizeof(CalComp) + sizeof(CalComp *) * comp->ncomps), hdr->propoff, 8,
+        sizeof(CalComp), false, &comp->comp[i]) == false || fixSnapComp(base, hdr, comp->comp[i], depth + 1) == false)
+            return false;
+    }
+
+    return true;
+}
+
+void releaseSnapMap (CalStore *store){
+
+    munmap(store->base, store->size);
+    free(store);
+}
+
+void releaseSnapBuffer (CalStore *store){
+
+    free(store->base);
+    free(store);
+}
+
+bool isSnapDate (const char *name){
+
+    return strcmp(name, "COMPLETED") == 0 || strcmp(name, "DTEND") == 0 || strcmp(name, "DUE") == 0 || strcmp(name, "DTSTART") == 0 ||
+           strcmp(name, "CREATED") == 0 || strcmp(name, "DTSTAMP") == 0 || strcmp(name, "LAST-MODIFIED") == 0;
+}
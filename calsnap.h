@@ -0,0 +1,112 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calsnap.h -- Public interface for binary calendar snapshots in calsnap.c
+Last updated:  Oct 19/26
+
+A snapshot is an image of a parsed CalComp tree: a header, the component,
+property and parameter structures with their pointers stored as file
+offsets, an array of precomputed date epochs (one per property) and a
+deduplicated string table. Loading one is a single mmap followed by a pass
+that turns the offsets back into pointers, so the tree is used in place.
+********/
+
+#ifndef CALSNAP_H
+#define CALSNAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "calutil.h"
+
+#define CALSNAP_MAGIC "\211VCSNAP\n"    // first 8 bytes of every snapshot (never valid iCalendar text)
+#define CALSNAP_VER 3                   // bumped whenever the file layout (or what its epochs mean) changes
+#define CALSNAP_NODATE INT64_MIN        // epoch slot of a property that isn't a date
+#define CALSNAP_DIGEST 32               // bytes in the SHA-256 digest of a snapshot's source text
+
+typedef struct {
+    char magic[8];          // CALSNAP_MAGIC
+    uint32_t version;       // CALSNAP_VER
+    uint32_t layout;        // pointer size, byte order and struct sizes of the writer
+    uint64_t size;          // total no. of bytes in the snapshot
+    int64_t tzcheck[2];     // writer's mktime() of two fixed dates, validates the epochs
+    int64_t srcmtime;       // modification time of the source .ics file (0 if none)
+    int64_t srcsize;        // size of the source .ics file
+    uint64_t srcpath;       // offset of the source file's path (0 if none), a record only: readCalSnap never opens it
+    unsigned char srcdigest[CALSNAP_DIGEST];    // SHA-256 of the text the tree was parsed from (zeros if not given)
+    uint32_t lines;         // line count reported when the source was parsed
+    uint32_t nprops;        // no. of properties (and epoch slots)
+    uint64_t root;          // offset of the top level CalComp
+    uint64_t propoff;       // offset of the CalProp array
+    uint64_t paramoff;      // offset of the CalParam section
+    uint64_t epochoff;      // offset of the int64_t epoch array
+    uint64_t stroff;        // offset of the string table
+} CalSnapHeader;
+
+/*	Write a parsed calendar out as a binary snapshot
+ *
+ * Arguments: output file, calendar to write, line count returned when it was read, the path of its source .ics file
+ *            (or NULL) and the digest of the text it was parsed from (or NULL, see digestCalText)
+ *
+ * Preconditions: snap is open for writing and comp was produced by readCalFile or readCalSnap
+ * Postconditions: the snapshot is written to snap; if srcpath is given its mtime and size are recorded for staleness
+ *                 checks, and if srcdigest is given it is recorded for calSnapDigest
+ *
+ * Return val: IOERR if writing fails, OK otherwise
+ * */
+CalStatus writeCalSnap( FILE *const snap, const CalComp *comp, int lines, const char *srcpath, const unsigned char *srcdigest );
+
+/*	Load a binary snapshot into a CalComp tree
+ *
+ * Arguments: an open snapshot file, the path of the .ics it was written from (or NULL if the caller doesn't know it)
+ *            and the address of the pointer that receives the tree
+ *
+ * Preconditions: snap is positioned at the start of the snapshot (see isCalSnap)
+ * Postconditions: *pcomp is set to a tree that lives inside the mapped snapshot and is released by freeCalComp.
+ *                 If srcpath is given and that file has changed since the snapshot was written, it is parsed with
+ *                 readCalFile instead and that tree is returned. The source path recorded in the snapshot is
+ *                 never opened.
+ *
+ * Return val: OK with lineto set to the source's line count, IOERR if the snapshot is unreadable, damaged or was
+ *             written by an incompatible build, STALE if srcpath has changed but can't be opened, or any status
+ *             returned by readCalFile for a stale snapshot
+ * */
+CalStatus readCalSnap( FILE *const snap, const char *srcpath, CalComp **const pcomp );
+
+/*	Check whether a file holds a snapshot rather than iCalendar text
+ *
+ * Arguments: an open file
+ *
+ * Preconditions: nothing has been read from ics yet
+ * Postconditions: the file position is unchanged
+ *
+ * Return val: true if ics starts with CALSNAP_MAGIC, false otherwise
+ * */
+bool isCalSnap( FILE *const ics );
+
+/*	Look up the precomputed epoch of a date property in a loaded snapshot
+ *
+ * Arguments: the top level CalComp of the tree, one of its properties, and where to store the result
+ *
+ * Preconditions: prop belongs to comp's tree
+ * Postconditions: *epoch is set if the snapshot has a usable epoch for prop
+ *
+ * Return val: true if *epoch was set, false if comp wasn't loaded from a snapshot, prop isn't a date,
+ *             or the snapshot was written under a different local timezone
+ * */
+bool calSnapEpoch( const CalComp *comp, const CalProp *prop, time_t *const epoch );
+
+/*	Get the digest of the text a loaded snapshot's tree was parsed from
+ *
+ * Arguments: a tree and the buffer to copy the digest into
+ *
+ * Preconditions: none
+ * Postconditions: if the tree was loaded from a snapshot, digest holds what writeCalSnap recorded
+ *
+ * Return val: true if comp was loaded from a snapshot that records a digest, false otherwise
+ * */
+bool calSnapDigest( const CalComp *comp, unsigned char digest[CALSNAP_DIGEST] );
+
+#endif
@@ -0,0 +1,278 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calsort.c -- Source code for the parallel sort
+Last updated:  Oct 19/26
+********/
+
+#define _GNU_SOURCE   // for sysconf(_SC_NPROCESSORS_ONLN)
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "calsort.h"
+
+static int sortThreads = 0;     // threads asked for with calSortSetThreads, 0 for one per CPU
+
+typedef struct {        // one thread's part of a sort: a run to qsort, or two adjacent runs to merge
+    const char *left, *right;   // runs to merge (left is the run to qsort when right is NULL)
+    size_t nleft, nright;       // no. of elements in each
+    char *out;                  // where the merged run goes
+    size_t size;                // size of each element
+    int (*compare)(const void *, const void *);
+} SortJob;
+
+typedef struct {        // a string with its first 8 bytes as a big-endian key
+    uint64_t prefix;
+    const char *text;
+} SortString;
+
+/* Run one part of a sort, as a thread or in the caller
+ *
+ * Arguments: the SortJob to run
+ *
+ * Preconditions: the job's runs don't overlap the runs of any other job running at the same time
+ * Postconditions: the run is sorted in place, or the two runs are merged into job->out, equal elements
+ *                 of the left run first
+ *
+ * Return val: NULL
+ * */
+void *runSortJob (void *job);
+
+/* Run jobs side by side, each on a thread of its own
+ *
+ * Arguments: the jobs and how many there are
+ *
+ * Preconditions: as for runSortJob
+ * Postconditions: every job has finished; jobs that couldn't get a thread were run in the caller
+ *
+ * Return val: none
+ * */
+void runSortJobs (SortJob *jobs, int njobs);
+
+/* Compare two SortStrings as strcmp compares their strings
+ *
+ * Arguments: both a and b are SortString * variables
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: negative, zero or positive as the string of a is less than, equal to or greater than that of b
+ * */
+int compareSortStrings (const void *a, const void *b);
+
+void calSort( void *base, size_t n, size_t size, int (*compare)(const void *, const void *) ){
+
+    SortJob jobs[CALSORT_MAXTHREADS];
+    size_t bounds[CALSORT_MAXTHREADS + 1];
+    char * from, * to, * swap;
+    int threads, runs, i, njobs;
+
+    threads = calSortGetThreads();
+
+    /* Small sorts aren't worth starting threads for */
+    if (n < CALSORT_THRESHOLD || threads < 2){
+
+        if (n > 1)
+            qsort(base, n, size, compare);
+        return;
+    }
+
+    /* One run per thread, each sorted on its own */
+    for (i = 0; i <= threads; ++i)
+        bounds[i] = n / threads * i + (n % threads) * i / threads;
+
+    from = base;
+
+    for (i = 0; i < threads; ++i){
+
+        jobs[i].left = from + bounds[i] * size;
+        jobs[i].right = NULL;
+        jobs[i].nleft = bounds[i + 1] - bounds[i];
+        jobs[i].nright = 0;
+        jobs[i].out = NULL;
+        jobs[i].size = size;
+        jobs[i].compare = compare;
+    }
+
+    runSortJobs(jobs, threads);
+
+    to = malloc(n * size);
+    assert(to);
+
+    /* Merge neighbouring runs until one is left, going back and forth between the array and the scratch copy */
+    for (runs = threads; runs > 1; runs = (runs + 1) / 2){
+
+        njobs = 0;
+
+        for (i = 0; i + 1 < runs; i += 2){
+
+            jobs[njobs].left = from + bounds[i] * size;
+            jobs[njobs].right = from + bounds[i + 1] * size;
+            jobs[njobs].nleft = bounds[i + 1] - bounds[i];
+            jobs[njobs].nright = bounds[i + 2] - bounds[i + 1];
+            jobs[njobs].out = to + bounds[i] * size;
+            jobs[njobs].size = size;
+            jobs[njobs].compare = compare;
+            ++njobs;
+        }
+
+        /* A run without a partner this round moves across as it is */
+        if (runs % 2 == 1)
+            memcpy(to + bounds[runs - 1] * size, from + bounds[runs - 1] * size, (bounds[runs] - bounds[runs - 1]) * size);
+
+        runSortJobs(jobs, njobs);
+
+        for (i = 0; 2 * i < runs; ++i)
+            bounds[i] = bounds[2 * i];
+        bounds[(runs + 1) / 2] = n;
+
+        swap = from;
+        from = to;
+        to = swap;
+    }
+
+    /* The last merge may have left the result in the scratch copy */
+    if (from != (char *) base){
+
+        memcpy(base, from, n * size);
+        free(from);
+    }
+
+    else
+        free(to);
+}
+
+void calSortStrings( const char **strs, size_t n ){
+
+    SortString * keys;
+    size_t i, j;
+
+    if (n < 2)
+        return;
+
+    keys = malloc(sizeof(SortString) * n);
+    assert(keys);
+
+    /* Bytes after the terminator count as zero, which sorts below every other byte as it does for strcmp */
+    for (i = 0; i < n; ++i){
+
+        keys[i].prefix = 0;
+        keys[i].text = strs[i];
+
+        for (j = 0; j < 8 && strs[i][j] != '\0'; ++j)
+            keys[i].prefix |= (uint64_t)(unsigned char) strs[i][j] << (56 - 8 * j);
+    }
+
+    calSort(keys, n, sizeof(SortString), compareSortStrings);
+
+    for (i = 0; i < n; ++i)
+        strs[i] = keys[i].text;
+
+    free(keys);
+}
+
+void calSortSetThreads( int threads ){
+
+    sortThreads = threads < 0 ? 0 : threads > CALSORT_MAXTHREADS ? CALSORT_MAXTHREADS : threads;
+}
+
+int calSortGetThreads( void ){
+
+    long cpus;
+
+    if (sortThreads > 0)
+        return sortThreads;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return cpus < 1 ? 1 : cpus > CALSORT_MAXTHREADS ? CALSORT_MAXTHREADS : (int) cpus;
+}
+
+void *runSortJob (void *job){
+
+    SortJob * sortJob;
+    const char * left, * right, * leftEnd, * rightEnd;
+    char * out;
+    size_t size;
+
+    sortJob = job;
+    size = sortJob->size;
+
+    if (sortJob->right == NULL){
+
+        qsort((void *) sortJob->left, sortJob->nleft, size, sortJob->compare);
+        return NULL;
+    }
+
+    left = sortJob->left;
+    right = sortJob->right;
+    leftEnd = left + sortJob->nleft * size;
+    rightEnd = right + sortJob->nright * size;
+    out = sortJob->out;
+
+    /* Ties go to the left run so equal elements keep the order of the runs */
+    while (left < leftEnd && right < rightEnd){
+
+        if (sortJob->compare(left, right) <= 0){
+
+            memcpy(out, left, size);
+            left += size;
+        }
+
+        else{
+
+            memcpy(out, right, size);
+            right += size;
+        }
+
+        out += size;
+    }
+
+    memcpy(out, left, leftEnd - left);
+    memcpy(out + (leftEnd - left), right, rightEnd - right);
+
+    return NULL;
+}
+
+void runSortJobs (SortJob *jobs, int njobs){
+
+    pthread_t threads[CALSORT_MAXTHREADS];
+    bool started[CALSORT_MAXTHREADS];
+    int i;
+
+    /* The caller takes the first job rather than sit idle */
+    for (i = 1; i < njobs; ++i)
+        started[i] = pthread_create(&threads[i], NULL, runSortJob, &jobs[i]) == 0;
+
+    if (njobs > 0)
+        runSortJob(&jobs[0]);
+
+    for (i = 1; i < njobs; ++i){
+
+        if (started[i] == true)
+            pthread_join(threads[i], NULL);
+        else
+            runSortJob(&jobs[i]);
+    }
+}
+
+int compareSortStrings (const void *a, const void *b){
+
+    const SortString * castA = (const SortString *) a;
+    const SortString * castB = (const SortString *) b;
+
+    if (castA->prefix != castB->prefix)
+        return castA->prefix < castB->prefix ? -1 : 1;
+
+    /* Equal prefixes that end early are equal strings */
+    if ((castA->prefix & 0xFF) == 0)
+        return 0;
+
+    return strcmp(castA->text + 8, castB->text + 8);
+}
@@ -0,0 +1,69 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calsort.h -- Public interface for the parallel sort in calsort.c
+Last updated:  Oct 19/26
+
+Arrays of at least CALSORT_THRESHOLD elements are split into one run
+per thread, each run is sorted with qsort, and the runs are merged
+pairwise, the merges of each round running side by side. Smaller arrays
+are sorted with a single qsort. Merging keeps equal elements in the
+order of their runs, so as long as the comparison only calls elements
+equal when they print the same, the result doesn't depend on the
+number of threads.
+********/
+
+#ifndef CALSORT_H
+#define CALSORT_H
+
+#include <stddef.h>
+
+#define CALSORT_THRESHOLD 65536     // fewest elements sorted in parallel
+#define CALSORT_MAXTHREADS 16       // most threads a sort uses
+
+/*	Sort an array, in parallel when it is large
+ *
+ * Arguments: the array, no. of elements, size of each element and the comparison, as for qsort
+ *
+ * Preconditions: compare never returns 0 for elements that must come out in a particular order
+ * Postconditions: the array is sorted in ascending order
+ *
+ * Return val: none
+ * */
+void calSort( void *base, size_t n, size_t size, int (*compare)(const void *, const void *) );
+
+/*	Sort strings as strcmp orders them, comparing 8-byte prefixes before whole strings
+ *
+ * Arguments: array of null terminated strings and how many there are
+ *
+ * Preconditions: none
+ * Postconditions: the pointers in strs are sorted so that the strings are in ascending order
+ *
+ * Return val: none
+ * */
+void calSortStrings( const char **strs, size_t n );
+
+/*	Choose how many threads large sorts use
+ *
+ * Arguments: no. of threads (clamped to CALSORT_MAXTHREADS), or 0 for one per CPU
+ *
+ * Preconditions: none
+ * Postconditions: sorts that follow use that many threads
+ *
+ * Return val: none
+ * */
+void calSortSetThreads( int threads );
+
+/*	Get the no. of threads large sorts use
+ *
+ * Arguments: none
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: the no. of threads, at least 1
+ * */
+int calSortGetThreads( void );
+
+#endif
@@ -0,0 +1,108 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calstats.c -- Source code for parser and tool instrumentation
+Last updated:  Oct 19/26
+********/
+
+#define _GNU_SOURCE   // for clock_gettime
+#define CALSTATS_IMPL // use the real malloc and realloc here
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "calstats.h"
+
+#ifdef CALSTATS
+
+CalStatsCounters calStats;
+
+long long statsNow( void ){
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void *statsMalloc( size_t size ){
+
+    STATS_ADD(allocs, 1);
+    STATS_ADD(allocbytes, (long long) size);
+
+    return malloc(size);
+}
+
+void *statsRealloc( void *ptr, size_t size ){
+
+    STATS_ADD(allocs, 1);
+    STATS_ADD(allocbytes, (long long) size);
+
+    return realloc(ptr, size);
+}
+
+#endif
+
+bool calGetStats( CalStats *const stats ){
+
+#ifdef CALSTATS
+    /* Each counter is read on its own, so a snapshot taken while threads count may be a little uneven */
+    stats->bytesread = atomic_load_explicit(&calStats.bytesread, memory_order_relaxed);
+    stats->lines = atomic_load_explicit(&calStats.lines, memory_order_relaxed);
+    stats->folds = atomic_load_explicit(&calStats.folds, memory_order_relaxed);
+    stats->props = atomic_load_explicit(&calStats.props, memory_order_relaxed);
+    stats->params = atomic_load_explicit(&calStats.params, memory_order_relaxed);
+    stats->allocs = atomic_load_explicit(&calStats.allocs, memory_order_relaxed);
+    stats->allocbytes = atomic_load_explicit(&calStats.allocbytes, memory_order_relaxed);
+    stats->linebufs = atomic_load_explicit(&calStats.linebufs, memory_order_relaxed);
+    stats->readline = atomic_load_explicit(&calStats.readline, memory_order_relaxed) / 1e9;
+    stats->parseprop = atomic_load_explicit(&calStats.parseprop, memory_order_relaxed) / 1e9;
+    stats->readcomp = atomic_load_explicit(&calStats.readcomp, memory_order_relaxed) / 1e9;
+    stats->write = atomic_load_explicit(&calStats.write, memory_order_relaxed) / 1e9;
+    stats->filter = atomic_load_explicit(&calStats.filter, memory_order_relaxed) / 1e9;
+    return true;
+#else
+    memset(stats, 0, sizeof(CalStats));
+    return false;
+#endif
+}
+
+void calResetStats( void ){
+
+#ifdef CALSTATS
+    atomic_store_explicit(&calStats.bytesread, 0, memory_order_relaxed);
+    atomic_store_explicit(&calStats.lines, 0, memory_order_relaxed);
+    atomic_store_explicit(&calStats.folds, 0, memory_order_relaxed);
+    atomic_store_explicit(&calStats.props, 0, memory_order_relaxed);
+    atomic_store_explicit(&calStats.params, 0, memory_order_relaxed);
+    atomic_store_explicit(&calStats.allocs, 0, memory_order_relaxed);
+    atomic_store_explicit(&calStats.allocbytes, 0, memory_order_relaxed);
+    atomic_store_explicit(&calStats.linebufs, 0, memory_order_relaxed);
+    atomic_store_explicit(&calStats.readline, 0, memory_order_relaxed);
+    atomic_store_explicit(&calStats.parseprop, 0, memory_order_relaxed);
+    atomic_store_explicit(&calStats.readcomp, 0, memory_order_relaxed);
+    atomic_store_explicit(&calStats.write, 0, memory_order_relaxed);
+    atomic_store_explicit(&calStats.filter, 0, memory_order_relaxed);
+#endif
+}
+
+void calPrintStats( const CalStats *stats, FILE *const txtfile ){
+
+    fprintf(txtfile, "bytes read: %lld\n", stats->bytesread);
+    fprintf(txtfile, "lines: %lld\n", stats->lines);
+    fprintf(txtfile, "folds: %lld\n", stats->folds);
+    fprintf(txtfile, "properties: %lld\n", stats->props);
+    fprintf(txtfile, "parameters: %lld\n", stats->params);
+    fprintf(txtfile, "allocations: %lld\n", stats->allocs);
+    fprintf(txtfile, "bytes allocated: %lld\n", stats->allocbytes);
+    fprintf(txtfile, "line buffer allocations: %lld\n", stats->linebufs);
+    fprintf(txtfile, "readCalLine: %.6f s\n", stats->readline);
+    fprintf(txtfile, "parseCalProp: %.6f s\n", stats->parseprop);
+    fprintf(txtfile, "readCalComp: %.6f s\n", stats->readcomp);
+    fprintf(txtfile, "writeCalComp: %.6f s\n", stats->write);
+    fprintf(txtfile, "calFilter: %.6f s\n", stats->filter);
+}
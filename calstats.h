@@ -0,0 +1,123 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calstats.h -- Public interface for parser and tool instrumentation in calstats.c
+Last updated:  Oct 19/26
+
+Counters are only collected when the library is compiled with -DCALSTATS
+(make STATS=-DCALSTATS). Otherwise the STATS_ macros expand to nothing,
+so the parser and tools run exactly as they would without them, and
+calGetStats reports that no counters are available.
+
+Include this header after the standard headers: in a CALSTATS build it
+redirects malloc and realloc so that allocations are counted.
+
+The counters are atomic and added to with relaxed ordering, so threads
+(calSortComps, calBusyMany, the watch thread) can count at once without
+losing updates. Times are kept as whole nanoseconds while counting and
+turned into seconds by calGetStats.
+********/
+
+#ifndef CALSTATS_H
+#define CALSTATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+typedef struct {
+    long long bytesread;    // bytes read by readCalLine
+    long long lines;        // physical lines read
+    long long folds;        // folded continuation lines
+    long long props;        // properties stored in components
+    long long params;       // parameters of those properties
+    long long allocs;       // malloc and realloc calls
+    long long allocbytes;   // bytes requested by those calls
+    long long linebufs;     // line buffers allocated or grown by readCalLine and writeCalComp
+    double readline;        // seconds spent in readCalLine
+    double parseprop;       // seconds spent in parseCalProp
+    double readcomp;        // seconds spent in readCalComp (includes readline and parseprop)
+    double write;           // seconds spent in writeCalComp
+    double filter;          // seconds spent in calFilter (includes its write)
+} CalStats;
+
+#ifdef CALSTATS
+
+#include <stdatomic.h>
+
+typedef struct {        // the fields of CalStats as they are counted, with times in nanoseconds
+    _Atomic long long bytesread;
+    _Atomic long long lines;
+    _Atomic long long folds;
+    _Atomic long long props;
+    _Atomic long long params;
+    _Atomic long long allocs;
+    _Atomic long long allocbytes;
+    _Atomic long long linebufs;
+    _Atomic long long readline;
+    _Atomic long long parseprop;
+    _Atomic long long readcomp;
+    _Atomic long long write;
+    _Atomic long long filter;
+} CalStatsCounters;
+
+extern CalStatsCounters calStats;   // counters since the last calResetStats
+
+long long statsNow( void );
+void *statsMalloc( size_t size );
+void *statsRealloc( void *ptr, size_t size );
+
+#define STATS_ADD(field, n) ((void) atomic_fetch_add_explicit(&calStats.field, (n), memory_order_relaxed))
+#define STATS_TIME(field, stmt) do { long long statsStart = statsNow(); stmt; STATS_ADD(field, statsNow() - statsStart); } while (0)
+#define STATS_START(var) long long var = statsNow()
+#define STATS_STOP(field, var) STATS_ADD(field, statsNow() - (var))
+
+#ifndef CALSTATS_IMPL
+#define malloc(size) statsMalloc(size)
+#define realloc(ptr, size) statsRealloc(ptr, size)
+#endif
+
+#else
+
+#define STATS_ADD(field, n) ((void) 0)
+#define STATS_TIME(field, stmt) do { stmt; } while (0)
+#define STATS_START(var)
+#define STATS_STOP(field, var) ((void) 0)
+
+#endif
+
+/*	Copy the counters collected since the last reset
+ *
+ * Arguments: where to store the counters
+ *
+ * Preconditions: none
+ * Postconditions: *stats holds the current counters (all zero when compiled without CALSTATS)
+ *
+ * Return val: true if the library was compiled with CALSTATS, false otherwise
+ * */
+bool calGetStats( CalStats *const stats );
+
+/*	Set every counter back to zero
+ *
+ * Arguments: none
+ *
+ * Preconditions: none
+ * Postconditions: counting starts over
+ *
+ * Return val: none
+ * */
+void calResetStats( void );
+
+/*	Print counters one per line
+ *
+ * Arguments: counters to print and the output file
+ *
+ * Preconditions: none
+ * Postconditions: the counters are written to txtfile
+ *
+ * Return val: none
+ * */
+void calPrintStats( const CalStats *stats, FILE *const txtfile );
+
+#endif
@@ -9,13 +9,94 @@ Last updated:  Feb 22/2016
 #include "caltool.h"
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "calutil.h"
+#include "calsnap.h"
+#include "calcache.h"
+#include "calserve.h"
+#include "calstats.h"
+#include "calsort.h"
+#include "calrecur.h"
+#include "caltz.h"
+#include "calbusy.h"
+#include "calmerge.h"
+#include "calquery.h"
+#include "calindex.h"
 
-static int lineCount = 0;
+/* Each thread counts and builds its own lines, so calendars can be written from several at once */
+static _Thread_local int lineCount = 0;
+
+static _Thread_local struct {   // content line writeCalComp is building, reused from one line to the next
+    char *text;
+    size_t length, size;        // no. of bytes in text and no. of bytes allocated for it
+} writeLine;
+
+static pthread_key_t writeLineKey;      // holds each thread's writeLine.text, to free it when the thread exits
+static pthread_once_t writeLineOnce = PTHREAD_ONCE_INIT;
+
+typedef struct {        // a VEVENT start found by calExtract
+    time_t start;
+    const char *summary;    // the event's SUMMARY value, "" if it has none
+    long order;             // no. of DTSTARTs found before the one this came from, so events starting together keep file order
+} ExtractRec;
+
+typedef struct {        // what calExtract collects, each array grown by doubling
+    ExtractRec *recs;
+    const char **names;     // X-property names
+    size_t nrecs, caprecs, nnames, capnames;
+    const char **kept;      // while limit is set, the names in the heap as a linear probing set (NULL = empty slot)
+    size_t nkept;           // no. of slots in kept, a power of two at least twice capnames
+    size_t limit;           // 0 to keep everything, else keep only the first limit items of each array as a max-heap
+    const CalCursor *after; // keep only items that come after this (or NULL for all)
+    long order;             // no. of starts found so far
+    CalTzSet *zones;        // the calendar's VTIMEZONEs (OEVENT only, else NULL)
+} ExtractList;
+
+typedef struct {        // one identity in calCombineDedup's hash table, empty while uid is NULL
+    uint64_t hash;
+    const char *name;       // component name
+    const char *uid;        // UID value (TZID for a VTIMEZONE)
+    const char *rid;        // RECURRENCE-ID value, "" if there is none
+    int kept;               // where the version kept so far sits in the merged component array
+} DedupSlot;
+
+typedef struct {        // one identity in a DiffIndex, empty while uid is NULL
+    uint64_t hash;
+    const char *name;       // component name
+    const char *uid;        // UID value (TZID for a VTIMEZONE), "" if there is none
+    const char *rid;        // RECURRENCE-ID value, "" if there is none
+    int first, last;        // first and last indexed component with it (-1 if none), chained by DiffIndex.next
+    int pending;            // calDiff: the first of them not yet paired, -1 once none is left
+    int seen;               // calDiff: no. of the old calendar's components with it met so far
+} DiffSlot;
+
+typedef struct {        // a calendar's components by identity, see buildDiffIndex
+    DiffSlot *slots;
+    size_t nslots;          // a power of two
+    int *next;              // for each component, the next one with the same identity (-1 at the end)
+} DiffIndex;
+
+typedef struct {        // where calConflicts writes the pairs calBusyConflicts finds
+    FILE *txtfile;
+    bool ok;                // false once a write has failed
+} ConflictWriter;
+
+/* Get the calendar time of a date property, using the epoch precomputed in a snapshot when there is one
+ * 
+ * Arguments: top level CalComp structure, its VTIMEZONEs (or NULL) and one of its date properties
+ * 
+ * Preconditions: prop belongs to comp's tree, zones was built from comp by calTzBuild
+ * Postconditions: none
+ * 
+ * Return val: the date as returned by calTzEpoch
+ * */
+time_t propEpoch (const CalComp *comp, const CalTzSet *zones, const CalProp *prop);
 
 /* Count VEVENT components in comp
  * 
@@ -83,45 +164,525 @@ int countProperties (const CalComp *comp);
  * */
 CalStatus sortedCommonNames (const CalComp *comp, FILE *const txtfile );
 
-/* Compares two strings and checks which comes first alphabetically
+/* Compares two calExtract records by start, then by file order
+ * 
+ * Arguments: both a and b are ExtractRec * variables
+ * 
+ * Preconditions: none
+ * Postconditions: none
+ * 
+ * Return val: negative if a comes first, positive if b comes first
+ * */
+int compareExtract (const void *a, const void *b);
+
+/* Collect what calExtract prints from one component's own properties
+ * 
+ * Arguments: top level CalComp structure, the component to look at, the kind of extraction and the list to add to
+ * 
+ * Preconditions: comp belongs to top's tree
+ * Postconditions: for OEVENT each DTSTART of a VEVENT is added to list->recs with the event's SUMMARY, once per
+ *                 occurrence if the event recurs (without list->limit, a series with no end only up to
+ *                 EXTRACT_ENDLESS_DAYS from its start or list->after, whichever is later);
+ *                 for OPROP each X-property name is added to list->names. Strings point into the tree.
+ * 
+ * Return val: none
+ * */
+void collectExtract (const CalComp *top, const CalComp *comp, CalOpt kind, ExtractList *list);
+
+/* Check whether an occurrence of a recurring component falls in a date range
+ * 
+ * Arguments: top level CalComp structure, its VTIMEZONEs (or NULL), one of its components, and the range
+ *            (dateto 0 for no end)
+ * 
+ * Preconditions: comp belongs to top's tree, zones was built from top by calTzBuild
+ * Postconditions: none
+ * 
+ * Return val: true if the component has an RRULE or RDATE and one of its occurrences, running from its start for
+ *             as long as DTEND (or DUE) is after DTSTART, overlaps the range; false otherwise
+ * */
+bool recursInRange (const CalComp *top, const CalTzSet *zones, const CalComp *comp, time_t datefrom, time_t dateto);
+
+/* Add an event start to what calExtract collects
+ * 
+ * Arguments: the list to add to and the record to add
+ * 
+ * Preconditions: list->recs is a max-heap under compareExtract when list->limit is set
+ * Postconditions: the record is dropped if it doesn't come after list->after; otherwise it is appended, or when
+ *                 list->limit is set it is kept only if it is among the first limit seen so far, in place of the last
+ * 
+ * Return val: none
+ * */
+void addExtractRec (ExtractList *list, const ExtractRec *rec);
+
+/* Add an X-property name to what calExtract collects
+ * 
+ * Arguments: the list to add to and the name to add
+ * 
+ * Preconditions: list->names is a max-heap under strcmp when list->limit is set
+ * Postconditions: as for addExtractRec; under a limit a name already kept isn't kept twice
+ * 
+ * Return val: none
+ * */
+void addExtractName (ExtractList *list, const char *name);
+
+/* Find a name in the set of names addExtractName has kept
+ * 
+ * Arguments: the list and the name
+ * 
+ * Preconditions: list->kept is allocated
+ * Postconditions: none
+ * 
+ * Return val: the slot holding the name, or the empty slot where it would go
+ * */
+size_t findExtractName (const ExtractList *list, const char *name);
+
+/* Take a name out of the set of names addExtractName has kept
+ * 
+ * Arguments: the list and the name
+ * 
+ * Preconditions: the name is in list->kept
+ * Postconditions: the name is removed, and names after it in its run are moved back so none is cut off from its slot
+ * 
+ * Return val: none
+ * */
+void dropExtractName (ExtractList *list, const char *name);
+
+/* Size the set of kept names for the heap's capacity and fill it from the heap
+ * 
+ * Arguments: the list
+ * 
+ * Preconditions: list->capnames has changed (or the set hasn't been made yet)
+ * Postconditions: list->kept has room for capnames names at most half full and holds every name in the heap
+ * 
+ * Return val: none
+ * */
+void resizeExtractNames (ExtractList *list);
+
+/* Read the options that follow caltool -extract kind
+ * 
+ * Arguments: the options and how many there are, the kind of extraction, where to put the page size and the cursor
+ *            and where to record whether --after was given
+ * 
+ * Preconditions: none
+ * Postconditions: *limit is set from --limit N (0 if it isn't given); *after is set from --after, which takes a date,
+ *                 "today", or for events the @start.order cursor printed after a page and for x the last name on a page.
+ *                 An error is printed on stderr for options that can't be used
+ * 
+ * Return val: false if the options can't be used, true otherwise
+ * */
+bool readExtractOptions (int argc, char *argv[], CalOpt kind, size_t *limit, CalCursor *after, bool *hasAfter);
+
+/* Tell the user how to ask for the next page of caltool -extract output
+ * 
+ * Arguments: the kind of extraction, the page size and the cursor set by calExtractPage
+ * 
+ * Preconditions: none
+ * Postconditions: when more items follow the page, the command for the next one is printed on stderr
+ * 
+ * Return val: none
+ * */
+void reportExtractPage (CalOpt kind, size_t limit, const CalCursor *next);
+
+/* Read a date given on the command line, as -filter does
+ * 
+ * Arguments: the argument ("today" or a date DATEMSK can read), whether to take the end of the day rather than its
+ *            start, and where to put the date
+ * 
+ * Preconditions: none
+ * Postconditions: *date is the calendar time of the day's first second, or of the next day's first when endOfDay is
+ *                 set; an error is printed on stderr if the date can't be read
+ * 
+ * Return val: false if the date can't be read, true otherwise
+ * */
+bool readToolDate (const char *arg, bool endOfDay, time_t *date);
+
+/* Print on stderr why the input calendar couldn't be read
+ * 
+ * Arguments: status returned by readCalInput
+ * 
+ * Preconditions: status.code is not OK
+ * Postconditions: the error is printed as the other commands print it
+ * 
+ * Return val: none
+ * */
+void reportReadError (CalStatus status);
+
+/* Read each calendar named on the command line
+ * 
+ * Arguments: the file names, how many there are and an array for that many calendars
+ * 
+ * Preconditions: none
+ * Postconditions: every calendar is read, or none is kept and why one couldn't be read is printed on stderr
+ * 
+ * Return val: false if a file can't be opened or read, true otherwise
+ * */
+bool readToolFiles (char *const *paths, int n, CalComp **comps);
+
+/* Find what identifies a component for calCombineDedup
+ * 
+ * Arguments: the component and where to store its UID and RECURRENCE-ID values
+ * 
+ * Preconditions: none
+ * Postconditions: *uid is the UID value (the TZID value for a VTIMEZONE) and *rid the RECURRENCE-ID value, or ""
+ * 
+ * Return val: false if the component has no UID (or TZID) and so can't be a duplicate, true otherwise
+ * */
+bool dedupKey (const CalComp *comp, const char **uid, const char **rid);
+
+/* Hash a component's identity for calCombineDedup's and calDiff's tables
+ * 
+ * Arguments: component name, UID (or TZID) value and RECURRENCE-ID value
+ * 
+ * Preconditions: none
+ * Postconditions: none
+ * 
+ * Return val: FNV-1a hash of the three, with a zero byte between each
+ * */
+uint64_t hashCompKey (const char *name, const char *uid, const char *rid);
+
+/* Check if one version of a component supersedes another
+ * 
+ * Arguments: the version kept so far and the one found later
+ * 
+ * Preconditions: both have the same identity, see dedupKey
+ * Postconditions: none
+ * 
+ * Return val: true if later has a higher SEQUENCE, or an equal one and a later LAST-MODIFIED, or equal ones of both
+ *             and a later DTSTAMP (a missing property counts as lowest); false otherwise, so ties keep the first
+ * */
+bool dedupNewer (const CalComp *kept, const CalComp *later);
+
+/* Index a calendar's components by identity for calDiff and calPatch
+ * 
+ * Arguments: top level CalComp structure, how many more identities to leave room for and the index to fill in
+ * 
+ * Preconditions: *comp must be initialized
+ * Postconditions: every component of comp is in the index under its identity as dedupKey finds it (UID "" if it
+ *                 has none), those sharing one chained in file order; the caller releases it with freeDiffIndex
+ * 
+ * Return val: none
+ * */
+void buildDiffIndex (const CalComp *comp, int extra, DiffIndex *index);
+
+/* Look an identity up in a DiffIndex
+ * 
+ * Arguments: the index, and the component name, UID and RECURRENCE-ID values
+ * 
+ * Preconditions: the index has an empty slot left
+ * Postconditions: none, except that an empty slot returned has its hash set
+ * 
+ * Return val: the identity's slot, or the empty one it would take (uid NULL)
+ * */
+DiffSlot *findDiffSlot (DiffIndex *index, const char *name, const char *uid, const char *rid);
+
+/* Release what buildDiffIndex allocated
+ * 
+ * Arguments: the index
+ * 
+ * Preconditions: index was filled in by buildDiffIndex
+ * Postconditions: its table and chain are free'd
+ * 
+ * Return val: none
+ * */
+void freeDiffIndex (DiffIndex *index);
+
+/* Check if two properties would be written as the same content line
+ * 
+ * Arguments: the two properties
+ * 
+ * Preconditions: none
+ * Postconditions: parameters of both are decoded
+ * 
+ * Return val: true if names, values and parameters (in order) are equal, false otherwise
+ * */
+bool sameCalProp (const CalProp *prop1, const CalProp *prop2);
+
+/* Check if two components would be written the same way
+ * 
+ * Arguments: the two components
+ * 
+ * Preconditions: none
+ * Postconditions: parameters of both are decoded
+ * 
+ * Return val: true if names, properties and subcomponents are equal in order, false otherwise
+ * */
+bool sameCalComp (const CalComp *comp1, const CalComp *comp2);
+
+/* Write what calDiff records for a pair of components with the same identity
+ * 
+ * Arguments: output file, the old and new versions, and their identity (uid NULL for the calendars themselves)
+ * 
+ * Preconditions: ics is open for writing
+ * Postconditions: an X-CALTOOL-MODIFY is written unless the versions differ only in the order of their properties;
+ *                 for the calendars it is always written and covers properties only
+ * 
+ * Return val: false if writing fails, true otherwise
+ * */
+bool writeDiffModify (FILE *const ics, const CalComp *from, const CalComp *to, const char *uid, const char *rid, int nth);
+
+/* Begin one change of calDiff output
+ * 
+ * Arguments: output file, the change's component name, and the identity of the component it applies to
+ * 
+ * Preconditions: ics is open for writing
+ * Postconditions: BEGIN and the X-CALTOOL- identity lines are written; the caller ends the component
+ * 
+ * Return val: false if writing fails, true otherwise
+ * */
+bool writeDiffIdentity (FILE *const ics, const char *kind, const char *name, const char *uid, const char *rid, int nth);
+
+/* Read which component a change of calPatch input applies to
+ * 
+ * Arguments: the X-CALTOOL-REMOVE or X-CALTOOL-MODIFY, and where to store the identity
+ * 
+ * Preconditions: none
+ * Postconditions: each part missing from the change is "" (0 for nth), and nth is -1 if it can't be read
+ * 
+ * Return val: none
+ * */
+void readDiffIdentity (const CalComp *change, const char **name, const char **uid, const char **rid, int *nth);
+
+/* Find a subcomponent of an X-CALTOOL-MODIFY by name
  * 
- * Arguments: both a and b are initialized char * strings
+ * Arguments: the change and X-CALTOOL-DELETE or X-CALTOOL-INSERT
  * 
- * Preconditions:  both a and b are initialized char * strings
+ * Preconditions: none
  * Postconditions: none
  * 
- * Return val: positive int if a comes first alphabetically, negative int if b comes first alphabetically
+ * Return val: the first subcomponent so named, or NULL
  * */
-int compareStrings(const void *a, const void *b);
+const CalComp *findDiffPart (const CalComp *change, const char *name);
 
-/* Compares two dates and check which comes first
+/* Find the properties an X-CALTOOL-MODIFY removes from a component
  * 
- * Arguments: both a and b are initialized struct tm * variables
+ * Arguments: the component and the change
  * 
- * Preconditions:   both a and b are initialized struct tm * variables
+ * Preconditions: none
  * Postconditions: none
  * 
- * Return val: 1 if a comes first, -1 if b comes first
+ * Return val: a malloc'd flag for each of comp's properties, true where the change removes it (each property removed
+ *             matching a different one), for the caller to free; NULL if some property removed isn't there
+ * */
+bool *matchDiffModify (const CalComp *comp, const CalComp *change);
+
+/* Write a component's properties with a change applied
+ * 
+ * Arguments: output file, the component and the X-CALTOOL-MODIFY (NULL for none)
+ * 
+ * Preconditions: ics is open for writing and matchDiffModify accepts the change
+ * Postconditions: the properties kept are written in order, then the ones the change adds
+ * 
+ * Return val: false if writing fails, true otherwise
+ * */
+bool writePatchedProps (FILE *const ics, const CalComp *comp, const CalComp *change);
+
+/* Write a component with a change applied
+ * 
+ * Arguments: output file, the component and its X-CALTOOL-MODIFY
+ * 
+ * Preconditions: ics is open for writing and matchDiffModify accepts the change
+ * Postconditions: the component is written with its properties patched and its subcomponents kept or replaced
+ * 
+ * Return val: false if writing fails, true otherwise
+ * */
+bool writePatchedComp (FILE *const ics, const CalComp *comp, const CalComp *change);
+
+/* Write one pair of overlapping events for calConflicts, see CalConflictFn
+ * 
+ * Arguments: the two occurrences and the ConflictWriter
+ * 
+ * Preconditions: none
+ * Postconditions: both are written on one line, start and summary as calExtract prints them
+ * 
+ * Return val: false if writing fails, true otherwise
+ * */
+bool writeConflict (const CalBusyEvent *first, const CalBusyEvent *second, void *arg);
+
+/* Find the window caltool -conflicts looks at when none is given
+ * 
+ * Arguments: top level CalComp structure and where to store the window
+ * 
+ * Preconditions: *comp must be initialized
+ * Postconditions: the window runs from the earliest VEVENT start to the latest end of an event that doesn't recur
+ *                 (at least a day after its start), and to EXTRACT_ENDLESS_DAYS after the start of one that does,
+ *                 as calExtract cuts off a series with no end; it is empty if there are no VEVENTs
+ * 
+ * Return val: none
+ * */
+void findConflictWindow (const CalComp *comp, time_t *const datefrom, time_t *const dateto);
+
+/* Write the lines calFreeBusy and calFreeSlots output starts with
+ * 
+ * Arguments: output file, what the output holds (the UID's first part) and the window
+ * 
+ * Preconditions: ics is open for writing
+ * Postconditions: the VCALENDAR is begun, up to the VFREEBUSY's DTEND
+ * 
+ * Return val: false if writing fails, true otherwise
+ * */
+bool writeFreeBusyStart (FILE *const ics, const char *kind, time_t datefrom, time_t dateto);
+
+/* Write one FREEBUSY line of calFreeBusy or calFreeSlots output
+ * 
+ * Arguments: output file, the line's name and parameters (up to the colon) and the period
+ * 
+ * Preconditions: ics is open for writing
+ * Postconditions: the period is written in UTC as start/end
+ * 
+ * Return val: false if writing fails, true otherwise
+ * */
+bool writeFreeBusyPeriod (FILE *const ics, const char *name, const CalSpan *span);
+
+/* Copy bytes of a file as they are, for calSearch
+ * 
+ * Arguments: output file, the file to copy from and the no. of bytes to copy (UINT64_MAX for the rest of it)
+ * 
+ * Preconditions: ics is open for writing and src is at the first byte to copy
+ * Postconditions: the bytes are written to ics, stopping early at the end of src
+ * 
+ * Return val: false if reading or writing fails, true otherwise
+ * */
+bool copyCalText (FILE *const ics, FILE *src, uint64_t count);
+
+/* Write one content line of caltool's own output (calFreeBusy, calFreeSlots, calDiff, calPatch)
+ * 
+ * Arguments: output file, the line's name and parameters (up to the colon) and its value
+ * 
+ * Preconditions: ics is open for writing
+ * Postconditions: the line is written, folded as writeCalComp folds lines
+ * 
+ * Return val: false if writing fails, true otherwise
+ * */
+bool writeContentLine (FILE *const ics, const char *name, const char *value);
+
+/* Write one property as a content line, as writeCalComp writes it
+ * 
+ * Arguments: output file and the property
+ * 
+ * Preconditions: ics is open for writing
+ * Postconditions: name, parameters and value are written, folded every FOLD_LEN octets
+ * 
+ * Return val: false if writing fails, true otherwise
+ * */
+bool writePropLine (FILE *const ics, const CalProp *prop);
+
+/* Write a component and its subcomponents, the body of writeCalComp
+ * 
+ * Arguments: output file and initialized CalComp structure
+ * 
+ * Preconditions: ics is open for writing and *comp must be initialized 
+ * Postconditions: comp is written to ics in iCalendar form
+ * 
+ * Return val: IOERR if fprintf fails, OK otherwise
+ * */
+CalStatus writeCompLines (FILE *const ics, const CalComp *comp);
+
+/* Add text to the end of the line writeCalComp is building
+ * 
+ * Arguments: null terminated text
+ * 
+ * Preconditions: none
+ * Postconditions: writeLine.text holds the text after what it held before, growing if it must
+ * 
+ * Return val: none
+ * */
+void appendWriteLine (const char *text);
+
+/* Create the key that frees a thread's writeLine buffer when the thread exits
+ * 
+ * Arguments: none
+ * 
+ * Preconditions: called through pthread_once
+ * Postconditions: writeLineKey is created with free as its destructor
+ * 
+ * Return val: none
+ * */
+void makeWriteLineKey (void);
+
+/* Write the line writeCalComp built, folded every FOLD_LEN octets
+ * 
+ * Arguments: output file
+ * 
+ * Preconditions: ics is open for writing
+ * Postconditions: the line is written, each physical line ending in CRLF, and lineCount counts them
+ * 
+ * Return val: false if writing fails, true otherwise
+ * */
+bool emitWriteLine (FILE *const ics);
+
+/* Print the instrumentation counters on stderr, registered with atexit by caltool -stats
+ * 
+ * Arguments: none
+ * 
+ * Preconditions: none
+ * Postconditions: counters are written to stderr
+ * 
+ * Return val: none
  * */
-int compareDates (const void *a, const void *b);
+void reportStats (void);
 
 int main(int argc, char *argv[]){
     
-    FILE * combineFile;
+    FILE * combineFile, ** inputs;
+    CalMergeKey key;
     struct tm * start, * end;
-    time_t today;
-    CalComp * pcomp, * pcomp2;
+    time_t today, datefrom, dateto, length;
+    CalComp * pcomp, * pcomp2, ** comps;
     CalStatus status;
+    CalStats stats;
+    CalCursor after, next;
+    CalQuery query;
+    CalIndex textIndex;
+    size_t limit;
+    char * stop;
+    const char * source;
+    bool hasAfter;
+    int i, nfiles, bad;
     
+    source = NULL;
     status.code = OK;
     status.linefrom = lineCount;
     status.lineto = lineCount;
     
+    /* Options that apply to the command that follows */
+    while (argc >= 2 && (strcmp(argv[1], "-stats") == 0 || strcmp(argv[1], "-strict") == 0 ||
+    (argc >= 3 && strcmp(argv[1], "-source") == 0))){
+        
+        /* If user names the file a snapshot on stdin was made from, so it is parsed instead once it changes */
+        if (strcmp(argv[1], "-source") == 0){
+            
+            source = argv[2];
+            --argc;
+            ++argv;
+        }
+        
+        /* If user wants counters for the command, report them however it exits */
+        else if (strcmp(argv[1], "-stats") == 0){
+            
+            if (calGetStats(&stats) == false){
+                
+                fprintf(stderr, "Error: caltool was built without CALSTATS (make STATS=-DCALSTATS)\n");
+                return EXIT_FAILURE;
+            }
+            
+            atexit(reportStats);
+        }
+        
+        /* If user wants input with control characters or invalid UTF-8 rejected */
+        else{
+            
+            setCalStrict(true);
+        }
+        
+        --argc;
+        ++argv;
+    }
+    
     /* If user wants to run calInfo */
     if (argc == 2 && strcmp(argv[1], "-info") == 0){
         
         pcomp = NULL;
-        status = readCalFile(stdin, &pcomp);
+        status = readCalSource(stdin, source, &pcomp);
         
         /* Check if readCalFile returned successfully, prints an error on stderr if readCalFile returns an error */
         if (status.code != OK){
@@ -156,6 +717,9 @@ int main(int argc, char *argv[]){
 			if (status.code == SYNTAX)
 				fprintf(stderr, "Error: SYNTAX reported by readCalFile, linefrom = %d, lineto = %d\n", status.linefrom, status.lineto);
 			
+			if (status.code == BADTEXT)
+				fprintf(stderr, "Error: BADTEXT reported by readCalFile, linefrom = %d, lineto = %d\n", status.linefrom, status.lineto);
+			
             return EXIT_FAILURE;
         }
         
@@ -165,10 +729,13 @@ int main(int argc, char *argv[]){
     }
     
     /* If user wants to run calExtract with kind set to events */
-    else if (argc == 3 && strcmp(argv[1], "-extract") == 0 && strcmp(argv[2], "e") == 0){
+    else if (argc >= 3 && strcmp(argv[1], "-extract") == 0 && strcmp(argv[2], "e") == 0){
+        
+        if (readExtractOptions(argc - 3, argv + 3, OEVENT, &limit, &after, &hasAfter) == false)
+            return EXIT_FAILURE;
         
         pcomp = NULL;
-        status = readCalFile(stdin, &pcomp);
+        status = readCalSource(stdin, source, &pcomp);
         
 		/* Check if readCalFile returned successfully, prints an error on stderr if readCalFile returns an error */
         if (status.code != OK){
@@ -202,20 +769,28 @@ int main(int argc, char *argv[]){
 			
 			if (status.code == SYNTAX)
 				fprintf(stderr, "Error: SYNTAX reported by readCalFile, linefrom = %d, lineto = %d\n", status.linefrom, status.lineto);
+			
+			if (status.code == BADTEXT)
+				fprintf(stderr, "Error: BADTEXT reported by readCalFile, linefrom = %d, lineto = %d\n", status.linefrom, status.lineto);
 				        
             return EXIT_FAILURE;
         }
         
-        status = calExtract(pcomp, OEVENT, stdout);
+        status = calExtractPage(pcomp, OEVENT, hasAfter == true ? &after : NULL, limit, &next, stdout);
+        reportExtractPage(OEVENT, limit, &next);
         
+        free(next.name);
         freeCalComp(pcomp);
     }
     
     /* If user wants to run calExtract with kind set to x-properties */
-    else if (argc == 3 && strcmp(argv[1], "-extract") == 0 && strcmp(argv[2], "x") == 0){
+    else if (argc >= 3 && strcmp(argv[1], "-extract") == 0 && strcmp(argv[2], "x") == 0){
+        
+        if (readExtractOptions(argc - 3, argv + 3, OPROP, &limit, &after, &hasAfter) == false)
+            return EXIT_FAILURE;
         
         pcomp = NULL;
-        status = readCalFile(stdin, &pcomp);
+        status = readCalSource(stdin, source, &pcomp);
         
 		/* Check if readCalFile returned successfully, prints an error on stderr if readCalFile returns an error */
         if (status.code != OK){
@@ -249,12 +824,17 @@ int main(int argc, char *argv[]){
 			
 			if (status.code == SYNTAX)
 				fprintf(stderr, "Error: SYNTAX reported by readCalFile, linefrom = %d, lineto = %d\n", status.linefrom, status.lineto);
+			
+			if (status.code == BADTEXT)
+				fprintf(stderr, "Error: BADTEXT reported by readCalFile, linefrom = %d, lineto = %d\n", status.linefrom, status.lineto);
 				        
             return EXIT_FAILURE;
         }
         
-        status = calExtract(pcomp, OPROP, stdout);
+        status = calExtractPage(pcomp, OPROP, hasAfter == true ? &after : NULL, limit, &next, stdout);
+        reportExtractPage(OPROP, limit, &next);
         
+        free(next.name);
         freeCalComp(pcomp);
     }
     
@@ -262,7 +842,7 @@ int main(int argc, char *argv[]){
     else if (argc == 3 && strcmp(argv[1], "-filter") == 0 && (strcmp(argv[2], "t") == 0 || strcmp(argv[2], "e") == 0)){
         
         pcomp = NULL;
-        status = readCalFile(stdin, &pcomp);
+        status = readCalSource(stdin, source, &pcomp);
         
         if (status.code != OK){
 
@@ -295,6 +875,9 @@ int main(int argc, char *argv[]){
 			
 			if (status.code == SYNTAX)
 				fprintf(stderr, "Error: SYNTAX reported by readCalFile, linefrom = %d, lineto = %d\n", status.linefrom, status.lineto);
+			
+			if (status.code == BADTEXT)
+				fprintf(stderr, "Error: BADTEXT reported by readCalFile, linefrom = %d, lineto = %d\n", status.linefrom, status.lineto);
 
             return EXIT_FAILURE;
         }
@@ -329,7 +912,7 @@ int main(int argc, char *argv[]){
 		}
 		
 		pcomp = NULL;
-        status = readCalFile(stdin, &pcomp);
+        status = readCalSource(stdin, source, &pcomp);
         
 		/* Check if readCalFile returned successfully, prints an error on stderr if readCalFile returns an error */
         if (status.code != OK){
@@ -363,6 +946,9 @@ int main(int argc, char *argv[]){
 			
 			if (status.code == SYNTAX)
 				fprintf(stderr, "Error: SYNTAX reported by readCalFile, linefrom = %d, lineto = %d\n", status.linefrom, status.lineto);
+			
+			if (status.code == BADTEXT)
+				fprintf(stderr, "Error: BADTEXT reported by readCalFile, linefrom = %d, lineto = %d\n", status.linefrom, status.lineto);
 				
             return EXIT_FAILURE;
         }
@@ -626,10 +1212,10 @@ int main(int argc, char *argv[]){
 	}
 	
 	/* If user wants to run calCombine */
-	else if (argc == 3 && strcmp(argv[1], "-combine") == 0){
+	else if ((argc == 3 || (argc == 4 && strcmp(argv[3], "--dedup") == 0)) && strcmp(argv[1], "-combine") == 0){
 		
         pcomp = NULL;
-        status = readCalFile(stdin, &pcomp);
+        status = readCalSource(stdin, source, &pcomp);
         
         /* Check if readCalFile returned successfully, prints an error on stderr if readCalFile returns an error */
         if (status.code != OK){
@@ -663,6 +1249,9 @@ int main(int argc, char *argv[]){
 			
 			if (status.code == SYNTAX)
 				fprintf(stderr, "Error: SYNTAX reported by readCalFile, linefrom = %d, lineto = %d\n", status.linefrom, status.lineto);
+			
+			if (status.code == BADTEXT)
+				fprintf(stderr, "Error: BADTEXT reported by readCalFile, linefrom = %d, lineto = %d\n", status.linefrom, status.lineto);
 				
             return EXIT_FAILURE;
         }
@@ -674,7 +1263,7 @@ int main(int argc, char *argv[]){
         /* Check if file opened successfully */
         if (combineFile != NULL){
 			
-			status = readCalFile(combineFile, &pcomp2);
+			status = readCalInput(combineFile, &pcomp2);
 			
 			/* Check if readCalFile returned successfully, prints an error on stderr if readCalFile returns an error */
 			if (status.code != OK){
@@ -709,11 +1298,15 @@ int main(int argc, char *argv[]){
 				if (status.code == SYNTAX)
 					fprintf(stderr, "Error: SYNTAX reported by readCalFile, linefrom = %d, lineto = %d\n", status.linefrom, status.lineto);
 				
-				free(pcomp);
+				if (status.code == BADTEXT)
+					fprintf(stderr, "Error: BADTEXT reported by readCalFile, linefrom = %d, lineto = %d\n", status.linefrom, status.lineto);
+				
+				freeCalComp(pcomp);
+				fclose(combineFile);
 				return EXIT_FAILURE;
 			}
 			
-			status = calCombine(pcomp, pcomp2, stdout);
+			status = argc == 4 ? calCombineDedup(pcomp, pcomp2, stdout) : calCombine(pcomp, pcomp2, stdout);
 			
 			/* Close the file and free both CalComp's */
 			fclose(combineFile); 
@@ -733,27 +1326,369 @@ int main(int argc, char *argv[]){
 		}
 	}
 	
-	/* Otherwise, print error and let the user know what the proper syntax is */
-	else{
+	/* If user wants the free/busy time of the calendar between two dates */
+	else if (argc == 4 && strcmp(argv[1], "-freebusy") == 0){
 		
-		fprintf(stderr, "Error: invalid syntax, please use one of the following commands.\n");
-		fprintf(stderr, "caltool -info\n");
-		fprintf(stderr, "caltool -extract kind\n");
-		fprintf(stderr, "caltool -filter content [from date ] [to date ]\n");
-		fprintf(stderr, "caltool -combine file2\n");
-        
-        return EXIT_FAILURE;
-	}
-    
-    /* If any subcomponent calls returned an error print an error to stderr and return EXIT_FAILURE */
-    if (status.code != OK){
+		if (readToolDate(argv[2], false, &datefrom) == false || readToolDate(argv[3], true, &dateto) == false)
+			return EXIT_FAILURE;
 		
-		if (status.code == IOERR){
+		if (datefrom >= dateto){
 			
-			fprintf(stderr, "Error: IOERR received\n");
+			fprintf(stderr, "Error: freebusy start date is not before end date.\n");
+			return EXIT_FAILURE;
 		}
 		
-		else if (status.code == NOCAL){
+		pcomp = NULL;
+		status = readCalSource(stdin, source, &pcomp);
+		
+		if (status.code != OK){
+			
+			reportReadError(status);
+			return EXIT_FAILURE;
+		}
+		
+		status = calFreeBusy(pcomp, datefrom, dateto, stdout);
+		
+		freeCalComp(pcomp);
+	}
+	
+	/* If user wants the time free in every one of several calendars between two dates */
+	else if (argc >= 6 && strcmp(argv[1], "-freeslots") == 0){
+		
+		if (readToolDate(argv[2], false, &datefrom) == false || readToolDate(argv[3], true, &dateto) == false)
+			return EXIT_FAILURE;
+		
+		length = strtol(argv[4], &stop, 10) * 60;
+		
+		if (*stop != '\0' || length <= 0 || datefrom >= dateto){
+			
+			fprintf(stderr, "Error: invalid arguments. Correct syntax is: caltool -freeslots from to minutes file1 [file2 ...]\n");
+			return EXIT_FAILURE;
+		}
+		
+		/* Calendars are read one after another, since the parser isn't reentrant; their busy time is found in parallel */
+		comps = malloc(sizeof(CalComp *) * (argc - 5));
+		assert(comps);
+		
+		if (readToolFiles(argv + 5, argc - 5, comps) == false){
+			
+			free(comps);
+			return EXIT_FAILURE;
+		}
+		
+		status = calFreeSlots((const CalComp *const *) comps, argc - 5, datefrom, dateto, length, stdout);
+		
+		for (i = 0; i < argc - 5; ++i)
+			freeCalComp(comps[i]);
+		
+		free(comps);
+	}
+	
+	/* If user wants many calendars merged into one without loading them */
+	else if (argc >= 3 && strcmp(argv[1], "-merge") == 0){
+		
+		/* --sort dtstart may only come last */
+		nfiles = argc - 2;
+		key = MCONCAT;
+		
+		if (argc >= 5 && strcmp(argv[argc - 2], "--sort") == 0 && strcmp(argv[argc - 1], "dtstart") == 0){
+			
+			nfiles -= 2;
+			key = MDTSTART;
+		}
+		
+		for (i = 2; i < nfiles + 2; ++i){
+			
+			if (strncmp(argv[i], "--", 2) == 0){
+				
+				fprintf(stderr, "Error: invalid arguments. Correct syntax is: caltool -merge file1 [file2 ...] [--sort dtstart]\n");
+				return EXIT_FAILURE;
+			}
+		}
+		
+		inputs = malloc(sizeof(FILE *) * nfiles);
+		assert(inputs);
+		
+		for (i = 0; i < nfiles; ++i){
+			
+			inputs[i] = fopen(argv[i + 2], "r");
+			
+			if (inputs[i] == NULL){
+				
+				fprintf(stderr, "Error: Unable to open file %s\n", argv[i + 2]);
+				
+				while (i-- > 0)
+					fclose(inputs[i]);
+				
+				free(inputs);
+				return EXIT_FAILURE;
+			}
+		}
+		
+		status = calMerge(inputs, nfiles, key, stdout, &bad);
+		
+		for (i = 0; i < nfiles; ++i)
+			fclose(inputs[i]);
+		
+		free(inputs);
+		
+		if (status.code != OK && bad >= 0){
+			
+			fprintf(stderr, "Error: Unable to merge file %s\n", argv[bad + 2]);
+			reportReadError(status);
+			return EXIT_FAILURE;
+		}
+	}
+	
+	/* If user wants the pairs of events that overlap between two dates */
+	else if ((argc == 2 || argc == 4) && strcmp(argv[1], "-conflicts") == 0){
+		
+		if (argc == 4 && (readToolDate(argv[2], false, &datefrom) == false || readToolDate(argv[3], true, &dateto) == false))
+			return EXIT_FAILURE;
+		
+		if (argc == 4 && datefrom >= dateto){
+			
+			fprintf(stderr, "Error: conflicts start date is not before end date.\n");
+			return EXIT_FAILURE;
+		}
+		
+		pcomp = NULL;
+		status = readCalSource(stdin, source, &pcomp);
+		
+		if (status.code != OK){
+			
+			reportReadError(status);
+			return EXIT_FAILURE;
+		}
+		
+		/* Without a window the whole calendar is looked at */
+		if (argc == 2)
+			findConflictWindow(pcomp, &datefrom, &dateto);
+		
+		status = calConflicts(pcomp, datefrom, dateto, stdout);
+		
+		freeCalComp(pcomp);
+	}
+	
+	/* If user wants the changes that turn one calendar into another */
+	else if (argc == 4 && strcmp(argv[1], "-diff") == 0){
+		
+		comps = malloc(sizeof(CalComp *) * 2);
+		assert(comps);
+		
+		if (readToolFiles(argv + 2, 2, comps) == false){
+			
+			free(comps);
+			return EXIT_FAILURE;
+		}
+		
+		status = calDiff(comps[0], comps[1], stdout);
+		
+		freeCalComp(comps[0]);
+		freeCalComp(comps[1]);
+		free(comps);
+	}
+	
+	/* If user wants the changes -diff found applied to the calendar */
+	else if (argc == 3 && strcmp(argv[1], "-patch") == 0){
+		
+		pcomp = NULL;
+		status = readCalSource(stdin, source, &pcomp);
+		
+		if (status.code != OK){
+			
+			reportReadError(status);
+			return EXIT_FAILURE;
+		}
+		
+		/* A change set of only removals and edits holds no V-component, so it isn't read as a calendar */
+		combineFile = fopen(argv[2], "r");
+		
+		if (combineFile == NULL){
+			
+			fprintf(stderr, "Error: Unable to open file %s\n", argv[2]);
+			freeCalComp(pcomp);
+			return EXIT_FAILURE;
+		}
+		
+		pcomp2 = NULL;
+		status = readCalChanges(combineFile, &pcomp2);
+		fclose(combineFile);
+		
+		if (status.code != OK){
+			
+			fprintf(stderr, "Error: Unable to read file %s\n", argv[2]);
+			reportReadError(status);
+			freeCalComp(pcomp);
+			return EXIT_FAILURE;
+		}
+		
+		status = calPatch(pcomp, pcomp2, stdout, &bad);
+		
+		freeCalComp(pcomp);
+		freeCalComp(pcomp2);
+		
+		/* The rest of the changes are still applied, but the result isn't what the change set was made for */
+		if (status.code == OK && bad > 0){
+			
+			fprintf(stderr, "Error: %d changes in %s do not apply to this calendar\n", bad, argv[2]);
+			return EXIT_FAILURE;
+		}
+	}
+	
+	/* If user wants the components a query picks */
+	else if (argc == 3 && strcmp(argv[1], "-query") == 0){
+		
+		/* A query that doesn't compile is reported before anything is read */
+		status = calQueryCompile(argv[2], &query);
+		
+		if (status.code != OK){
+			
+			fprintf(stderr, "Error: query could not be compiled, column %d\n", status.linefrom);
+			return EXIT_FAILURE;
+		}
+		
+		pcomp = NULL;
+		status = readCalSource(stdin, source, &pcomp);
+		
+		if (status.code != OK){
+			
+			reportReadError(status);
+			calQueryFree(&query);
+			return EXIT_FAILURE;
+		}
+		
+		status = calQuery(pcomp, &query, stdout);
+		
+		freeCalComp(pcomp);
+		calQueryFree(&query);
+		
+		if (status.code == NOCAL){
+			
+			fprintf(stderr, "Error: no components match the query\n");
+			return EXIT_FAILURE;
+		}
+	}
+	
+	/* If user wants a calendar's search index written, or brought up to date */
+	else if (argc == 3 && strcmp(argv[1], "-index") == 0){
+		
+		status = calIndexOpen(argv[2], &textIndex);
+		
+		if (status.code == IOERR){
+			
+			fprintf(stderr, "Error: Unable to open file %s\n", argv[2]);
+			return EXIT_FAILURE;
+		}
+		
+		if (status.code != OK){
+			
+			fprintf(stderr, "Error: %s could not be parsed, linefrom = %d, lineto = %d\n", argv[2], status.linefrom, status.lineto);
+			return EXIT_FAILURE;
+		}
+		
+		calIndexFree(&textIndex);
+	}
+	
+	/* If user wants the components whose text holds some words */
+	else if (argc == 4 && strcmp(argv[1], "-search") == 0){
+		
+		/* The sidecar index is used when it is fresh, and written first when it isn't */
+		status = calIndexOpen(argv[2], &textIndex);
+		
+		if (status.code == IOERR){
+			
+			fprintf(stderr, "Error: Unable to open file %s\n", argv[2]);
+			return EXIT_FAILURE;
+		}
+		
+		if (status.code != OK){
+			
+			fprintf(stderr, "Error: %s could not be parsed, linefrom = %d, lineto = %d\n", argv[2], status.linefrom, status.lineto);
+			return EXIT_FAILURE;
+		}
+		
+		status = calSearch(argv[2], &textIndex, argv[3], stdout);
+		
+		calIndexFree(&textIndex);
+		
+		if (status.code == NOCAL){
+			
+			fprintf(stderr, "Error: no components match the search\n");
+			return EXIT_FAILURE;
+		}
+	}
+	
+	/* If user wants to save a binary snapshot of a file */
+	else if (argc == 3 && strcmp(argv[1], "-snapshot") == 0){
+		
+		combineFile = fopen(argv[2], "r");
+		
+		/* If file failed to open print an error and return EXIT_FAILURE */
+		if (combineFile == NULL){
+			
+			fprintf(stderr, "Error: Unable to open file %s\n", argv[2]);
+			
+			return EXIT_FAILURE;
+		}
+		
+		pcomp = NULL;
+		status = readCalFile(combineFile, &pcomp);
+		fclose(combineFile);
+		
+		if (status.code != OK){
+			
+			fprintf(stderr, "Error: %s could not be parsed, linefrom = %d, lineto = %d\n", argv[2], status.linefrom, status.lineto);
+			
+			return EXIT_FAILURE;
+		}
+		
+		status = writeCalSnap(stdout, pcomp, status.lineto, argv[2], NULL);
+		
+		freeCalComp(pcomp);
+	}
+	
+	/* If user wants to run the daemon */
+	else if (argc == 3 && strcmp(argv[1], "-serve") == 0){
+		
+		status = serveCal(argv[2]);
+	}
+	
+	/* Otherwise, print error and let the user know what the proper syntax is */
+	else{
+		
+		fprintf(stderr, "Error: invalid syntax, please use one of the following commands.\n");
+		fprintf(stderr, "caltool -info\n");
+		fprintf(stderr, "caltool -extract kind [--limit N] [--after date]   (without --limit, a series with no end is listed for %d days from its start or --after)\n", EXTRACT_ENDLESS_DAYS);
+		fprintf(stderr, "caltool -filter content [from date ] [to date ]\n");
+		fprintf(stderr, "caltool -combine file2 [--dedup]\n");
+		fprintf(stderr, "caltool -freebusy from to\n");
+		fprintf(stderr, "caltool -freeslots from to minutes file1 [file2 ...]\n");
+		fprintf(stderr, "caltool -conflicts [from to]   (without a window, series with no end are looked at for %d days)\n", EXTRACT_ENDLESS_DAYS);
+		fprintf(stderr, "caltool -merge file1 [file2 ...] [--sort dtstart]\n");
+		fprintf(stderr, "caltool -diff old.ics new.ics > changes.ics\n");
+		fprintf(stderr, "caltool -patch changes.ics\n");
+		fprintf(stderr, "caltool -query \"expression\"\n");
+		fprintf(stderr, "caltool -index file.ics\n");
+		fprintf(stderr, "caltool -search file.ics \"words\"\n");
+		fprintf(stderr, "caltool -snapshot file.ics > file.snap\n");
+		fprintf(stderr, "caltool -serve socket\n");
+		fprintf(stderr, "caltool -stats command [arguments]\n");
+		fprintf(stderr, "caltool -strict command [arguments]\n");
+		fprintf(stderr, "caltool -source file.ics command [arguments] < file.snap\n");
+        
+        return EXIT_FAILURE;
+	}
+    
+    /* If any subcomponent calls returned an error print an error to stderr and return EXIT_FAILURE */
+    if (status.code != OK){
+		
+		if (status.code == IOERR){
+			
+			fprintf(stderr, "Error: IOERR received\n");
+		}
+		
+		else if (status.code == NOCAL){
 			
 			fprintf(stderr, "Error: NOCAL received from calFilter\n");
 		}
@@ -768,6 +1703,17 @@ int main(int argc, char *argv[]){
 	}
 }
 
+time_t propEpoch (const CalComp *comp, const CalTzSet *zones, const CalProp *prop){
+	
+	time_t date;
+	
+	/* Use the snapshot's precomputed value if there is one, otherwise parse the value */
+	if (calSnapEpoch(comp, prop, &date) == true)
+		return date;
+	
+	return calTzEpoch(zones, prop);
+}
+
 CalStatus calInfo( const CalComp *comp, int lines, FILE *const txtfile ){
     
     CalStatus status;
@@ -1021,7 +1967,8 @@ CalStatus sortedCommonNames (const CalComp *comp, FILE *const txtfile ){
     /* Iterate through all properties */
     while (currentProp != NULL){
         
-        currentParam = currentProp->param;
+        /* Only organizer CNs are wanted, so other properties keep their parameters undecoded */
+        currentParam = strcmp(currentProp->name, "ORGANIZER") == 0 ? getCalParams(currentProp) : NULL;
         
         /* Iterate through all paramters in current property */
         while (currentParam != NULL){
@@ -1060,7 +2007,8 @@ CalStatus sortedCommonNames (const CalComp *comp, FILE *const txtfile ){
 		/* Iterate through all properties */
         while (currentProp != NULL){
             
-            currentParam = currentProp->param;
+            /* Only organizer CNs are wanted, so other properties keep their parameters undecoded */
+            currentParam = strcmp(currentProp->name, "ORGANIZER") == 0 ? getCalParams(currentProp) : NULL;
             
             /* If current prop is a recognized date prop */
             if (strcmp(currentProp->name, "COMPLETED") == 0 || strcmp(currentProp->name, "DTEND") == 0 || strcmp(currentProp->name, "DUE") == 0 || strcmp(currentProp->name, "DTSTART") == 0 ||
@@ -1214,7 +2162,8 @@ CalStatus sortedCommonNames (const CalComp *comp, FILE *const txtfile ){
 			/* Iterate through all properties */
             while (currentProp != NULL){
                 
-                currentParam = currentProp->param;
+                /* Only organizer CNs are wanted, so other properties keep their parameters undecoded */
+                currentParam = strcmp(currentProp->name, "ORGANIZER") == 0 ? getCalParams(currentProp) : NULL;
                 
 				/* If current prop is a recognized date prop */
                 if (strcmp(currentProp->name, "COMPLETED") == 0 || strcmp(currentProp->name, "DTEND") == 0 || strcmp(currentProp->name, "DUE") == 0 || strcmp(currentProp->name, "DTSTART") == 0 ||
@@ -1483,7 +2432,7 @@ CalStatus sortedCommonNames (const CalComp *comp, FILE *const txtfile ){
 	/* If atleast one organizer was found, sort organizer names alphabetically */
     else{
         
-        qsort(toReturn, nameCount, sizeof(char *), compareStrings);
+        calSortStrings((const char **) toReturn, nameCount);
         
         /* Check if we wrote to txtfile succesfully */
         if (fprintf(txtfile, "Organizers:\n") < 0){
@@ -1551,32 +2500,16 @@ CalStatus sortedCommonNames (const CalComp *comp, FILE *const txtfile ){
     return status;
 }
 
-int compareStrings (const void *a, const void *b){ 
+int compareExtract (const void *a, const void *b){
     
     /* Cast parameters */
-    const char ** castA = (const char **) a;
-    const char ** castB = (const char **) b;
+    const ExtractRec * castA = (const ExtractRec *) a;
+    const ExtractRec * castB = (const ExtractRec *) b;
     
-    return strcmp(*castA, *castB); // Compare and b as strings and call strmcp to check which comes first alphabetically 
-} 
-
-int compareDates (const void *a, const void *b){
-    
-    /* Cast parameters */
-    struct tm * castA = (struct tm *) a;
-    struct tm * castB = (struct tm *) b;
+    if (castA->start != castB->start)
+        return castA->start < castB->start ? -1 : 1;
     
-    /* If date a is newer than date b */
-    if (mktime(castA) > mktime(castB))
-        return 1;
-        
-	/* If date b is newer than date a */
-    else if (mktime(castA) < mktime(castB))
-        return -1;
-       
-    /* If the date a and b are the same */
-    else 
-        return 0;
+    return castA->order < castB->order ? -1 : castA->order > castB->order;
 }
 
 int countProperties (const CalComp *comp){
@@ -1669,317 +2602,378 @@ int countOther (const CalComp *comp){
 
 CalStatus calExtract( const CalComp *comp, CalOpt kind, FILE *const txtfile){
 
+    return calExtractPage(comp, kind, NULL, 0, NULL, txtfile);
+}
+
+CalStatus calExtractPage( const CalComp *comp, CalOpt kind, const CalCursor *after, size_t limit, CalCursor *const next, FILE *const txtfile ){
+
     CalStatus status;
-    struct  tm times[1000];
-    char ** toReturn;
-    char ** sortedNames;
+    ExtractList list;
+    struct tm date;
     char printDate[MAXSTRINGLENGTH];
-    int i, y, nameCount, timeCount;
-    CalProp * currentProp;
+    size_t n, shown;
+    int i, y;
     
-    nameCount = 0;
-    timeCount = 0;
+    list.recs = NULL;
+    list.names = NULL;
+    list.nrecs = 0;
+    list.caprecs = 0;
+    list.nnames = 0;
+    list.capnames = 0;
+    list.kept = NULL;
+    list.nkept = 0;
+    list.after = after;
+    list.order = 0;
+    list.zones = kind == OEVENT ? calTzBuild(comp) : NULL;
+    
+    /* Keep one item past the page so we know whether another page follows */
+    list.limit = limit == 0 ? 0 : limit + 1;
+    
+    /* Collect from the calendar, its components and their subcomponents */
+    collectExtract(comp, comp, kind, &list);
+    
+    for (i = 0; i < comp->ncomps; ++i){
         
-    toReturn = malloc(sizeof(char*));
-    assert(toReturn);
+        collectExtract(comp, comp->comp[i], kind, &list);
+        
+        for (y = 0; y < comp->comp[i]->ncomps; ++y)
+            collectExtract(comp, comp->comp[i]->comp[y], kind, &list);
+    }
+    
+    status.code = OK;
+    shown = 0;
     
-    currentProp = comp->prop;    
+    /* A page that is empty ends where it started */
+    if (next != NULL){
+        
+        next->start = after != NULL ? after->start : 0;
+        next->order = after != NULL ? after->order : -1;
+        next->name = after != NULL && after->name != NULL ? strdup(after->name) : NULL;
+        next->more = false;
+    }
     
-    /* Iterate through all properties*/
-    while (currentProp != NULL){
-
-        /* If we've run into an X-property or a summary property store it in our string array */
-        if ((kind == OPROP && currentProp->name[0] == 'X' && currentProp->name[1] == '-') || (kind == OEVENT && strcmp(currentProp->name, "SUMMARY") == 0)){
+    /* If we are dealing with only VEVENTs, print them from oldest to newest */
+    if (kind == OEVENT){
+        
+        calSort(list.recs, list.nrecs, sizeof(ExtractRec), compareExtract);
+        
+        for (n = 0; n < list.nrecs && (limit == 0 || n < limit) && status.code == OK; ++n){
             
-            if (nameCount != 0){
-                
-                toReturn = realloc(toReturn, sizeof(char *) * (nameCount + 1));
-                assert(toReturn);
-            }
+            localtime_r(&list.recs[n].start, &date);
+            strftime(printDate, MAXSTRINGLENGTH, "%Y-%b-%d %l:%M %p: ", &date);
             
-            if (kind == OPROP){
-                
-                toReturn[nameCount] = malloc(sizeof(char) * (strlen(currentProp->name) + 1));
-                assert(toReturn[nameCount]);
+            if (fprintf(txtfile, "%s%s\n", printDate, list.recs[n].summary[0] == '\0' ? "(na)" : list.recs[n].summary) < 0)
+                status.code = IOERR;
+            else
+                ++lineCount;
             
-                strcpy(toReturn[nameCount],currentProp->name);
-                ++nameCount;
-            }
+            ++shown;
         }
+        
+        if (next != NULL && shown > 0){
             
-        currentProp = currentProp->next;
+            next->start = list.recs[shown - 1].start;
+            next->order = list.recs[shown - 1].order;
+            next->more = shown < list.nrecs;
+        }
     }
-
-    /* Iterate through all components at the top level */
-    for (i = 0; i < comp->ncomps; ++i){
-            
-        currentProp = comp->comp[i]->prop;
     
-		/* Iterate through all properties*/
-        while (currentProp != NULL){
+    /* If we are dealing with X-properties, print each name once in alphabetical order */
+    else if (kind == OPROP){
+        
+        calSortStrings(list.names, list.nnames);
+        
+        for (n = 0; n < list.nnames && (limit == 0 || shown < limit) && status.code == OK; ++n){
             
-            /* If current comp is a VEVENT and current property is DTSTART, convert the time value and store it */
-            if (strcmp(comp->comp[i]->name, "VEVENT") == 0 && kind == OEVENT && strcmp(currentProp->name, "DTSTART") == 0){
-                
-                times[timeCount].tm_sec = 0;
-                times[timeCount].tm_min = 0;
-                times[timeCount].tm_hour = 0;
-                times[timeCount].tm_mday = 0;
-                times[timeCount].tm_mon = 0;
-                times[timeCount].tm_year = 0;
-                times[timeCount].tm_wday = 0;
-                times[timeCount].tm_yday = 0;
-                times[timeCount].tm_isdst = -1;
-                
-                strptime(currentProp->value, "%Y%m%eT%H%M%S", &times[timeCount]);
-                strftime(printDate, MAXSTRINGLENGTH, "%Y-%b-%d %l:%M %p:", &times[timeCount]);
-                ++timeCount;
-            }
-
-            /* If we've run into an X-property or a summary property store it in our string array */
-            else if ((kind == OPROP && currentProp->name[0] == 'X' && currentProp->name[1] == '-') || (kind == OEVENT && strcmp(currentProp->name, "SUMMARY") == 0)){
-                
-                if (nameCount != 0){
-                    
-                    toReturn = realloc(toReturn, sizeof(char *) * (nameCount + 1));
-                    assert(toReturn);
-                }
-                
-                if (kind == OPROP){
-                    
-                    toReturn[nameCount] = malloc(sizeof(char) * (strlen(currentProp->name) + 1));
-                    assert(toReturn[nameCount]);
-                
-                    strcpy(toReturn[nameCount],currentProp->name);
-                    ++nameCount;
-                }
-                
-                else if (kind == OEVENT){
-                    
-                    toReturn[nameCount] = malloc(sizeof(char) * (strlen(currentProp->value) + 1));
-                    assert(toReturn[nameCount]);
-                
-                    strcpy(toReturn[nameCount],currentProp->value);
-                    ++nameCount;
-                }
-            }
-                
-            currentProp = currentProp->next;
+            if (n > 0 && strcmp(list.names[n], list.names[n - 1]) == 0)
+                continue;
+            
+            if (fprintf(txtfile, "%s\n", list.names[n]) < 0)
+                status.code = IOERR;
+            else
+                ++lineCount;
+            
+            ++shown;
         }
         
-        /* If we didn't find a summary property to match one of our DTSTART properties */
-        if (timeCount != nameCount){
-        
-			/* Enlarge our string array */
-            if (nameCount != 0){
-                
-                toReturn = realloc(toReturn, sizeof(char *) * (nameCount + 1));
-                assert(toReturn);
-            }
+        if (next != NULL && shown > 0){
             
-            /* Allocate memory for 1 character */
-            toReturn[nameCount] = malloc(sizeof(char));
-            assert(toReturn[nameCount]);
-            
-            /* Add null terminator and increment name count */
-            toReturn[nameCount][0] = '\0';
-            ++nameCount;
+            free(next->name);
+            next->name = strdup(list.names[n - 1]);
+            assert(next->name);
+            next->more = n < list.nnames;
         }
+    }
+    
+    free(list.recs);
+    free(list.names);
+    free(list.kept);
+    calTzFree(list.zones);
+    
+    status.linefrom = lineCount;
+    status.lineto = lineCount;
+    
+    return status;
+}
+
+void collectExtract (const CalComp *top, const CalComp *comp, CalOpt kind, ExtractList *list){
+    
+    const CalProp * currentProp;
+    const CalTzZone * zone;
+    CalRecur recur;
+    ExtractRec rec;
+    time_t occurrence, from;
+    bool event;
+    
+    event = kind == OEVENT && strcmp(comp->name, "VEVENT") == 0;
+    rec.summary = "";
+    
+    /* An event's summary may come after its starts, so find it first */
+    for (currentProp = comp->prop; event == true && currentProp != NULL; currentProp = currentProp->next){
         
-        /* Iterate through all subcomponents */
-        for (y = 0; y < comp->comp[i]->ncomps; ++y){
+        if (rec.summary[0] == '\0' && strcmp(currentProp->name, "SUMMARY") == 0)
+            rec.summary = currentProp->value;
+    }
+    
+    for (currentProp = comp->prop; currentProp != NULL; currentProp = currentProp->next){
+        
+        /* Record each start of an event */
+        if (event == true && strcmp(currentProp->name, "DTSTART") == 0){
             
-            currentProp = comp->comp[i]->comp[y]->prop;
-			
-			/* Iterate through properties */
-            while (currentProp != NULL){
-                 
-                /* If current comp is a VEVENT and current property is DTSTART, convert the time value and store it */
-                if (strcmp(comp->comp[i]->comp[y]->name, "VEVENT") == 0 && kind == OEVENT && strcmp(currentProp->name, "DTSTART") == 0){
-                    
-                    times[timeCount].tm_sec = 0;
-                    times[timeCount].tm_min = 0;
-                    times[timeCount].tm_hour = 0;
-                    times[timeCount].tm_mday = 0;
-                    times[timeCount].tm_mon = 0;
-                    times[timeCount].tm_year = 0;
-                    times[timeCount].tm_wday = 0;
-                    times[timeCount].tm_yday = 0;
-                    times[timeCount].tm_isdst = -1;
-                    
-                    strptime(currentProp->value, "%Y%m%eT%H%M%S", &times[timeCount]);
-                    
-                    strftime(printDate, MAXSTRINGLENGTH, "%Y-%b-%d %l:%M %p:", &times[timeCount]);
-                    ++timeCount;
-                }
+            rec.start = propEpoch(top, list->zones, currentProp);
+            rec.order = list->order;
+            ++list->order;
             
-				/* If we've run into an X-property or a summary property store it in our string array */
-                else if ((kind == OPROP && currentProp->name[0] == 'X' && currentProp->name[1] == '-') || (kind == OEVENT && strcmp(currentProp->name, "SUMMARY") == 0)){
-                    
-                    if (nameCount != 0){
-                        
-                        toReturn = realloc(toReturn, sizeof(char *) * (nameCount + 1));
-                        assert(toReturn);
-                    }
+            if (calRecurInit(&recur, comp, calRecurWall(currentProp->value)) == false){
+                
+                addExtractRec(list, &rec);
+            }
+            
+            else{
+                
+                /* The rule runs on the event's own clock */
+                zone = calTzZone(list->zones, currentProp);
+                
+                if (recur.untilUTC == true)
+                    recur.until = calTzFromUTC(zone, recur.until);
+                
+                /* Where listing starts: the series' own start, or the cursor if that comes later */
+                from = recur.dtstart;
+                
+                if (list->after != NULL && calTzFromUTC(zone, list->after->start) > from)
+                    from = calTzFromUTC(zone, list->after->start);
+                
+                /* A page stops a series with no end at its edge; without a limit the series is cut off
+                   EXTRACT_ENDLESS_DAYS after where listing starts */
+                if (calRecurBounded(&recur) == false && list->limit == 0){
                     
-                    if (kind == OPROP){
-                        
-                        toReturn[nameCount] = malloc(sizeof(char) * (strlen(currentProp->name) + 1));
-                        assert(toReturn[nameCount]);
+                    recur.until = from + EXTRACT_ENDLESS_DAYS * 24L * 60 * 60 - 1;
+                    recur.hasUntil = true;
+                }
+                
+                if (list->after != NULL)
+                    calRecurSkip(&recur, from - CALTZ_SLACK);
+                
+                /* Occurrences come in order, so once one can't get into a full heap none of the rest can */
+                while (calRecurNext(&recur, &occurrence) == true){
                     
-                        strcpy(toReturn[nameCount],currentProp->name);
-                        ++nameCount;
-                    }
+                    rec.start = calTzToUTC(zone, occurrence);
                     
-                    else if (kind == OEVENT){
-                        
-                        toReturn[nameCount] = malloc(sizeof(char) * (strlen(currentProp->value) + 1));
-                        assert(toReturn[nameCount]);
+                    if (list->limit != 0 && list->nrecs == list->limit && compareExtract(&rec, &list->recs[0]) >= 0)
+                        break;
                     
-                        strcpy(toReturn[nameCount],currentProp->value);
-                        ++nameCount;
-                    }
+                    addExtractRec(list, &rec);
                 }
-    
-                currentProp = currentProp->next;
             }
             
-            /* If we didn't find a summary property to match one of our DTSTART properties */
-            if (timeCount != nameCount){
+            calRecurFree(&recur);
+        }
         
-				/* Enlarge our string array */
-				if (nameCount != 0){
-					
-					toReturn = realloc(toReturn, sizeof(char *) * (nameCount + 1));
-					assert(toReturn);
-				}
-				
-				
-				/* Allocate memory for 1 character */
-				toReturn[nameCount] = malloc(sizeof(char));
-				assert(toReturn[nameCount]);
-				
-				toReturn[nameCount][0] = '\0';
-				++nameCount;
-			}
+        /* Store X-property names as they are in the tree */
+        else if (kind == OPROP && currentProp->name[0] == 'X' && currentProp->name[1] == '-'){
+            
+            addExtractName(list, currentProp->name);
         }
-    }       
+    }
+}
+
+void addExtractRec (ExtractList *list, const ExtractRec *rec){
     
+    ExtractRec cursor;
+    size_t n, child;
     
-    /* If we are dealing with only VEVENTs */
-    if (kind == OEVENT){
+    if (list->after != NULL){
         
-        sortedNames = malloc(sizeof(char *) * timeCount); // Allocate memory for array of sorted names
+        cursor.start = list->after->start;
+        cursor.order = list->after->order;
         
-        /* Iterate through array and create string for each line that will be printed while the dates and values are still in the same array positions */
-        for (i = 0; i < timeCount; ++i){
-			
-			strftime(printDate, MAXSTRINGLENGTH, "%Y-%b-%d %l:%M %p: ", &times[i]);
-			
-			sortedNames[i] = malloc(sizeof(char) * (strlen(toReturn[i]) + strlen(printDate) + 5));
-			
-			strcpy(sortedNames[i], printDate);
-			
-			if (strlen(toReturn[i]) == 0)
-				strcat(sortedNames[i], "(na)");
-			
-			else
-				strcat(sortedNames[i], toReturn[i]);
-		}
-		
-        qsort(times, timeCount, sizeof(struct tm), compareDates); // Sort the array of dates
-         
-        /* Print dates from oldest to newest */
-        for (i = 0; i < timeCount; ++i){
-            
-            strftime(printDate, MAXSTRINGLENGTH, "%Y-%b-%d %l:%M %p: ", &times[i]);
-            
-            for (y = 0; y < timeCount; ++y){
-				
-				if (strncmp(printDate, sortedNames[y], strlen(printDate)) == 0){
-					
-					if (fprintf(txtfile, "%s\n", sortedNames[y]) < 0){
-						
-						status.code = IOERR;
-						status.linefrom = lineCount;
-						status.lineto = lineCount;
-						
-						return status;
-					}
-					
-					++lineCount;
-				}
-			}
-        }
+        if (compareExtract(rec, &cursor) <= 0)
+            return;
+    }
+    
+    /* Grow by doubling, but never past the limit */
+    if (list->nrecs == list->caprecs && (list->limit == 0 || list->nrecs < list->limit)){
         
-        /* Free elements of array */
-        for (i = 0; i < timeCount; ++i){
-		
-			free(sortedNames[i]);
-		}
-		
-		free(sortedNames); // Free the array itself
+        list->caprecs = list->caprecs == 0 ? 64 : list->caprecs * 2;
+        
+        if (list->limit != 0 && list->caprecs > list->limit)
+            list->caprecs = list->limit;
+        
+        list->recs = realloc(list->recs, sizeof(ExtractRec) * list->caprecs);
+        assert(list->recs);
     }
     
-    /* If we are dealing with X-properties */
-    if (kind == OPROP){
+    if (list->limit == 0){
         
-        qsort(toReturn, nameCount, sizeof(char *), compareStrings); // Sort x-properties alphabetically 
+        list->recs[list->nrecs] = *rec;
+        ++list->nrecs;
+        return;
+    }
+    
+    /* Until the heap is full, add at the bottom and move up past parents that come before it */
+    if (list->nrecs < list->limit){
         
-        /* Iterate through all x-properties */
-        for (i = 0; i < nameCount; ++i){
+        for (n = list->nrecs; n > 0 && compareExtract(rec, &list->recs[(n - 1) / 2]) > 0; n = (n - 1) / 2)
+            list->recs[n] = list->recs[(n - 1) / 2];
         
-			/* Print current x-property */
-			if (strlen(toReturn[i]) != 0){
-			
-				if (fprintf(txtfile, "%s\n", toReturn[i]) < 0){
-					
-					status.code = IOERR;
-					status.linefrom = lineCount;
-					status.lineto = lineCount;
-					
-					return status;
-				}
-            
-				++lineCount;
-			}
-			
-			/* Iterate to the next unique x-property */
-            for (y = i + 1; y < nameCount; ++y){
-                    
-				if (strcmp(toReturn[i], toReturn[y]) == 0 && y == nameCount - 1){
-					
-					i = nameCount;
-					break;
-				}
-				
-                else if (strcmp(toReturn[i], toReturn[y]) == 0){
-                    
-                    continue;
-                }
-                
-                else{
-                    
-                    i = y - 1;
-                    break;
-                }
-            }
-        }
+        list->recs[n] = *rec;
+        ++list->nrecs;
+        return;
     }
     
-    /* Free array contents */
-    for (i = 0; i < nameCount; ++i){
+    /* Once it is full, a record only goes in to replace the last one kept, moving down past children that come after it */
+    if (compareExtract(rec, &list->recs[0]) >= 0)
+        return;
+    
+    for (n = 0; (child = 2 * n + 1) < list->nrecs; n = child){
         
-        free(toReturn[i]);
+        if (child + 1 < list->nrecs && compareExtract(&list->recs[child + 1], &list->recs[child]) > 0)
+            ++child;
+        
+        if (compareExtract(&list->recs[child], rec) <= 0)
+            break;
+        
+        list->recs[n] = list->recs[child];
     }
-         
-    free(toReturn); // Free string array 
     
-    status.code = OK;
-    status.linefrom = lineCount;
-    status.lineto = lineCount;
+    list->recs[n] = *rec;
+}
+
+void addExtractName (ExtractList *list, const char *name){
     
-    return status;
+    size_t n, child;
+    
+    if (list->after != NULL && list->after->name != NULL && strcmp(name, list->after->name) <= 0)
+        return;
+    
+    /* Most names come after the last one kept once the heap is full, so check that before looking for a copy */
+    if (list->limit != 0 && list->nnames == list->limit && strcmp(name, list->names[0]) >= 0)
+        return;
+    
+    /* Under a limit each name is kept once, so a copy already in the heap is found in the set of kept names */
+    if (list->limit != 0 && list->kept != NULL && list->kept[findExtractName(list, name)] != NULL)
+        return;
+    
+    /* Grow by doubling, but never past the limit */
+    if (list->nnames == list->capnames && (list->limit == 0 || list->nnames < list->limit)){
+        
+        list->capnames = list->capnames == 0 ? 64 : list->capnames * 2;
+        
+        if (list->limit != 0 && list->capnames > list->limit)
+            list->capnames = list->limit;
+        
+        list->names = realloc(list->names, sizeof(char *) * list->capnames);
+        assert(list->names);
+        
+        if (list->limit != 0)
+            resizeExtractNames(list);
+    }
+    
+    if (list->limit == 0){
+        
+        list->names[list->nnames] = name;
+        ++list->nnames;
+        return;
+    }
+    
+    /* Same heap as addExtractRec, ordered by strcmp */
+    if (list->nnames < list->limit){
+        
+        for (n = list->nnames; n > 0 && strcmp(name, list->names[(n - 1) / 2]) > 0; n = (n - 1) / 2)
+            list->names[n] = list->names[(n - 1) / 2];
+        
+        list->names[n] = name;
+        ++list->nnames;
+        list->kept[findExtractName(list, name)] = name;
+        return;
+    }
+    
+    /* The name replaces the last one kept, which leaves the set with it */
+    dropExtractName(list, list->names[0]);
+    list->kept[findExtractName(list, name)] = name;
+    
+    for (n = 0; (child = 2 * n + 1) < list->nnames; n = child){
+        
+        if (child + 1 < list->nnames && strcmp(list->names[child + 1], list->names[child]) > 0)
+            ++child;
+        
+        if (strcmp(list->names[child], name) <= 0)
+            break;
+        
+        list->names[n] = list->names[child];
+    }
+    
+    list->names[n] = name;
+}
+
+size_t findExtractName (const ExtractList *list, const char *name){
+    
+    size_t slot;
+    
+    for (slot = hashCalText(name, strlen(name)) & (list->nkept - 1); list->kept[slot] != NULL; slot = (slot + 1) & (list->nkept - 1))
+        if (strcmp(list->kept[slot], name) == 0)
+            break;
+    
+    return slot;
+}
+
+void dropExtractName (ExtractList *list, const char *name){
+    
+    size_t hole, slot, home, mask;
+    
+    mask = list->nkept - 1;
+    hole = findExtractName(list, name);
+    
+    /* A name further along the run moves into the hole unless its own slot lies between the hole and where it is */
+    for (slot = (hole + 1) & mask; list->kept[slot] != NULL; slot = (slot + 1) & mask){
+        
+        home = hashCalText(list->kept[slot], strlen(list->kept[slot])) & mask;
+        
+        if (((slot - home) & mask) >= ((slot - hole) & mask)){
+            
+            list->kept[hole] = list->kept[slot];
+            hole = slot;
+        }
+    }
+    
+    list->kept[hole] = NULL;
+}
+
+void resizeExtractNames (ExtractList *list){
+    
+    size_t n;
+    
+    list->nkept = 16;
+    
+    while (list->nkept < 2 * list->capnames)
+        list->nkept *= 2;
+    
+    free(list->kept);
+    list->kept = calloc(list->nkept, sizeof(char *));
+    assert(list->kept);
+    
+    for (n = 0; n < list->nnames; ++n)
+        list->kept[findExtractName(list, list->names[n])] = list->names[n];
 }
 
 CalStatus calFilter(const CalComp *comp, CalOpt content, time_t datefrom, time_t dateto, FILE *const icsfile){
@@ -1989,11 +2983,17 @@ CalStatus calFilter(const CalComp *comp, CalOpt content, time_t datefrom, time_t
     CalStatus status;
     int i, y;
     CalProp * currentProp;
-    struct tm * temp;
+    CalTzSet * zones;
+    time_t date;
+    
+    STATS_START(started);
     
     compCopy = malloc(sizeof(CalComp) + (sizeof(CalComp *) * comp->ncomps));
     assert(compCopy);
     
+    /* Built once per call, so every TZID date below is a table lookup */
+    zones = datefrom != 0 || dateto != 0 ? calTzBuild(comp) : NULL;
+    
     memcpy(compCopy, comp, sizeof(CalComp) + (sizeof(CalComp *) * comp->ncomps));
 
 	/* Iterate through all components */
@@ -2045,33 +3045,13 @@ CalStatus calFilter(const CalComp *comp, CalOpt content, time_t datefrom, time_t
 				/* Check if property is one of the recognized date props */
 				if (strcmp(currentProp->name, "COMPLETED") == 0 || strcmp(currentProp->name, "DTEND") == 0 || strcmp(currentProp->name, "DUE") == 0 || strcmp(currentProp->name, "DTSTART") == 0){
 						
-					temp = malloc(sizeof(struct tm));
-					assert(temp);
-					
-					temp->tm_sec = 0;
-					temp->tm_min = 0;
-					temp->tm_hour = 0;
-					temp->tm_mday = 0;
-					temp->tm_mon = 0;
-					temp->tm_year = 0;
-					temp->tm_wday = 0;
-					temp->tm_yday = 0;
-					temp->tm_isdst = -1;
-					
-					strptime(currentProp->value, "%Y%m%eT%H%M%S", temp);
+					date = propEpoch(comp, zones, currentProp);
 					
 					/* If date property's value falls within the date range don't remove it */
-					if (datefrom <= mktime(temp) && mktime(temp) <= dateto){
+					if (datefrom <= date && date <= dateto){
 						
-						free(temp);
 						removeComp = false;
 						break;
-					}
-					
-					/* Otherwise free the temp struct tm */
-					else{
-						
-						free(temp);
 					}					
 				}
 				
@@ -2089,33 +3069,13 @@ CalStatus calFilter(const CalComp *comp, CalOpt content, time_t datefrom, time_t
 					/* Check if property is one of the recognized date props */
 					if (strcmp(currentProp->name, "COMPLETED") == 0 || strcmp(currentProp->name, "DTEND") == 0 || strcmp(currentProp->name, "DUE") == 0 || strcmp(currentProp->name, "DTSTART") == 0){
 							
-						temp = malloc(sizeof(struct tm));
-						assert(temp);
-						
-						temp->tm_sec = 0;
-						temp->tm_min = 0;
-						temp->tm_hour = 0;
-						temp->tm_mday = 0;
-						temp->tm_mon = 0;
-						temp->tm_year = 0;
-						temp->tm_wday = 0;
-						temp->tm_yday = 0;
-						temp->tm_isdst = -1;
-						
-						strptime(currentProp->value, "%Y%m%eT%H%M%S", temp);
+						date = propEpoch(comp, zones, currentProp);
 						
 						/* If date property's value falls within the date range don't remove it */
-						if (datefrom <= mktime(temp) && mktime(temp) <= dateto){
+						if (datefrom <= date && date <= dateto){
 							
-							free(temp);
 							removeComp = false;
 							break;
-						}
-						
-						/* Otherwise free the temp struct tm */
-						else{
-							
-							free(temp);
 						}						
 					}
 		
@@ -2123,6 +3083,10 @@ CalStatus calFilter(const CalComp *comp, CalOpt content, time_t datefrom, time_t
 				}
 			}
 			
+			/* A recurring component may have a later occurrence in the range */
+			if (removeComp == true && recursInRange(comp, zones, compCopy->comp[i], datefrom, dateto) == true)
+				removeComp = false;
+			
 			/* If we didn't find a date prop with a value within the specified range remove the component */
 			if (removeComp == true){
 				
@@ -2153,34 +3117,14 @@ CalStatus calFilter(const CalComp *comp, CalOpt content, time_t datefrom, time_t
 				/* Check if property is one of the recognized date props */
 				if (strcmp(currentProp->name, "COMPLETED") == 0 || strcmp(currentProp->name, "DTEND") == 0 || strcmp(currentProp->name, "DUE") == 0 || strcmp(currentProp->name, "DTSTART") == 0){
 						
-					temp = malloc(sizeof(struct tm));
-					assert(temp);
-					
-					temp->tm_sec = 0;
-					temp->tm_min = 0;
-					temp->tm_hour = 0;
-					temp->tm_mday = 0;
-					temp->tm_mon = 0;
-					temp->tm_year = 0;
-					temp->tm_wday = 0;
-					temp->tm_yday = 0;
-					temp->tm_isdst = -1;
-					
-					strptime(currentProp->value, "%Y%m%eT%H%M%S", temp);
+					date = propEpoch(comp, zones, currentProp);
 					
 					/* If date property's value falls within the date range don't remove it */
-					if (datefrom <= mktime(temp)){
+					if (datefrom <= date){
 						
-						free(temp);
 						removeComp = false;
 						break;
 					}
-					
-					/* Otherwise free the temp struct tm */
-					else{
-						
-						free(temp);
-					}
 				}
 				
 				currentProp = currentProp->next;
@@ -2197,33 +3141,13 @@ CalStatus calFilter(const CalComp *comp, CalOpt content, time_t datefrom, time_t
 					/* Check if property is one of the recognized date props */
 					if (strcmp(currentProp->name, "COMPLETED") == 0 || strcmp(currentProp->name, "DTEND") == 0 || strcmp(currentProp->name, "DUE") == 0 || strcmp(currentProp->name, "DTSTART") == 0){
 							
-						temp = malloc(sizeof(struct tm));
-						assert(temp);
-						
-						temp->tm_sec = 0;
-						temp->tm_min = 0;
-						temp->tm_hour = 0;
-						temp->tm_mday = 0;
-						temp->tm_mon = 0;
-						temp->tm_year = 0;
-						temp->tm_wday = 0;
-						temp->tm_yday = 0;
-						temp->tm_isdst = -1;
-						
-						strptime(currentProp->value, "%Y%m%eT%H%M%S", temp);
+						date = propEpoch(comp, zones, currentProp);
 						
 						/* If date property's value falls within the date range don't remove it */
-						if (datefrom <= mktime(temp)){
-						
-							free(temp);
+						if (datefrom <= date){
+							
 							removeComp = false;
 							break;
-						}
-						
-						/* Otherwise free the temp struct tm */
-						else{
-							
-							free(temp);
 						}						
 					}
 		
@@ -2231,6 +3155,10 @@ CalStatus calFilter(const CalComp *comp, CalOpt content, time_t datefrom, time_t
 				}
 			}
 			
+			/* A recurring component may have a later occurrence in the range */
+			if (removeComp == true && recursInRange(comp, zones, compCopy->comp[i], datefrom, 0) == true)
+				removeComp = false;
+			
 			/* If we didn't find a date prop with a value within the specified range remove the component */
 			if (removeComp == true){
 				
@@ -2263,34 +3191,14 @@ CalStatus calFilter(const CalComp *comp, CalOpt content, time_t datefrom, time_t
 				/* Check if property is one of the recognized date props */
 				if (strcmp(currentProp->name, "COMPLETED") == 0 || strcmp(currentProp->name, "DTEND") == 0 || strcmp(currentProp->name, "DUE") == 0 || strcmp(currentProp->name, "DTSTART") == 0){
 						
-					temp = malloc(sizeof(struct tm));
-					assert(temp);
-					
-					temp->tm_sec = 0;
-					temp->tm_min = 0;
-					temp->tm_hour = 0;
-					temp->tm_mday = 0;
-					temp->tm_mon = 0;
-					temp->tm_year = 0;
-					temp->tm_wday = 0;
-					temp->tm_yday = 0;
-					temp->tm_isdst = -1;
-					
-					strptime(currentProp->value, "%Y%m%eT%H%M%S", temp);
+					date = propEpoch(comp, zones, currentProp);
 					
 					/* If date property's value falls within the date range don't remove it */
-					if (mktime(temp) <= dateto){
+					if (date <= dateto){
 						
-						free(temp);
 						removeComp = false;
 						break;
 					}
-					
-					/* Otherwise free the temp struct tm */
-					else{
-						
-						free(temp);
-					}
 				}
 				
 				currentProp = currentProp->next;
@@ -2307,33 +3215,13 @@ CalStatus calFilter(const CalComp *comp, CalOpt content, time_t datefrom, time_t
 					/* Check if property is one of the recognized date props */
 					if (strcmp(currentProp->name, "COMPLETED") == 0 || strcmp(currentProp->name, "DTEND") == 0 || strcmp(currentProp->name, "DUE") == 0 || strcmp(currentProp->name, "DTSTART") == 0){
 							
-						temp = malloc(sizeof(struct tm));
-						assert(temp);
-						
-						temp->tm_sec = 0;
-						temp->tm_min = 0;
-						temp->tm_hour = 0;
-						temp->tm_mday = 0;
-						temp->tm_mon = 0;
-						temp->tm_year = 0;
-						temp->tm_wday = 0;
-						temp->tm_yday = 0;
-						temp->tm_isdst = -1;
-						
-						strptime(currentProp->value, "%Y%m%eT%H%M%S", temp);
+						date = propEpoch(comp, zones, currentProp);
 						
 						/* If date property's value falls within the date range don't remove it */
-						if (mktime(temp) <= dateto){
+						if (date <= dateto){
 							
-							free(temp);
 							removeComp = false;
 							break;
-						}
-						
-						/* Otherwise free the temp struct tm */
-						else{
-							
-							free(temp);
 						}						
 					}
 		
@@ -2368,10 +3256,71 @@ CalStatus calFilter(const CalComp *comp, CalOpt content, time_t datefrom, time_t
 	}
 	
 	free(compCopy);
+	calTzFree(zones);
+	
+	STATS_STOP(filter, started);
 
 	return status;
 }
 
+bool recursInRange (const CalComp *top, const CalTzSet *zones, const CalComp *comp, time_t datefrom, time_t dateto){
+    
+    const CalProp * currentProp, * dtstart, * dtend;
+    const CalTzZone * zone;
+    CalRecur recur;
+    time_t start, length, occurrence;
+    bool found;
+    
+    dtstart = NULL;
+    dtend = NULL;
+    
+    for (currentProp = comp->prop; currentProp != NULL; currentProp = currentProp->next){
+        
+        if (dtstart == NULL && strcmp(currentProp->name, "DTSTART") == 0)
+            dtstart = currentProp;
+        else if (dtend == NULL && (strcmp(currentProp->name, "DTEND") == 0 || strcmp(currentProp->name, "DUE") == 0))
+            dtend = currentProp;
+    }
+    
+    if (dtstart == NULL)
+        return false;
+    
+    start = propEpoch(top, zones, dtstart);
+    length = dtend != NULL ? propEpoch(top, zones, dtend) - start : 0;
+    
+    if (length < 0)
+        length = 0;
+    
+    found = false;
+    
+    /* The first occurrence that hasn't ended by datefrom is the only one that needs looking at; the rule runs on
+       DTSTART's clock, so the skip starts a little early and the occurrences it lets through are passed over here */
+    if (calRecurInit(&recur, comp, calRecurWall(dtstart->value)) == true){
+        
+        zone = calTzZone(zones, dtstart);
+        
+        if (recur.untilUTC == true)
+            recur.until = calTzFromUTC(zone, recur.until);
+        
+        calRecurSkip(&recur, calTzFromUTC(zone, datefrom - length) - CALTZ_SLACK);
+        
+        while (calRecurNext(&recur, &occurrence) == true){
+            
+            occurrence = calTzToUTC(zone, occurrence);
+            
+            if (occurrence + length < datefrom)
+                continue;
+            
+            found = dateto == 0 || occurrence <= dateto;
+            break;
+        }
+    }
+    
+    calRecurFree(&recur);
+    
+    return found;
+}
+
 CalStatus calCombine( const CalComp *comp1, const CalComp *comp2, FILE *const icsfile ){
     
     bool foundVer, foundProdid;
@@ -2527,22 +3476,1046 @@ CalStatus calCombine( const CalComp *comp1, const CalComp *comp2, FILE *const ic
 	return status;	
 }
 
-CalStatus writeCalComp (FILE *const ics, const CalComp *comp){
+CalStatus calFreeBusy( const CalComp *comp, time_t datefrom, time_t dateto, FILE *const icsfile ){
 	
-    char buffer[MAXSTRINGLENGTH], foldedBuffer[MAXSTRINGLENGTH];
-	CalParam * currentParam;
-    CalProp * currentProp;
-    CalStatus status;
-    int i, y;
-    	
-	/* BEGIN statement */
-	strcpy(buffer, "BEGIN:");
-	strcat(buffer, comp->name);
-	strcat(buffer, "\r");
-	strcat(buffer, "\n");
+	CalStatus status;
+	CalBusy busy;
+	const CalSpan * span;
+	size_t b, t;
+	bool ok, tentative;
+	
+	calBusyTimes(comp, datefrom, dateto, &busy);
+	
+	ok = writeFreeBusyStart(icsfile, "freebusy", datefrom, dateto);
+	
+	/* One period per line, busy and tentative taken together in order of start */
+	for (b = 0, t = 0; ok == true && (b < busy.nbusy || t < busy.ntentative); ){
+		
+		tentative = t < busy.ntentative && (b == busy.nbusy || busy.tentative[t].start < busy.busy[b].start);
+		span = tentative == true ? &busy.tentative[t++] : &busy.busy[b++];
+		
+		ok = writeFreeBusyPeriod(icsfile, tentative == true ? "FREEBUSY;FBTYPE=BUSY-TENTATIVE" : "FREEBUSY", span);
+	}
+	
+	ok = ok && writeContentLine(icsfile, "END", "VFREEBUSY") && writeContentLine(icsfile, "END", "VCALENDAR");
+	
+	calBusyFree(&busy);
+	
+	status.code = ok == true ? OK : IOERR;
+	status.linefrom = lineCount;
+	status.lineto = lineCount;
+	
+	return status;
+}
+
+CalStatus calFreeSlots( const CalComp *const *comps, int ncomps, time_t datefrom, time_t dateto, time_t length, FILE *const icsfile ){
+	
+	CalStatus status;
+	CalBusy * busy;
+	CalSpan * slots;
+	size_t nslots, i;
+	bool ok;
+	int j;
+	
+	busy = malloc(sizeof(CalBusy) * (ncomps + 1));
+	assert(busy);
+	
+	calBusyMany(comps, ncomps, datefrom, dateto, busy);
+	nslots = calBusyFreeSlots(busy, ncomps, datefrom, dateto, length, &slots);
+	
+	for (j = 0; j < ncomps; ++j)
+		calBusyFree(&busy[j]);
+	
+	free(busy);
+	
+	ok = writeFreeBusyStart(icsfile, "freeslots", datefrom, dateto);
+	
+	for (i = 0; ok == true && i < nslots; ++i)
+		ok = writeFreeBusyPeriod(icsfile, "FREEBUSY;FBTYPE=FREE", &slots[i]);
+	
+	ok = ok && writeContentLine(icsfile, "END", "VFREEBUSY") && writeContentLine(icsfile, "END", "VCALENDAR");
+	
+	free(slots);
+	
+	status.code = ok == true ? OK : IOERR;
+	status.linefrom = lineCount;
+	status.lineto = lineCount;
+	
+	return status;
+}
+
+CalStatus calCombineDedup( const CalComp *comp1, const CalComp *comp2, FILE *const icsfile ){
+	
+	const CalComp * inputs[2] = { comp1, comp2 };
+	const CalComp * comp;
+	const char * uid, * rid;
+	CalComp * merged, * rest;
+	DedupSlot * slots;
+	CalStatus status;
+	uint64_t hash;
+	size_t nslots, slot;
+	int input, i;
+	
+	/* Sized from the component counts to stay at most half full, so every lookup is a probe or two */
+	nslots = 16;
+	
+	while (nslots < 2 * ((size_t) comp1->ncomps + comp2->ncomps))
+		nslots *= 2;
+	
+	slots = calloc(nslots, sizeof(DedupSlot));
+	assert(slots);
+	
+	merged = malloc(sizeof(CalComp) + (sizeof(CalComp *) * (comp1->ncomps + comp2->ncomps)));
+	assert(merged);
+	
+	memcpy(merged, comp1, sizeof(CalComp));
+	merged->ncomps = 0;
+	
+	/* One pass over both calendars; a duplicate takes the place of the first version if it supersedes it */
+	for (input = 0; input < 2; ++input){
+		
+		for (i = 0; i < inputs[input]->ncomps; ++i){
+			
+			comp = inputs[input]->comp[i];
+			
+			if (dedupKey(comp, &uid, &rid) == false){
+				
+				merged->comp[merged->ncomps++] = (CalComp *) comp;
+				continue;
+			}
+			
+			hash = hashCompKey(comp->name, uid, rid);
+			
+			for (slot = hash & (nslots - 1); slots[slot].uid != NULL; slot = (slot + 1) & (nslots - 1))
+				if (slots[slot].hash == hash && strcmp(slots[slot].uid, uid) == 0 && strcmp(slots[slot].rid, rid) == 0 &&
+				    strcmp(slots[slot].name, comp->name) == 0)
+					break;
+			
+			if (slots[slot].uid == NULL){
+				
+				slots[slot].hash = hash;
+				slots[slot].name = comp->name;
+				slots[slot].uid = uid;
+				slots[slot].rid = rid;
+				slots[slot].kept = merged->ncomps;
+				merged->comp[merged->ncomps++] = (CalComp *) comp;
+			}
+			
+			else if (dedupNewer(merged->comp[slots[slot].kept], comp) == true)
+				merged->comp[slots[slot].kept] = (CalComp *) comp;
+		}
+	}
+	
+	free(slots);
+	
+	/* calCombine merges the calendar properties as usual; comp2's components are already among comp1's */
+	rest = malloc(sizeof(CalComp));
+	assert(rest);
+	
+	memcpy(rest, comp2, sizeof(CalComp));
+	rest->ncomps = 0;
+	
+	status = calCombine(merged, rest, icsfile);
+	
+	free(merged);
+	free(rest);
+	
+	return status;
+}
+
+uint64_t hashCompKey (const char *name, const char *uid, const char *rid){
+	
+	const char * key[3] = { name, uid, rid };
+	const unsigned char * c;
+	uint64_t hash;
+	int i;
+	
+	/* FNV-1a, with a zero byte between the parts so that moving text from one to the next changes the hash */
+	hash = 14695981039346656037ULL;
+	
+	for (i = 0; i < 3; ++i){
+		
+		if (i > 0)
+			hash *= 1099511628211ULL;
+		
+		for (c = (const unsigned char *) key[i]; *c != '\0'; ++c)
+			hash = (hash ^ *c) * 1099511628211ULL;
+	}
+	
+	return hash;
+}
+
+bool dedupKey (const CalComp *comp, const char **uid, const char **rid){
+	
+	const CalProp * currentProp;
+	const char * key;
+	
+	key = strcmp(comp->name, "VTIMEZONE") == 0 ? "TZID" : "UID";
+	*uid = NULL;
+	*rid = "";
+	
+	for (currentProp = comp->prop; currentProp != NULL; currentProp = currentProp->next){
+		
+		if (*uid == NULL && strcmp(currentProp->name, key) == 0)
+			*uid = currentProp->value;
+		else if (strcmp(currentProp->name, "RECURRENCE-ID") == 0)
+			*rid = currentProp->value;
+	}
+	
+	return *uid != NULL;
+}
+
+bool dedupNewer (const CalComp *kept, const CalComp *later){
+	
+	static const char *const names[] = { "SEQUENCE", "LAST-MODIFIED", "DTSTAMP" };
+	const CalComp * versions[2] = { kept, later };
+	const CalProp * currentProp;
+	long long value[2];
+	int i, v;
+	
+	for (i = 0; i < 3; ++i){
+		
+		/* SEQUENCE is a count and the others are UTC DATE-TIMEs, so both compare as numbers */
+		for (v = 0; v < 2; ++v){
+			
+			value[v] = -1;
+			
+			for (currentProp = versions[v]->prop; currentProp != NULL; currentProp = currentProp->next){
+				
+				if (strcmp(currentProp->name, names[i]) == 0){
+					
+					value[v] = i == 0 ? atoll(currentProp->value) : (long long) calRecurWall(currentProp->value);
+					break;
+				}
+			}
+		}
+		
+		if (value[0] != value[1])
+			return value[1] > value[0];
+	}
+	
+	return false;
+}
+
+CalStatus calConflicts( const CalComp *comp, time_t datefrom, time_t dateto, FILE *const txtfile ){
+	
+	ConflictWriter writer;
+	CalStatus status;
+	
+	writer.txtfile = txtfile;
+	writer.ok = true;
+	
+	calBusyConflicts(comp, datefrom, dateto, writeConflict, &writer);
+	
+	status.code = writer.ok == true ? OK : IOERR;
+	status.linefrom = lineCount;
+	status.lineto = lineCount;
+	
+	return status;
+}
+
+void findConflictWindow (const CalComp *comp, time_t *const datefrom, time_t *const dateto){
+	
+	const CalProp * currentProp, * dtstart;
+	CalTzSet * zones;
+	time_t start, end, length;
+	bool recurs, found;
+	int i;
+	
+	zones = calTzBuild(comp);
+	found = false;
+	*datefrom = 0;
+	*dateto = 0;
+	
+	for (i = 0; i < comp->ncomps; ++i){
+		
+		if (strcmp(comp->comp[i]->name, "VEVENT") != 0)
+			continue;
+		
+		dtstart = NULL;
+		recurs = false;
+		
+		for (currentProp = comp->comp[i]->prop; currentProp != NULL; currentProp = currentProp->next){
+			
+			if (dtstart == NULL && strcmp(currentProp->name, "DTSTART") == 0)
+				dtstart = currentProp;
+			else if (strcmp(currentProp->name, "RRULE") == 0 || strcmp(currentProp->name, "RDATE") == 0)
+				recurs = true;
+		}
+		
+		if (dtstart == NULL)
+			continue;
+		
+		start = propEpoch(comp, zones, dtstart);
+		
+		/* A day covers an event given as a DATE; a longer DTEND or DURATION stretches it */
+		end = start + (recurs == true ? EXTRACT_ENDLESS_DAYS * 24L * 60 * 60 : 24 * 60 * 60);
+		
+		for (currentProp = comp->comp[i]->prop; recurs == false && currentProp != NULL; currentProp = currentProp->next){
+			
+			if (strcmp(currentProp->name, "DTEND") == 0 && propEpoch(comp, zones, currentProp) > end)
+				end = propEpoch(comp, zones, currentProp);
+			else if (strcmp(currentProp->name, "DURATION") == 0 && calBusyDuration(currentProp->value, &length) == true && start + length > end)
+				end = start + length;
+		}
+		
+		if (found == false || start < *datefrom)
+			*datefrom = start;
+		
+		if (found == false || end > *dateto)
+			*dateto = end;
+		
+		found = true;
+	}
+	
+	calTzFree(zones);
+}
+
+bool writeConflict (const CalBusyEvent *first, const CalBusyEvent *second, void *arg){
+	
+	ConflictWriter * writer = (ConflictWriter *) arg;
+	const CalBusyEvent * occ[2] = { first, second };
+	const CalProp * currentProp;
+	const char * summary[2];
+	char printDate[2][64];
+	struct tm date;
+	int i;
+	
+	for (i = 0; i < 2; ++i){
+		
+		summary[i] = "(na)";
+		
+		for (currentProp = occ[i]->event->prop; currentProp != NULL; currentProp = currentProp->next){
+			
+			if (strcmp(currentProp->name, "SUMMARY") == 0 && currentProp->value[0] != '\0'){
+				
+				summary[i] = currentProp->value;
+				break;
+			}
+		}
+		
+		localtime_r(&occ[i]->span.start, &date);
+		strftime(printDate[i], sizeof(printDate[i]), "%Y-%b-%d %l:%M %p: ", &date);
+	}
+	
+	if (fprintf(writer->txtfile, "%s%s <-> %s%s\n", printDate[0], summary[0], printDate[1], summary[1]) < 0){
+		
+		writer->ok = false;
+		return false;
+	}
+	
+	++lineCount;
+	
+	return true;
+}
+
+/* The change set calDiff writes is itself a calendar, so it goes through readCalFile like any other. A component
+ * removed is named by an X-CALTOOL-REMOVE holding its identity: X-CALTOOL-NAME, then X-CALTOOL-UID and X-CALTOOL-RID
+ * (UID, or TZID for a VTIMEZONE, and RECURRENCE-ID, each left out when it is "") and X-CALTOOL-NTH when it is not the
+ * first component with that identity. A component changed gets an X-CALTOOL-MODIFY with the same identity holding
+ * an X-CALTOOL-DELETE of the properties it lost and an X-CALTOOL-INSERT of those it gained; if its subcomponents
+ * changed at all, the MODIFY also has X-CALTOOL-COMPONENTS (their new number) and every new one beside the two
+ * lists, since readCalFile allows no deeper nesting. The calendar's own properties are changed by an
+ * X-CALTOOL-MODIFY named VCALENDAR, always written first. Components added are copied as they are. */
+CalStatus calDiff( const CalComp *comp1, const CalComp *comp2, FILE *const icsfile ){
+	
+	const CalComp * comp;
+	const char * uid, * rid;
+	DiffIndex index;
+	DiffSlot * slot;
+	CalStatus status;
+	bool * paired;
+	bool ok;
+	int i, j, nth;
+	
+	/* comp2 is indexed; identities only comp1 has go in as they are met, so there must be room for them too */
+	buildDiffIndex(comp2, comp1->ncomps, &index);
+	
+	paired = calloc(comp2->ncomps + 1, sizeof(bool));
+	assert(paired);
+	
+	ok = writeContentLine(icsfile, "BEGIN", "VCALENDAR") && writeContentLine(icsfile, "VERSION", "2.0") &&
+	     writeContentLine(icsfile, "PRODID", "-//caltool//diff//EN");
+	
+	/* The calendar's change is written even if empty, so the change set always has a component and can be read */
+	ok = ok && writeDiffModify(icsfile, comp1, comp2, NULL, "", 0);
+	
+	/* The nth of comp1's components with an identity pairs with the nth of comp2's */
+	for (i = 0; ok == true && i < comp1->ncomps; ++i){
+		
+		comp = comp1->comp[i];
+		
+		if (dedupKey(comp, &uid, &rid) == false)
+			uid = "";
+		
+		slot = findDiffSlot(&index, comp->name, uid, rid);
+		
+		if (slot->uid == NULL){
+			
+			slot->name = comp->name;
+			slot->uid = uid;
+			slot->rid = rid;
+			slot->first = slot->last = slot->pending = -1;
+		}
+		
+		nth = slot->seen++;
+		j = slot->pending;
+		
+		if (j == -1){
+			
+			ok = writeDiffIdentity(icsfile, "X-CALTOOL-REMOVE", comp->name, uid, rid, nth) &&
+			     writeContentLine(icsfile, "END", "X-CALTOOL-REMOVE");
+			continue;
+		}
+		
+		paired[j] = true;
+		slot->pending = index.next[j];
+		
+		ok = writeDiffModify(icsfile, comp, comp2->comp[j], uid, rid, nth);
+	}
+	
+	/* Whatever of comp2 is left unpaired was added */
+	for (j = 0; ok == true && j < comp2->ncomps; ++j)
+		if (paired[j] == false)
+			ok = writeCalComp(icsfile, comp2->comp[j]).code == OK;
+	
+	ok = ok && writeContentLine(icsfile, "END", "VCALENDAR");
+	
+	free(paired);
+	freeDiffIndex(&index);
+	
+	status.code = ok == true ? OK : IOERR;
+	status.linefrom = lineCount;
+	status.lineto = lineCount;
+	
+	return status;
+}
+
+CalStatus calPatch( const CalComp *comp, const CalComp *changes, FILE *const icsfile, int *const rejected ){
+	
+	const CalComp ** applied, * calendar, * change;
+	const char * name, * uid, * rid;
+	DiffIndex index;
+	DiffSlot * slot;
+	CalStatus status;
+	bool * deleted;
+	bool ok, modify;
+	int i, target, nth;
+	
+	buildDiffIndex(comp, 0, &index);
+	
+	applied = calloc(comp->ncomps + 1, sizeof(CalComp *));
+	assert(applied);
+	
+	calendar = NULL;
+	*rejected = 0;
+	
+	/* Each removal or modification finds its component through the index; one that doesn't fit is rejected whole */
+	for (i = 0; i < changes->ncomps; ++i){
+		
+		change = changes->comp[i];
+		modify = strcmp(change->name, "X-CALTOOL-MODIFY") == 0;
+		
+		if (modify == false && strcmp(change->name, "X-CALTOOL-REMOVE") != 0)
+			continue;
+		
+		readDiffIdentity(change, &name, &uid, &rid, &nth);
+		deleted = NULL;
+		
+		if (strcmp(name, "VCALENDAR") == 0){
+			
+			if (modify == true && calendar == NULL && (deleted = matchDiffModify(comp, change)) != NULL)
+				calendar = change;
+			else
+				++*rejected;
+			
+			free(deleted);
+			continue;
+		}
+		
+		slot = findDiffSlot(&index, name, uid, rid);
+		
+		/* Step to the nth component with the identity; the chain is in file order */
+		for (target = slot->uid == NULL || nth < 0 ? -1 : slot->first; target != -1 && nth > 0; --nth)
+			target = index.next[target];
+		
+		if (target == -1 || applied[target] != NULL ||
+		    (modify == true && (deleted = matchDiffModify(comp->comp[target], change)) == NULL))
+			++*rejected;
+		else
+			applied[target] = change;
+		
+		free(deleted);
+	}
+	
+	ok = writeContentLine(icsfile, "BEGIN", "VCALENDAR") && writePatchedProps(icsfile, comp, calendar);
+	
+	/* Components keep their places; removed ones are left out and modified ones rewritten */
+	for (i = 0; ok == true && i < comp->ncomps; ++i){
+		
+		if (applied[i] == NULL)
+			ok = writeCalComp(icsfile, comp->comp[i]).code == OK;
+		else if (strcmp(applied[i]->name, "X-CALTOOL-MODIFY") == 0)
+			ok = writePatchedComp(icsfile, comp->comp[i], applied[i]);
+	}
+	
+	/* Added components go after the rest, in the order calDiff found them */
+	for (i = 0; ok == true && i < changes->ncomps; ++i){
+		
+		change = changes->comp[i];
+		
+		if (strcmp(change->name, "X-CALTOOL-MODIFY") != 0 && strcmp(change->name, "X-CALTOOL-REMOVE") != 0)
+			ok = writeCalComp(icsfile, change).code == OK;
+	}
+	
+	ok = ok && writeContentLine(icsfile, "END", "VCALENDAR");
+	
+	free(applied);
+	freeDiffIndex(&index);
+	
+	status.code = ok == true ? OK : IOERR;
+	status.linefrom = lineCount;
+	status.lineto = lineCount;
+	
+	return status;
+}
+
+/* Components are written as they are found to match, after the calendar's own properties, so nothing is
+ * gathered first. As with calFilter, NOCAL is returned if none match (the calendar written is then empty). */
+CalStatus calQuery( const CalComp *comp, const CalQuery *query, FILE *const icsfile ){
+	
+	const CalProp * currentProp;
+	CalTzSet * zones;
+	CalStatus status;
+	bool ok;
+	int i, matched;
+	
+	/* Built once per call, and only if some test compares dates */
+	zones = query->dates == true ? calTzBuild(comp) : NULL;
+	
+	ok = writeContentLine(icsfile, "BEGIN", comp->name);
+	
+	for (currentProp = comp->prop; ok == true && currentProp != NULL; currentProp = currentProp->next)
+		ok = writePropLine(icsfile, currentProp);
+	
+	matched = 0;
+	
+	for (i = 0; ok == true && i < comp->ncomps; ++i){
+		
+		if (calQueryMatch(query, comp, zones, comp->comp[i]) == true){
+			
+			ok = writeCalComp(icsfile, comp->comp[i]).code == OK;
+			++matched;
+		}
+	}
+	
+	ok = ok && writeContentLine(icsfile, "END", comp->name);
+	
+	calTzFree(zones);
+	
+	status.code = ok == false ? IOERR : matched == 0 ? NOCAL : OK;
+	status.linefrom = lineCount;
+	status.lineto = lineCount;
+	
+	return status;
+}
+
+CalStatus calSearch( const char *path, const CalIndex *index, const char *query, FILE *const icsfile ){
+	
+	const CalProp * currentProp;
+	CalComp * pcomp;
+	CalStatus status;
+	uint64_t at;
+	FILE * src;
+	int * hits;
+	int i, j, n;
+	bool ok;
+	
+	status.code = IOERR;
+	status.linefrom = lineCount;
+	status.lineto = lineCount;
+	
+	n = calIndexSearch(index, query, &hits);
+	
+	if (n == 0){
+		
+		status.code = NOCAL;
+		return status;
+	}
+	
+	src = fopen(path, "rb");
+	
+	if (src == NULL){
+		
+		free(hits);
+		return status;
+	}
+	
+	/* With the components' spans the file is copied as it is, leaving out the ones that didn't match */
+	if (index->spans != NULL){
+		
+		ok = true;
+		at = 0;
+		
+		for (i = 0, j = 0; ok == true && i < (int)index->ncomps; ++i){
+			
+			if (j < n && hits[j] == i){
+				
+				++j;
+				continue;
+			}
+			
+			ok = copyCalText(icsfile, src, index->spans[2 * i] - at);
+			at = index->spans[2 * i] + index->spans[2 * i + 1];
+			ok = ok && fseeko(src, at, SEEK_SET) == 0;
+		}
+		
+		ok = ok && copyCalText(icsfile, src, UINT64_MAX);
+	}
+	
+	/* Otherwise the file is parsed and the matches written as calQuery writes them */
+	else{
+		
+		pcomp = NULL;
+		status = readCalFile(src, &pcomp);
+		
+		if (status.code != OK){
+			
+			fclose(src);
+			free(hits);
+			return status;
+		}
+		
+		ok = writeContentLine(icsfile, "BEGIN", pcomp->name);
+		
+		for (currentProp = pcomp->prop; ok == true && currentProp != NULL; currentProp = currentProp->next)
+			ok = writePropLine(icsfile, currentProp);
+		
+		for (j = 0; ok == true && j < n && hits[j] < pcomp->ncomps; ++j)
+			ok = writeCalComp(icsfile, pcomp->comp[hits[j]]).code == OK;
+		
+		ok = ok && writeContentLine(icsfile, "END", pcomp->name);
+		
+		freeCalComp(pcomp);
+	}
+	
+	fclose(src);
+	free(hits);
+	
+	status.code = ok == false ? IOERR : OK;
+	status.linefrom = lineCount;
+	status.lineto = lineCount;
+	
+	return status;
+}
+
+void buildDiffIndex (const CalComp *comp, int extra, DiffIndex *index){
+	
+	const char * uid, * rid;
+	DiffSlot * slot;
+	int i;
+	
+	/* At most half full even once extra identities are added, as calCombineDedup sizes its table */
+	index->nslots = 16;
+	
+	while (index->nslots < 2 * ((size_t) comp->ncomps + extra))
+		index->nslots *= 2;
+	
+	index->slots = calloc(index->nslots, sizeof(DiffSlot));
+	assert(index->slots);
+	
+	index->next = malloc(sizeof(int) * (comp->ncomps + 1));
+	assert(index->next);
+	
+	for (i = 0; i < comp->ncomps; ++i){
+		
+		/* Components without a UID share the identity "", so they pair off by their order in the file */
+		if (dedupKey(comp->comp[i], &uid, &rid) == false)
+			uid = "";
+		
+		slot = findDiffSlot(index, comp->comp[i]->name, uid, rid);
+		
+		if (slot->uid == NULL){
+			
+			slot->name = comp->comp[i]->name;
+			slot->uid = uid;
+			slot->rid = rid;
+			slot->first = slot->pending = i;
+			slot->seen = 0;
+		}
+		
+		else{
+			
+			index->next[slot->last] = i;
+		}
+		
+		slot->last = i;
+		index->next[i] = -1;
+	}
+}
+
+DiffSlot *findDiffSlot (DiffIndex *index, const char *name, const char *uid, const char *rid){
+	
+	uint64_t hash;
+	size_t slot;
+	
+	hash = hashCompKey(name, uid, rid);
+	
+	for (slot = hash & (index->nslots - 1); index->slots[slot].uid != NULL; slot = (slot + 1) & (index->nslots - 1))
+		if (index->slots[slot].hash == hash && strcmp(index->slots[slot].uid, uid) == 0 &&
+		    strcmp(index->slots[slot].rid, rid) == 0 && strcmp(index->slots[slot].name, name) == 0)
+			return &index->slots[slot];
+	
+	/* Left ready to be claimed by filling in the rest */
+	index->slots[slot].hash = hash;
+	
+	return &index->slots[slot];
+}
+
+void freeDiffIndex (DiffIndex *index){
+	
+	free(index->slots);
+	free(index->next);
+	index->slots = NULL;
+	index->next = NULL;
+}
+
+bool sameCalProp (const CalProp *prop1, const CalProp *prop2){
+	
+	const CalParam * param1, * param2;
+	int i;
+	
+	if (strcmp(prop1->name, prop2->name) != 0 || strcmp(prop1->value, prop2->value) != 0 ||
+	    prop1->nparams != prop2->nparams)
+		return false;
+	
+	if (prop1->nparams == 0)
+		return true;
+	
+	/* Parameters must match in order, as writePropLine writes them */
+	for (param1 = getCalParams(prop1), param2 = getCalParams(prop2); param1 != NULL && param2 != NULL;
+	     param1 = param1->next, param2 = param2->next){
+		
+		if (strcmp(param1->name, param2->name) != 0 || param1->nvalues != param2->nvalues)
+			return false;
+		
+		for (i = 0; i < param1->nvalues; ++i)
+			if (strcmp(param1->value[i], param2->value[i]) != 0)
+				return false;
+	}
+	
+	return param1 == NULL && param2 == NULL;
+}
+
+bool sameCalComp (const CalComp *comp1, const CalComp *comp2){
+	
+	const CalProp * prop1, * prop2;
+	int i;
+	
+	if (strcmp(comp1->name, comp2->name) != 0 || comp1->nprops != comp2->nprops || comp1->ncomps != comp2->ncomps)
+		return false;
+	
+	for (prop1 = comp1->prop, prop2 = comp2->prop; prop1 != NULL && prop2 != NULL; prop1 = prop1->next, prop2 = prop2->next)
+		if (sameCalProp(prop1, prop2) == false)
+			return false;
+	
+	for (i = 0; i < comp1->ncomps; ++i)
+		if (sameCalComp(comp1->comp[i], comp2->comp[i]) == false)
+			return false;
+	
+	return true;
+}
+
+bool writeDiffModify (FILE *const ics, const CalComp *from, const CalComp *to, const char *uid, const char *rid, int nth){
+	
+	const CalProp * prop1, * prop2;
+	char count[32];
+	bool * used;
+	bool ok, same;
+	int i, j, ndeleted, ninserted;
+	
+	/* Most components pair with an unchanged copy, which one walk in step finds without matching */
+	if (uid != NULL && sameCalComp(from, to) == true)
+		return true;
+	
+	/* Properties are matched as multisets: each of from's takes the first equal one of to's not yet taken */
+	used = calloc(from->nprops + to->nprops + 1, sizeof(bool));
+	assert(used);
+	
+	ndeleted = 0;
+	
+	for (prop1 = from->prop, i = 0; prop1 != NULL; prop1 = prop1->next, ++i){
+		
+		for (prop2 = to->prop, j = 0; prop2 != NULL; prop2 = prop2->next, ++j)
+			if (used[from->nprops + j] == false && sameCalProp(prop1, prop2) == true)
+				break;
+		
+		if (prop2 == NULL){
+			
+			++ndeleted;
+			continue;
+		}
+		
+		used[i] = true;
+		used[from->nprops + j] = true;
+	}
+	
+	ninserted = to->nprops - (from->nprops - ndeleted);
+	
+	/* Subcomponents rarely change, so when they do they are compared in order and replaced together */
+	same = uid == NULL || from->ncomps == to->ncomps;
+	
+	for (i = 0; same == true && uid != NULL && i < from->ncomps; ++i)
+		same = sameCalComp(from->comp[i], to->comp[i]);
+	
+	ok = true;
+	
+	if (uid == NULL || ndeleted > 0 || ninserted > 0 || same == false){
+		
+		ok = writeDiffIdentity(ics, "X-CALTOOL-MODIFY", from->name, uid, rid, nth);
+		
+		if (ok == true && same == false){
+			
+			snprintf(count, sizeof(count), "%d", to->ncomps);
+			ok = writeContentLine(ics, "X-CALTOOL-COMPONENTS", count);
+		}
+		
+		if (ok == true && ndeleted > 0){
+			
+			ok = writeContentLine(ics, "BEGIN", "X-CALTOOL-DELETE");
+			
+			for (prop1 = from->prop, i = 0; ok == true && prop1 != NULL; prop1 = prop1->next, ++i)
+				if (used[i] == false)
+					ok = writePropLine(ics, prop1);
+			
+			ok = ok && writeContentLine(ics, "END", "X-CALTOOL-DELETE");
+		}
+		
+		if (ok == true && ninserted > 0){
+			
+			ok = writeContentLine(ics, "BEGIN", "X-CALTOOL-INSERT");
+			
+			for (prop2 = to->prop, j = 0; ok == true && prop2 != NULL; prop2 = prop2->next, ++j)
+				if (used[from->nprops + j] == false)
+					ok = writePropLine(ics, prop2);
+			
+			ok = ok && writeContentLine(ics, "END", "X-CALTOOL-INSERT");
+		}
+		
+		/* readCalFile allows no deeper nesting, so the new subcomponents sit beside the two lists */
+		for (i = 0; ok == true && same == false && i < to->ncomps; ++i)
+			ok = writeCalComp(ics, to->comp[i]).code == OK;
+		
+		ok = ok && writeContentLine(ics, "END", "X-CALTOOL-MODIFY");
+	}
+	
+	free(used);
+	
+	return ok;
+}
+
+bool writeDiffIdentity (FILE *const ics, const char *kind, const char *name, const char *uid, const char *rid, int nth){
+	
+	char count[32];
+	bool ok;
+	
+	ok = writeContentLine(ics, "BEGIN", kind) && writeContentLine(ics, "X-CALTOOL-NAME", name);
+	
+	if (ok == true && uid != NULL && uid[0] != '\0')
+		ok = writeContentLine(ics, "X-CALTOOL-UID", uid);
+	
+	if (ok == true && rid[0] != '\0')
+		ok = writeContentLine(ics, "X-CALTOOL-RID", rid);
+	
+	if (ok == true && nth > 0){
+		
+		snprintf(count, sizeof(count), "%d", nth);
+		ok = writeContentLine(ics, "X-CALTOOL-NTH", count);
+	}
+	
+	return ok;
+}
+
+void readDiffIdentity (const CalComp *change, const char **name, const char **uid, const char **rid, int *nth){
+	
+	const CalProp * currentProp;
+	char * stop;
+	long value;
+	
+	*name = "";
+	*uid = "";
+	*rid = "";
+	*nth = 0;
+	
+	for (currentProp = change->prop; currentProp != NULL; currentProp = currentProp->next){
+		
+		if (strcmp(currentProp->name, "X-CALTOOL-NAME") == 0)
+			*name = currentProp->value;
+		else if (strcmp(currentProp->name, "X-CALTOOL-UID") == 0)
+			*uid = currentProp->value;
+		else if (strcmp(currentProp->name, "X-CALTOOL-RID") == 0)
+			*rid = currentProp->value;
+		else if (strcmp(currentProp->name, "X-CALTOOL-NTH") == 0){
+			
+			value = strtol(currentProp->value, &stop, 10);
+			*nth = *stop != '\0' || stop == currentProp->value || value < 0 || value > INT_MAX ? -1 : (int) value;
+		}
+	}
+}
+
+const CalComp *findDiffPart (const CalComp *change, const char *name){
 	
-	/* Check if we wrote to ics succesfully */           
-	if (fprintf(ics, "%s", buffer) < 0){
+	int i;
+	
+	for (i = 0; i < change->ncomps; ++i)
+		if (strcmp(change->comp[i]->name, name) == 0)
+			return change->comp[i];
+	
+	return NULL;
+}
+
+bool *matchDiffModify (const CalComp *comp, const CalComp *change){
+	
+	const CalComp * part;
+	const CalProp * prop1, * prop2;
+	bool * deleted;
+	int i;
+	
+	deleted = calloc(comp->nprops + 1, sizeof(bool));
+	assert(deleted);
+	
+	part = findDiffPart(change, "X-CALTOOL-DELETE");
+	
+	/* Each property removed must still be there, matched as calDiff matched it */
+	for (prop2 = part == NULL ? NULL : part->prop; prop2 != NULL; prop2 = prop2->next){
+		
+		for (prop1 = comp->prop, i = 0; prop1 != NULL; prop1 = prop1->next, ++i)
+			if (deleted[i] == false && sameCalProp(prop1, prop2) == true)
+				break;
+		
+		if (prop1 == NULL){
+			
+			free(deleted);
+			return NULL;
+		}
+		
+		deleted[i] = true;
+	}
+	
+	return deleted;
+}
+
+bool writePatchedProps (FILE *const ics, const CalComp *comp, const CalComp *change){
+	
+	const CalComp * part;
+	const CalProp * currentProp;
+	bool * deleted;
+	bool ok;
+	int i;
+	
+	deleted = change == NULL ? NULL : matchDiffModify(comp, change);
+	ok = true;
+	
+	for (currentProp = comp->prop, i = 0; ok == true && currentProp != NULL; currentProp = currentProp->next, ++i)
+		if (deleted == NULL || deleted[i] == false)
+			ok = writePropLine(ics, currentProp);
+	
+	/* Properties gained go after the ones kept */
+	part = change == NULL ? NULL : findDiffPart(change, "X-CALTOOL-INSERT");
+	
+	for (currentProp = part == NULL ? NULL : part->prop; ok == true && currentProp != NULL; currentProp = currentProp->next)
+		ok = writePropLine(ics, currentProp);
+	
+	free(deleted);
+	
+	return ok;
+}
+
+bool writePatchedComp (FILE *const ics, const CalComp *comp, const CalComp *change){
+	
+	const CalProp * currentProp;
+	bool ok, replace;
+	int i;
+	
+	ok = writeContentLine(ics, "BEGIN", comp->name) && writePatchedProps(ics, comp, change);
+	
+	/* The subcomponents are either all kept or all replaced by the change's own, less its two lists */
+	for (currentProp = change->prop, replace = false; currentProp != NULL; currentProp = currentProp->next)
+		if (strcmp(currentProp->name, "X-CALTOOL-COMPONENTS") == 0)
+			replace = true;
+	
+	if (replace == false){
+		
+		for (i = 0; ok == true && i < comp->ncomps; ++i)
+			ok = writeCalComp(ics, comp->comp[i]).code == OK;
+	}
+	
+	else{
+		
+		for (i = 0; ok == true && i < change->ncomps; ++i)
+			if (strcmp(change->comp[i]->name, "X-CALTOOL-DELETE") != 0 && strcmp(change->comp[i]->name, "X-CALTOOL-INSERT") != 0)
+				ok = writeCalComp(ics, change->comp[i]).code == OK;
+	}
+	
+	return ok && writeContentLine(ics, "END", comp->name);
+}
+
+bool writeFreeBusyStart (FILE *const ics, const char *kind, time_t datefrom, time_t dateto){
+	
+	struct tm date;
+	char from[32], to[32], stamp[32], value[96];
+	time_t now;
+	
+	now = time(NULL);
+	strftime(from, sizeof(from), "%Y%m%dT%H%M%SZ", gmtime_r(&datefrom, &date));
+	strftime(to, sizeof(to), "%Y%m%dT%H%M%SZ", gmtime_r(&dateto, &date));
+	strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%SZ", gmtime_r(&now, &date));
+	snprintf(value, sizeof(value), "%s-%s-%s@caltool", kind, from, to);
+	
+	return writeContentLine(ics, "BEGIN", "VCALENDAR") && writeContentLine(ics, "VERSION", "2.0") &&
+	       writeContentLine(ics, "PRODID", "-//caltool//freebusy//EN") && writeContentLine(ics, "BEGIN", "VFREEBUSY") &&
+	       writeContentLine(ics, "UID", value) && writeContentLine(ics, "DTSTAMP", stamp) &&
+	       writeContentLine(ics, "DTSTART", from) && writeContentLine(ics, "DTEND", to);
+}
+
+bool writeFreeBusyPeriod (FILE *const ics, const char *name, const CalSpan *span){
+	
+	struct tm date;
+	char value[64];
+	
+	strftime(value, sizeof(value), "%Y%m%dT%H%M%SZ/", gmtime_r(&span->start, &date));
+	strftime(value + strlen(value), sizeof(value) - strlen(value), "%Y%m%dT%H%M%SZ", gmtime_r(&span->end, &date));
+	
+	return writeContentLine(ics, name, value);
+}
+
+bool writeContentLine (FILE *const ics, const char *name, const char *value){
+	
+	writeLine.length = 0;
+	appendWriteLine(name);
+	appendWriteLine(":");
+	appendWriteLine(value);
+	
+	return emitWriteLine(ics);
+}
+
+CalStatus writeCalComp (FILE *const ics, const CalComp *comp){
+	
+	CalStatus status;
+	
+	STATS_TIME(write, status = writeCompLines(ics, comp));
+	
+	return status;
+}
+
+CalStatus writeCompLines (FILE *const ics, const CalComp *comp){
+	
+    CalProp * currentProp;
+    CalStatus status;
+    int i;
+    	
+	/* BEGIN statement; check if we wrote to ics succesfully */
+	if (fprintf(ics, "BEGIN:%s\r\n", comp->name) < 0){
 		
 		status.code = IOERR;
 		status.linefrom = lineCount;
@@ -2555,174 +4528,386 @@ CalStatus writeCalComp (FILE *const ics, const CalComp *comp){
 	
 	/* Iterate through all properties */
 	while (currentProp != NULL){
-			
-		strcpy(buffer, currentProp->name); // Add prop name to buffer
 		
-		/* Add paramters to buffer if there are any */
-		if (currentProp->nparams != 0){
+		/* Check if we wrote to ics succesfully */ 
+		if (writePropLine(ics, currentProp) == false){
+			
+			status.code = IOERR;
+			status.linefrom = lineCount;
+			status.lineto = lineCount;
 			
-			strcat(buffer, ";");
+			return status;	
+		}
+		
+		currentProp = currentProp->next;
+	}
+	
+	/* Recursively call writeCalComp on all components */
+	for (i = 0; i < comp->ncomps; ++i){
+		
+        if (comp->comp[i] != NULL)
+            writeCompLines(ics, comp->comp[i]);
+	}
+	
+	/* Print END statement; check if we wrote to ics succesfully */ 
+	if (fprintf(ics, "END:%s\r\n", comp->name) < 0){
+		
+		status.code = IOERR;
+		status.linefrom = lineCount;
+		status.lineto = lineCount;
+		
+		return status;		
+	}
+	
+	++lineCount;
+	
+	status.linefrom = lineCount;
+	status.lineto = lineCount;
+	status.code = OK;
+	
+	return status;
+}
+
+bool writePropLine (FILE *const ics, const CalProp *prop){
+	
+	CalParam * currentParam;
+	int y;
+	
+	writeLine.length = 0;
+	appendWriteLine(prop->name); // Add prop name to the line
+	
+	/* Add paramters to the line if there are any */
+	if (prop->nparams != 0){
+		
+		appendWriteLine(";");
+		
+		currentParam = getCalParams(prop);
+		
+		/* Iterate through params */
+		while (currentParam != NULL){
 			
-			currentParam = currentProp->param;
+			/* Add param name and equal sign */
+			appendWriteLine(currentParam->name);
+			appendWriteLine("=");
 			
-			/* Iterate through params */
-			while (currentParam != NULL){
+			/* Add all values for current param */
+			for (y = 0; y < currentParam->nvalues; ++y){
 				
-				/* Add param name and equal sign */
-				strcat(buffer, currentParam->name);
-				strcat(buffer, "=");
+				appendWriteLine(currentParam->value[y]);
 				
-				/* Add all values for current param */
-				for (y = 0; y < currentParam->nvalues; ++y){
-					
-					strcat(buffer, currentParam->value[y]);
+				/* If not the last value add a comma */
+				if (y != currentParam->nvalues - 1){
 					
-					/* If not the last value add a comma */
-					if (y != currentParam->nvalues - 1){
-						
-						strcat(buffer, ",");
-					}
+					appendWriteLine(",");
 				}
+			}
+			
+			/* If not the last param add semi colon */
+			if (currentParam->next != NULL)
+				appendWriteLine(";");
+			
+			currentParam = currentParam->next;
+		}
+	}
+	
+	/* Add colon and prop value */
+	appendWriteLine(":");
+	appendWriteLine(prop->value);
+	
+	/* Fold the line if it is too long */
+	return emitWriteLine(ics);
+}
+
+void appendWriteLine (const char *text){
+	
+	size_t length;
+	
+	length = strlen(text);
+	
+	/* Grow by doubling, leaving room for the null terminator; the buffer is kept for the lines that follow */
+	if (writeLine.length + length >= writeLine.size){
+		
+		if (writeLine.size == 0)
+			writeLine.size = MAXSTRINGLENGTH;
+		
+		while (writeLine.length + length >= writeLine.size)
+			writeLine.size *= 2;
+		
+		writeLine.text = realloc(writeLine.text, sizeof(char) * writeLine.size);
+		assert(writeLine.text);
+		STATS_ADD(linebufs, 1);
+		
+		pthread_once(&writeLineOnce, makeWriteLineKey);
+		pthread_setspecific(writeLineKey, writeLine.text);
+	}
+	
+	memcpy(writeLine.text + writeLine.length, text, length + 1);
+	writeLine.length += length;
+}
+
+void makeWriteLineKey (void){
+	
+	pthread_key_create(&writeLineKey, free);
+}
+
+bool emitWriteLine (FILE *const ics){
+	
+	size_t pos, run;
+	
+	/* The first physical line holds FOLD_LEN octets */
+	run = writeLine.length > FOLD_LEN ? FOLD_LEN : writeLine.length;
+	
+	if (fwrite(writeLine.text, 1, run, ics) != run || fputs("\r\n", ics) == EOF)
+		return false;
+	
+	++lineCount;
+	
+	/* Each one after it starts with the space that marks a fold, then holds FOLD_LEN - 1 more */
+	for (pos = run; pos < writeLine.length; pos += run){
+		
+		run = writeLine.length - pos > FOLD_LEN - 1 ? FOLD_LEN - 1 : writeLine.length - pos;
+		
+		if (fputc(' ', ics) == EOF || fwrite(writeLine.text + pos, 1, run, ics) != run || fputs("\r\n", ics) == EOF)
+			return false;
+		
+		++lineCount;
+	}
+	
+	return true;
+}
+
+void reportStats (void){
+	
+	CalStats stats;
+	
+	calGetStats(&stats);
+	calPrintStats(&stats, stderr);
+}
+
+bool readExtractOptions (int argc, char *argv[], CalOpt kind, size_t *limit, CalCursor *after, bool *hasAfter){
+	
+	struct tm date;
+	char * end;
+	int i, dateError;
+	
+	*limit = 0;
+	*hasAfter = false;
+	after->start = 0;
+	after->order = -1;
+	after->name = NULL;
+	after->more = false;
+	
+	for (i = 0; i < argc; i += 2){
+		
+		if (i + 1 >= argc){
+			
+			fprintf(stderr, "Error: %s needs a value. Correct syntax is: caltool -extract kind [--limit N] [--after date]\n", argv[i]);
+			return false;
+		}
+		
+		/* A page size of at least one item */
+		if (strcmp(argv[i], "--limit") == 0){
+			
+			*limit = strtoul(argv[i + 1], &end, 10);
+			
+			if (*end != '\0' || *limit == 0 || argv[i + 1][0] == '-'){
 				
-				/* If not the last param add semi colon */
-				if (currentParam->next != NULL)
-					strcat(buffer, ";");
-				
-				currentParam = currentParam->next;
+				fprintf(stderr, "Error: --limit \"%s\" is not a positive number\n", argv[i + 1]);
+				return false;
 			}
 		}
 		
-		/* Add colon and prop value */
-		strcat(buffer, ":");
-		strcat(buffer, currentProp->value);
+		/* Names are their own cursor */
+		else if (strcmp(argv[i], "--after") == 0 && kind == OPROP){
+			
+			after->name = argv[i + 1];
+			*hasAfter = true;
+		}
 		
-		/* Check if line is too long and must be folded */
-		if (strlen(buffer) > FOLD_LEN){
+		/* The cursor printed after a page of events: the last start shown and its file order */
+		else if (strcmp(argv[i], "--after") == 0 && argv[i + 1][0] == '@'){
+			
+			after->start = (time_t) strtoll(argv[i + 1] + 1, &end, 10);
+			
+			if (*end == '.')
+				after->order = strtol(end + 1, &end, 10);
+			
+			if (*end != '\0' || end == argv[i + 1] + 1){
+				
+				fprintf(stderr, "Error: cursor \"%s\" could not be interpreted\n", argv[i + 1]);
+				return false;
+			}
+			
+			*hasAfter = true;
+		}
 		
-			y = 0;
+		/* Events from a date on, as for -filter */
+		else if (strcmp(argv[i], "--after") == 0){
 			
-			/* Iterate through buffer */
-			for (i = 0; i < strlen(buffer); ++i){
+			if (strcmp(argv[i + 1], "today") == 0){
 				
-				/* Add characters for first line */
-				if (y <= 75){
-					
-					foldedBuffer[y] = buffer[i];
-					++y;
-				}
-
-				/* If at max length for a line and it is the first one add EOL and NULL terminator*/
-				if (i <= 74 && y == 75){
-					
-					foldedBuffer[y] = '\r';
-					++y;
-					foldedBuffer[y] = '\n';
-					++y;
-					foldedBuffer[y] = '\0';
-					
-					/* Check if we wrote to ics succesfully */ 
-					if (fprintf(ics, "%s", foldedBuffer) < 0){
-						
-						status.code = IOERR;
-						status.linefrom = lineCount;
-						status.lineto = lineCount;
-						
-						return status;	
-					}
+				after->start = time(NULL);
+			}
+			
+			else{
+				
+				memset(&date, 0, sizeof(struct tm));
+				date.tm_isdst = -1;
+				dateError = getdate_r(argv[i + 1], &date);
+				
+				if (dateError >= 1 && dateError <= 5){
 					
-					++lineCount;
-					y = 0;
+					fprintf(stderr, "Error: Problem with DATEMSK environment variable or template file (error codes 1-5)\n");
+					return false;
 				}
 				
-				/* If at max length for a line and it is the first one or we've reached the end of the buffer, add EOL and NULL terminator */
-				else if ((i > 73 && y == 74) || i == strlen(buffer) - 1){
-					
-					/* Check if we wrote to ics succesfully */ 
-					if (fprintf(ics, " ") < 0){
-						
-						status.code = IOERR;
-						status.linefrom = lineCount;
-						status.lineto = lineCount;
-						
-						return status;						
-					}
-						
-					
-					foldedBuffer[y] = '\r';
-					++y;
-					foldedBuffer[y] = '\n';
-					++y;
-					foldedBuffer[y] = '\0';
-					
-					/* Check if we wrote to ics succesfully */ 
-					if (fprintf(ics, "%s", foldedBuffer) < 0){
-						
-						status.code = IOERR;
-						status.linefrom = lineCount;
-						status.lineto = lineCount;
-						
-						return status;						
-					}
+				if (dateError != 0){
 					
-					++lineCount;
-					y = 0;
-					
-					strcpy(foldedBuffer, ""); // Clear the buffer 
+					fprintf(stderr, "Error: Date \"%s\" could not be interpreted (7-8).\n", argv[i + 1]);
+					return false;
 				}
 				
+				/* From the start of the day, as -filter takes its from date */
+				date.tm_sec = 0;
+				date.tm_min = 0;
+				date.tm_hour = 0;
+				after->start = mktime(&date);
 			}
 			
+			/* Events that start right at the date are on the first page */
+			after->order = -1;
+			*hasAfter = true;
 		}
 		
-		/* Otherwise add EOL and print the line to ics */
 		else{
-			strcat(buffer, "\r");
-			strcat(buffer, "\n");
-			
-			/* Check if we wrote to ics succesfully */ 
-			if (fprintf(ics, "%s", buffer) < 0){
-				
-				status.code = IOERR;
-				status.linefrom = lineCount;
-				status.lineto = lineCount;
-				
-				return status;	
-			}
 			
-			++lineCount;
+			fprintf(stderr, "Error: invalid arguments. Correct syntax is: caltool -extract kind [--limit N] [--after date]\n");
+			return false;
 		}
+	}
+	
+	return true;
+}
+
+bool readToolDate (const char *arg, bool endOfDay, time_t *date){
+	
+	struct tm day;
+	time_t now;
+	int dateError;
+	
+	if (strcmp(arg, "today") == 0){
 		
-		currentProp = currentProp->next;
+		now = time(NULL);
+		localtime_r(&now, &day);
 	}
 	
-	/* Recursively call writeCalComp on all components */
-	for (i = 0; i < comp->ncomps; ++i){
+	else{
 		
-        if (comp->comp[i] != NULL)
-            writeCalComp(ics, comp->comp[i]);
+		memset(&day, 0, sizeof(struct tm));
+		dateError = getdate_r(arg, &day);
+		
+		if (dateError >= 1 && dateError <= 5){
+			
+			fprintf(stderr, "Error: Problem with DATEMSK environment variable or template file (error codes 1-5)\n");
+			return false;
+		}
+		
+		if (dateError != 0){
+			
+			fprintf(stderr, "Error: Date \"%s\" could not be interpreted (7-8).\n", arg);
+			return false;
+		}
 	}
 	
-	/* Print END statement */
-	strcpy(buffer, "END:");
-	strcat(buffer, comp->name);
-	strcat(buffer, "\r");
-	strcat(buffer, "\n");
+	/* mktime carries a day past the end of the month over */
+	day.tm_sec = 0;
+	day.tm_min = 0;
+	day.tm_hour = 0;
+	day.tm_isdst = -1;
+	
+	if (endOfDay == true)
+		++day.tm_mday;
 	
-	/* Check if we wrote to ics succesfully */ 
-	if (fprintf(ics, "%s", buffer) < 0){
+	*date = mktime(&day);
+	
+	return true;
+}
+
+bool readToolFiles (char *const *paths, int n, CalComp **comps){
+	
+	CalStatus status;
+	FILE * ics;
+	int i;
+	
+	for (i = 0; i < n; ++i){
 		
-		status.code = IOERR;
-		status.linefrom = lineCount;
-		status.lineto = lineCount;
+		ics = fopen(paths[i], "r");
 		
-		return status;		
+		if (ics == NULL){
+			
+			fprintf(stderr, "Error: Unable to open file %s\n", paths[i]);
+			break;
+		}
+		
+		comps[i] = NULL;
+		status = readCalInput(ics, &comps[i]);
+		fclose(ics);
+		
+		if (status.code != OK){
+			
+			fprintf(stderr, "Error: Unable to read file %s\n", paths[i]);
+			reportReadError(status);
+			break;
+		}
 	}
 	
-	++lineCount;
+	if (i == n)
+		return true;
 	
-	status.linefrom = lineCount;
-	status.lineto = lineCount;
-	status.code = OK;
+	while (i-- > 0)
+		freeCalComp(comps[i]);
 	
-	return status;
+	return false;
+}
+
+void reportReadError (CalStatus status){
+	
+	static const char *const names[] = { "OK", "AFTEND", "BADVER", "BEGEND", "IOERR", "NOCAL", "NOCRNL", "NODATA", "NOPROD",
+	                                     "SUBCOM", "SYNTAX", "STALE", "BADTEXT" };
+	
+	if (status.code > OK && status.code <= BADTEXT)
+		fprintf(stderr, "Error: %s reported by readCalFile, linefrom = %d, lineto = %d\n", names[status.code], status.linefrom, status.lineto);
+}
+
+void reportExtractPage (CalOpt kind, size_t limit, const CalCursor *next){
+	
+	if (next->more == false)
+		return;
+	
+	if (kind == OEVENT)
+		fprintf(stderr, "Next page: caltool -extract e --limit %zu --after @%lld.%ld\n", limit, (long long) next->start, next->order);
+	else
+		fprintf(stderr, "Next page: caltool -extract x --limit %zu --after %s\n", limit, next->name);
+}
+
+bool copyCalText (FILE *const ics, FILE *src, uint64_t count){
+	
+	char buffer[65536];
+	size_t want, got;
+	
+	while (count > 0){
+		
+		want = count < sizeof(buffer) ? count : sizeof(buffer);
+		got = fread(buffer, 1, want, src);
+		
+		if (got > 0 && fwrite(buffer, 1, got, ics) != got)
+			return false;
+		
+		if (got < want)
+			return ferror(src) == 0;
+		
+		count -= got;
+	}
+	
+	return true;
 }
@@ -16,6 +16,10 @@ Last updated:  10:09 PM January-27-16
 #include <time.h>
 #include <stdio.h>
 #include "calutil.h"
+#include "calquery.h"
+#include "calindex.h"
+
+#define EXTRACT_ENDLESS_DAYS 3653   // without --limit, a series with no end is extracted for this many days (ten years) from its start or --after
 
 /* Symbols used to send options to command execution modules */
 
@@ -25,11 +29,27 @@ typedef enum {
     OTODO,      // to-do items
 } CalOpt;
 
+typedef struct {        // where a page of calExtractPage output starts or ends
+    time_t start;       // OEVENT: start of the last event on the page, or the time to list events from
+    long order;         // OEVENT: that event's file order (as in calExtract), -1 to take every event at start
+    char *name;         // OPROP: last name on the page (NULL to list from the first); malloc'd when set by calExtractPage
+    bool more;          // set by calExtractPage: true if more items follow the page
+} CalCursor;
+
 /* iCalendar tool functions */
 
 CalStatus calInfo( const CalComp *comp, int lines, FILE *const txtfile );
 CalStatus calExtract( const CalComp *comp, CalOpt kind, FILE *const txtfile );
+CalStatus calExtractPage( const CalComp *comp, CalOpt kind, const CalCursor *after, size_t limit, CalCursor *const next, FILE *const txtfile );
 CalStatus calFilter( const CalComp *comp, CalOpt content, time_t datefrom, time_t dateto, FILE *const icsfile );
 CalStatus calCombine( const CalComp *comp1, const CalComp *comp2, FILE *const icsfile );
+CalStatus calCombineDedup( const CalComp *comp1, const CalComp *comp2, FILE *const icsfile );
+CalStatus calFreeBusy( const CalComp *comp, time_t datefrom, time_t dateto, FILE *const icsfile );
+CalStatus calConflicts( const CalComp *comp, time_t datefrom, time_t dateto, FILE *const txtfile );
+CalStatus calFreeSlots( const CalComp *const *comps, int ncomps, time_t datefrom, time_t dateto, time_t length, FILE *const icsfile );
+CalStatus calDiff( const CalComp *comp1, const CalComp *comp2, FILE *const icsfile );
+CalStatus calPatch( const CalComp *comp, const CalComp *changes, FILE *const icsfile, int *const rejected );
+CalStatus calQuery( const CalComp *comp, const CalQuery *query, FILE *const icsfile );
+CalStatus calSearch( const char *path, const CalIndex *index, const char *query, FILE *const icsfile );
 
 #endif
@@ -0,0 +1,486 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+caltz.c -- Source code for the timezone tables
+Last updated:  Oct 19/26
+********/
+
+#define _GNU_SOURCE   // for gmtime_r, localtime_r and tm_gmtoff
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "caltz.h"
+#include "calrecur.h"
+
+const CalTzZone calTzUTC = { "UTC", 0, NULL, NULL, 0 };
+
+static CalTzZone localZone;     // see calTzLocal
+static pthread_once_t localOnce = PTHREAD_ONCE_INIT;
+
+typedef struct {        // one change of offset while a zone is built
+    time_t utc;
+    int from, to;           // offsets before and after
+} TzTrans;
+
+typedef struct {        // a zone's transitions while it is built
+    TzTrans *trans;
+    size_t ntrans, cap;
+} TzList;
+
+/* Compile one VTIMEZONE
+ *
+ * Arguments: the VTIMEZONE and the zone to fill in
+ *
+ * Preconditions: *comp must be initialized
+ * Postconditions: zone holds the transitions of every STANDARD and DAYLIGHT subcomponent up to CALTZ_HORIZON
+ *
+ * Return val: false if the VTIMEZONE has no TZID, true otherwise
+ * */
+bool buildTzZone (const CalComp *comp, CalTzZone *zone);
+
+/* Add the transitions of one STANDARD or DAYLIGHT subcomponent
+ *
+ * Arguments: the subcomponent and the list to add to
+ *
+ * Preconditions: *comp must be initialized
+ * Postconditions: each onset of the subcomponent's DTSTART, RRULE and RDATE up to CALTZ_HORIZON is in list
+ *
+ * Return val: false if the subcomponent lacks DTSTART, TZOFFSETFROM or TZOFFSETTO, true otherwise
+ * */
+bool addTzRules (const CalComp *comp, TzList *list);
+
+/* Build the table calTzLocal returns, run once through pthread_once
+ *
+ * Arguments: none
+ *
+ * Preconditions: none
+ * Postconditions: localZone holds the local offsets, each change found to the second
+ *
+ * Return val: none
+ * */
+void buildTzLocal (void);
+
+/* Get the local timezone's offset at a time from libc
+ *
+ * Arguments: the calendar time
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: seconds east of UTC
+ * */
+int localTzOffset (time_t utc);
+
+/* Add a transition to a list being built
+ *
+ * Arguments: the list, the calendar time of the change and the offsets before and after it
+ *
+ * Preconditions: none
+ * Postconditions: the transition is at the end of list, which grows if it must
+ *
+ * Return val: none
+ * */
+void addTzTrans (TzList *list, time_t utc, int from, int to);
+
+/* Read a UTC offset value
+ *
+ * Arguments: the value ([+-]HHMM or [+-]HHMMSS) and where to put the offset
+ *
+ * Preconditions: none
+ * Postconditions: *offset is set if the value can be read
+ *
+ * Return val: false if the value can't be read, true otherwise
+ * */
+bool readTzOffset (const char *value, int *offset);
+
+/* Get a zone's offset at a time
+ *
+ * Arguments: the zone and the calendar time
+ *
+ * Preconditions: zone is not NULL
+ * Postconditions: none
+ *
+ * Return val: seconds east of UTC
+ * */
+int tzOffset (const CalTzZone *zone, time_t utc);
+
+/* Compare two transitions for qsort
+ *
+ * Arguments: both a and b are TzTrans * variables
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: negative, zero or positive as a is before, at the same time as or after b
+ * */
+int compareTzTrans (const void *a, const void *b);
+
+CalTzSet *calTzBuild( const CalComp *comp ){
+
+    CalTzSet * set;
+    int i;
+
+    set = malloc(sizeof(CalTzSet));
+    assert(set);
+
+    set->nzones = 0;
+    set->zones = NULL;
+
+    for (i = 0; i < comp->ncomps; ++i){
+
+        if (strcmp(comp->comp[i]->name, "VTIMEZONE") != 0)
+            continue;
+
+        set->zones = realloc(set->zones, sizeof(CalTzZone) * (set->nzones + 1));
+        assert(set->zones);
+
+        if (buildTzZone(comp->comp[i], &set->zones[set->nzones]) == true)
+            ++set->nzones;
+    }
+
+    return set;
+}
+
+void calTzFree( CalTzSet *set ){
+
+    size_t i;
+
+    if (set == NULL)
+        return;
+
+    for (i = 0; i < set->nzones; ++i){
+
+        free(set->zones[i].utc);
+        free(set->zones[i].offset);
+    }
+
+    free(set->zones);
+    free(set);
+}
+
+const CalTzZone *calTzLocal( void ){
+
+    pthread_once(&localOnce, buildTzLocal);
+
+    return &localZone;
+}
+
+const CalTzZone *calTzZone( const CalTzSet *set, const CalProp *prop ){
+
+    const CalParam * param;
+    const char * tzid;
+    size_t length, i;
+
+    length = strlen(prop->value);
+
+    if (length > 0 && prop->value[length - 1] == 'Z')
+        return &calTzUTC;
+
+    /* Most dates have no parameters at all, so those are never decoded */
+    if (set == NULL || set->nzones == 0 || prop->nparams == 0)
+        return NULL;
+
+    for (param = getCalParams(prop); param != NULL; param = param->next){
+
+        if (strcmp(param->name, "TZID") != 0 || param->nvalues < 1)
+            continue;
+
+        /* A quoted TZID keeps its quotes in the parameter */
+        tzid = param->value[0];
+        length = strlen(tzid);
+
+        if (length >= 2 && tzid[0] == '"'){
+
+            ++tzid;
+            length -= 2;
+        }
+
+        for (i = 0; i < set->nzones; ++i)
+            if (strncmp(set->zones[i].tzid, tzid, length) == 0 && set->zones[i].tzid[length] == '\0')
+                return &set->zones[i];
+
+        break;
+    }
+
+    return NULL;
+}
+
+time_t calTzToUTC( const CalTzZone *zone, time_t wall ){
+
+    struct tm date;
+    int before, after;
+
+    if (zone == NULL){
+
+        gmtime_r(&wall, &date);
+        date.tm_isdst = -1;
+
+        return mktime(&date);
+    }
+
+    /* Offsets are well under a day, so the ones a day either side are those before and after any transition near */
+    before = tzOffset(zone, wall - CALTZ_SLACK);
+    after = tzOffset(zone, wall + CALTZ_SLACK);
+
+    if (before == after)
+        return wall - before;
+
+    /* Repeated times are read the first time round; skipped ones with the offset before (RFC 5545 3.3.5) */
+    if (tzOffset(zone, wall - before) == before || tzOffset(zone, wall - after) != after)
+        return wall - before;
+
+    return wall - after;
+}
+
+time_t calTzFromUTC( const CalTzZone *zone, time_t utc ){
+
+    struct tm date;
+
+    if (zone == NULL){
+
+        localtime_r(&utc, &date);
+
+        return utc + date.tm_gmtoff;
+    }
+
+    return utc + tzOffset(zone, utc);
+}
+
+time_t calTzEpoch( const CalTzSet *set, const CalProp *prop ){
+
+    const CalTzZone * zone;
+
+    zone = calTzZone(set, prop);
+
+    if (zone == NULL)
+        return parseCalDate(prop->value);
+
+    return calTzToUTC(zone, calRecurWall(prop->value));
+}
+
+bool buildTzZone (const CalComp *comp, CalTzZone *zone){
+
+    const CalProp * currentProp;
+    TzList list;
+    size_t i;
+    int j;
+
+    zone->tzid = NULL;
+
+    for (currentProp = comp->prop; currentProp != NULL; currentProp = currentProp->next)
+        if (zone->tzid == NULL && strcmp(currentProp->name, "TZID") == 0)
+            zone->tzid = currentProp->value;
+
+    if (zone->tzid == NULL)
+        return false;
+
+    list.trans = NULL;
+    list.ntrans = 0;
+    list.cap = 0;
+
+    for (j = 0; j < comp->ncomps; ++j)
+        if (strcmp(comp->comp[j]->name, "STANDARD") == 0 || strcmp(comp->comp[j]->name, "DAYLIGHT") == 0)
+            addTzRules(comp->comp[j], &list);
+
+    if (list.ntrans > 1)
+        qsort(list.trans, list.ntrans, sizeof(TzTrans), compareTzTrans);
+
+    /* Kept as two arrays so the searches only touch the times */
+    zone->ntrans = list.ntrans;
+    zone->utc = malloc(sizeof(time_t) * (list.ntrans > 0 ? list.ntrans : 1));
+    zone->offset = malloc(sizeof(int) * (list.ntrans > 0 ? list.ntrans : 1));
+    assert(zone->utc && zone->offset);
+
+    for (i = 0; i < list.ntrans; ++i){
+
+        zone->utc[i] = list.trans[i].utc;
+        zone->offset[i] = list.trans[i].to;
+    }
+
+    /* Before the first onset the zone is at that onset's TZOFFSETFROM */
+    zone->initial = list.ntrans > 0 ? list.trans[0].from : 0;
+
+    free(list.trans);
+
+    return true;
+}
+
+bool addTzRules (const CalComp *comp, TzList *list){
+
+    const CalProp * currentProp, * dtstart;
+    CalRecur recur;
+    time_t onset, horizon;
+    int from, to;
+    bool hasFrom, hasTo;
+
+    dtstart = NULL;
+    hasFrom = false;
+    hasTo = false;
+
+    for (currentProp = comp->prop; currentProp != NULL; currentProp = currentProp->next){
+
+        if (dtstart == NULL && strcmp(currentProp->name, "DTSTART") == 0)
+            dtstart = currentProp;
+        else if (hasFrom == false && strcmp(currentProp->name, "TZOFFSETFROM") == 0)
+            hasFrom = readTzOffset(currentProp->value, &from);
+        else if (hasTo == false && strcmp(currentProp->name, "TZOFFSETTO") == 0)
+            hasTo = readTzOffset(currentProp->value, &to);
+    }
+
+    if (dtstart == NULL || hasFrom == false || hasTo == false)
+        return false;
+
+    horizon = calRecurWall(CALTZ_HORIZON);
+
+    /* Onsets are wall-clock times on the clock being left, a UTC UNTIL included */
+    calRecurInit(&recur, comp, calRecurWall(dtstart->value));
+
+    if (recur.untilUTC == true)
+        recur.until += from;
+
+    while (calRecurNext(&recur, &onset) == true && onset < horizon)
+        addTzTrans(list, onset - from, from, to);
+
+    calRecurFree(&recur);
+
+    return true;
+}
+
+void buildTzLocal (void){
+
+    TzList list;
+    time_t probe, horizon, low, high, mid;
+    int offset, previous;
+    size_t i;
+
+    list.trans = NULL;
+    list.ntrans = 0;
+    list.cap = 0;
+
+    probe = calRecurWall(CALTZ_LOCALFROM);
+    horizon = calRecurWall(CALTZ_HORIZON);
+    previous = localTzOffset(probe);
+
+    /* Step through the years, narrowing each change libc shows down to the second it happens */
+    for (probe += CALTZ_PROBE; probe < horizon; probe += CALTZ_PROBE){
+
+        offset = localTzOffset(probe);
+
+        if (offset == previous)
+            continue;
+
+        low = probe - CALTZ_PROBE;
+        high = probe;
+
+        while (high - low > 1){
+
+            mid = low + (high - low) / 2;
+
+            if (localTzOffset(mid) == previous)
+                low = mid;
+            else
+                high = mid;
+        }
+
+        addTzTrans(&list, high, previous, offset);
+        previous = offset;
+    }
+
+    localZone.tzid = "";
+    localZone.ntrans = list.ntrans;
+    localZone.utc = malloc(sizeof(time_t) * (list.ntrans > 0 ? list.ntrans : 1));
+    localZone.offset = malloc(sizeof(int) * (list.ntrans > 0 ? list.ntrans : 1));
+    assert(localZone.utc && localZone.offset);
+
+    for (i = 0; i < list.ntrans; ++i){
+
+        localZone.utc[i] = list.trans[i].utc;
+        localZone.offset[i] = list.trans[i].to;
+    }
+
+    localZone.initial = list.ntrans > 0 ? list.trans[0].from : previous;
+
+    free(list.trans);
+}
+
+int localTzOffset (time_t utc){
+
+    struct tm date;
+
+    localtime_r(&utc, &date);
+
+    return (int) date.tm_gmtoff;
+}
+
+void addTzTrans (TzList *list, time_t utc, int from, int to){
+
+    if (list->ntrans == list->cap){
+
+        list->cap = list->cap == 0 ? 64 : list->cap * 2;
+        list->trans = realloc(list->trans, sizeof(TzTrans) * list->cap);
+        assert(list->trans);
+    }
+
+    list->trans[list->ntrans].utc = utc;
+    list->trans[list->ntrans].from = from;
+    list->trans[list->ntrans].to = to;
+    ++list->ntrans;
+}
+
+bool readTzOffset (const char *value, int *offset){
+
+    int digits[6], n;
+
+    if (value[0] != '+' && value[0] != '-')
+        return false;
+
+    for (n = 0; n < 6 && value[n + 1] >= '0' && value[n + 1] <= '9'; ++n)
+        digits[n] = value[n + 1] - '0';
+
+    if ((n != 4 && n != 6) || value[n + 1] != '\0')
+        return false;
+
+    *offset = (digits[0] * 10 + digits[1]) * 3600 + (digits[2] * 10 + digits[3]) * 60;
+
+    if (n == 6)
+        *offset += digits[4] * 10 + digits[5];
+
+    if (value[0] == '-')
+        *offset = -*offset;
+
+    return true;
+}
+
+int tzOffset (const CalTzZone *zone, time_t utc){
+
+    size_t low, high, mid;
+
+    low = 0;
+    high = zone->ntrans;
+
+    /* Count the transitions at or before utc */
+    while (low < high){
+
+        mid = low + (high - low) / 2;
+
+        if (zone->utc[mid] <= utc)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low == 0 ? zone->initial : zone->offset[low - 1];
+}
+
+int compareTzTrans (const void *a, const void *b){
+
+    time_t castA = ((const TzTrans *) a)->utc;
+    time_t castB = ((const TzTrans *) b)->utc;
+
+    return castA < castB ? -1 : castA > castB;
+}
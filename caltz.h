@@ -0,0 +1,126 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+caltz.h -- Public interface for the timezone tables in caltz.c
+Last updated:  Oct 19/26
+
+Each VTIMEZONE of a calendar is compiled once into a table of the calendar
+times its UTC offset changes at, worked out from the STANDARD and
+DAYLIGHT rules up to CALTZ_HORIZON. Turning a DATE-TIME with a TZID
+parameter into a calendar time is then two binary searches of that table
+rather than a libc timezone call. A value ending in Z is UTC; one with
+no TZID (or a TZID the calendar doesn't define) stays in the local
+timezone, as parseCalDate gives it. calTzLocal compiles the local
+timezone into a table too, once per process, for callers that convert
+too many local times to afford mktime.
+********/
+
+#ifndef CALTZ_H
+#define CALTZ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include "calutil.h"
+
+#define CALTZ_HORIZON "21000101"    // rules are expanded up to this date; later times keep the last offset
+#define CALTZ_SLACK (24 * 60 * 60)  // more than any offset or jump in one, so wall-clock searches start this far early
+#define CALTZ_LOCALFROM "19000101"  // calTzLocal's table starts here; earlier times keep the offset it had then
+#define CALTZ_PROBE (7 * 24 * 60 * 60)  // calTzLocal asks libc for the offset this often, so closer transitions are missed
+
+typedef struct {        // one VTIMEZONE, see calTzBuild
+    const char *tzid;       // TZID value, pointing into the tree
+    size_t ntrans;          // no. of transitions
+    time_t *utc;            // calendar times the offset changes at, ascending
+    int *offset;            // seconds east of UTC from utc[i] on
+    int initial;            // seconds east of UTC before the first transition
+} CalTzZone;
+
+typedef struct {        // every VTIMEZONE of a calendar
+    size_t nzones;
+    CalTzZone *zones;
+} CalTzSet;
+
+extern const CalTzZone calTzUTC;    // zone of a value ending in Z
+
+/*	Compile the VTIMEZONEs of a calendar
+ *
+ * Arguments: the calendar
+ *
+ * Preconditions: *comp must be initialized
+ * Postconditions: the returned set points into comp's TZID values, so it must be released with calTzFree
+ *                 before comp is
+ *
+ * Return val: the malloc'd set (with no zones if the calendar has no VTIMEZONE)
+ * */
+CalTzSet *calTzBuild( const CalComp *comp );
+
+/*	Release a set from calTzBuild
+ *
+ * Arguments: the set, or NULL
+ *
+ * Preconditions: none
+ * Postconditions: the set and its tables are free'd
+ *
+ * Return val: none
+ * */
+void calTzFree( CalTzSet *set );
+
+/*	Get the local timezone as a table
+ *
+ * Arguments: none
+ *
+ * Preconditions: TZ doesn't change once this has been called
+ * Postconditions: the table is built on the first call (thread-safe) and kept for the life of the process
+ *
+ * Return val: the local zone, with the transitions libc reports from CALTZ_LOCALFROM to CALTZ_HORIZON
+ * */
+const CalTzZone *calTzLocal( void );
+
+/*	Find the zone a DATE-TIME property is in
+ *
+ * Arguments: the calendar's set (or NULL) and the property
+ *
+ * Preconditions: none
+ * Postconditions: the property's parameters may be decoded, see getCalParams
+ *
+ * Return val: &calTzUTC for a value ending in Z, the zone named by its TZID parameter, or NULL for local time
+ * */
+const CalTzZone *calTzZone( const CalTzSet *set, const CalProp *prop );
+
+/*	Turn a wall-clock time in a zone into a calendar time
+ *
+ * Arguments: the zone (NULL for local time) and the time as calRecurWall gives it
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: the calendar time; a time a transition repeats is taken the first time round, and one it
+ *             skips counts with the offset before it
+ * */
+time_t calTzToUTC( const CalTzZone *zone, time_t wall );
+
+/*	Turn a calendar time into the wall-clock time of a zone
+ *
+ * Arguments: the zone (NULL for local time) and the calendar time
+ *
+ * Preconditions: none
+ * Postconditions: none
+ *
+ * Return val: the time as calRecurWall would give it
+ * */
+time_t calTzFromUTC( const CalTzZone *zone, time_t utc );
+
+/*	Get the calendar time of a DATE or DATE-TIME property
+ *
+ * Arguments: the calendar's set (or NULL) and the property
+ *
+ * Preconditions: none
+ * Postconditions: as for calTzZone
+ *
+ * Return val: the calendar time in the property's zone, or as returned by parseCalDate for local time
+ * */
+time_t calTzEpoch( const CalTzSet *set, const CalProp *prop );
+
+#endif
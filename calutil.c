@@ -6,39 +6,176 @@ calutil.c -- Source code for iCalendar utility functions
 Last updated:  Jan 29/16
 ********/
 
+#define _GNU_SOURCE   // for strptime
+
 #include <assert.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "calutil.h"
+#include "calscan.h"
+#include "calstats.h"
+
+#define CALREAD_BLOCK 65536 // bytes readCalLine reads ahead at a time
 
 static int lineCount = 0;
+static bool strictText = false;    // reject control characters and invalid UTF-8
+
+static struct {             // readCalLine's read-ahead and the line it is building
+    FILE *file;                 // file the block came from
+    char block[CALREAD_BLOCK];
+    size_t pos, fill;           // next unread byte and no. of bytes in block
+    char *line;                 // unfolded line, reused from one line to the next (or NULL)
+    size_t size;                // bytes allocated for line
+} reader;
+
+static pthread_mutex_t parseLock = PTHREAD_MUTEX_INITIALIZER;  // held by readCalFile, since the state above is shared
+
+/* Refill readCalLine's read-ahead from its file
+ * 
+ * Arguments: none
+ * 
+ * Preconditions: reader.file is open for reading and every byte in the block has been used
+ * Postconditions: the block holds the next bytes of the file
+ * 
+ * Return val: false at end of file, true otherwise
+ * */
+bool fillCalReader (void);
+
+/* Look at the next byte of readCalLine's file without using it up
+ * 
+ * Arguments: none
+ * 
+ * Preconditions: reader.file is open for reading
+ * Postconditions: the block is refilled if it was used up
+ * 
+ * Return val: the next byte as an unsigned char, or EOF
+ * */
+int peekCalReader (void);
+
+/* Read the next line that isn't blank into the reader's own buffer, the body of readCalLine
+ * 
+ * Arguments: input file (or NULL to reset), where to store the line and where to store its length
+ * 
+ * Preconditions: as for readCalLine
+ * Postconditions: as for readCalLine, except that *pline points into reader.line, which the next call reuses
+ * 
+ * Return val: as for readCalLine
+ * */
+CalStatus scanCalLine (FILE *const ics, char **const pline, size_t *const plength);
+
+/* Hand the line in the reader's buffer to a caller that keeps it
+ * 
+ * Arguments: length of the line
+ * 
+ * Preconditions: reader.line holds the line and its null terminator
+ * Postconditions: short lines are copied; long ones are handed over whole and the reader starts a new buffer
+ * 
+ * Return val: malloc'd line the caller owns
+ * */
+char *takeCalLine (size_t length);
+
+/* Give a property split in place a line of its own to keep its name and value in
+ * 
+ * Arguments: property returned by splitCalProp with keepLine set, and the line it was split from
+ * 
+ * Preconditions: buff is reader.line
+ * Postconditions: prop->line is set and prop->name and prop->value point into it
+ * 
+ * Return val: none
+ * */
+void keepCalLine (CalProp *prop, const char *buff);
 
-int countParams (CalParam * node);
+/* Free a property split in place that isn't kept
+ * 
+ * Arguments: property returned by splitCalProp with keepLine set
+ * 
+ * Preconditions: *prop was malloc'd
+ * Postconditions: prop and its parameters are free'd; the line its name and value point into is left alone
+ * 
+ * Return val: none
+ * */
+void dropCalProp (CalProp *prop);
+
+/* Give up on a line that strict parsing rejects
+ * 
+ * Arguments: scanCalLine's pline and the no. of folds in the line
+ * 
+ * Preconditions: none
+ * Postconditions: *pline is set to NULL
+ * 
+ * Return val: BADTEXT with the lines the rejected line came from
+ * */
+CalStatus badCalText (char **const pline, int foldedCount);
+
+/* Parse a calendar file, the body of readCalFile and readCalChanges
+ * 
+ * Arguments: as for readCalFile, and whether a calendar with no V-component is reported as NOCAL
+ * 
+ * Preconditions: parseLock is held
+ * Postconditions: as for readCalFile
+ * 
+ * Return val: as for readCalFile
+ * */
+CalStatus parseCalFile (FILE *const ics, CalComp **const pcomp, bool needComps);
+
+/* Split a content line into a property's name, parameters and value
+ * 
+ * Arguments: the line, the property to fill in, and true to split the line in place rather than copy pieces out of it
+ * 
+ * Preconditions: buff is null terminated
+ * Postconditions: as for parseCalProp; if keepLine is true and the line parses, prop->name and prop->value point into buff
+ * 
+ * Return val: as for parseCalProp
+ * */
+CalError splitCalProp (char *const buff, CalProp *const prop, bool keepLine);
 
 /* Free all components in CalProp object and the Calprop object itself
  * 
- * Arguments: initialized Calprop structure
+ * Arguments: initialized Calprop structure and the store it was loaded into (or NULL)
  * 
  * Preconditions: *head must be initialized 
- * Postconditions: contents of *head are free'd and so is *head itself
+ * Postconditions: contents of *head are free'd and so is *head itself, except memory that lies inside store
  * 
  * Return val: none
  * */
-void freePropList (CalProp *head);
+void freePropList (CalProp *head, const CalStore *store);
 
 /* Free all components in CalParam object and the CalParam object itself
  * 
- * Arguments: initialized CalParam structure
+ * Arguments: initialized CalParam structure and the store it was loaded into (or NULL)
  * 
  * Preconditions: *head must be initialized 
- * Postconditions: contents of *head are free'd and so is *head itself
+ * Postconditions: contents of *head are free'd and so is *head itself, except memory that lies inside store
  * 
  * Return val: none
  * */
-void freeParamList (CalParam * head);
+void freeParamList (CalParam * head, const CalStore *store);
+
+/* Free a component, its properties and all of its subcomponents
+ * 
+ * Arguments: initialized CalComp structure and the store of the tree it belongs to (or NULL)
+ * 
+ * Preconditions: *comp must be initialized
+ * Postconditions: comp and everything below it is free'd, except memory that lies inside store
+ * 
+ * Return val: none
+ * */
+void freeCompTree (CalComp *comp, const CalStore *store);
+
+/* Check if a pointer lies inside a store's block
+ * 
+ * Arguments: a store (or NULL) and any pointer
+ * 
+ * Preconditions: none
+ * Postconditions: none
+ * 
+ * Return val: true if ptr points into store, false otherwise (always false when store is NULL)
+ * */
+bool inStore (const CalStore *store, const void *ptr);
 
 /*	Parse a string of parameters of unlimited length, then return a CalParam structure
  * 
@@ -51,16 +188,27 @@ void freeParamList (CalParam * head);
  * */
 CalParam * parseParams (char * optionalParams);
 
-/*	Checks if a the contents of a CalParam linked list are valid according to the A1 spec
+/*	Counts the parameters parseParams would build from a string and checks their names, without building them
  * 
- * Arguments: an initalized CalParam structure
+ * Arguments: initialized string of VCALENDAR parameters and a flag to clear if a name is invalid
  * 
- * Preconditions: *node must be initialized
+ * Preconditions: *optionalParams must be initialized
+ * Postconditions: *valid is set to false if any parameter name is empty or has a space in it, unchanged otherwise
+ * 
+ * Return val: no. of CalParam structures parseParams returns for optionalParams
+ * */
+int checkParams (char * optionalParams, bool * valid);
+
+/*	Checks the name createNode would give a parameter, according to the A1 spec
+ * 
+ * Arguments: a parameter and its length
+ * 
+ * Preconditions: length characters are readable at parameter
  * Postconditions: none
  * 
- * Return val: true if all parameter names and values are valid according to the A1 spec, false otherwise
+ * Return val: true if the name isn't empty and has no spaces, false otherwise
  * */
-bool validateParams (CalParam * node);
+bool checkParamName (const char * parameter, int length);
 
 /*	Creates a CalParam structure and assigns its contents based on the parameter passed as an argument
  * 
@@ -130,31 +278,53 @@ bool checkProd (CalProp * head);
 
 void freeCalComp (CalComp *const comp){
 	
+	CalStore * store;
+	
+	store = comp->store;
+	
+	freeCompTree(comp, store);
+	
+	/* Release the backing block last since the tree lived inside it */
+	if (store != NULL)
+		store->release(store);
+}
+
+void freeCompTree (CalComp *comp, const CalStore *store){
+	
 	int i;
 	
 	/* Check if comp->name is already NULL, if not free it then set to NULL */
 	if (comp->name != NULL){
-		free(comp->name);
+		if (inStore(store, comp->name) == false)
+			free(comp->name);
 		comp->name = NULL;
 	}
 	
 	/* Check if comp->prop is already NULL, if not free it */
 	if (comp->prop != NULL)
-		freePropList(comp->prop);
+		freePropList(comp->prop, store);
 	
 	/* Free all flexible array elements by recursively calling this function */
 	for (i = 0; i < comp->ncomps; ++i){
 		
-		freeCalComp(comp->comp[i]);
+		freeCompTree(comp->comp[i], store);
 	}
 	
 	/* If comp isn't already NULL free it */
-	if (comp != NULL){
+	if (comp != NULL && inStore(store, comp) == false){
 		free(comp);
 	}
 }
 
-void freePropList (CalProp *head){
+bool inStore (const CalStore *store, const void *ptr){
+	
+	if (store == NULL)
+		return false;
+	
+	return (const char *)ptr >= store->base && (const char *)ptr < store->base + store->size;
+}
+
+void freePropList (CalProp *head, const CalStore *store){
 	
 	CalProp * temp;
 	
@@ -164,37 +334,58 @@ void freePropList (CalProp *head){
 		temp = head; 
 		head = head->next; // Set head to the next element 
        
+		/* Name and value lie inside the line the property was read from, if it kept one */
+		if (temp->line != NULL){
+			
+			if (inStore(store, temp->line) == false)
+				free(temp->line);
+			temp->line = NULL;
+			temp->name = NULL;
+			temp->value = NULL;
+		}
+		
        /* If temp->name isn't NULL free it and set to NULL */
 		if (temp->name != NULL){
 			
-			free(temp->name);
+			if (inStore(store, temp->name) == false)
+				free(temp->name);
 			temp->name = NULL;
 		}
 		
 		/* If temp->value isn't NULL free it and set to NULL */
 		if (temp->value != NULL){
 			
-			free(temp->value);
+			if (inStore(store, temp->value) == false)
+				free(temp->value);
 			temp->value = NULL;
 		}
 		
 		/* If temp->param isn't NULL free the CalParam list and set to NULL */
 		if (temp->param != NULL){
 			
-			freeParamList(temp->param);
+			freeParamList(temp->param, store);
 			temp->param = NULL;
 		}
 		
+		/* Free parameters that were never decoded */
+		if (temp->rawparam != NULL){
+			
+			if (inStore(store, temp->rawparam) == false)
+				free(temp->rawparam);
+			temp->rawparam = NULL;
+		}
+		
 		/* If temp isn't NULL free it and set to NULL */
 		if (temp != NULL){
 			
-			free(temp);
+			if (inStore(store, temp) == false)
+				free(temp);
 			temp = NULL;
 		}
 	}
 }
 
-void freeParamList (CalParam * head){
+void freeParamList (CalParam * head, const CalStore *store){
 	
 	CalParam * temp;
 	int i;
@@ -208,7 +399,8 @@ void freeParamList (CalParam * head){
        /* If temp->name isn't NULL free it and set to NULL */
        if (temp->name != NULL){
 		   
-			free(temp->name);
+			if (inStore(store, temp->name) == false)
+				free(temp->name);
 			temp->name = NULL;
 		}
 		
@@ -216,14 +408,16 @@ void freeParamList (CalParam * head){
 		for (i = 0; i < temp->nvalues; ++i){
 			
 			if (temp->value[i] != NULL){
-				free(temp->value[i]);	
+				if (inStore(store, temp->value[i]) == false)
+					free(temp->value[i]);	
 				temp->value[i] = NULL;
 			}
 		}
 		
 		/* If temp isn't NULL free it and set and to NULL */
 		if (temp != NULL){
-			free(temp);
+			if (inStore(store, temp) == false)
+				free(temp);
 			temp = NULL;
 		}
 	}
@@ -342,6 +536,29 @@ bool checkProd (CalProp * head){
  
 CalStatus readCalFile( FILE *const ics, CalComp **const pcomp ){
 
+	CalStatus status;
+	
+	/* The reader and the line count are shared, so only one file is parsed at a time */
+	pthread_mutex_lock(&parseLock);
+	status = parseCalFile(ics, pcomp, true);
+	pthread_mutex_unlock(&parseLock);
+	
+	return status;
+}
+
+CalStatus readCalChanges( FILE *const ics, CalComp **const pcomp ){
+
+	CalStatus status;
+	
+	pthread_mutex_lock(&parseLock);
+	status = parseCalFile(ics, pcomp, false);
+	pthread_mutex_unlock(&parseLock);
+	
+	return status;
+}
+
+CalStatus parseCalFile (FILE *const ics, CalComp **const pcomp, bool needComps){
+
 	CalStatus status;
 	char * buffer;
 	
@@ -356,9 +573,10 @@ CalStatus readCalFile( FILE *const ics, CalComp **const pcomp ){
 	(*pcomp)->name = NULL;
 	(*pcomp)->nprops = 0;
 	(*pcomp)->prop = NULL;
+	(*pcomp)->store = NULL;
 	(*pcomp)->ncomps = 0;
 	
-	status = readCalComp(ics, pcomp);
+	STATS_TIME(readcomp, status = readCalComp(ics, pcomp));
 	
 	/* Check if readCalComp returned an error, free *pcomp if so and return the suberror */
 	if (status.code != OK){
@@ -368,7 +586,7 @@ CalStatus readCalFile( FILE *const ics, CalComp **const pcomp ){
 	}
 	
 	/* Check for NOCAL error, free *pcomp if so and return the suberror */
-	else if (checkNoCal(*pcomp) == false){
+	else if (needComps == true && checkNoCal(*pcomp) == false){
 		
 		status.code = NOCAL;
 		status.linefrom = lineCount;
@@ -400,7 +618,14 @@ CalStatus readCalFile( FILE *const ics, CalComp **const pcomp ){
 		return status;
 	}
 	
-	readCalLine(ics, &buffer); // Call readCalLine to check for AFTEND error 
+	STATS_TIME(readline, status = readCalLine(ics, &buffer)); // Call readCalLine to check for AFTEND error 
+	
+	/* Strict parsing rejects bad text even after the end of the calendar */
+	if (status.code == BADTEXT){
+		
+		freeCalComp(*pcomp);
+		return status;
+	}
 	
 	/* If we receive something other then NULL from readCalLine the file hasn't ended so return AFTEND and free *pcomp */
 	if (buffer != NULL){
@@ -433,6 +658,7 @@ CalStatus readCalComp( FILE *const ics, CalComp **const pcomp ){
 	CalError returnVal;
 	CalStatus status, returnValStatus;
 	char ** pbuff, * buffer;
+	size_t length;
 	int i;
 	
 	buffer = NULL;
@@ -443,7 +669,11 @@ CalStatus readCalComp( FILE *const ics, CalComp **const pcomp ){
 	/* Read lines from file until EOF or we run into END:VCALENDAR */
 	do{
 
-		status = readCalLine(ics, pbuff); // Read a line from the input file 
+		STATS_TIME(readline, status = scanCalLine(ics, pbuff, &length)); // Read a line from the input file 
+		
+		/* Lines rejected by strict parsing end the component like any other error */
+		if (status.code == BADTEXT)
+			return status;
 		
 		if (buffer != NULL){
 		
@@ -451,13 +681,13 @@ CalStatus readCalComp( FILE *const ics, CalComp **const pcomp ){
 			toAdd = malloc(sizeof(CalProp));
 			assert(toAdd);
 			
-			returnVal = parseCalProp(buffer, toAdd);
+			/* Split the line where it lies; only properties that are kept get a copy of it */
+			STATS_TIME(parseprop, returnVal = splitCalProp(buffer, toAdd, true));
 			
-			/* If parseCalProp returns an error, free temp CalProp and return suberror */
+			/* If splitCalProp returns an error, free temp CalProp and return suberror */
 			if (returnVal != OK){
 				
-				free(buffer);
-				freePropList(toAdd);
+				freePropList(toAdd, NULL);
 				
 				status.code = returnVal;
 				status.linefrom = lineCount;
@@ -484,19 +714,14 @@ CalStatus readCalComp( FILE *const ics, CalComp **const pcomp ){
 					depth = 1; // Set depth to 1
 					
 					/* Free temp CalProp */
-					free(toAdd->name);
-					free(toAdd->value);
-					free(toAdd);
+					dropCalProp(toAdd);
 				}
 				
 				/* If first BEGIN didn't have "VCALENDAR" as value */
 				else{
 					
-					/* Free temp CalProp and buffer from readCalLine */
-					free(toAdd->name);
-					free(toAdd->value);
-					free(toAdd);
-					free(buffer);
+					/* Free temp CalProp */
+					dropCalProp(toAdd);
 					
 					/* Return NOCAL error */
 					status.code = NOCAL;
@@ -512,11 +737,8 @@ CalStatus readCalComp( FILE *const ics, CalComp **const pcomp ){
 				/* Check for SUBCOM error */
 				if (depth == 3){
 					
-					/* Free temp CalProp and other allocated memory */
-					free(toAdd->name);
-					free(toAdd->value);
-					free(toAdd);
-					free(buffer);
+					/* Free temp CalProp */
+					dropCalProp(toAdd);
 					
 					/* Return SUBCOM error */
 					status.code = SUBCOM;
@@ -534,6 +756,7 @@ CalStatus readCalComp( FILE *const ics, CalComp **const pcomp ){
 				
 				(*pcomp)->comp[(*pcomp)->ncomps]->nprops = 0;
 				(*pcomp)->comp[(*pcomp)->ncomps]->prop = NULL;
+				(*pcomp)->comp[(*pcomp)->ncomps]->store = NULL;
 				(*pcomp)->comp[(*pcomp)->ncomps]->ncomps = 0;
 				
 				(*pcomp)->comp[(*pcomp)->ncomps]->name = malloc(sizeof(char) * (strlen(toAdd->value) + 1));
@@ -546,9 +769,7 @@ CalStatus readCalComp( FILE *const ics, CalComp **const pcomp ){
 				(*pcomp)->comp[(*pcomp)->ncomps]->name[i] = '\0'; // Add null terminator
 				
 				/* Free temp CalProp */
-				free(toAdd->name);
-				free(toAdd->value);
-				free(toAdd);
+				dropCalProp(toAdd);
 				
 				++depth; // Increment depth
 				
@@ -556,20 +777,15 @@ CalStatus readCalComp( FILE *const ics, CalComp **const pcomp ){
 				returnValStatus = readCalComp(ics, &(*pcomp)->comp[(*pcomp)->ncomps]); 
 				++(*pcomp)->ncomps;
 				
-				/* If readCalComp return an error, return the suberror and free buffer from readCalLine */
-				if (returnValStatus.code != OK){
-
-					free(buffer);
-				
+				/* If readCalComp return an error, return the suberror */
+				if (returnValStatus.code != OK)
 					return returnValStatus;
-				}
 			}
 			
 			/* If we've run into an END */
 			else if (toAdd != NULL && toAdd->name != NULL && strcmp(toAdd->name, "END") == 0){
 				
-                for (i = 0; i < strlen(toAdd->value); ++i)
-					toAdd->value[i] = toupper(toAdd->value[i]);
+                calScanUpper(toAdd->value, strlen(toAdd->value));
                     
 				/* Check if value for END matches the current name */
 				if (strcmp((*pcomp)->name, toAdd->value) == 0){
@@ -577,11 +793,8 @@ CalStatus readCalComp( FILE *const ics, CalComp **const pcomp ){
 					/* Check for NODATA error */
 					if ((*pcomp)->ncomps == 0 && (*pcomp)->nprops == 0){
 						
-						/* Free temp CalProp and buffer from readCalLine */
-						free(toAdd->value);
-						free(toAdd->name);
-						free(toAdd);
-						free(buffer);
+						/* Free temp CalProp */
+						dropCalProp(toAdd);
 						--depth;
 
 						/* Return NODATA error */
@@ -600,10 +813,7 @@ CalStatus readCalComp( FILE *const ics, CalComp **const pcomp ){
 						}
 						
 						/* Free temp CalProp */
-						free(toAdd->value);
-						free(toAdd->name);
-						free(toAdd);
-						free(buffer);
+						dropCalProp(toAdd);
 
 						/* Reduce depth and return OK */
 						--depth;
@@ -618,11 +828,8 @@ CalStatus readCalComp( FILE *const ics, CalComp **const pcomp ){
 				else if (strcmp((*pcomp)->name, toAdd->value) != 0){
 					
 					
-					/* Free temp CalProp and buffer */
-					free(toAdd->value);
-					free(toAdd->name);
-					free(toAdd);
-					free(buffer);
+					/* Free temp CalProp */
+					dropCalProp(toAdd);
 					
 					
 					/* Reduce depth and return BEGEND error */
@@ -638,10 +845,12 @@ CalStatus readCalComp( FILE *const ics, CalComp **const pcomp ){
 			else if (toAdd  != NULL){
 				
 				(*pcomp)->nprops++;
+				keepCalLine(toAdd, buffer);
 				addPropNode(&(*pcomp)->prop, toAdd);
+				
+				STATS_ADD(props, 1);
+				STATS_ADD(params, toAdd->nparams);
 			}
-			
-			free(buffer); // Free readCalLine buffer
 		}
 		
         if ((*pcomp)->name == NULL){
@@ -668,18 +877,31 @@ CalStatus readCalComp( FILE *const ics, CalComp **const pcomp ){
 		}
 		
 	}while (*pbuff != NULL);
-
-
-	free(buffer); // Free readCalLine buffer 
 	
 	return status;
 }
 
 CalStatus readCalLine( FILE *const ics, char **const pbuff ){
 	
+	CalStatus status;
+	char * line;
+	size_t length;
+	
+	status = scanCalLine(ics, &line, &length);
+	
+	/* Callers own the lines they get, so the reader's buffer is never handed out as it is */
+	if (ics != NULL)
+		*pbuff = line == NULL ? NULL : takeCalLine(length);
+	
+	return status;
+}
+
+CalStatus scanCalLine (FILE *const ics, char **const pline, size_t *const plength){
+	
 	char currentChar, *buildBuffer;
 	CalStatus status;
-	int charCount, loopCount, foldedCount;
+	int nextChar, foldedCount;
+	size_t charCount, bufferSize, run, length;
 	bool carriageReturn, onlyEOF;
 	
 	carriageReturn = false;
@@ -690,8 +912,10 @@ CalStatus readCalLine( FILE *const ics, char **const pbuff ){
 	/* Reset everything if no input file is given */
 	if (ics == NULL){
 		
-        //printf("NULL\n");
 		lineCount = 0;
+		reader.file = NULL;
+		reader.pos = 0;
+		reader.fill = 0;
 		status.linefrom = 0;
 		status.lineto = 0;
 		return status; 
@@ -699,18 +923,65 @@ CalStatus readCalLine( FILE *const ics, char **const pbuff ){
 	
 	else{
 		
-        //lineStart = lineCount;
-		buildBuffer = malloc(sizeof(char) * MAXSTRINGLENGTH); // Allocate memory for current line 
-		assert(buildBuffer);
+		/* Drop read-ahead that belongs to some other file */
+		if (reader.file != ics){
+			
+			reader.file = ics;
+			reader.pos = 0;
+			reader.fill = 0;
+		}
+		
+		/* The buffer is only allocated once and then kept for every line that follows */
+		if (reader.line == NULL){
+			
+			reader.size = MAXSTRINGLENGTH;
+			reader.line = malloc(sizeof(char) * reader.size);
+			assert(reader.line);
+			STATS_ADD(linebufs, 1);
+		}
+		
+		bufferSize = reader.size;
+		buildBuffer = reader.line;
 		
 		/* Get characters from file until EOF */
-		while((currentChar = fgetc(ics)) != EOF){ 				
+		while (reader.pos < reader.fill || fillCalReader() == true){
             
             onlyEOF = false;
             
+            /* Copy everything up to the next CR or LF in one go */
+            if (carriageReturn == false){
+				
+				run = calScanFind(reader.block + reader.pos, reader.fill - reader.pos, "\r\n", 2);
+				
+				if (run > 0){
+					
+					/* Grow the line, leaving room for the null terminator */
+					if (charCount + run >= bufferSize){
+						
+						while (charCount + run >= bufferSize)
+							bufferSize *= 2;
+						
+						buildBuffer = realloc(buildBuffer, sizeof(char) * bufferSize);
+						assert(buildBuffer);
+						STATS_ADD(linebufs, 1);
+						
+						reader.line = buildBuffer;
+						reader.size = bufferSize;
+					}
+					
+					memcpy(buildBuffer + charCount, reader.block + reader.pos, run);
+					charCount += run;
+					reader.pos += run;
+					STATS_ADD(bytesread, run);
+					continue;
+				}
+			}
+			
+			currentChar = reader.block[reader.pos++];
+			STATS_ADD(bytesread, 1);
+            
 			/* If we've run into a carraige return */
 			if (currentChar == '\r'){
-				//status.linefrom = lineStart;
 					
 				carriageReturn = true;
 				continue;
@@ -720,65 +991,50 @@ CalStatus readCalLine( FILE *const ics, char **const pbuff ){
 			else if (currentChar == '\n' && carriageReturn == true){
 				
                 ++lineCount;
+                STATS_ADD(lines, 1);
                 
-				/* Check for folding */
-				if ((currentChar = fgetc(ics)) != EOF){
+				/* Check for folding without consuming the next character unless it is a fold */
+				if ((nextChar = peekCalReader()) != EOF){
 						
 					/* Continue if this line is folded */
-					if (currentChar == '\t' || currentChar == ' '){
+					if (nextChar == '\t' || nextChar == ' '){
+                        ++reader.pos;
                         ++foldedCount;
+                        STATS_ADD(folds, 1);
+                        STATS_ADD(bytesread, 1);
 						carriageReturn = false;
 						continue;
 					}
-					
-					/* If EOF return OK and set *pbuff to NULL */
-					else if (currentChar == EOF){
-						
-						*pbuff = NULL;
-						free(buildBuffer);
-
-						status.code = OK;
-						status.linefrom = lineCount - foldedCount;
-						status.lineto = lineCount;
-						return status;
-					}					
-					
-					/* If line isn't folded put the character we grabbed to check for folding back in its place */
-					else{
-						
-						ungetc(currentChar, ics);
-					}
 				}
-				
                 
 				buildBuffer[charCount] = '\0'; // Add null terminator 
+				length = strlen(buildBuffer);
 				
-				/* Check if line is only whitespace; return OK and set *pbuff to the current line if we run into atleast one non-whitespace char */
-				for (loopCount = 0; loopCount < strlen(buildBuffer); ++loopCount){
-					
-					if (isspace(buildBuffer[loopCount]) == 0){
+				if (strictText == true && calScanText(buildBuffer, charCount) < charCount)
+					return badCalText(pline, foldedCount);
+				
+				/* Check if line is only whitespace; return OK and set *pline to the current line if there is atleast one non-whitespace char */
+				if (calScanSpace(buildBuffer, length) < length){
 
-						*pbuff = buildBuffer;
-						
-                        //printf("%s %d\n", *pbuff, lineCount);
-						status.code = OK;
-						status.linefrom = lineCount - foldedCount;
-						status.lineto = lineCount;
-						
-						return status;
-					}
+					*pline = buildBuffer;
+					*plength = charCount;
+					
+					status.code = OK;
+					status.linefrom = lineCount - foldedCount;
+					status.lineto = lineCount;
+					
+					return status;
 				}
 				
                 carriageReturn = false;
 				continue;
 			}
 			
-			/* If we run into an EOL and didn't previously receive a carriage return */
-			else if (currentChar == '\n' && carriageReturn == false){
+			/* If we run into an EOL and didn't previously receive a carriage return, or a carriage return isn't followed by one */
+			else{
 				
-				/* Set *pbuff to null and free buffer */
-				*pbuff = NULL;
-				free(buildBuffer);
+				/* Set *pline to null */
+				*pline = NULL;
 
 				/* Return NOCRNL error */
 				status.code = NOCRNL;
@@ -786,88 +1042,203 @@ CalStatus readCalLine( FILE *const ics, char **const pbuff ){
 				status.lineto = lineCount;
 				return status;
 			}
-            
-            else if (currentChar != '\n' && carriageReturn == true){
-                
-                //printf("HERE!\n");
-				*pbuff = NULL;
-				free(buildBuffer);
-
-				
-				status.code = NOCRNL;
-				status.linefrom = lineCount - foldedCount;
-				status.lineto = lineCount;
-				return status;
-                
-            }
-
-			/* Otherwise just add current character to buffer */
-			else{
-				
-				buildBuffer[charCount] = currentChar;
-				++charCount;	
-			}
 		}
-        
-        /*if (onlyEOF == true)
-            buildBuffer[charCount] = '\0';*/
             
-        if (currentChar == EOF && buildBuffer != NULL ){
-                
-            ++lineCount;
-            buildBuffer[charCount] = '\0'; // Add null terminator 
+        ++lineCount;
+        buildBuffer[charCount] = '\0'; // Add null terminator 
+        length = strlen(buildBuffer);
+        
+        if (onlyEOF == false)
+            STATS_ADD(lines, 1);
+        
+        if (strictText == true && calScanText(buildBuffer, charCount) < charCount)
+            return badCalText(pline, foldedCount);
+        
+        /* Check if line is only whitespace; return OK and set *pline to the current line if there is atleast one non-whitespace char */
+        if (calScanSpace(buildBuffer, length) < length){
+    
+            *pline = buildBuffer;
+            *plength = charCount;
+            status.code = OK;
+            status.linefrom = lineCount - foldedCount;
+            status.lineto = lineCount;
             
-            if (strlen(buildBuffer) != 0){
-            //printf("%d \n", strlen(buildBuffer));
-
-                    
-                /* Check if line is only whitespace; return OK and set *pbuff to the current line if we run into atleast one non-whitespace char */
-                for (loopCount = 0; loopCount < strlen(buildBuffer); ++loopCount){
-                    
-                    if (isspace(buildBuffer[loopCount]) == 0){
-                
-                        *pbuff = buildBuffer;
-                        //printf("%s - %d\n", *pbuff, lineCount);
-                        status.code = OK;
-                        status.linefrom = lineCount - foldedCount;
-                        status.lineto = lineCount;
-                        
-                        return status;
-                    }
-                }
-            }
+            return status;
         }
 		
-		/* Free buffer and set *pbuff to NULL */
-		free(buildBuffer);
-		*pbuff = NULL;
-        
-        if (onlyEOF == true && lineCount == 1){
-            //printf("true!\n");
-            onlyEOF = false;
-            --lineCount;
-        }
+		/* Set *pline to NULL */
+		*pline = NULL;
         
-        else if (onlyEOF == true && lineCount != 1){
-            //printf("!!!");
+        /* Nothing was left to read, so the last line counted doesn't exist */
+        if (onlyEOF == true)
             --lineCount;
-            onlyEOF = false;
-        }
+            
         status.code = OK;
         status.linefrom = lineCount - foldedCount;
         status.lineto = lineCount;
-        //printf("%d\n", lineCount - foldedCount);
 	}
 
 	return status;
 }
 
+void setCalStrict( bool strict ){
+	
+	strictText = strict;
+}
+
+CalParam *getCalParams( const CalProp *prop ){
+	
+	CalProp * decoded;
+	char * params;
+	
+	if (prop->rawparam == NULL)
+		return prop->param;
+	
+	/* Decoding only fills in the list the property already stands for */
+	decoded = (CalProp *) prop;
+	
+	for (params = decoded->rawparam; *params != '\0'; params += strlen(params) + 1)
+		addParamNode(&decoded->param, parseParams(params));
+	
+	free(decoded->rawparam);
+	decoded->rawparam = NULL;
+	
+	return decoded->param;
+}
+
+char *getCalText( const CalProp *prop ){
+	
+	char * text;
+	size_t length, from, to, run;
+	
+	length = strlen(prop->value);
+	
+	text = malloc(sizeof(char) * (length + 1));
+	assert(text);
+	
+	/* Copy from one backslash to the next; escapes only ever shorten the text */
+	for (from = 0, to = 0; from < length; ){
+		
+		run = calScanFind(prop->value + from, length - from, "\\", 1);
+		
+		memcpy(text + to, prop->value + from, run);
+		to += run;
+		from += run;
+		
+		if (from == length)
+			break;
+		
+		/* A backslash at the very end has nothing to escape and is kept */
+		if (from + 1 == length){
+			
+			text[to++] = '\\';
+			break;
+		}
+		
+		/* \n and \N are newlines; anything else stands for itself */
+		if (prop->value[from + 1] == 'n' || prop->value[from + 1] == 'N')
+			text[to++] = '\n';
+		else
+			text[to++] = prop->value[from + 1];
+		
+		from += 2;
+	}
+	
+	text[to] = '\0';
+	
+	return text;
+}
+
+bool getCalStrict( void ){
+	
+	return strictText;
+}
+
+CalStatus badCalText (char **const pline, int foldedCount){
+	
+	CalStatus status;
+	
+	*pline = NULL;
+	
+	status.code = BADTEXT;
+	status.linefrom = lineCount - foldedCount;
+	status.lineto = lineCount;
+	
+	return status;
+}
+
+char *takeCalLine (size_t length){
+	
+	char * line;
+	
+	/* Copying a long line would cost more than starting the reader's buffer over */
+	if (length >= MAXSTRINGLENGTH){
+		
+		line = realloc(reader.line, sizeof(char) * (length + 1));
+		assert(line);
+		
+		reader.line = NULL;
+		reader.size = 0;
+		
+		return line;
+	}
+	
+	line = malloc(sizeof(char) * (length + 1));
+	assert(line);
+	
+	memcpy(line, reader.line, length + 1);
+	
+	return line;
+}
+
+void keepCalLine (CalProp *prop, const char *buff){
+	
+	size_t valueAt;
+	
+	/* Parameters were copied out and the name starts the line, so the line only needs to last to the end of the value */
+	valueAt = prop->value - buff;
+	
+	prop->line = takeCalLine(valueAt + strlen(prop->value));
+	prop->name = prop->line;
+	prop->value = prop->line + valueAt;
+}
+
+void dropCalProp (CalProp *prop){
+	
+	prop->name = NULL;
+	prop->value = NULL;
+	
+	freePropList(prop, NULL);
+}
+
+bool fillCalReader (void){
+	
+	reader.pos = 0;
+	reader.fill = fread(reader.block, 1, CALREAD_BLOCK, reader.file);
+	
+	return reader.fill > 0;
+}
+
+int peekCalReader (void){
+	
+	if (reader.pos == reader.fill && fillCalReader() == false)
+		return EOF;
+	
+	return (unsigned char) reader.block[reader.pos];
+}
+
 CalError parseCalProp( char *const buff, CalProp *const prop ){
 	
-	bool onlyPropVal, parsedParams, quoteStart;
+	return splitCalProp(buff, prop, false);
+}
+
+CalError splitCalProp (char *const buff, CalProp *const prop, bool keepLine){
+	
+	bool onlyPropVal, parsedParams, quoteStart, validParams;
 	CalError status;
+	CalScanIter delims;
     
-	int i, j, count;
+	int i, start, count, length, rawCount;
 	char * currentString;
 	
 	/* Set all contents to NULL or zero */
@@ -875,19 +1246,63 @@ CalError parseCalProp( char *const buff, CalProp *const prop ){
 	prop->value = NULL;
 	prop->nparams = 0;
 	prop->param = NULL;
+	prop->rawparam = NULL;
+	prop->line = NULL;
 	prop->next = NULL;
 
-	currentString = malloc(sizeof(char) * strlen(buff)); 
-	assert(currentString);
+	length = strlen(buff);
+	
+	/* Pieces of a line split in place are read straight out of it, ended where their delimiter was */
+	if (keepLine == true)
+		currentString = buff;
+	
+	else{
+		
+		currentString = malloc(sizeof(char) * length); 
+		assert(currentString);
+	}
 	
 	/* Set count to 0 and boolean to false */
 	count = 0;
 	onlyPropVal = false;
 	parsedParams = false;
 	quoteStart = false;
+	validParams = true;
+	rawCount = 0;
 	
-	/* Iterate through buffer */
-	for (i = 0; i < strlen(buff); ++i){
+	/* Only ; : and " change anything, so jump from one to the next copying what lies between */
+	calScanStart(&delims, buff, length, ";:\"", 3);
+	
+	for (start = 0; start < length; start = i + 1){
+		
+		/* Everything after the params is the value */
+		if (onlyPropVal == true || parsedParams == true){
+			
+			/* The value already ends the line, so it can stay where it is */
+			if (keepLine == true){
+				
+				prop->value = buff + start;
+				break;
+			}
+			
+			memcpy(currentString + count, buff + start, length - start);
+			count += length - start;
+			
+			currentString[count] = '\0';
+			prop->value = currentString;
+			
+			count = 0;
+			break;
+		}
+		
+		i = calScanNext(&delims);
+		
+		if (keepLine == false)
+			memcpy(currentString + count, buff + start, i - start);
+		count += i - start;
+		
+		if (i == length)
+			break;
 		
 		/* If we've run into a quote and its the opening one */
 		if (buff[i] == '"' && quoteStart == false){
@@ -912,17 +1327,18 @@ CalError parseCalProp( char *const buff, CalProp *const prop ){
 			
 			prop->name = currentString;
 			
-			/* Convert to uppercase */
-			for (j = 0; j < strlen(prop->name); ++j){
-				
-				prop->name[j] = toupper(prop->name[j]);
-			}
+			calScanUpper(prop->name, count); // Convert to uppercase
 			
 			count = 0;
-			currentString = malloc(sizeof(char) * strlen(buff));
-			assert(currentString);
 			
-			//printf("Prop name: %s\n\n", prop->name);
+			if (keepLine == true)
+				currentString = buff + i + 1;
+			
+			else{
+				
+				currentString = malloc(sizeof(char) * length);
+				assert(currentString);
+			}
 			
 			continue;
 		}
@@ -935,28 +1351,26 @@ CalError parseCalProp( char *const buff, CalProp *const prop ){
 
 			currentString[count] = '\0';
             
-            addParamNode(&prop->param, parseParams(currentString));
-			prop->nparams = countParams(prop->param);
-            
-			free(currentString);
+            /* Only count and check the parameters here; getCalParams builds them the first time they're needed */
+            if (count > 0){
+				
+				if (prop->rawparam == NULL){
+					
+					prop->rawparam = malloc(sizeof(char) * (length + 1));
+					assert(prop->rawparam);
+				}
+				
+				prop->nparams += checkParams(currentString, &validParams);
+				
+				memcpy(prop->rawparam + rawCount, currentString, count + 1);
+				rawCount += count + 1;
+			}
 			
 			count = 0;
-			currentString = malloc(sizeof(char) * strlen(buff));
-			assert(currentString);
-			
-			continue;
-		}
-		
-		/* Parse value */
-		else if ((onlyPropVal == true || parsedParams == true) && i == (strlen(buff) - 1)){
 			
-			currentString[count] = buff[i];
-			++count;
-			
-			currentString[count] = '\0';
-			prop->value = currentString;
+			if (keepLine == true)
+				currentString = buff + i + 1;
 			
-			count = 0;
 			continue;
 		}
 		
@@ -964,8 +1378,17 @@ CalError parseCalProp( char *const buff, CalProp *const prop ){
 		++count;
 	}
 	
+	/* An empty string ends the undecoded parameters */
+	if (prop->rawparam != NULL)
+		prop->rawparam[rawCount] = '\0';
+	
 	/* If we didn't find a value, set it to zero length */
-	if (prop->value == NULL){
+	if (prop->value == NULL && keepLine == true){
+		
+		prop->value = buff + length;
+	}
+	
+	else if (prop->value == NULL){
 		
 		prop->value = malloc(sizeof(char));
 		assert(prop->value);
@@ -978,28 +1401,30 @@ CalError parseCalProp( char *const buff, CalProp *const prop ){
 	if (prop->name != NULL && strlen(prop->name) != 0){
 		
 		/* Check if params are valid, return OK if so */
-		if (prop->param != NULL && validateParams(prop->param) == true){
+		if (prop->nparams > 0 && validParams == true){
 			
 			status = OK;
 			return status;
 		}
 		
 		/* Check if params are invalid, free prop and its contents if so then return SYNTAX */
-		else if (prop->param != NULL && validateParams(prop->param) == false){
+		else if (prop->nparams > 0 && validParams == false){
 				
 			if (prop->name != NULL){
-				free(prop->name);
+				if (keepLine == false)
+					free(prop->name);
 				prop->name = NULL;
 			}
 			
 			if (prop->value != NULL){
-				free(prop->value);
+				if (keepLine == false)
+					free(prop->value);
 				prop->value = NULL;
 			}
 			
-			if (prop->param != NULL){
-				freeParamList(prop->param);
-				prop->param = NULL;
+			if (prop->rawparam != NULL){
+				free(prop->rawparam);
+				prop->rawparam = NULL;
 			}
 				
 			status = SYNTAX;
@@ -1010,18 +1435,20 @@ CalError parseCalProp( char *const buff, CalProp *const prop ){
 		else if (parsedParams == true && prop->nparams == 0){
 				
 			if (prop->name != NULL){
-				free(prop->name);
+				if (keepLine == false)
+					free(prop->name);
 				prop->name = NULL;
 			}
 			
 			if (prop->value != NULL){
-				free(prop->value);
+				if (keepLine == false)
+					free(prop->value);
 				prop->value = NULL;
 			}
 			
-			if (prop->param != NULL){
-				freeParamList(prop->param);
-				prop->param = NULL;
+			if (prop->rawparam != NULL){
+				free(prop->rawparam);
+				prop->rawparam = NULL;
 			}
 				
 			status = SYNTAX;
@@ -1037,18 +1464,20 @@ CalError parseCalProp( char *const buff, CalProp *const prop ){
 	else{
 
 		if (prop->name != NULL){
-			free(prop->name);
+			if (keepLine == false)
+				free(prop->name);
 			prop->name = NULL;
 		}
 		
 		if (prop->value != NULL){
-			free(prop->value);
+			if (keepLine == false)
+				free(prop->value);
 			prop->value = NULL;
 		}
 		
-		if (prop->param != NULL){
-			freeParamList(prop->param);
-			prop->param = NULL;
+		if (prop->rawparam != NULL){
+			free(prop->rawparam);
+			prop->rawparam = NULL;
 		}
 		
 		status = SYNTAX;
@@ -1063,7 +1492,7 @@ CalParam * parseParams (char * optionalParams){
 	bool quoteStart, multipleParams;
 	CalParam * toReturn;
 	char * paramName;
-	int i, charCount;
+	int i, length, charCount;
 		
 	/* Set charCount to zero and all booleans to false */
 	multipleParams = false;
@@ -1071,12 +1500,13 @@ CalParam * parseParams (char * optionalParams){
 	charCount = 0;
 	
 	toReturn = NULL;
+	length = strlen(optionalParams);
 	
-	paramName = malloc(sizeof(char) * strlen(optionalParams));
+	paramName = malloc(sizeof(char) * length);
 	assert(paramName);
 	
 	/* Iterate through each char */
-	for (i = 0; i < strlen(optionalParams); ++i){
+	for (i = 0; i < length; ++i){
 		
 		//prop->param = malloc(sizeof(CalParam));
 		
@@ -1112,7 +1542,7 @@ CalParam * parseParams (char * optionalParams){
 			
 			/* Free temp string and allocate memory for next temp string */
 			free(paramName);
-			paramName = malloc(sizeof(char) * strlen(optionalParams));
+			paramName = malloc(sizeof(char) * length);
 			assert(paramName);
 			
 			charCount = 0;
@@ -1120,7 +1550,7 @@ CalParam * parseParams (char * optionalParams){
 		}
 		
 		/* Last param with multiple */
-		else if (multipleParams == true && i == (strlen(optionalParams) - 1)){
+		else if (multipleParams == true && i == (length - 1)){
 			
 			paramName[charCount] = optionalParams[i];
 			++charCount;
@@ -1145,7 +1575,7 @@ CalParam * parseParams (char * optionalParams){
 		}
 		
 		/* Last and only param */
-		else if (multipleParams == false && i == (strlen(optionalParams) - 1)){
+		else if (multipleParams == false && i == (length - 1)){
 			
             free(paramName);
 			paramName = optionalParams;
@@ -1173,53 +1603,92 @@ CalParam * parseParams (char * optionalParams){
 	return toReturn;
 }
 
-int countParams (CalParam * node){
-    
-    int count;
-    
-    count = 0;
-    
-    /* Iterate through linked list */
-	while (node != NULL){
+int checkParams (char * optionalParams, bool * valid){
+	
+	bool quoteStart;
+	int i, start, length, count;
+	
+	quoteStart = false;
+	start = 0;
+	count = 0;
+	length = strlen(optionalParams);
+	
+	/* Split where parseParams does: at each semi colon before the first quote */
+	for (i = 0; i < length; ++i){
 		
-        ++count;
+		if (optionalParams[i] == '"')
+			quoteStart = true;
 		
-        //printf("%s\n", node->name);
-		node = node->next;
+		if (optionalParams[i] == ';' && quoteStart == false){
+			
+			if (checkParamName(optionalParams + start, i - start) == false)
+				*valid = false;
+			
+			++count;
+			start = i + 1;
+		}
 	}
-    
-    return count;
+	
+	/* The last param, unless the string ended with the semi colon before it */
+	if (start < length){
+		
+		if (checkParamName(optionalParams + start, length - start) == false)
+			*valid = false;
+		
+		++count;
+	}
+	
+	return count;
 }
 
-bool validateParams (CalParam * node){
+bool checkParamName (const char * parameter, int length){
 	
-    int i;
-    
-	/* Iterate through linked list */
-	while (node != NULL){
+	bool quoteStart;
+	int i, charCount, nameSize;
+	
+	quoteStart = false;
+	charCount = 0;
+	nameSize = 0;
+	
+	/* The name is as long as the run before the last equals sign outside quotes, as in createNode */
+	for (i = 0; i < length; ++i){
 		
-        
-		/* If name is NULL or zero length return false */
-		if (node->name == NULL || strlen(node->name) == 0){
+		if (parameter[i] == '"')
+			quoteStart = !quoteStart;
+		
+		if (parameter[i] == '=' && quoteStart == false){
 			
-			return false;
+			nameSize = charCount;
+			charCount = 0;
+			continue;
 		}
-        
-        for (i = 0; i < strlen(node->name); ++i){
-            
-            if (node->name[i] == ' ')
-                return false;
-        }
 		
-		node = node->next;
+		if (parameter[i] == ',' && quoteStart == false && i != length - 1){
+			
+			charCount = 0;
+			continue;
+		}
+		
+		++charCount;
+	}
+	
+	/* If name is zero length or has a space in it, it isn't valid */
+	if (nameSize == 0)
+		return false;
+	
+	for (i = 0; i < nameSize; ++i){
+		
+		if (parameter[i] == ' ')
+			return false;
 	}
 	
-	return true; // Return true if we've made it to the end of the linked list 
+	return true;
 }
 
 CalParam * createNode (char * parameter){
 	
-	int i, j, charCount, nameSize, valueCount;
+	int i, j, start, length, charCount, nameSize, valueCount;
+	CalScanIter delims;
 	bool quoteStart;
 	CalParam * toReturn;
 	
@@ -1236,9 +1705,20 @@ CalParam * createNode (char * parameter){
 	
 	toReturn = NULL;
 	
-	/* Iterate through parameter string */
-	for (i = 0; i < strlen(parameter); ++i){
+	length = strlen(parameter);
+	
+	/* Other characters only add to charCount, so jump from one quote, equals sign or comma to the next */
+	calScanStart(&delims, parameter, length, "\"=,", 3);
+	
+	for (start = 0; start < length; start = i + 1){
+		
+		i = calScanNext(&delims);
+		
+		/* The last character always goes through the checks below */
+		if (i == length)
+			i = length - 1;
 		
+		charCount += i - start;
         
 		/* If we've run into a quote and it is the opening one */
 		if (parameter[i] == '"' && quoteStart == false){
@@ -1261,7 +1741,7 @@ CalParam * createNode (char * parameter){
 			charCount = 0;
 			
             /* If we've run into the paramter value */
-            if (i == (strlen(parameter) - 1)){
+            if (i == (length - 1)){
                 
                 //printf("!!!!!");
                 valueSize[valueCount] = charCount;
@@ -1274,7 +1754,7 @@ CalParam * createNode (char * parameter){
 		}
         
 		/* If we've run into the paramter value */
-		if (i == (strlen(parameter) - 1)){
+		if (i == (length - 1)){
 			
 			++charCount;
 			valueSize[valueCount] = charCount;
@@ -1305,13 +1785,11 @@ CalParam * createNode (char * parameter){
 	toReturn->next = NULL;
 	toReturn->nvalues  = valueCount;
 	
-	/* Set the name for the parameter converting it to uppercase as we go */
-	for (i = 0; i < nameSize; ++i){
-		
-		toReturn->name[i] = toupper(parameter[i]);
-	}
+	/* Set the name for the parameter and convert it to uppercase */
+	memcpy(toReturn->name, parameter, nameSize);
+	calScanUpper(toReturn->name, nameSize);
 	
-	toReturn->name[i] = '\0'; // Add null terminator to name 
+	toReturn->name[nameSize] = '\0'; // Add null terminator to name 
     
 	/* Set values for paramter using the arrays initialized at the beginning of this function */
 	for (i = 0; i < valueCount; ++i){
@@ -1392,3 +1870,23 @@ void addPropNode (CalProp **head, CalProp *toAdd){
     last->next = toAdd; // Add *toAdd to the end of the list 
     return;    
 }
+
+time_t parseCalDate( const char *value ){
+	
+	struct tm date;
+	
+	/* Zero all fields so anything strptime can't parse stays at zero */
+	date.tm_sec = 0;
+	date.tm_min = 0;
+	date.tm_hour = 0;
+	date.tm_mday = 0;
+	date.tm_mon = 0;
+	date.tm_year = 0;
+	date.tm_wday = 0;
+	date.tm_yday = 0;
+	date.tm_isdst = -1;
+	
+	strptime(value, "%Y%m%eT%H%M%S", &date);
+	
+	return mktime(&date);
+}
@@ -6,12 +6,23 @@ calutil.h -- Public interface for iCalendar utility functions in calutil.c
 Last updated:  8:04 PM January-16-16
 
 RevA: Changed CalComp* argument of readCalComp().
+RevB: Added CalStore backing blocks for loaded trees.
+RevC: Added strict parsing and the BADTEXT error.
+RevD: Parameters are decoded on first use; read them with getCalParams().
+RevE: Properties read from a file keep their name and value in the line read;
+      escaped text values are decoded on request with getCalText().
+RevF: readCalFile may be called from more than one thread; the calls take
+      turns, as the parser keeps its place in static state.
+RevG: Added readCalChanges for caltool -diff change sets, which need not
+      hold a V-component.
 ********/
 
 #ifndef CALUTIL_H
 #define CALUTIL_H A1_RevA
 
+#include <stdbool.h>
 #include <stdio.h>
+#include <time.h>
 
 #define FOLD_LEN 75     // fold lines longer than this length (RFC 5545 3.1)
 #define VCAL_VER "2.0"  // version of standard accepted
@@ -33,15 +44,25 @@ typedef struct CalProp {    // (sub)component's property (=contentline)
     char *name;         // uppercase
     char *value;
     int nparams;        // no. of parameters
-    CalParam *param;    // -> first parameter (or NULL)
+    CalParam *param;    // -> first parameter (or NULL) once decoded, see getCalParams()
+    char *rawparam;     // parameter text not yet decoded (or NULL): null-terminated pieces, then an empty one
+    char *line;         // content line name and value point into (or NULL if they're allocated on their own)
     CalProp *next;      // linked list of properties (ends with NULL)
 } CalProp;
 
+typedef struct CalStore CalStore;
+typedef struct CalStore {   // memory block that a tree's nodes and strings point into
+    char *base;         // start of block
+    size_t size;        // no. of bytes in block
+    void (*release)( CalStore *store );    // frees the block and the store itself
+} CalStore;
+
 typedef struct CalComp CalComp;
 typedef struct CalComp {    // calendar's (sub)component
     char *name;         // uppercase
     int nprops;         // no. of properties
     CalProp *prop;      // -> first property (or NULL)
+    CalStore *store;    // backing block of a loaded tree (root only, else NULL)
     int ncomps;         // no. of subcomponents
     CalComp *comp[];    // component pointers (flexible array member)
 } CalComp;
@@ -60,6 +81,8 @@ typedef enum { OK=0,
     NOPROD,     // PRODID missing
     SUBCOM,     // subcomponent not allowed
     SYNTAX,     // property not in valid form
+    STALE,      // snapshot older than its source file, which can't be read
+    BADTEXT,    // control character or invalid UTF-8 (strict parsing only)
 } CalError;
     
 typedef struct {
@@ -76,6 +99,29 @@ CalError parseCalProp( char *const buff, CalProp *const prop );
 void freeCalComp( CalComp *const comp );
 CalStatus writeCalComp(FILE *const ics, const CalComp *comp);
 
+/*	Reads a change set written by caltool -diff
+ * 
+ * Arguments: an open file and the address of the pointer that receives the calendar
+ * 
+ * Preconditions: as for readCalFile
+ * Postconditions: as for readCalFile, except that a calendar holding only X-components (or none) is accepted,
+ *                 as a change set with nothing but removals and edits is
+ * 
+ * Return val: as for readCalFile, without NOCAL
+ * */
+CalStatus readCalChanges( FILE *const ics, CalComp **const pcomp );
+
+/*	Converts a DATE-TIME value to calendar time in the local timezone
+ * 
+ * Arguments: a property value of the form YYYYMMDDTHHMMSS
+ * 
+ * Preconditions: *value must be initialized
+ * Postconditions: none
+ * 
+ * Return val: the value as returned by mktime; fields that can't be parsed are left at zero
+ * */
+time_t parseCalDate( const char *value );
+
 /*	Adds a node to the end of a CalProp linked list
  * 
  * Arguments: a reference to the head of a CalProp linked list and CalProp node to add to the end of the linked list
@@ -87,4 +133,49 @@ CalStatus writeCalComp(FILE *const ics, const CalComp *comp);
  * */
 void addPropNode (CalProp **head, CalProp *toAdd);
 
+/*	Gets the parameters of a property, decoding them the first time they're asked for
+ * 
+ * Arguments: a property read by readCalFile (or built by hand with rawparam set to NULL)
+ * 
+ * Preconditions: *prop must be initialized
+ * Postconditions: prop->param holds the decoded list and prop->rawparam is free'd and set to NULL
+ * 
+ * Return val: the first parameter, or NULL if the property has none
+ * */
+CalParam *getCalParams( const CalProp *prop );
+
+/*	Gets the value of a TEXT property with its escapes decoded
+ * 
+ * Arguments: a property
+ * 
+ * Preconditions: *prop must be initialized
+ * Postconditions: none; prop->value keeps the text as it was read
+ * 
+ * Return val: malloc'd copy of the value with \n or \N turned into a newline and \, \; \\ into the character escaped;
+ *             the caller frees it
+ * */
+char *getCalText( const CalProp *prop );
+
+/*	Turns strict parsing on or off for the readCalFile calls that follow
+ * 
+ * Arguments: true to reject lines with control characters (other than tab) or invalid UTF-8, false to accept them
+ * 
+ * Preconditions: none
+ * Postconditions: readCalLine reports BADTEXT for such lines while strict parsing is on
+ * 
+ * Return val: none
+ * */
+void setCalStrict( bool strict );
+
+/*	Checks whether strict parsing is on
+ * 
+ * Arguments: none
+ * 
+ * Preconditions: none
+ * Postconditions: none
+ * 
+ * Return val: the value last passed to setCalStrict, false if it was never called
+ * */
+bool getCalStrict( void );
+
 #endif
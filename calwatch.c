@@ -0,0 +1,432 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calwatch.c -- Source code for hot-reloaded calendars
+Last updated:  Oct 19/26
+********/
+
+#define _GNU_SOURCE   // for pipe2
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "calwatch.h"
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE)   // what a change to the file looks like
+
+/* Wait for a watched file to change and reload it, until told to stop; the body of the watching thread
+ *
+ * Arguments: the CalWatch
+ *
+ * Preconditions: watch->notify and watch->wake are open
+ * Postconditions: each change to the file is reloaded and published
+ *
+ * Return val: NULL
+ * */
+void *runCalWatch (void *arg);
+
+/* Read every inotify event waiting and check if any is about the watched file
+ *
+ * Arguments: the CalWatch
+ *
+ * Preconditions: watch->notify is non-blocking
+ * Postconditions: no events are left waiting
+ *
+ * Return val: true if an event named the watched file, false otherwise
+ * */
+bool drainCalWatch (CalWatch *watch);
+
+/* Bring a watched calendar up to date with its file and publish the result
+ *
+ * Arguments: the CalWatch
+ *
+ * Preconditions: called by the watching thread
+ * Postconditions: if the tree changed, a new version is current and the old one keeps what the reload replaced;
+ *                 watch->status is what the reload returned
+ *
+ * Return val: none
+ * */
+void reloadCalWatch (CalWatch *watch);
+
+/* Decode the parameters of every property in a tree, so readers of a shared tree don't
+ *
+ * Arguments: the tree
+ *
+ * Preconditions: no other thread can see comp yet, or only its decoded properties
+ * Postconditions: every property's rawparam is NULL
+ *
+ * Return val: none
+ * */
+void decodeCalWatch (const CalComp *comp);
+
+/* Unlink the versions nobody holds from the front of the list
+ *
+ * Arguments: the CalWatch
+ *
+ * Preconditions: watch->lock is held
+ * Postconditions: watch->oldest is the oldest version held or the current one
+ *
+ * Return val: the versions unlinked, oldest first and ending in NULL, for the caller to free with the lock released
+ * */
+CalWatchVersion *takeCalWatch (CalWatch *watch);
+
+/* Free unlinked versions and what the reloads after them replaced
+ *
+ * Arguments: the first version, as returned by takeCalWatch (or NULL)
+ *
+ * Preconditions: nobody holds the versions
+ * Postconditions: the versions and their retired components are free'd
+ *
+ * Return val: none
+ * */
+void freeCalWatch (CalWatchVersion *version);
+
+CalStatus calWatchOpen( const char *path, CalWatch *const watch ){
+
+    CalStatus status;
+    sigset_t all, old;
+    char * dir, * slash;
+    int added;
+    bool started;
+
+    memset(&watch->incr, 0, sizeof(CalIncr));
+    watch->oldest = NULL;
+    watch->current = NULL;
+
+    status.code = IOERR;
+    status.linefrom = 0;
+    status.lineto = 0;
+
+    /* The directory is watched rather than the file, so a file replaced by rename (as editors save) is still seen */
+    dir = strdup(path);
+    assert(dir);
+
+    slash = strrchr(dir, '/');
+
+    if (slash == NULL){
+
+        watch->name = strdup(path);
+        strcpy(dir, ".");
+    }
+
+    else{
+
+        watch->name = strdup(slash + 1);
+        slash[slash == dir ? 1 : 0] = '\0';
+    }
+
+    assert(watch->name);
+
+    watch->notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    added = watch->notify >= 0 ? inotify_add_watch(watch->notify, dir, WATCH_EVENTS) : -1;
+    free(dir);
+
+    if (added < 0 || pipe2(watch->wake, O_CLOEXEC) != 0){
+
+        if (watch->notify >= 0)
+            close(watch->notify);
+
+        free(watch->name);
+        return status;
+    }
+
+    /* Read the file only once it is watched, so a change made in between isn't missed */
+    status = calIncrOpen(path, &watch->incr);
+
+    if (status.code != OK){
+
+        close(watch->notify);
+        close(watch->wake[0]);
+        close(watch->wake[1]);
+        free(watch->name);
+        return status;
+    }
+
+    watch->incr.defer = true;
+    decodeCalWatch(watch->incr.comp);
+
+    watch->current = malloc(sizeof(CalWatchVersion));
+    assert(watch->current);
+
+    watch->current->comp = watch->incr.comp;
+    watch->current->lines = watch->incr.lines;
+    watch->current->serial = 0;
+    watch->current->readers = 0;
+    watch->current->retired = NULL;
+    watch->current->retiredTop = NULL;
+    watch->current->next = NULL;
+
+    watch->oldest = watch->current;
+    watch->status = status;
+    pthread_mutex_init(&watch->lock, NULL);
+
+    /* Signals are left to the threads that were already running */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    started = pthread_create(&watch->thread, NULL, runCalWatch, watch) == 0;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    /* Without the thread nothing would reload the file or be there for calWatchClose to join, so nothing is kept */
+    if (started == false){
+
+        free(watch->current);
+        watch->oldest = NULL;
+        watch->current = NULL;
+
+        calIncrClose(&watch->incr);
+        close(watch->notify);
+        close(watch->wake[0]);
+        close(watch->wake[1]);
+        pthread_mutex_destroy(&watch->lock);
+        free(watch->name);
+
+        status.code = IOERR;
+        status.linefrom = 0;
+        status.lineto = 0;
+    }
+
+    return status;
+}
+
+const CalWatchVersion *calWatchAcquire( CalWatch *const watch ){
+
+    CalWatchVersion * version;
+
+    pthread_mutex_lock(&watch->lock);
+    version = watch->current;
+    ++version->readers;
+    pthread_mutex_unlock(&watch->lock);
+
+    return version;
+}
+
+void calWatchRelease( CalWatch *const watch, const CalWatchVersion *version ){
+
+    CalWatchVersion * dead;
+
+    pthread_mutex_lock(&watch->lock);
+    --((CalWatchVersion *) version)->readers;
+    dead = takeCalWatch(watch);
+    pthread_mutex_unlock(&watch->lock);
+
+    freeCalWatch(dead);
+}
+
+CalStatus calWatchStatus( CalWatch *const watch ){
+
+    CalStatus status;
+
+    pthread_mutex_lock(&watch->lock);
+    status = watch->status;
+    pthread_mutex_unlock(&watch->lock);
+
+    return status;
+}
+
+void calWatchClose( CalWatch *const watch ){
+
+    CalWatchVersion * version;
+
+    while (write(watch->wake[1], "", 1) < 0 && errno == EINTR)
+        ;
+
+    pthread_join(watch->thread, NULL);
+
+    /* The current version's tree is the CalIncr's own; older ones only keep what was replaced */
+    version = watch->oldest;
+    watch->current->next = NULL;
+    freeCalWatch(version);
+
+    calIncrClose(&watch->incr);
+    close(watch->notify);
+    close(watch->wake[0]);
+    close(watch->wake[1]);
+    pthread_mutex_destroy(&watch->lock);
+    free(watch->name);
+
+    watch->oldest = NULL;
+    watch->current = NULL;
+}
+
+void *runCalWatch (void *arg){
+
+    CalWatch * watch;
+    struct pollfd fds[2];
+    int ready, settle;
+
+    watch = arg;
+
+    fds[0].fd = watch->notify;
+    fds[0].events = POLLIN;
+    fds[1].fd = watch->wake[0];
+    fds[1].events = POLLIN;
+
+    while (true){
+
+        ready = poll(fds, 2, -1);
+
+        if (ready < 0 && errno != EINTR)
+            break;
+
+        if (ready <= 0)
+            continue;
+
+        if (fds[1].revents != 0)
+            break;
+
+        if (drainCalWatch(watch) == false)
+            continue;
+
+        /* A file is usually written in pieces; wait for it to go quiet rather than parse each piece */
+        for (settle = 0; settle < CALWATCH_MAXSETTLE; ++settle){
+
+            ready = poll(fds, 2, CALWATCH_SETTLE);
+
+            if (ready == 0 || (ready < 0 && errno != EINTR) || fds[1].revents != 0)
+                break;
+
+            if (ready > 0)
+                drainCalWatch(watch);
+        }
+
+        if (ready > 0 && fds[1].revents != 0)
+            break;
+
+        reloadCalWatch(watch);
+    }
+
+    return NULL;
+}
+
+bool drainCalWatch (CalWatch *watch){
+
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event * event;
+    ssize_t got;
+    bool named;
+    char * next;
+
+    named = false;
+
+    while ((got = read(watch->notify, buffer, sizeof(buffer))) > 0){
+
+        for (next = buffer; next < buffer + got; next += sizeof(struct inotify_event) + event->len){
+
+            event = (const struct inotify_event *) next;
+
+            if (event->len > 0 && strcmp(event->name, watch->name) == 0)
+                named = true;
+        }
+    }
+
+    return named;
+}
+
+void reloadCalWatch (CalWatch *watch){
+
+    CalWatchVersion * version, * dead;
+    const CalComp * old;
+    CalStatus status;
+    int reparsed;
+
+    old = watch->incr.comp;
+    status = calIncrRefresh(&watch->incr, &reparsed);
+
+    /* An error (or a file found unchanged) keeps the current version */
+    if (status.code != OK || watch->incr.comp == old){
+
+        pthread_mutex_lock(&watch->lock);
+        watch->status = status;
+        pthread_mutex_unlock(&watch->lock);
+
+        return;
+    }
+
+    /* Nobody can see the new components yet, and the ones kept were decoded when they were first published */
+    decodeCalWatch(watch->incr.comp);
+
+    version = malloc(sizeof(CalWatchVersion));
+    assert(version);
+
+    version->comp = watch->incr.comp;
+    version->lines = watch->incr.lines;
+    version->readers = 0;
+    version->retired = NULL;
+    version->retiredTop = NULL;
+    version->next = NULL;
+
+    pthread_mutex_lock(&watch->lock);
+
+    version->serial = watch->current->serial + 1;
+    watch->current->retired = watch->incr.retired;
+    watch->current->retiredTop = watch->incr.retiredTop;
+    watch->current->next = version;
+    watch->current = version;
+    watch->status = status;
+    dead = takeCalWatch(watch);
+
+    pthread_mutex_unlock(&watch->lock);
+
+    watch->incr.retired = NULL;
+    watch->incr.retiredTop = NULL;
+    freeCalWatch(dead);
+}
+
+void decodeCalWatch (const CalComp *comp){
+
+    const CalProp * prop;
+    int i;
+
+    for (prop = comp->prop; prop != NULL; prop = prop->next)
+        getCalParams(prop);
+
+    for (i = 0; i < comp->ncomps; ++i)
+        decodeCalWatch(comp->comp[i]);
+}
+
+CalWatchVersion *takeCalWatch (CalWatch *watch){
+
+    CalWatchVersion * first, * last;
+
+    /* A version's retired components may still be in older versions' trees, so versions go strictly in order */
+    first = watch->oldest;
+    last = NULL;
+
+    while (watch->oldest != watch->current && watch->oldest->readers == 0){
+
+        last = watch->oldest;
+        watch->oldest = watch->oldest->next;
+    }
+
+    if (last == NULL)
+        return NULL;
+
+    last->next = NULL;
+
+    return first;
+}
+
+void freeCalWatch (CalWatchVersion *version){
+
+    CalWatchVersion * next;
+
+    for (; version != NULL; version = next){
+
+        next = version->next;
+
+        if (version->retired != NULL)
+            freeCalComp(version->retired);
+        free(version->retiredTop);
+
+        free(version);
+    }
+}
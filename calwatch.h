@@ -0,0 +1,115 @@
+/********
+ * Author: Andrew Adams #0828800
+ * Contact: aadams03@mail.uoguelph.ca
+ *
+calwatch.h -- Public interface for hot-reloaded calendars in calwatch.c
+Last updated:  Oct 19/26
+
+A CalWatch keeps a calendar in step with its file while other threads
+read it. A thread of its own waits on inotify for the file to be written,
+renamed over or created again, lets it settle, and brings the tree up to
+date with calIncrRefresh, so only the components that changed are parsed.
+Each reload is published as a new version. Readers take the current
+version with calWatchAcquire and hand it back with calWatchRelease; the
+lock between them is held only to swap a pointer or count a reader, never
+while parsing or reading, so readers are not held up by a reload and a
+version they hold doesn't change under them. Versions share the
+components a reload didn't touch. What a reload replaced is freed once no
+reader holds that version or any older one, so a tree stays whole for as
+long as someone is reading it. A file that fails to parse leaves the last
+good version in place; calWatchStatus tells what went wrong. Parameters
+are decoded before a version is published, so readers never write to a
+shared tree.
+********/
+
+#ifndef CALWATCH_H
+#define CALWATCH_H
+
+#include <pthread.h>
+#include "calutil.h"
+#include "calincr.h"
+
+#define CALWATCH_SETTLE 50      // ms the file must go unwritten before it is reloaded
+#define CALWATCH_MAXSETTLE 20   // most settle periods waited out before reloading anyway
+
+typedef struct CalWatchVersion CalWatchVersion;
+typedef struct CalWatchVersion {   // one version of a watched calendar
+    const CalComp *comp;    // the tree; readers must leave it as it is
+    int lines;              // no. of lines in the file it was read from
+    long serial;            // 0 for the version calWatchOpen read, one more for each reload after
+    int readers;            // no. of calWatchAcquire calls not yet released
+    CalComp *retired;       // what the reload after this version replaced (or NULL), freed with it
+    CalComp *retiredTop;    // and its top component, if the reload patched the tree (or NULL)
+    CalWatchVersion *next;  // the next newer version (or NULL)
+} CalWatchVersion;
+
+typedef struct {        // a calendar reloaded whenever its file changes, see calWatchOpen
+    CalIncr incr;           // the file and the newest tree, only used by the watching thread once it runs
+    char *name;             // the file's name within its directory, as inotify reports it
+    int notify;             // inotify descriptor watching the file's directory
+    int wake[2];            // pipe calWatchClose writes to, to stop the thread
+    pthread_t thread;
+    pthread_mutex_t lock;   // held to change the fields below
+    CalWatchVersion *oldest;    // versions not yet freed, oldest first, linked by next
+    CalWatchVersion *current;   // the newest version, the one calWatchAcquire gives
+    CalStatus status;       // what the latest reload returned
+} CalWatch;
+
+/*	Read a calendar file and start reloading it whenever it changes
+ *
+ * Arguments: path of the iCalendar file and the CalWatch to fill in
+ *
+ * Preconditions: none
+ * Postconditions: on success version 0 is current and a thread watches the file until calWatchClose; on error
+ *                 nothing is kept
+ *
+ * Return val: IOERR if the file can't be read or watched, otherwise the status readCalFile returns for it
+ * */
+CalStatus calWatchOpen( const char *path, CalWatch *const watch );
+
+/*	Take the current version of a watched calendar for reading
+ *
+ * Arguments: the CalWatch
+ *
+ * Preconditions: watch was filled in by calWatchOpen
+ * Postconditions: the version and its tree stay as they are until it is given to calWatchRelease
+ *
+ * Return val: the current version
+ * */
+const CalWatchVersion *calWatchAcquire( CalWatch *const watch );
+
+/*	Give back a version taken with calWatchAcquire
+ *
+ * Arguments: the CalWatch and the version
+ *
+ * Preconditions: version came from calWatchAcquire on watch and hasn't been released
+ * Postconditions: versions older than the current one that nobody holds any more are freed, oldest first
+ *
+ * Return val: none
+ * */
+void calWatchRelease( CalWatch *const watch, const CalWatchVersion *version );
+
+/*	Tell how the latest reload of a watched calendar went
+ *
+ * Arguments: the CalWatch
+ *
+ * Preconditions: watch was filled in by calWatchOpen
+ * Postconditions: none
+ *
+ * Return val: OK if the current version is the file as last seen, otherwise the status calIncrRefresh returned
+ *             (the current version being the last one read without error)
+ * */
+CalStatus calWatchStatus( CalWatch *const watch );
+
+/*	Stop watching a calendar and free it
+ *
+ * Arguments: the CalWatch
+ *
+ * Preconditions: watch was filled in by calWatchOpen and every version acquired has been released
+ * Postconditions: the thread is stopped and every version is free'd
+ *
+ * Return val: none
+ * */
+void calWatchClose( CalWatch *const watch );
+
+#endif
@@ -1,4 +1,9 @@
 #include "calutil.h"
+#include "calcache.h"
+#include "calwatch.h"
+#include "calquery.h"
+#include "calindex.h"
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,12 +42,144 @@ static PyObject *Cal_writeFile( PyObject *self, PyObject *args );
  * */
 static PyObject *Cal_freeFile( PyObject *self, PyObject *args );
 
+/* Start watching a file, so that it is reloaded whenever it changes
+ * 
+ * Arguments: fileName (which is a file name)
+ * 
+ * Preconditions: none
+ * Postconditions: a thread reloads the file until watchClose is called
+ * 
+ * Return val: a handle for watchRead and watchClose, or 0 if the file can't be read or watched
+ * */
+static PyObject *Cal_watchFile( PyObject *self, PyObject *args );
+
+/* List the components of a watched file as it is now
+ * 
+ * Arguments: handle (from watchFile)
+ * 
+ * Preconditions: handle must be open
+ * Postconditions: none
+ * 
+ * Return val: a PyList holding the version no. (one more for each reload) at index 0 and strings as readFile gives
+ *             afterwards
+ * */
+static PyObject *Cal_watchRead( PyObject *self, PyObject *args );
+
+/* Stop watching a file and free it
+ * 
+ * Arguments: handle (from watchFile)
+ * 
+ * Preconditions: handle must be open
+ * Postconditions: the handle is closed
+ * 
+ * Return val: NULL
+ * */
+static PyObject *Cal_watchClose( PyObject *self, PyObject *args );
+
+/* Compile a query (see calquery.h) for queryMatch
+ * 
+ * Arguments: expr (the query text)
+ * 
+ * Preconditions: none
+ * Postconditions: on success the compiled query is kept until queryFree is called
+ * 
+ * Return val: a tuple of a handle for queryMatch and queryFree and 0, or of 0 and the column the query went wrong at
+ * */
+static PyObject *Cal_queryCompile( PyObject *self, PyObject *args );
+
+/* Find the top level components of a CalComp that satisfy a compiled query
+ * 
+ * Arguments: handle (from queryCompile) and pcal (CalComp structure)
+ * 
+ * Preconditions: handle and pcal must be initialized
+ * Postconditions: none
+ * 
+ * Return val: a PyList of the indexes of the components that match, in order
+ * */
+static PyObject *Cal_queryMatch( PyObject *self, PyObject *args );
+
+/* Free a compiled query
+ * 
+ * Arguments: handle (from queryCompile)
+ * 
+ * Preconditions: handle must be initialized
+ * Postconditions: the handle is freed
+ * 
+ * Return val: NULL
+ * */
+static PyObject *Cal_queryFree( PyObject *self, PyObject *args );
+
+/* Open the search index (see calindex.h) of a calendar file, writing its sidecar first if it is missing or stale
+ * 
+ * Arguments: fileName (path of the iCalendar file)
+ * 
+ * Preconditions: none
+ * Postconditions: on success the index is kept until indexFree is called
+ * 
+ * Return val: a handle for indexSearch and indexFree, or 0 if the file can't be read or parsed
+ * */
+static PyObject *Cal_indexOpen( PyObject *self, PyObject *args );
+
+/* Build a search index of a CalComp in memory
+ * 
+ * Arguments: pcal (CalComp structure)
+ * 
+ * Preconditions: pcal must be initialized
+ * Postconditions: the index is kept until indexFree is called
+ * 
+ * Return val: a handle for indexSearch and indexFree
+ * */
+static PyObject *Cal_indexBuild( PyObject *self, PyObject *args );
+
+/* Find the top level components whose SUMMARY, DESCRIPTION or LOCATION holds every word of a search
+ * 
+ * Arguments: handle (from indexOpen or indexBuild) and words (a word ending in * matches any it begins)
+ * 
+ * Preconditions: handle must be initialized
+ * Postconditions: none
+ * 
+ * Return val: a PyList of the indexes of the components that match, in order
+ * */
+static PyObject *Cal_indexSearch( PyObject *self, PyObject *args );
+
+/* Free a search index
+ * 
+ * Arguments: handle (from indexOpen or indexBuild)
+ * 
+ * Preconditions: handle must be initialized
+ * Postconditions: the handle is freed
+ * 
+ * Return val: NULL
+ * */
+static PyObject *Cal_indexFree( PyObject *self, PyObject *args );
+
+/* Fill in a list with a string for each top level component: name, prop count, sub comp count and summary
+ * 
+ * Arguments: result (a PyList) and comp (a CalComp)
+ * 
+ * Preconditions: result has room for comp->ncomps items after index 0
+ * Postconditions: items 1 onwards are set
+ * 
+ * Return val: none
+ * */
+static void listComps( PyObject *result, const CalComp *comp );
+
 
 static PyMethodDef CalMethods[] = {
 
 	{"readFile", Cal_readFile, METH_VARARGS},
 	{"writeFile", Cal_writeFile, METH_VARARGS},
 	{"freeFile", Cal_freeFile, METH_VARARGS},
+	{"watchFile", Cal_watchFile, METH_VARARGS},
+	{"watchRead", Cal_watchRead, METH_VARARGS},
+	{"watchClose", Cal_watchClose, METH_VARARGS},
+	{"queryCompile", Cal_queryCompile, METH_VARARGS},
+	{"queryMatch", Cal_queryMatch, METH_VARARGS},
+	{"queryFree", Cal_queryFree, METH_VARARGS},
+	{"indexOpen", Cal_indexOpen, METH_VARARGS},
+	{"indexBuild", Cal_indexBuild, METH_VARARGS},
+	{"indexSearch", Cal_indexSearch, METH_VARARGS},
+	{"indexFree", Cal_indexFree, METH_VARARGS},
 	{NULL, NULL} 
 };
 	
@@ -64,17 +201,15 @@ static PyObject *Cal_readFile( PyObject *self, PyObject *args ){
 	
     PyObject * result;
     PyObject * toAdd;
-	char * fileName, compInfo[MAXSTRINGLENGTH], buffer[10];
+	char * fileName;
 	FILE * file;
 	CalComp * comp = NULL;
-    CalProp * currentProp;
-    int i;
     
 	PyArg_ParseTuple(args, "sO", &fileName, &result); // Parse arguments
 	
-    /* Open file for reading and then call readCalFile on the newly opened file*/
+    /* Open file for reading and then read it (through the parse cache if one is configured) */
 	file = fopen(fileName, "r");
-    readCalFile(file, &comp);
+    readCalInput(file, &comp);
 
     fclose(file); // Close the file
 	
@@ -84,6 +219,18 @@ static PyObject *Cal_readFile( PyObject *self, PyObject *args ){
     toAdd = Py_BuildValue("k", (unsigned long*)comp);
     PyList_SetItem(result, 0, toAdd);
     
+    listComps(result, comp);
+    
+	return result;
+}
+
+static void listComps( PyObject *result, const CalComp *comp ){
+	
+    PyObject * toAdd;
+	char compInfo[MAXSTRINGLENGTH], buffer[10];
+    CalProp * currentProp;
+    int i;
+    
     /* Iterate through all top level components */
     for (i = 0; i < comp->ncomps; ++i){
         
@@ -117,8 +264,6 @@ static PyObject *Cal_readFile( PyObject *self, PyObject *args ){
 
         memset(&compInfo[0], 0, sizeof(compInfo)); // Clear the buffer 
     }
-    
-	return result;
 }
 
 static PyObject *Cal_writeFile( PyObject *self, PyObject *args ){
@@ -188,3 +333,196 @@ static PyObject *Cal_freeFile( PyObject *self, PyObject *args ){
     toReturn = Py_BuildValue("z", NULL);
     return toReturn;
 }
+
+static PyObject *Cal_watchFile( PyObject *self, PyObject *args ){
+    
+    CalWatch * watch;
+    char * fileName;
+    
+    PyArg_ParseTuple(args, "s", &fileName); // Parse the argument
+    
+    watch = malloc(sizeof(CalWatch));
+    assert(watch);
+    
+    /* Reading the file and starting the watcher can take a while, so let other Python threads run meanwhile */
+    Py_BEGIN_ALLOW_THREADS
+    if (calWatchOpen(fileName, watch).code != OK){
+        
+        free(watch);
+        watch = NULL;
+    }
+    Py_END_ALLOW_THREADS
+    
+    return Py_BuildValue("k", (unsigned long)watch);
+}
+
+static PyObject *Cal_watchRead( PyObject *self, PyObject *args ){
+    
+    const CalWatchVersion * version;
+    PyObject * result;
+    CalWatch * watch;
+    
+    PyArg_ParseTuple(args, "k", (unsigned long*)&watch); // Parse the argument
+    
+    /* The version taken stays whole while it is listed, even if the file is reloaded meanwhile */
+    version = calWatchAcquire(watch);
+    
+    result = PyList_New(version->comp->ncomps + 1); // Create a new PyList
+    PyList_SetItem(result, 0, Py_BuildValue("l", version->serial));
+    listComps(result, version->comp);
+    
+    calWatchRelease(watch, version);
+    
+    return result;
+}
+
+static PyObject *Cal_watchClose( PyObject *self, PyObject *args ){
+    
+    CalWatch * watch;
+    
+    PyArg_ParseTuple(args, "k", (unsigned long*)&watch); // Parse the argument
+    
+    calWatchClose(watch);
+    free(watch);
+    
+    /* Return NULL */
+    return Py_BuildValue("z", NULL);
+}
+
+static PyObject *Cal_queryCompile( PyObject *self, PyObject *args ){
+    
+    CalQuery * query;
+    CalStatus status;
+    char * expr;
+    
+    PyArg_ParseTuple(args, "s", &expr); // Parse the argument
+    
+    query = malloc(sizeof(CalQuery));
+    assert(query);
+    
+    status = calQueryCompile(expr, query);
+    
+    if (status.code != OK){
+        
+        free(query);
+        return Py_BuildValue("(ki)", 0UL, status.linefrom);
+    }
+    
+    return Py_BuildValue("(ki)", (unsigned long)query, 0);
+}
+
+static PyObject *Cal_queryMatch( PyObject *self, PyObject *args ){
+    
+    PyObject * result;
+    PyObject * toAdd;
+    CalQuery * query;
+    CalComp * pcal;
+    CalTzSet * zones;
+    int i;
+    
+    PyArg_ParseTuple(args, "kk", (unsigned long*)&query, (unsigned long*)&pcal); // Parse arguments
+    
+    result = PyList_New(0); // Create a new PyList
+    zones = query->dates == true ? calTzBuild(pcal) : NULL;
+    
+    /* Add the index of each component that matches */
+    for (i = 0; i < pcal->ncomps; ++i){
+        
+        if (calQueryMatch(query, pcal, zones, pcal->comp[i]) == true){
+            
+            toAdd = PyLong_FromLong(i);
+            PyList_Append(result, toAdd);
+            Py_DECREF(toAdd);
+        }
+    }
+    
+    calTzFree(zones);
+    
+    return result;
+}
+
+static PyObject *Cal_queryFree( PyObject *self, PyObject *args ){
+    
+    CalQuery * query;
+    
+    PyArg_ParseTuple(args, "k", (unsigned long*)&query); // Parse the argument
+    
+    calQueryFree(query);
+    free(query);
+    
+    /* Return NULL */
+    return Py_BuildValue("z", NULL);
+}
+
+static PyObject *Cal_indexOpen( PyObject *self, PyObject *args ){
+    
+    CalIndex * index;
+    char * fileName;
+    
+    PyArg_ParseTuple(args, "s", &fileName); // Parse the argument
+    
+    index = malloc(sizeof(CalIndex));
+    assert(index);
+    
+    if (calIndexOpen(fileName, index).code != OK){
+        
+        free(index);
+        return Py_BuildValue("k", 0UL);
+    }
+    
+    return Py_BuildValue("k", (unsigned long)index);
+}
+
+static PyObject *Cal_indexBuild( PyObject *self, PyObject *args ){
+    
+    CalIndex * index;
+    CalComp * pcal;
+    
+    PyArg_ParseTuple(args, "k", (unsigned long*)&pcal); // Parse the argument
+    
+    index = malloc(sizeof(CalIndex));
+    assert(index);
+    
+    calIndexBuild(pcal, index);
+    
+    return Py_BuildValue("k", (unsigned long)index);
+}
+
+static PyObject *Cal_indexSearch( PyObject *self, PyObject *args ){
+    
+    PyObject * result;
+    PyObject * toAdd;
+    CalIndex * index;
+    char * words;
+    int * hits;
+    int i, n;
+    
+    PyArg_ParseTuple(args, "ks", (unsigned long*)&index, &words); // Parse arguments
+    
+    n = calIndexSearch(index, words, &hits);
+    result = PyList_New(n); // Create a new PyList
+    
+    /* Add the index of each component that matches */
+    for (i = 0; i < n; ++i){
+        
+        toAdd = PyLong_FromLong(hits[i]);
+        PyList_SetItem(result, i, toAdd);
+    }
+    
+    free(hits);
+    
+    return result;
+}
+
+static PyObject *Cal_indexFree( PyObject *self, PyObject *args ){
+    
+    CalIndex * index;
+    
+    PyArg_ParseTuple(args, "k", (unsigned long*)&index); // Parse the argument
+    
+    calIndexFree(index);
+    free(index);
+    
+    /* Return NULL */
+    return Py_BuildValue("z", NULL);
+}
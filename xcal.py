@@ -13,6 +13,9 @@ import os
 from tkinter import filedialog
 import subprocess 
 
+# Share parsed calendars between the caltool runs for each GUI action
+os.environ.setdefault('CALTOOL_CACHE', os.path.join(os.path.expanduser('~'), '.cache', 'caltool'))
+
 class xCalGUI:
     
     # global variables